@@ -139,6 +139,10 @@
       ARG_BOOLEAN,                                                                              \
       "no",                                                                                     \
       "Compute all senone scores in every frame (can be faster when there are many senones)" }, \
+{ "-lookback",                                                                                  \
+      ARG_INT32,                                                                                \
+      "0",                                                                                      \
+      "Number of decoded frames of features kept for searches to rewind into" },                \
 { "-fwdtree",                                                                                   \
       ARG_BOOLEAN,                                                                              \
       "yes",                                                                                    \
@@ -159,6 +163,10 @@
       ARG_INT32,                                                                                \
       "5000",                                                                                   \
       "Initial backpointer table size" },                                                       \
+{ "-latgc",                                                                                     \
+      ARG_BOOLEAN,                                                                              \
+      "no",                                                                                     \
+      "Free backpointer table entries no path can reach (long utterances; no lattice)" },           \
 { "-maxwpf",                                                                                    \
       ARG_INT32,                                                                                \
       "-1",                                                                                     \
@@ -201,7 +209,23 @@
 { "-kws_threshold",                                             \
       ARG_FLOAT64,                                              \
       "1",                                                      \
-      "Threshold for p(hyp)/p(alternatives) ratio" }
+      "Threshold for p(hyp)/p(alternatives) ratio" },          \
+{ "-kws_fa_target",                                             \
+      ARG_FLOAT64,                                              \
+      "0",                                                      \
+      "Target false alarms per hour for each keyphrase, adapts thresholds if not 0" }, \
+{ "-kws_fa_range",                                              \
+      ARG_FLOAT64,                                              \
+      "1e10",                                                   \
+      "Largest factor between an adapted threshold and the configured one" }, \
+{ "-kws_fa_window",                                             \
+      ARG_FLOAT64,                                              \
+      "1",                                                      \
+      "Hours of audio over which false alarm rates are estimated" }, \
+{ "-kws_verify",                                                \
+      ARG_FLOAT64,                                              \
+      "0",                                                      \
+      "Lowest probability per frame of the forced alignment of a detection, verification is off if 0. Needs -lookback" }
 
 /** Command-line options for finite state grammars. */
 #define POCKETSPHINX_FSG_OPTIONS \
@@ -248,6 +272,14 @@
       ARG_STRING,									\
       NULL,									\
       "Which language model in -lmctl to use by default"},				\
+{ "-lmcache",										\
+      ARG_INT32,									\
+      "65536",										\
+      "Number of entries in the language model score cache (0 to disable)" },		\
+{ "-lmthreads",										\
+      ARG_INT32,									\
+      "1",										\
+      "Number of threads used to parse, sort and build ARPA language models" },		\
 { "-lw",										\
       ARG_FLOAT32,									\
       "6.5",										\
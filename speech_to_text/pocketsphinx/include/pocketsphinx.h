@@ -408,6 +408,23 @@ int ps_end_utt(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 char const *ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score);
 
+/**
+ * Get the part of the hypothesis that can no longer change.
+ *
+ * With -latgc, the N-Gram search keeps track of the last word that all
+ * of the paths it still follows go through.  The words up to it are
+ * final: ps_get_hyp() and ps_seg_iter() begin with them for the rest
+ * of the utterance, and the search forgets how it got there.
+ *
+ * @param ps Decoder.
+ * @param out_frame Output: first frame after the final words.  Can be
+ *                  NULL.
+ * @return String containing the final words, NULL if there are none
+ *         yet, or if the current search is not an N-Gram search.
+ */
+POCKETSPHINX_EXPORT
+char const *ps_get_final_hyp(ps_decoder_t *ps, int32 *out_frame);
+
 /**
  * Get posterior probability.
  *
@@ -450,6 +467,25 @@ ps_lattice_t *ps_get_lattice(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 ps_seg_t *ps_seg_iter(ps_decoder_t *ps);
 
+/**
+ * Get the hypothesis of a search, which may be the current one or one
+ * running alongside it.
+ *
+ * @see ps_get_hyp
+ */
+POCKETSPHINX_EXPORT
+char const *ps_get_search_hyp(ps_decoder_t *ps, const char *name,
+                              int32 *out_best_score);
+
+/**
+ * Get an iterator over the word segmentation of a search, which may be
+ * the current one or one running alongside it.
+ *
+ * @see ps_seg_iter
+ */
+POCKETSPHINX_EXPORT
+ps_seg_t *ps_get_search_seg_iter(ps_decoder_t *ps, const char *name);
+
 /**
  * Get the next segment in a word segmentation.
  *
@@ -116,6 +116,61 @@ const char* ps_get_search(ps_decoder_t *ps);
 POCKETSPHINX_EXPORT
 int ps_unset_search(ps_decoder_t *ps, const char *name);
 
+/**
+ * Runs a search alongside the current one.
+ *
+ * Every frame, the searches added this way step over the same senone
+ * scores as the current search. Senones needed by any of them are
+ * computed once, so for example a keyphrase search can listen for a wake
+ * word while a grammar search recognizes commands. Results of each one
+ * are available from ps_get_search_hyp() and ps_get_search_seg_iter().
+ * Phone loop and alignment searches can't run concurrently.
+ *
+ * @return 0 on success, -1 on failure (including while decoding).
+ */
+POCKETSPHINX_EXPORT
+int ps_add_concurrent_search(ps_decoder_t *ps, const char *name);
+
+/**
+ * Stops running a search alongside the current one.
+ *
+ * @return 0 on success, -1 on failure (including while decoding).
+ */
+POCKETSPHINX_EXPORT
+int ps_remove_concurrent_search(ps_decoder_t *ps, const char *name);
+
+/**
+ * Keeps all the features of each utterance, so that it can be decoded again.
+ *
+ * Must be enabled before ps_start_utt() for ps_replay_search() to reach
+ * back to the start of that utterance. Memory grows with the length of
+ * the utterance, so utterances should be ended from time to time. To only
+ * keep the last frames, use the -lookback option instead.
+ *
+ * @return previous setting.
+ */
+POCKETSPHINX_EXPORT
+int ps_set_replay(ps_decoder_t *ps, int replay);
+
+/**
+ * Switches to another search in the middle of an utterance.
+ *
+ * The frames of the current utterance from @a frame_idx on are decoded
+ * again by the search with the provided name, which then goes on with the
+ * rest of the utterance. Frames are counted as by ps_seg_frames(), so the
+ * end frame of a segment plus one replays what follows it. Earlier frames
+ * are dropped. Results of the previous search are
+ * lost, and searches running alongside it start over too. Typically used
+ * to pass the audio following a wake word, spotted by a cheap keyphrase
+ * search, to a grammar or language model search. The frames must still be
+ * kept, either by the -lookback option or by ps_set_replay().
+ *
+ * @see ps_set_replay
+ * @return 0 on success, -1 on failure.
+ */
+POCKETSPHINX_EXPORT
+int ps_replay_search(ps_decoder_t *ps, const char *name, int frame_idx);
+
 /**
  * Returns iterator over current searches 
  *
@@ -272,6 +327,53 @@ int ps_set_kws(ps_decoder_t *ps, const char *name, const char *keyfile);
 POCKETSPHINX_EXPORT 
 int ps_set_keyphrase(ps_decoder_t *ps, const char *name, const char *keyphrase);
 
+/**
+ * Adds a keyphrase to an existing KWS search, without rebuilding it.
+ *
+ * Only the HMMs of the new keyphrase are added to the search, so this can
+ * be done between calls to ps_process_raw() in the middle of an utterance.
+ * Words of the keyphrase must be in the dictionary; use ps_add_word() with
+ * update set to FALSE to add missing ones. If the keyphrase is already
+ * spotted, only its threshold is changed.
+ *
+ * @param name Name of the KWS search, or NULL for the current search.
+ * @param threshold Detection threshold for the keyphrase, as in a
+ *        keyphrase file, or 0 to use -kws_threshold.
+ * @return 0 on success, -1 on error.
+ */
+POCKETSPHINX_EXPORT
+int ps_add_keyphrase(ps_decoder_t *ps, const char *name,
+                     const char *keyphrase, double threshold);
+
+/**
+ * Removes a keyphrase from an existing KWS search.
+ *
+ * Keyphrases being matched in the current utterance start over.
+ *
+ * @param name Name of the KWS search, or NULL for the current search.
+ * @return 0 on success, -1 on error.
+ */
+POCKETSPHINX_EXPORT
+int ps_remove_keyphrase(ps_decoder_t *ps, const char *name,
+                        const char *keyphrase);
+
+/**
+ * Get the current detection threshold of a keyphrase.
+ *
+ * With -kws_fa_target set, thresholds move over time so that each keyphrase
+ * gets about that many false alarms per hour of audio.
+ *
+ * @param name Name of the KWS search, or NULL for the current search.
+ * @param out_threshold Output: detection threshold, as in a keyphrase file.
+ * @param out_fa_rate Output: estimated false alarms per hour at that
+ *        threshold, or 0 if thresholds are not adaptive. May be NULL.
+ * @return 0 on success, -1 on error.
+ */
+POCKETSPHINX_EXPORT
+int ps_get_kws_threshold(ps_decoder_t *ps, const char *name,
+                         const char *keyphrase, double *out_threshold,
+                         double *out_fa_rate);
+
 /**
  * Adds new search based on phone N-gram language model.
  *
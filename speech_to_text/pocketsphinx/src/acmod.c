@@ -192,6 +192,11 @@ acmod_init_feat(acmod_t *acmod)
         }
         ckd_free(vallist);
     }
+    if (acmod->fcb->cmn_struct
+        && cmd_ln_exists_r(acmod->config, "-cmnwin")) {
+        cmn_live_set_decay(acmod->fcb->cmn_struct,
+                           cmd_ln_int32_r(acmod->config, "-cmnwin"));
+    }
     return 0;
 }
 
@@ -273,8 +278,11 @@ acmod_init(cmd_ln_t *config, logmath_t *lmath, fe_t *fe, feat_t *fcb)
         ckd_calloc_2d(acmod->n_mfc_alloc, acmod->fcb->cepsize,
                       sizeof(**acmod->mfc_buf));
 
-    /* Feature buffer has to be at least as large as MFCC buffer. */
-    acmod->n_feat_alloc = acmod->n_mfc_alloc + cmd_ln_int32_r(config, "-pl_window");
+    /* Feature buffer has to be at least as large as MFCC buffer.  Frames
+     * already decoded stay in it until overwritten, so extra room keeps
+     * the last -lookback frames for searches to rewind into. */
+    acmod->n_feat_alloc = acmod->n_mfc_alloc + cmd_ln_int32_r(config, "-pl_window")
+        + cmd_ln_int32_r(config, "-lookback");
     acmod->feat_buf = feat_array_alloc(acmod->fcb, acmod->n_feat_alloc);
     acmod->framepos = ckd_calloc(acmod->n_feat_alloc, sizeof(*acmod->framepos));
 
@@ -895,6 +903,45 @@ acmod_rewind(acmod_t *acmod)
     return 0;
 }
 
+int
+acmod_lookback(acmod_t *acmod)
+{
+    int n_backfr;
+
+    /* Frames before the output frame survive until new input overwrites
+     * them, which never happens if the buffer grows. */
+    n_backfr = acmod->n_feat_alloc - acmod->n_feat_frame;
+    if (n_backfr > acmod->output_frame)
+        n_backfr = acmod->output_frame;
+    return n_backfr;
+}
+
+int
+acmod_rewind_to(acmod_t *acmod, int frame_idx)
+{
+    int n_backfr;
+
+    n_backfr = acmod->output_frame - frame_idx;
+    if (frame_idx < 0 || n_backfr > acmod_lookback(acmod)
+        || -n_backfr > acmod->n_feat_frame) {
+        E_ERROR("Cannot rewind to frame %d, frames %d to %d are available\n",
+                frame_idx, acmod->output_frame - acmod_lookback(acmod),
+                acmod->output_frame + acmod->n_feat_frame);
+        return -1;
+    }
+
+    /* Move the output pointer there, and count frames from it. */
+    acmod->feat_outidx = (acmod->feat_outidx + acmod->n_feat_alloc - n_backfr)
+        % acmod->n_feat_alloc;
+    acmod->n_feat_frame += n_backfr;
+    acmod->output_frame = 0;
+    acmod->senscr_frame = -1;
+    acmod->mgau->frame_idx = 0;
+    acmod->utt_start_frame += frame_idx;
+
+    return 0;
+}
+
 int
 acmod_advance(acmod_t *acmod)
 {
@@ -1111,8 +1158,9 @@ acmod_score(acmod_t *acmod, int *inout_frame_idx)
     frame_idx = calc_frame_idx(acmod, inout_frame_idx);
 
     /* If all senones are being computed, or we are using a senone file,
-       then we can reuse existing scores. */
-    if ((acmod->compallsen || acmod->insenfh)
+       or another search already scored this frame, then we can reuse
+       existing scores. */
+    if ((acmod->compallsen || acmod->insenfh || acmod->shared_frame)
         && frame_idx == acmod->senscr_frame) {
         if (inout_frame_idx)
             *inout_frame_idx = frame_idx;
@@ -1196,12 +1244,69 @@ acmod_best_score(acmod_t *acmod, int *out_best_senid)
 void
 acmod_clear_active(acmod_t *acmod)
 {
-    if (acmod->compallsen)
+    if (acmod->compallsen || acmod->shared_frame)
         return;
     bitvec_clear_all(acmod->senone_active_vec, bin_mdef_n_sen(acmod->mdef));
     acmod->n_senone_active = 0;
 }
 
+void
+acmod_begin_shared_frame(acmod_t *acmod)
+{
+    acmod->shared_frame = FALSE;
+    acmod_clear_active(acmod);
+    acmod->shared_frame = TRUE;
+    /* Scores of the previous pass over this frame, if any, are stale */
+    acmod->senscr_frame = -1;
+}
+
+void
+acmod_end_shared_frame(acmod_t *acmod)
+{
+    acmod->shared_frame = FALSE;
+}
+
+acmod_scores_t *
+acmod_scores_init(acmod_t *acmod)
+{
+    acmod_scores_t *scores;
+
+    scores = ckd_calloc(1, sizeof(*scores));
+    scores->senone_scores = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                       sizeof(*scores->senone_scores));
+    scores->senone_active_vec = bitvec_alloc(bin_mdef_n_sen(acmod->mdef));
+    scores->senone_active = ckd_calloc(bin_mdef_n_sen(acmod->mdef),
+                                       sizeof(*scores->senone_active));
+    scores->senscr_frame = -1;
+    return scores;
+}
+
+void
+acmod_scores_free(acmod_scores_t *scores)
+{
+    if (scores == NULL)
+        return;
+    ckd_free(scores->senone_scores);
+    ckd_free(scores->senone_active_vec);
+    ckd_free(scores->senone_active);
+    ckd_free(scores);
+}
+
+#define SWAP(a,b,t) do { t tmp = (a); (a) = (b); (b) = tmp; } while (0)
+
+void
+acmod_swap_scores(acmod_t *acmod, acmod_scores_t *scores)
+{
+    SWAP(acmod->senone_scores, scores->senone_scores, int16 *);
+    SWAP(acmod->senone_active_vec, scores->senone_active_vec, bitvec_t *);
+    SWAP(acmod->senone_active, scores->senone_active, uint8 *);
+    SWAP(acmod->senscr_frame, scores->senscr_frame, int);
+    SWAP(acmod->n_senone_active, scores->n_senone_active, int);
+    SWAP(acmod->shared_frame, scores->shared_frame, uint8);
+}
+
+#undef SWAP
+
 #define MPX_BITVEC_SET(a,h,i)                                   \
     if (hmm_mpx_ssid(h,i) != BAD_SSID)                          \
         bitvec_set((a)->senone_active_vec, hmm_mpx_senid(h,i))
@@ -168,6 +168,7 @@ struct acmod_s {
     int senscr_frame;          /**< Frame index for senone_scores. */
     int n_senone_active;       /**< Number of active GMMs. */
     int log_zero;              /**< Zero log-probability value. */
+    glist_t phone_loops;       /**< Phone loops shared by searches, see phone_loop_get(). */
 
     /* Utterance processing: */
     mfcc_t **mfc_buf;   /**< Temporary buffer of acoustic features. */
@@ -188,6 +189,7 @@ struct acmod_s {
     uint8 compallsen;   /**< Compute all senones? */
     uint8 grow_feat;    /**< Whether to grow feat_buf. */
     uint8 insen_swap;   /**< Whether to swap input senone score. */
+    uint8 shared_frame; /**< Several searches are scoring this frame. */
 
     frame_idx_t utt_start_frame; /**< Index of the utterance start in the stream, all timings are relative to that. */
 
@@ -201,6 +203,19 @@ struct acmod_s {
 };
 typedef struct acmod_s acmod_t;
 
+/**
+ * Senone scores of a frame with the set of senones they were computed
+ * for, kept aside by acmod_swap_scores().
+ */
+typedef struct acmod_scores_s {
+    int16 *senone_scores;      /**< GMM scores. */
+    bitvec_t *senone_active_vec; /**< Active GMMs. */
+    uint8 *senone_active;      /**< Array of deltas to active GMMs. */
+    int senscr_frame;          /**< Frame index for senone_scores. */
+    int n_senone_active;       /**< Number of active GMMs. */
+    uint8 shared_frame;        /**< Scored for several searches. */
+} acmod_scores_t;
+
 /**
  * Initialize an acoustic model.
  *
@@ -288,6 +303,30 @@ int acmod_end_utt(acmod_t *acmod);
  */
 int acmod_rewind(acmod_t *acmod);
 
+/**
+ * Number of frames before the current one which can still be rewound to.
+ *
+ * Decoded frames stay in the feature buffer until new data overwrites
+ * them.  The -lookback option keeps at least that many of them between
+ * calls which process data, and all of them are kept if acmod_set_grow()
+ * was called before the utterance started.
+ */
+int acmod_lookback(acmod_t *acmod);
+
+/**
+ * Rewind the current utterance to a past frame and drop what precedes it.
+ *
+ * Frame @a frame_idx becomes the first frame of the utterance, so that a
+ * search started afterwards decodes the rest of it again from the kept
+ * features, with frame indices counted from there, and the stream offset
+ * is moved forward accordingly.  The frame must be at most
+ * acmod_lookback() frames back, or among those not yet decoded.
+ *
+ * @return 0 for success, <0 for failure (if the frame is no longer or
+ *         not yet available)
+ */
+int acmod_rewind_to(acmod_t *acmod, int frame_idx);
+
 /**
  * Advance the frame index.
  *
@@ -425,9 +464,48 @@ int acmod_best_score(acmod_t *acmod, int *out_best_senid);
 
 /**
  * Clear set of active senones.
+ *
+ * Does nothing between acmod_begin_shared_frame() and
+ * acmod_end_shared_frame().
  */
 void acmod_clear_active(acmod_t *acmod);
 
+/**
+ * Start scoring a frame for several searches at once.
+ *
+ * Clears the set of active senones.  Until acmod_end_shared_frame(), the
+ * senones activated by each search are added to it, and acmod_score()
+ * computes the frame only once for all of them.  Every search must
+ * activate its senones before the first one calls acmod_score().
+ */
+void acmod_begin_shared_frame(acmod_t *acmod);
+
+/**
+ * Go back to scoring frames for a single search.
+ */
+void acmod_end_shared_frame(acmod_t *acmod);
+
+/**
+ * Allocate an empty set of senone scores for acmod_swap_scores().
+ */
+acmod_scores_t *acmod_scores_init(acmod_t *acmod);
+
+/**
+ * Free a set of senone scores.
+ */
+void acmod_scores_free(acmod_scores_t *scores);
+
+/**
+ * Exchange the senone scores and active senones of the acoustic model
+ * with @a scores.
+ *
+ * A search which has to score past frames in the middle of a frame, for
+ * instance to check a detection, swaps in scores of its own, and swaps
+ * them back afterwards so that the scores of the current frame are left
+ * as they were for other searches.
+ */
+void acmod_swap_scores(acmod_t *acmod, acmod_scores_t *scores);
+
 /**
  * Activate senones associated with an HMM.
  */
@@ -123,9 +123,12 @@ allphone_search_seg_iter(ps_search_t * search)
     return (ps_seg_t *) iter;
 }
 
+static void allphone_search_activate(ps_search_t * search, int frame_idx);
+
 static ps_searchfuncs_t allphone_funcs = {
     /* start: */ allphone_search_start,
     /* step: */ allphone_search_step,
+    /* sen_active: */ allphone_search_activate,
     /* finish: */ allphone_search_finish,
     /* reinit: */ allphone_search_reinit,
     /* free: */ allphone_search_free,
@@ -418,22 +421,22 @@ phmm_exit(allphone_search_t * allphs, int32 best)
                                     blkarray_list_get(history,
                                                       h->hist);
                                 h->tscore =
-                                    ngram_tg_score(allphs->lm,
-                                                   ci2lmwid
-                                                   [pred_pred->phmm->ci],
-                                                   ci2lmwid[pred->
-                                                            phmm->ci],
-                                                   ci2lmwid[p->ci],
-                                                   &n_used) >>
+                                    ngram_tg_score_r(allphs->lmq,
+                                                     ci2lmwid
+                                                     [pred_pred->phmm->ci],
+                                                     ci2lmwid[pred->
+                                                              phmm->ci],
+                                                     ci2lmwid[p->ci],
+                                                     &n_used) >>
                                     SENSCR_SHIFT;
                             }
                             else {
                                 h->tscore =
-                                    ngram_bg_score(allphs->lm,
-                                                   ci2lmwid
-                                                   [pred->phmm->ci],
-                                                   ci2lmwid[p->ci],
-                                                   &n_used) >>
+                                    ngram_bg_score_r(allphs->lmq,
+                                                     ci2lmwid
+                                                     [pred->phmm->ci],
+                                                     ci2lmwid[p->ci],
+                                                     &n_used) >>
                                     SENSCR_SHIFT;
                             }
                         }
@@ -493,17 +496,17 @@ phmm_trans(allphone_search_t * allphs, int32 best,
                     history_t *pred =
                         blkarray_list_get(allphs->history, h->hist);
                     tscore =
-                        ngram_tg_score(allphs->lm,
-                                       ci2lmwid[pred->phmm->ci],
-                                       ci2lmwid[from->ci],
-                                       ci2lmwid[to->ci],
-                                       &n_used) >> SENSCR_SHIFT;
+                        ngram_tg_score_r(allphs->lmq,
+                                         ci2lmwid[pred->phmm->ci],
+                                         ci2lmwid[from->ci],
+                                         ci2lmwid[to->ci],
+                                         &n_used) >> SENSCR_SHIFT;
                 }
                 else {
-                    tscore = ngram_bg_score(allphs->lm,
-                                            ci2lmwid[from->ci],
-                                            ci2lmwid[to->ci],
-                                            &n_used) >> SENSCR_SHIFT;
+                    tscore = ngram_bg_score_r(allphs->lmq,
+                                              ci2lmwid[from->ci],
+                                              ci2lmwid[to->ci],
+                                              &n_used) >> SENSCR_SHIFT;
                 }
             }
 
@@ -547,6 +550,7 @@ allphone_search_init(const char *name,
 	int32 silwid;
 	
         allphs->lm = ngram_model_retain(lm);
+        allphs->lmq = ngram_query_init(lm);
         
         silwid = ngram_wid(allphs->lm, bin_mdef_ciphone_str(mdef,
                                                             mdef_silphone
@@ -650,6 +654,8 @@ allphone_search_free(ps_search_t * search)
 
     hmm_context_free(allphs->hmmctx);
     phmm_free(allphs);
+    if (allphs->lmq)
+        ngram_query_free(allphs->lmq);
     if (allphs->lm)
         ngram_model_free(allphs->lm);
     if (allphs->ci2lmwid)
@@ -718,6 +724,12 @@ allphone_search_sen_active(allphone_search_t * allphs)
                 acmod_activate_hmm(acmod, &(p->hmm));
 }
 
+static void
+allphone_search_activate(ps_search_t * search, int frame_idx)
+{
+    allphone_search_sen_active((allphone_search_t *) search);
+}
+
 int
 allphone_search_step(ps_search_t * search, int frame_idx)
 {
@@ -112,6 +112,7 @@ typedef struct allphone_search_s {
 
     hmm_context_t *hmmctx;    /**< HMM context. */
     ngram_model_t *lm;        /**< Ngram model set */
+    ngram_query_t *lmq;       /**< Query state for lm, private to this search */
     int32 ci_only; 	      /**< Use context-independent phones for decoding */
     phmm_t **ci_phmm;         /**< PHMM lists (for each CI phone) */
     int32 *ci2lmwid;          /**< Mapping of CI phones to LM word IDs */
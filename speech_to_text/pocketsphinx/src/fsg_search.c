@@ -73,10 +73,12 @@
 static ps_seg_t *fsg_search_seg_iter(ps_search_t *search);
 static ps_lattice_t *fsg_search_lattice(ps_search_t *search);
 static int fsg_search_prob(ps_search_t *search);
+static void fsg_search_activate(ps_search_t *search, int frame_idx);
 
 static ps_searchfuncs_t fsg_funcs = {
     /* start: */  fsg_search_start,
     /* step: */   fsg_search_step,
+    /* sen_active: */ fsg_search_activate,
     /* finish: */ fsg_search_finish,
     /* reinit: */ fsg_search_reinit,
     /* free: */   fsg_search_free,
@@ -323,6 +325,12 @@ fsg_search_sen_active(fsg_search_t *fsgs)
     }
 }
 
+static void
+fsg_search_activate(ps_search_t *search, int frame_idx)
+{
+    fsg_search_sen_active((fsg_search_t *)search);
+}
+
 
 /*
  * Evaluate all the active HMMs.
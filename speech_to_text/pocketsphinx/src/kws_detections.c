@@ -36,31 +36,221 @@
 * kws_detections.c -- Object for storing keyphrase search results
 */
 
+#include <string.h>
+
+#include <sphinxbase/ckd_alloc.h>
+
 #include "kws_detections.h"
 
+kws_detections_t *
+kws_detections_init(int32 n_keyphrases)
+{
+    kws_detections_t *detections;
+
+    detections = (kws_detections_t *)ckd_calloc(1, sizeof(*detections));
+    detections->n_keyphrases = n_keyphrases;
+    if (n_keyphrases > 0) {
+        detections->pending = (kws_detection_t *)
+            ckd_calloc(n_keyphrases * KWS_DETECTIONS_PENDING,
+                       sizeof(*detections->pending));
+        detections->n_pending = (int32 *)ckd_calloc(n_keyphrases, sizeof(int32));
+        detections->last_final = (int32 *)ckd_calloc(n_keyphrases, sizeof(int32));
+        detections->busy = (int32 *)ckd_calloc(n_keyphrases, sizeof(int32));
+    }
+    detections->final = (kws_detection_t *)
+        ckd_calloc(KWS_DETECTIONS_MAX, sizeof(*detections->final));
+    kws_detections_reset(detections);
+
+    return detections;
+}
+
+void
+kws_detections_free(kws_detections_t *detections)
+{
+    if (detections == NULL)
+        return;
+
+    kws_detections_reset(detections);
+    ckd_free(detections->pending);
+    ckd_free(detections->n_pending);
+    ckd_free(detections->last_final);
+    ckd_free(detections->busy);
+    ckd_free(detections->final);
+    ckd_free(detections->hyp_str);
+    ckd_free(detections);
+}
+
+void
+kws_detections_add_keyphrase(kws_detections_t *detections)
+{
+    int32 n = ++detections->n_keyphrases;
+
+    detections->pending = (kws_detection_t *)
+        ckd_realloc(detections->pending,
+                    n * KWS_DETECTIONS_PENDING * sizeof(*detections->pending));
+    detections->n_pending = (int32 *)
+        ckd_realloc(detections->n_pending, n * sizeof(int32));
+    detections->last_final = (int32 *)
+        ckd_realloc(detections->last_final, n * sizeof(int32));
+    detections->busy = (int32 *)
+        ckd_realloc(detections->busy, n * sizeof(int32));
+    detections->n_pending[n - 1] = 0;
+    detections->last_final[n - 1] = -1;
+}
+
+void
+kws_detections_remove_keyphrase(kws_detections_t *detections, int32 kp_id)
+{
+    int32 i, n_after, n_busy;
+
+    n_after = detections->n_keyphrases - kp_id - 1;
+    memmove(&detections->pending[kp_id * KWS_DETECTIONS_PENDING],
+            &detections->pending[(kp_id + 1) * KWS_DETECTIONS_PENDING],
+            n_after * KWS_DETECTIONS_PENDING * sizeof(*detections->pending));
+    memmove(&detections->n_pending[kp_id], &detections->n_pending[kp_id + 1],
+            n_after * sizeof(int32));
+    memmove(&detections->last_final[kp_id], &detections->last_final[kp_id + 1],
+            n_after * sizeof(int32));
+    detections->n_keyphrases--;
+
+    n_busy = 0;
+    for (i = 0; i < detections->n_busy; i++) {
+        int32 busy = detections->busy[i];
+        if (busy != kp_id)
+            detections->busy[n_busy++] = busy > kp_id ? busy - 1 : busy;
+    }
+    detections->n_busy = n_busy;
+}
+
+void
+kws_detections_set_verify(kws_detections_t *detections,
+                          kws_detections_verify_f verify, void *data)
+{
+    detections->verify = verify;
+    detections->verify_data = data;
+}
+
 void
 kws_detections_reset(kws_detections_t *detections)
 {
-    gnode_t *gn;
+    int32 i;
 
-    if (!detections->detect_list)
-        return;
+    for (i = 0; i < detections->n_final; i++)
+        ckd_free((char *)kws_detections_final(detections, i)->keyphrase);
+    detections->final_head = 0;
+    detections->n_final = 0;
+    detections->n_final_total = 0;
+
+    for (i = 0; i < detections->n_busy; i++)
+        detections->n_pending[detections->busy[i]] = 0;
+    detections->n_busy = 0;
+    for (i = 0; i < detections->n_keyphrases; i++)
+        detections->last_final[i] = -1;
 
-    for (gn = detections->detect_list; gn; gn = gnode_next(gn))
-        ckd_free(gnode_ptr(gn));
-    glist_free(detections->detect_list);
-    detections->detect_list = NULL;
+    detections->n_rejected = 0;
+
+    detections->hyp_len = 0;
+    if (detections->hyp_str)
+        detections->hyp_str[0] = '\0';
+}
+
+/* Append a detection to the final ring and to the hypothesis, dropping
+ * the oldest one if the ring is full. */
+static void
+kws_detections_push_final(kws_detections_t *detections,
+                          int32 kp_id, kws_detection_t const *det)
+{
+    kws_detection_t *slot;
+    int32 len;
+
+    if (detections->n_final == KWS_DETECTIONS_MAX) {
+        slot = kws_detections_final(detections, 0);
+        len = strlen(slot->keyphrase);
+        if (detections->hyp_len > len) {
+            /* Drop the keyphrase and the separator after it */
+            memmove(detections->hyp_str, detections->hyp_str + len + 1,
+                    detections->hyp_len - len);
+            detections->hyp_len -= len + 1;
+        }
+        else {
+            detections->hyp_len = 0;
+            detections->hyp_str[0] = '\0';
+        }
+        ckd_free((char *)slot->keyphrase);
+        detections->final_head = (detections->final_head + 1) % KWS_DETECTIONS_MAX;
+        detections->n_final--;
+    }
+
+    slot = kws_detections_final(detections, detections->n_final);
+    *slot = *det;
+    slot->keyphrase = ckd_salloc(det->keyphrase);
+    detections->last_final[kp_id] = detections->n_final_total++;
+    detections->n_final++;
+
+    len = strlen(det->keyphrase);
+    if (detections->hyp_len + len + 2 > detections->hyp_alloc) {
+        detections->hyp_alloc = detections->hyp_len + len + 2 + 256;
+        detections->hyp_str = (char *)ckd_realloc(detections->hyp_str,
+                                                  detections->hyp_alloc);
+    }
+    if (detections->hyp_len > 0)
+        detections->hyp_str[detections->hyp_len++] = ' ';
+    memcpy(detections->hyp_str + detections->hyp_len, det->keyphrase, len);
+    detections->hyp_len += len;
+    detections->hyp_str[detections->hyp_len] = '\0';
+}
+
+/* Move the oldest pending detection of a keyphrase to the final ring. */
+static void
+kws_detections_pop_pending(kws_detections_t *detections, int32 kp_id)
+{
+    kws_detection_t *ring = &detections->pending[kp_id * KWS_DETECTIONS_PENDING];
+    int32 n = --detections->n_pending[kp_id];
+
+    if (detections->verify == NULL
+        || (*detections->verify)(detections->verify_data, kp_id, &ring[0]))
+        kws_detections_push_final(detections, kp_id, &ring[0]);
+    else
+        detections->n_rejected++;
+    memmove(ring, ring + 1, n * sizeof(*ring));
 }
 
 void
-kws_detections_add(kws_detections_t *detections, const char* keyphrase, int sf, int ef, int prob, int ascr)
+kws_detections_add(kws_detections_t *detections, int32 kp_id, const char* keyphrase, int sf, int ef, int prob, int ascr)
 {
-    gnode_t *gn;
-    kws_detection_t* detection;
-    for (gn = detections->detect_list; gn; gn = gnode_next(gn)) {
-        kws_detection_t *det = (kws_detection_t *)gnode_ptr(gn);
-        if (strcmp(keyphrase, det->keyphrase) == 0 && det->sf < ef && det->ef > sf) {
-            if (det->prob < prob) {
+    kws_detection_t *ring = &detections->pending[kp_id * KWS_DETECTIONS_PENDING];
+    kws_detection_t detection;
+    int32 n, first, i;
+
+    detection.keyphrase = keyphrase;
+    detection.sf = sf;
+    detection.ef = ef;
+    detection.prob = prob;
+    detection.ascr = ascr;
+
+    /* Pending detections of a keyphrase never overlap each other, so the
+     * ones overlapping the new one are at the end of the ring. Merge
+     * them all into the one with the best score. */
+    n = detections->n_pending[kp_id];
+    for (first = n; first > 0; first--) {
+        kws_detection_t *det = &ring[first - 1];
+        if (!(det->sf < ef && det->ef > sf))
+            break;
+    }
+    for (i = first; i < n; i++) {
+        if (!(ring[i].prob < detection.prob))
+            detection = ring[i];
+    }
+
+    /* Overlaps a detection which is already in the hypothesis. Only fold
+     * it in there if no pending one overlaps it too, since that would
+     * make the final and pending ones overlap: drop it instead. */
+    i = detections->last_final[kp_id];
+    if (i >= detections->n_final_total - detections->n_final) {
+        kws_detection_t *det = kws_detections_final(detections,
+                                                    i - (detections->n_final_total - detections->n_final));
+        if (det->ef > detection.sf) {
+            if (first == n && det->prob < prob) {
                 det->sf = sf;
                 det->ef = ef;
                 det->prob = prob;
@@ -70,51 +260,47 @@ kws_detections_add(kws_detections_t *detections, const char* keyphrase, int sf,
         }
     }
 
-    /* Nothing found */
-    detection = (kws_detection_t *)ckd_calloc(1, sizeof(*detection));
-    detection->sf = sf;
-    detection->ef = ef;
-    detection->keyphrase = keyphrase;
-    detection->prob = prob;
-    detection->ascr = ascr;
-    detections->detect_list = glist_add_ptr(detections->detect_list, detection);
+    if (first == KWS_DETECTIONS_PENDING) {
+        /* Ring is full, the oldest detection is final a bit early */
+        kws_detections_pop_pending(detections, kp_id);
+        first--;
+    }
+    if (detections->n_pending[kp_id] == 0)
+        detections->busy[detections->n_busy++] = kp_id;
+    ring[first] = detection;
+    detections->n_pending[kp_id] = first + 1;
 }
 
-char *
-kws_detections_hyp_str(kws_detections_t *detections, int frame, int delay)
+void
+kws_detections_finalize(kws_detections_t *detections, int frame)
 {
-    gnode_t *gn;
-    char *c;
-    int len;
-    char *hyp_str;
-
-    len = 0;
-    for (gn = detections->detect_list; gn; gn = gnode_next(gn)) {
-	kws_detection_t *det = (kws_detection_t *)gnode_ptr(gn);
-	if (det->ef < frame - delay) {
-	    len += strlen(det->keyphrase) + 1;
-	}
-    }
+    /* Move pending detections which ended before frame to the final
+     * ring, in order of their end frame. */
+    while (detections->n_busy > 0) {
+        int32 i, best = -1;
+        frame_idx_t best_ef = frame;
 
-    if (len == 0) {
-        return NULL;
-    }
+        for (i = 0; i < detections->n_busy; i++) {
+            int32 kp_id = detections->busy[i];
+            kws_detection_t *det = &detections->pending[kp_id * KWS_DETECTIONS_PENDING];
+            if (det->ef < best_ef) {
+                best_ef = det->ef;
+                best = i;
+            }
+        }
+        if (best < 0)
+            break;
 
-    hyp_str = (char *)ckd_calloc(len, sizeof(char));
-    c = hyp_str;
-    for (gn = detections->detect_list; gn; gn = gnode_next(gn)) {
-	kws_detection_t *det = (kws_detection_t *)gnode_ptr(gn);
-	if (det->ef < frame - delay) {
-            memcpy(c, det->keyphrase, strlen(det->keyphrase));
-    	    c += strlen(det->keyphrase);
-    	    *c = ' ';
-    	    c++;
-    	}
-    }
-    if (c > hyp_str) {
-        c--;
-	*c = '\0';
+        kws_detections_pop_pending(detections, detections->busy[best]);
+        if (detections->n_pending[detections->busy[best]] == 0)
+            detections->busy[best] = detections->busy[--detections->n_busy];
     }
-    return hyp_str;
 }
 
+const char *
+kws_detections_hyp_str(kws_detections_t *detections)
+{
+    if (detections->hyp_len == 0)
+        return NULL;
+    return detections->hyp_str;
+}
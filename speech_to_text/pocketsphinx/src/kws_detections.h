@@ -39,13 +39,15 @@
 #ifndef __KWS_DETECTIONS_H__
 #define __KWS_DETECTIONS_H__
 
-/* SphinxBase headers. */
-#include <sphinxbase/glist.h>
-
 /* Local headers. */
 #include "pocketsphinx_internal.h"
 #include "hmm.h"
 
+/** Number of pending detections kept per keyphrase */
+#define KWS_DETECTIONS_PENDING 4
+/** Number of final detections kept for the hypothesis and segments */
+#define KWS_DETECTIONS_MAX 256
+
 typedef struct kws_detection_s {
     const char* keyphrase;
     frame_idx_t sf;
@@ -54,23 +56,98 @@ typedef struct kws_detection_s {
     int32 ascr;
 } kws_detection_t;
 
+/**
+ * Check a detection before it becomes final, returning TRUE to keep it.
+ */
+typedef int (*kws_detections_verify_f)(void *data, int32 kp_id,
+                                       kws_detection_t const *det);
+
+/**
+ * Keyphrase detections of the current utterance.
+ *
+ * Candidate detections wait in a small ring per keyphrase, where
+ * overlapping candidates of the same keyphrase are merged into the best
+ * one. Once a detection ends more than -kws_delay frames in the past it
+ * is final: it moves to a bounded ring of final detections and its
+ * keyphrase is appended to the hypothesis string. A later candidate
+ * overlapping a final detection of the same keyphrase may still update
+ * its frames and score, which leaves the hypothesis string unchanged.
+ * If a verification callback is set, detections it rejects are dropped
+ * instead of becoming final.
+ */
 typedef struct kws_detections_s {
-    glist_t detect_list;
+    kws_detection_t *pending;     /**< KWS_DETECTIONS_PENDING slots per keyphrase, by start frame */
+    int32 *n_pending;             /**< Number of pending detections per keyphrase */
+    int32 *last_final;            /**< Serial number of the last final detection per keyphrase */
+    int32 *busy;                  /**< Keyphrases with pending detections */
+    int32 n_busy;
+    int32 n_keyphrases;
+
+    kws_detection_t *final;       /**< Ring of final detections, oldest first */
+    int32 final_head;             /**< Index of the oldest final detection */
+    int32 n_final;                /**< Number of final detections */
+    int32 n_final_total;          /**< Number of final detections including dropped ones */
+
+    char *hyp_str;                /**< Keyphrases of the final detections */
+    int32 hyp_len;
+    int32 hyp_alloc;
+
+    kws_detections_verify_f verify; /**< Check of detections, NULL if none */
+    void *verify_data;
+    int32 n_rejected;             /**< Number of detections verify rejected */
 } kws_detections_t;
 
+/**
+ * Allocate history structure for the given number of keyphrases.
+ */
+kws_detections_t *kws_detections_init(int32 n_keyphrases);
+
+/**
+ * Free history structure.
+ */
+void kws_detections_free(kws_detections_t *detections);
+
+/**
+ * Make room for one more keyphrase, numbered after the existing ones.
+ */
+void kws_detections_add_keyphrase(kws_detections_t *detections);
+
+/**
+ * Drop pending detections of keyphrase kp_id and renumber the keyphrases
+ * after it. Final detections are kept.
+ */
+void kws_detections_remove_keyphrase(kws_detections_t *detections, int32 kp_id);
+
+/**
+ * Set the check detections have to pass to become final, NULL for none.
+ */
+void kws_detections_set_verify(kws_detections_t *detections,
+                               kws_detections_verify_f verify, void *data);
+
 /**
  * Reset history structure.
  */
 void kws_detections_reset(kws_detections_t *detections);
 
 /**
- * Add history entry.
+ * Add history entry for keyphrase number kp_id.
+ */
+void kws_detections_add(kws_detections_t *detections, int32 kp_id, const char* keyphrase, int sf, int ef, int prob, int ascr);
+
+/**
+ * Make all pending detections which end before frame final.
+ */
+void kws_detections_finalize(kws_detections_t *detections, int frame);
+
+/**
+ * Get the n-th final detection, oldest first.
  */
-void kws_detections_add(kws_detections_t *detections, const char* keyphrase, int sf, int ef, int prob, int ascr);
+#define kws_detections_final(d,n) \
+    (&(d)->final[((d)->final_head + (n)) % KWS_DETECTIONS_MAX])
 
 /**
- * Compose hypothesis.
+ * Compose hypothesis. Returns NULL if nothing was detected yet.
  */
-char* kws_detections_hyp_str(kws_detections_t *detections, int frame, int delay);
+const char* kws_detections_hyp_str(kws_detections_t *detections);
 
 #endif /* __KWS_DETECTIONS_H__ */
@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include <sphinxbase/err.h>
 #include <sphinxbase/ckd_alloc.h>
@@ -48,10 +49,11 @@
 
 #include "pocketsphinx_internal.h"
 #include "kws_search.h"
+#include "state_align_search.h"
 
 /** Access macros */
 #define hmm_is_active(hmm) ((hmm)->frame > 0)
-#define kws_nth_hmm(keyphrase,n) (&((keyphrase)->hmms[n]))
+#define kws_node_hmm(kwss,n) (&((kwss)->hmms[n]))
 
 /* Value selected experimentally as maximum difference between triphone
 score and phone loop score, used in confidence computation to make sure
@@ -59,6 +61,9 @@ that confidence value is less than 1. This might be different for
 different models. Corresponds to threshold of about 1e+50 */ 
 #define KWS_MAX 1500
 
+/* Number of frames between updates of adaptive thresholds */
+#define KWS_FA_TICK 100
+
 static ps_lattice_t *
 kws_search_lattice(ps_search_t * search)
 {
@@ -81,7 +86,8 @@ kws_seg_free(ps_seg_t *seg)
 static void
 kws_seg_fill(kws_seg_t *itor)
 {
-    kws_detection_t* detection = (kws_detection_t*)gnode_ptr(itor->detection);
+    kws_search_t *kwss = (kws_search_t *)itor->base.search;
+    kws_detection_t* detection = kws_detections_final(kwss->detections, itor->pos);
 
     itor->base.word = detection->keyphrase;
     itor->base.sf = detection->sf;
@@ -95,13 +101,9 @@ static ps_seg_t *
 kws_seg_next(ps_seg_t *seg)
 {
     kws_seg_t *itor = (kws_seg_t *)seg;
+    kws_search_t *kwss = (kws_search_t *)itor->base.search;
 
-    gnode_t *detect_head = gnode_next(itor->detection);
-    while (detect_head != NULL && ((kws_detection_t*)gnode_ptr(detect_head))->ef > itor->last_frame)
-         detect_head = gnode_next(detect_head);
-    itor->detection = detect_head;
-
-    if (!itor->detection) {
+    if (++itor->pos >= kwss->detections->n_final) {
         kws_seg_free(seg);
         return NULL;
     }
@@ -121,27 +123,25 @@ kws_search_seg_iter(ps_search_t * search)
 {
     kws_search_t *kwss = (kws_search_t *)search;
     kws_seg_t *itor;
-    gnode_t *detect_head = kwss->detections->detect_list;
-    
-    while (detect_head != NULL && ((kws_detection_t*)gnode_ptr(detect_head))->ef > kwss->frame - kwss->delay)
-	detect_head = gnode_next(detect_head);
-    
-    if (!detect_head)
+
+    if (kwss->detections->n_final == 0)
         return NULL;
 
     itor = (kws_seg_t *)ckd_calloc(1, sizeof(*itor));
     itor->base.vt = &kws_segfuncs;
     itor->base.search = search;
     itor->base.lwf = 1.0;
-    itor->detection = detect_head;
-    itor->last_frame = kwss->frame - kwss->delay;
+    itor->pos = 0;
     kws_seg_fill(itor);
     return (ps_seg_t *)itor;
 }
 
+static void kws_search_activate(ps_search_t * search, int frame_idx);
+
 static ps_searchfuncs_t kws_funcs = {
     /* start: */ kws_search_start,
     /* step: */ kws_search_step,
+    /* sen_active: */ kws_search_activate,
     /* finish: */ kws_search_finish,
     /* reinit: */ kws_search_reinit,
     /* free: */ kws_search_free,
@@ -157,22 +157,22 @@ static void
 kws_search_sen_active(kws_search_t * kwss)
 {
     int i;
-    gnode_t *gn;
 
     acmod_clear_active(ps_search_acmod(kwss));
 
     /* active phone loop hmms */
-    for (i = 0; i < kwss->n_pl; i++)
-        acmod_activate_hmm(ps_search_acmod(kwss), &kwss->pl_hmms[i]);
+    phone_loop_activate(kwss->pl);
 
     /* activate hmms in active nodes */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-            if (hmm_is_active(kws_nth_hmm(keyphrase, i)))
-                acmod_activate_hmm(ps_search_acmod(kwss), kws_nth_hmm(keyphrase, i));
-        }
-    }
+    for (i = 0; i < kwss->n_active; i++)
+        acmod_activate_hmm(ps_search_acmod(kwss),
+                           kws_node_hmm(kwss, kwss->active[i]));
+}
+
+static void
+kws_search_activate(ps_search_t * search, int frame_idx)
+{
+    kws_search_sen_active((kws_search_t *) search);
 }
 
 /*
@@ -180,37 +180,26 @@ kws_search_sen_active(kws_search_t * kwss)
 * (Executed once per frame.)
 */
 static void
-kws_search_hmm_eval(kws_search_t * kwss, int16 const *senscr)
+kws_search_hmm_eval(kws_search_t * kwss, int16 const *senscr,
+                    int frame_idx)
 {
     int32 i;
-    gnode_t *gn;
-    int32 bestscore = WORST_SCORE;
+    int32 bestscore;
 
-    hmm_context_set_senscore(kwss->hmmctx, senscr);
+    /* evaluate hmms from phone loop, unless another search did */
+    phone_loop_step(kwss->pl, senscr, frame_idx);
+    bestscore = kwss->pl->best_score;
 
-    /* evaluate hmms from phone loop */
-    for (i = 0; i < kwss->n_pl; ++i) {
-        hmm_t *hmm = &kwss->pl_hmms[i];
+    hmm_context_set_senscore(kwss->hmmctx, senscr);
+    /* evaluate hmms for active nodes */
+    for (i = 0; i < kwss->n_active; i++) {
+        hmm_t *hmm = kws_node_hmm(kwss, kwss->active[i]);
         int32 score;
 
         score = hmm_vit_eval(hmm);
         if (score BETTER_THAN bestscore)
             bestscore = score;
     }
-    /* evaluate hmms for active nodes */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-            hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-
-            if (hmm_is_active(hmm)) {
-                int32 score;
-                score = hmm_vit_eval(hmm);
-                if (score BETTER_THAN bestscore)
-                    bestscore = score;
-            }
-        }
-    }
 
     kwss->bestscore = bestscore;
 }
@@ -222,21 +211,132 @@ kws_search_hmm_eval(kws_search_t * kwss, int16 const *senscr)
 static void
 kws_search_hmm_prune(kws_search_t * kwss)
 {
-    int32 thresh, i;
-    gnode_t *gn;
+    int32 thresh, i, n_active;
 
     thresh = kwss->bestscore + kwss->beam;
 
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        for (i = 0; i < keyphrase->n_hmms; i++) {
-    	    hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-            if (hmm_is_active(hmm) && hmm_bestscore(hmm) < thresh)
-                hmm_clear(hmm);
-        }
+    n_active = 0;
+    for (i = 0; i < kwss->n_active; i++) {
+        hmm_t *hmm = kws_node_hmm(kwss, kwss->active[i]);
+        if (hmm_bestscore(hmm) < thresh)
+            hmm_clear(hmm);
+        else
+            kwss->active[n_active++] = kwss->active[i];
     }
+    kwss->n_active = n_active;
 }
 
+/**
+* Enter a keyphrase node, adding it to the active list if it was not
+* active yet.
+*/
+static void
+kws_search_enter_node(kws_search_t * kwss, int32 node, int32 score,
+                      int32 histid)
+{
+    hmm_t *hmm = kws_node_hmm(kwss, node);
+
+    if (!hmm_is_active(hmm))
+        kwss->active[kwss->n_active++] = node;
+    else if (!(score BETTER_THAN hmm_in_score(hmm)))
+        return;
+    hmm_enter(hmm, score, histid, kwss->frame + 1);
+}
+
+/* Histogram bin of an event score, from the lowest allowed threshold */
+static int32
+kws_search_fa_bin(kws_search_t * kwss, kws_keyphrase_t * keyphrase, int32 score)
+{
+    int32 bin;
+
+    bin = (score - (keyphrase->base_threshold - kwss->fa_range)) * KWS_FA_BINS
+        / (2 * kwss->fa_range + 1);
+    if (bin < 0)
+        return 0;
+    if (bin >= KWS_FA_BINS)
+        return KWS_FA_BINS - 1;
+    return bin;
+}
+
+/* Lowest score falling in a histogram bin */
+static int32
+kws_search_fa_edge(kws_search_t * kwss, kws_keyphrase_t * keyphrase, int32 bin)
+{
+    return keyphrase->base_threshold - kwss->fa_range
+        + (bin * (2 * kwss->fa_range + 1) + KWS_FA_BINS - 1) / KWS_FA_BINS;
+}
+
+/* Add the peak of the open event to the histogram */
+static void
+kws_search_fa_close(kws_search_t * kwss, kws_keyphrase_t * keyphrase)
+{
+    kws_fa_stats_t *fa = keyphrase->fa;
+
+    fa->hist[kws_search_fa_bin(kwss, keyphrase, fa->peak)] += 1.0f;
+    fa->n_events++;
+    fa->last_frame = -1;
+}
+
+/* Track the keyphrase score of the current frame */
+static void
+kws_search_fa_observe(kws_search_t * kwss, kws_keyphrase_t * keyphrase,
+                      int32 score)
+{
+    kws_fa_stats_t *fa = keyphrase->fa;
+    int32 frame = kwss->n_tot_frame + kwss->frame;
+
+    if (score < keyphrase->base_threshold - kwss->fa_range)
+        return;
+
+    if (fa->last_frame >= 0 && frame - fa->last_frame > kwss->delay)
+        kws_search_fa_close(kwss, keyphrase);
+    if (fa->last_frame < 0 || score > fa->peak)
+        fa->peak = score;
+    fa->last_frame = frame;
+}
+
+/**
+* Decay the statistics by n_frames more frames of audio and move each
+* threshold to the lowest one whose estimated false alarm rate is within
+* the target.
+*/
+static void
+kws_search_fa_update(kws_search_t * kwss, int32 n_frames)
+{
+    float64 decay, allowed;
+    int32 frame, k, b;
+
+    decay = exp(-n_frames / kwss->fa_window);
+    kwss->fa_frames = kwss->fa_frames * decay + n_frames;
+    allowed = kwss->fa_target * kwss->fa_frames;
+    frame = kwss->n_tot_frame + kwss->frame;
+
+    for (k = 0; k < kwss->n_keyphrases; k++) {
+        kws_keyphrase_t *keyphrase = &kwss->keyphrases[k];
+        kws_fa_stats_t *fa = keyphrase->fa;
+        float64 n_above;
+
+        if (fa == NULL)
+            continue;
+
+        if (fa->last_frame >= 0 && frame - fa->last_frame > kwss->delay)
+            kws_search_fa_close(kwss, keyphrase);
+        for (b = 0; b < KWS_FA_BINS; b++)
+            fa->hist[b] *= decay;
+
+        /* Keep the configured threshold until there is enough audio */
+        if (kwss->fa_frames < 0.1 * kwss->fa_window)
+            continue;
+
+        n_above = 0;
+        for (b = KWS_FA_BINS - 1; b >= 0; b--) {
+            if (n_above + fa->hist[b] > allowed)
+                break;
+            n_above += fa->hist[b];
+        }
+        keyphrase->threshold = kws_search_fa_edge(kwss, keyphrase, b + 1);
+    }
+}
 
 /**
 * Do phone transitions
@@ -244,83 +344,156 @@ kws_search_hmm_prune(kws_search_t * kwss)
 static void
 kws_search_trans(kws_search_t * kwss)
 {
-    hmm_t *pl_best_hmm = NULL;
-    int32 best_out_score = WORST_SCORE;
-    int i;
-    gnode_t *gn;
-
-    /* select best hmm in phone-loop to be a predecessor */
-    for (i = 0; i < kwss->n_pl; i++)
-        if (hmm_out_score(&kwss->pl_hmms[i]) BETTER_THAN best_out_score) {
-            best_out_score = hmm_out_score(&kwss->pl_hmms[i]);
-            pl_best_hmm = &kwss->pl_hmms[i];
-        }
+    int32 pl_best_out = kwss->pl->best_out_score;
+    int32 n_active;
+    int i, n, k;
 
     /* out probs are not ready yet */
-    if (!pl_best_hmm)
+    if (!(pl_best_out BETTER_THAN WORST_SCORE))
         return;
 
-    /* Check whether keyphrase wasn't spotted yet */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
+    /* Check whether keyphrase wasn't spotted yet. Only nodes which end
+     * a keyphrase and survived pruning can raise a detection. */
+    for (i = 0; i < kwss->n_active; i++) {
         hmm_t *last_hmm;
-        
-        if (keyphrase->n_hmms < 1)
-    	    continue;
-        
-        last_hmm = kws_nth_hmm(keyphrase, keyphrase->n_hmms - 1);
 
-        if (hmm_is_active(last_hmm)
-            && hmm_out_score(pl_best_hmm) BETTER_THAN WORST_SCORE) {
+        n = kwss->active[i];
+        if (kwss->first_phrase[n] < 0)
+            continue;
+
+        last_hmm = kws_node_hmm(kwss, n);
+        for (k = kwss->first_phrase[n]; k >= 0;
+             k = kwss->keyphrases[k].next_phrase) {
+            kws_keyphrase_t *keyphrase = &kwss->keyphrases[k];
+
+            if (keyphrase->fa)
+                kws_search_fa_observe(kwss, keyphrase,
+                                      hmm_out_score(last_hmm) - pl_best_out);
 
-            if (hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) 
+            if (hmm_out_score(last_hmm) - pl_best_out 
                 >= keyphrase->threshold) {
 
-                int32 prob = hmm_out_score(last_hmm) - hmm_out_score(pl_best_hmm) - KWS_MAX;
-                kws_detections_add(kwss->detections, keyphrase->word,
+                int32 prob = hmm_out_score(last_hmm) - pl_best_out - KWS_MAX;
+                kws_detections_add(kwss->detections, k, keyphrase->word,
                                   hmm_out_history(last_hmm),
                                   kwss->frame, prob,
                                   hmm_out_score(last_hmm));
             } /* keyphrase is spotted */
-        } /* last hmm of keyphrase is active */
-    } /* keyphrase loop */
-
-    /* Make transition for all phone loop hmms */
-    for (i = 0; i < kwss->n_pl; i++) {
-        if (hmm_out_score(pl_best_hmm) + kwss->plp BETTER_THAN
-            hmm_in_score(&kwss->pl_hmms[i])) {
-            hmm_enter(&kwss->pl_hmms[i],
-                      hmm_out_score(pl_best_hmm) + kwss->plp,
-                      hmm_out_history(pl_best_hmm), kwss->frame + 1);
-        }
+        } /* keyphrases ending at node */
+    } /* active node loop */
+
+    /* Enter successors of the nodes active in this frame. Nodes entered
+     * for the first time are appended to the active list, so only the
+     * nodes already on it are used as predecessors. */
+    n_active = kwss->n_active;
+    for (i = 0; i < n_active; i++) {
+        hmm_t *pred_hmm = kws_node_hmm(kwss, kwss->active[i]);
+
+        if (!(hmm_out_score(pred_hmm) BETTER_THAN WORST_SCORE))
+            continue;
+        for (n = kwss->first_child[kwss->active[i]]; n >= 0;
+             n = kwss->sibling[n])
+            kws_search_enter_node(kwss, n, hmm_out_score(pred_hmm),
+                                  hmm_out_history(pred_hmm));
     }
 
-    /* Activate new keyphrase nodes, enter their hmms */
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        
-        if (keyphrase->n_hmms < 1)
-    	    continue;
-        
-        for (i = keyphrase->n_hmms - 1; i > 0; i--) {
-            hmm_t *pred_hmm = kws_nth_hmm(keyphrase, i - 1);
-            hmm_t *hmm = kws_nth_hmm(keyphrase, i);
-
-            if (hmm_is_active(pred_hmm)) {    
-                if (!hmm_is_active(hmm)
-                    || hmm_out_score(pred_hmm) BETTER_THAN
-                    hmm_in_score(hmm))
-                        hmm_enter(hmm, hmm_out_score(pred_hmm),
-                                  hmm_out_history(pred_hmm), kwss->frame + 1);
-            }
-        }
+    /* Enter keyphrase start nodes from phone loop */
+    for (n = kwss->first_root; n >= 0; n = kwss->sibling[n])
+        kws_search_enter_node(kwss, n, pl_best_out, kwss->frame);
+}
+
+/**
+* Find the child of a prefix tree node with the given triphone, adding
+* it if there is none yet. Returns the index of the child.
+*/
+static int32
+kws_search_add_node(kws_search_t * kwss, int32 parent, int32 ssid, int32 tmatid)
+{
+    int32 n;
+
+    n = parent < 0 ? kwss->first_root : kwss->first_child[parent];
+    for (; n >= 0; n = kwss->sibling[n]) {
+        hmm_t *hmm = kws_node_hmm(kwss, n);
+        if (hmm_nonmpx_ssid(hmm) == ssid && hmm_tmatid(hmm) == tmatid)
+            return n;
+    }
 
-        /* Enter keyphrase start node from phone loop */
-        if (hmm_out_score(pl_best_hmm) BETTER_THAN
-            hmm_in_score(kws_nth_hmm(keyphrase, 0)))
-                hmm_enter(kws_nth_hmm(keyphrase, 0), hmm_out_score(pl_best_hmm),
-                    kwss->frame, kwss->frame + 1);
+    if (kwss->n_nodes == kwss->n_nodes_alloc) {
+        kwss->n_nodes_alloc = kwss->n_nodes_alloc ? kwss->n_nodes_alloc * 2 : 64;
+        kwss->hmms = ckd_realloc(kwss->hmms,
+                                 kwss->n_nodes_alloc * sizeof(*kwss->hmms));
+        kwss->parent = ckd_realloc(kwss->parent,
+                                   kwss->n_nodes_alloc * sizeof(*kwss->parent));
+        kwss->first_child = ckd_realloc(kwss->first_child,
+                                        kwss->n_nodes_alloc * sizeof(*kwss->first_child));
+        kwss->sibling = ckd_realloc(kwss->sibling,
+                                    kwss->n_nodes_alloc * sizeof(*kwss->sibling));
+        kwss->first_phrase = ckd_realloc(kwss->first_phrase,
+                                         kwss->n_nodes_alloc * sizeof(*kwss->first_phrase));
+        kwss->active = ckd_realloc(kwss->active,
+                                   kwss->n_nodes_alloc * sizeof(*kwss->active));
+    }
+
+    n = kwss->n_nodes++;
+    hmm_init(kwss->hmmctx, kws_node_hmm(kwss, n), FALSE, ssid, tmatid);
+    kwss->parent[n] = parent;
+    kwss->first_child[n] = -1;
+    kwss->first_phrase[n] = -1;
+    if (parent < 0) {
+        kwss->sibling[n] = kwss->first_root;
+        kwss->first_root = n;
+    }
+    else {
+        kwss->sibling[n] = kwss->first_child[parent];
+        kwss->first_child[parent] = n;
     }
+
+    return n;
+}
+
+/**
+* Drop all prefix tree nodes, keeping their storage.
+*/
+static void
+kws_search_reset_nodes(kws_search_t * kwss)
+{
+    int32 i;
+
+    for (i = 0; i < kwss->n_nodes; i++)
+        hmm_deinit(kws_node_hmm(kwss, i));
+    kwss->n_nodes = 0;
+    kwss->n_active = 0;
+    kwss->first_root = -1;
+}
+
+/**
+* Append a keyphrase, returning it. The phrase is spotted only once
+* kws_search_reinit() has added it to the prefix tree.
+*/
+static kws_keyphrase_t *
+kws_search_new_keyphrase(kws_search_t * kwss, const char *word, int32 threshold)
+{
+    kws_keyphrase_t *keyphrase;
+
+    if (kwss->n_keyphrases == kwss->n_keyphrases_alloc) {
+        kwss->n_keyphrases_alloc = kwss->n_keyphrases_alloc ? kwss->n_keyphrases_alloc * 2 : 16;
+        kwss->keyphrases = ckd_realloc(kwss->keyphrases,
+                                       kwss->n_keyphrases_alloc * sizeof(*kwss->keyphrases));
+    }
+
+    keyphrase = &kwss->keyphrases[kwss->n_keyphrases++];
+    keyphrase->word = ckd_salloc(word);
+    keyphrase->threshold = threshold;
+    keyphrase->base_threshold = threshold;
+    keyphrase->fa = NULL;
+    if (kwss->fa_target > 0) {
+        keyphrase->fa = (kws_fa_stats_t *) ckd_calloc(1, sizeof(*keyphrase->fa));
+        keyphrase->fa->last_frame = -1;
+    }
+    keyphrase->last_node = -1;
+    keyphrase->next_phrase = -1;
+
+    return keyphrase;
 }
 
 static int
@@ -335,18 +508,14 @@ kws_search_read_list(kws_search_t *kwss, const char* keyfile)
         return -1;
     }
 
-    kwss->keyphrases = NULL;
-
     /* read keyphrases */
     for (li = lineiter_start_clean(list_file); li; li = lineiter_next(li)) {
         size_t begin, end;
-        kws_keyphrase_t *keyphrase;
+        int32 threshold;
 	
 	if (li->len == 0)
 	    continue;
 
-	keyphrase = ckd_calloc(1, sizeof(kws_keyphrase_t));
-
         line = li->buf;
         end = strlen(line) - 1;
 	begin = end - 1;
@@ -355,21 +524,97 @@ kws_search_read_list(kws_search_t *kwss, const char* keyfile)
                 begin--;
             line[end] = 0;
             line[begin] = 0;
-            keyphrase->threshold = (int32) logmath_log(kwss->base.acmod->lmath, atof_c(line + begin + 1)) 
+            threshold = (int32) logmath_log(kwss->base.acmod->lmath, atof_c(line + begin + 1)) 
                                           >> SENSCR_SHIFT;
         } else {
-            keyphrase->threshold = kwss->def_threshold;
+            threshold = kwss->def_threshold;
         }
 
-        keyphrase->word = ckd_salloc(line);
-
-        kwss->keyphrases = glist_add_ptr(kwss->keyphrases, keyphrase);
+        kws_search_new_keyphrase(kwss, line, threshold);
     }
 
     fclose(list_file);
     return 0;
 }
 
+/**
+* Check a detection by aligning its keyphrase to the frames it covers
+* once more. The detection is rejected if the alignment scores worse
+* than the verification threshold per frame, relative to the best of the
+* phone loop and keyphrase senones.
+*/
+static int
+kws_search_verify(void *data, int32 kp_id, kws_detection_t const *det)
+{
+    kws_search_t *kwss = (kws_search_t *) data;
+    acmod_t *acmod = ps_search_acmod(kwss);
+    dict_t *dict = ps_search_dict(kwss);
+    ps_alignment_t *al;
+    ps_alignment_iter_t *itor;
+    ps_search_t *align;
+    char **wrdptr;
+    char *tmp_keyphrase;
+    int32 n_wrds, score, n_frames;
+    int i, f, rv;
+
+    /* The first frame of the keyphrase is the one after sf */
+    if (acmod->output_frame - (det->sf + 1) > acmod_lookback(acmod)) {
+        if (!kwss->verify_warned) {
+            E_WARN("Frames of keyphrase '%s' are no longer kept, "
+                   "-lookback is too small to verify detections\n",
+                   det->keyphrase);
+            kwss->verify_warned = TRUE;
+        }
+        return TRUE;
+    }
+
+    al = ps_alignment_init(ps_search_dict2pid(kwss));
+    tmp_keyphrase = (char *) ckd_salloc(det->keyphrase);
+    n_wrds = str2words(tmp_keyphrase, NULL, 0);
+    wrdptr = (char **) ckd_calloc(n_wrds, sizeof(*wrdptr));
+    str2words(tmp_keyphrase, wrdptr, n_wrds);
+    for (i = 0; i < n_wrds; i++)
+        ps_alignment_add_word(al, dict_wordid(dict, wrdptr[i]), 0);
+    ckd_free(wrdptr);
+    ckd_free(tmp_keyphrase);
+    ps_alignment_populate(al);
+
+    /* Score the past frames aside, leaving those of the current frame
+     * to the searches which have not used them yet */
+    acmod_swap_scores(acmod, kwss->verify_scores);
+    align = state_align_search_init("_kws_verify", ps_search_config(kwss),
+                                    acmod, al);
+    state_align_search_set_start(align, det->sf + 1);
+    rv = ps_search_start(align);
+    for (f = det->sf + 1; rv >= 0 && f <= det->ef; f++) {
+        /* Phone loop senones keep the normalization as in decoding */
+        acmod_clear_active(acmod);
+        phone_loop_activate(kwss->pl);
+        rv = ps_search_step(align, f);
+    }
+    if (rv >= 0)
+        rv = ps_search_finish(align);
+    ps_search_free(align);
+    acmod_swap_scores(acmod, kwss->verify_scores);
+
+    score = 0;
+    for (itor = ps_alignment_words(al); itor;
+         itor = ps_alignment_iter_next(itor))
+        score += ps_alignment_iter_get(itor)->score;
+    ps_alignment_free(al);
+
+    n_frames = det->ef - det->sf;
+    if (rv < 0 || score / n_frames < kwss->verify_threshold) {
+        E_INFO("Rejected '%s' at frames %d to %d, alignment score %d per frame\n",
+               det->keyphrase, det->sf + 1, det->ef,
+               rv < 0 ? WORST_SCORE : score / n_frames);
+        return FALSE;
+    }
+    E_INFO("Verified '%s' at frames %d to %d, alignment score %d per frame\n",
+           det->keyphrase, det->sf + 1, det->ef, score / n_frames);
+    return TRUE;
+}
+
 ps_search_t *
 kws_search_init(const char *name,
                 const char *keyphrase,
@@ -381,8 +626,6 @@ kws_search_init(const char *name,
     ps_search_init(ps_search_base(kwss), &kws_funcs, PS_SEARCH_TYPE_KWS, name, config, acmod, dict,
                    d2p);
 
-    kwss->detections = (kws_detections_t *)ckd_calloc(1, sizeof(*kwss->detections));
-
     kwss->beam =
         (int32) logmath_log(acmod->lmath,
                             cmd_ln_float64_r(config,
@@ -405,6 +648,37 @@ kws_search_init(const char *name,
     E_INFO("KWS(beam: %d, plp: %d, default threshold %d, delay %d)\n",
            kwss->beam, kwss->plp, kwss->def_threshold, kwss->delay);
 
+    /* Adaptive thresholds */
+    kwss->fa_target = cmd_ln_float64_r(config, "-kws_fa_target")
+        / (3600.0 * cmd_ln_int32_r(config, "-frate"));
+    kwss->fa_range =
+        (int32) logmath_log(acmod->lmath,
+                            cmd_ln_float64_r(config,
+                                             "-kws_fa_range")) >> SENSCR_SHIFT;
+    kwss->fa_window = cmd_ln_float64_r(config, "-kws_fa_window")
+        * 3600.0 * cmd_ln_int32_r(config, "-frate");
+    if (kwss->fa_target > 0) {
+        if (kwss->fa_range <= 0 || kwss->fa_window <= 0) {
+            E_ERROR("-kws_fa_range must be greater than 1 and -kws_fa_window positive\n");
+            kws_search_free(ps_search_base(kwss));
+            return NULL;
+        }
+        E_INFO("KWS adaptive thresholds(target %.2f per hour, range %d, window %.0f frames)\n",
+               cmd_ln_float64_r(config, "-kws_fa_target"), kwss->fa_range,
+               kwss->fa_window);
+    }
+
+    /* Verification of detections */
+    if (cmd_ln_float64_r(config, "-kws_verify") > 0) {
+        kwss->verify_threshold =
+            (int32) logmath_log(acmod->lmath,
+                                cmd_ln_float64_r(config,
+                                                 "-kws_verify")) >> SENSCR_SHIFT;
+        kwss->verify_scores = acmod_scores_init(acmod);
+        E_INFO("KWS verification(threshold %d per frame, lookback %d frames)\n",
+               kwss->verify_threshold, cmd_ln_int32_r(config, "-lookback"));
+    }
+
     if (keyfile) {
 	if (kws_search_read_list(kwss, keyfile) < 0) {
 	    E_ERROR("Failed to create kws search\n");
@@ -412,12 +686,13 @@ kws_search_init(const char *name,
 	    return NULL;
 	}
     } else {
-        kws_keyphrase_t *k = ckd_calloc(1, sizeof(kws_keyphrase_t));
-        k->threshold = kwss->def_threshold;
-        k->word = ckd_salloc(keyphrase);
-        kwss->keyphrases = glist_add_ptr(NULL, k);
+        kws_search_new_keyphrase(kwss, keyphrase, kwss->def_threshold);
     }
 
+    kwss->detections = kws_detections_init(kwss->n_keyphrases);
+    if (kwss->verify_scores)
+        kws_detections_set_verify(kwss->detections, kws_search_verify, kwss);
+
     /* Reinit for provided keyphrase */
     if (kws_search_reinit(ps_search_base(kwss),
                           ps_search_dict(kwss),
@@ -436,7 +711,7 @@ kws_search_free(ps_search_t * search)
 {
     kws_search_t *kwss;
     double n_speech;
-    gnode_t *gn;
+    int32 i;
 
     kwss = (kws_search_t *) search;
 
@@ -453,33 +728,122 @@ kws_search_free(ps_search_t * search)
 
     ps_search_base_free(search);
     hmm_context_free(kwss->hmmctx);
-    kws_detections_reset(kwss->detections);
-    ckd_free(kwss->detections);
-
-    ckd_free(kwss->pl_hmms);
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-	kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-        ckd_free(keyphrase->hmms);
-        ckd_free(keyphrase->word);
-        ckd_free(keyphrase);
+    kws_detections_free(kwss->detections);
+    acmod_scores_free(kwss->verify_scores);
+
+    phone_loop_free(kwss->pl);
+    kws_search_reset_nodes(kwss);
+    ckd_free(kwss->hmms);
+    ckd_free(kwss->parent);
+    ckd_free(kwss->first_child);
+    ckd_free(kwss->sibling);
+    ckd_free(kwss->first_phrase);
+    ckd_free(kwss->active);
+    for (i = 0; i < kwss->n_keyphrases; i++) {
+        ckd_free(kwss->keyphrases[i].word);
+        ckd_free(kwss->keyphrases[i].fa);
     }
-    glist_free(kwss->keyphrases);
+    ckd_free(kwss->keyphrases);
     ckd_free(kwss);
 }
 
-int
-kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
+/**
+* Add the HMMs of keyphrase number k to the prefix tree. Returns -1 if a
+* word of the keyphrase is missing in the dictionary.
+*/
+static int
+kws_search_add_path(kws_search_t * kwss, int32 k)
 {
+    kws_keyphrase_t *keyphrase = &kwss->keyphrases[k];
+    dict_t *dict = ps_search_dict(kwss);
+    dict2pid_t *d2p = ps_search_dict2pid(kwss);
+    bin_mdef_t *mdef = ps_search_acmod(kwss)->mdef;
+    int32 silcipid = bin_mdef_silphone(mdef);
     char **wrdptr;
     char *tmp_keyphrase;
-    int32 wid, pronlen, in_dict;
-    int32 n_hmms, n_wrds;
+    int32 wid, pronlen;
+    int32 n_wrds, node;
     int32 ssid, tmatid;
-    int i, j, p;
+    int i, p;
+
+    keyphrase->last_node = -1;
+    keyphrase->next_phrase = -1;
+
+    /* Initialize keyphrase HMMs */
+    tmp_keyphrase = (char *) ckd_salloc(keyphrase->word);
+    n_wrds = str2words(tmp_keyphrase, NULL, 0);
+    wrdptr = (char **) ckd_calloc(n_wrds, sizeof(*wrdptr));
+    str2words(tmp_keyphrase, wrdptr, n_wrds);
+
+    /* check all words are known */
+    for (i = 0; i < n_wrds; i++) {
+        if (dict_wordid(dict, wrdptr[i]) == BAD_S3WID) {
+            E_ERROR("Word '%s' in phrase '%s' is missing in the dictionary\n", wrdptr[i], keyphrase->word);
+            ckd_free(wrdptr);
+            ckd_free(tmp_keyphrase);
+            return -1;
+        }
+    }
+
+    /* add the phrase path to the prefix tree */
+    node = -1;
+    for (i = 0; i < n_wrds; i++) {
+        wid = dict_wordid(dict, wrdptr[i]);
+        pronlen = dict_pronlen(dict, wid);
+        for (p = 0; p < pronlen; p++) {
+            int32 ci = dict_pron(dict, wid, p);
+            if (p == 0) {
+                /* first phone of word */
+                int32 rc =
+                    pronlen > 1 ? dict_pron(dict, wid, 1) : silcipid;
+                ssid = dict2pid_ldiph_lc(d2p, ci, rc, silcipid);
+            }
+            else if (p == pronlen - 1) {
+                /* last phone of the word */
+                int32 lc = dict_pron(dict, wid, p - 1);
+                xwdssid_t *rssid = dict2pid_rssid(d2p, ci, lc);
+                int j = rssid->cimap[silcipid];
+                ssid = rssid->ssid[j];
+            }
+            else {
+                /* word internal phone */
+                ssid = dict2pid_internal(d2p, wid, p);
+            }
+            tmatid = bin_mdef_pid2tmatid(mdef, ci);
+            node = kws_search_add_node(kwss, node, ssid, tmatid);
+        }
+    }
+    if (node >= 0) {
+        keyphrase->last_node = node;
+        keyphrase->next_phrase = kwss->first_phrase[node];
+        kwss->first_phrase[node] = k;
+    }
+
+    ckd_free(wrdptr);
+    ckd_free(tmp_keyphrase);
+    return 0;
+}
+
+/**
+* Rebuild the prefix tree for the current keyphrases.
+*/
+static void
+kws_search_build_tree(kws_search_t * kwss)
+{
+    int32 k;
+
+    kws_search_reset_nodes(kwss);
+    for (k = 0; k < kwss->n_keyphrases; k++)
+        kws_search_add_path(kwss, k);
+
+    E_INFO("KWS prefix tree: %d keyphrases, %d nodes\n",
+           kwss->n_keyphrases, kwss->n_nodes);
+}
+
+int
+kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
+{
     kws_search_t *kwss = (kws_search_t *) search;
-    bin_mdef_t *mdef = search->acmod->mdef;
-    int32 silcipid = bin_mdef_silphone(mdef);
-    gnode_t *gn;
 
     /* Free old dict2pid, dict */
     ps_search_base_reinit(search, dict, d2p);
@@ -487,6 +851,7 @@ kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
     /* Initialize HMM context. */
     if (kwss->hmmctx)
         hmm_context_free(kwss->hmmctx);
+    kws_search_reset_nodes(kwss);
     kwss->hmmctx =
         hmm_context_init(bin_mdef_n_emit_state(search->acmod->mdef),
                          search->acmod->tmat->tp, NULL,
@@ -494,93 +859,84 @@ kws_search_reinit(ps_search_t * search, dict_t * dict, dict2pid_t * d2p)
     if (kwss->hmmctx == NULL)
         return -1;
 
-    /* Initialize phone loop HMMs. */
-    if (kwss->pl_hmms) {
-        for (i = 0; i < kwss->n_pl; ++i)
-            hmm_deinit((hmm_t *) & kwss->pl_hmms[i]);
-        ckd_free(kwss->pl_hmms);
+    /* Phone loop only depends on the acoustic model */
+    if (kwss->pl == NULL
+        && (kwss->pl = phone_loop_get(search->acmod, kwss->plp)) == NULL)
+        return -1;
+
+    kws_search_build_tree(kwss);
+
+    return 0;
+}
+
+static int32
+kws_search_find_keyphrase(kws_search_t * kwss, const char *keyphrase)
+{
+    int32 k;
+
+    for (k = 0; k < kwss->n_keyphrases; k++)
+        if (strcmp(kwss->keyphrases[k].word, keyphrase) == 0)
+            return k;
+    return -1;
+}
+
+int
+kws_search_add_keyphrase(ps_search_t * search, const char *keyphrase,
+                         int32 threshold)
+{
+    kws_search_t *kwss = (kws_search_t *) search;
+    int32 k;
+
+    /* Known keyphrase, only its threshold changes */
+    if ((k = kws_search_find_keyphrase(kwss, keyphrase)) >= 0) {
+        kwss->keyphrases[k].threshold = threshold;
+        kwss->keyphrases[k].base_threshold = threshold;
+        if (kwss->keyphrases[k].fa) {
+            memset(kwss->keyphrases[k].fa, 0, sizeof(*kwss->keyphrases[k].fa));
+            kwss->keyphrases[k].fa->last_frame = -1;
+        }
+        return 0;
     }
-    kwss->n_pl = bin_mdef_n_ciphone(search->acmod->mdef);
-    kwss->pl_hmms =
-        (hmm_t *) ckd_calloc(kwss->n_pl, sizeof(*kwss->pl_hmms));
-    for (i = 0; i < kwss->n_pl; ++i) {
-        hmm_init(kwss->hmmctx, (hmm_t *) & kwss->pl_hmms[i],
-                 FALSE,
-                 bin_mdef_pid2ssid(search->acmod->mdef, i),
-                 bin_mdef_pid2tmatid(search->acmod->mdef, i));
+
+    /* Nodes are only appended to the tree, so HMMs active in the
+     * current utterance keep their scores. */
+    kws_search_new_keyphrase(kwss, keyphrase, threshold);
+    k = kwss->n_keyphrases - 1;
+    if (kws_search_add_path(kwss, k) < 0) {
+        ckd_free(kwss->keyphrases[k].word);
+        ckd_free(kwss->keyphrases[k].fa);
+        kwss->n_keyphrases--;
+        return -1;
     }
+    kws_detections_add_keyphrase(kwss->detections);
 
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        kws_keyphrase_t *keyphrase = gnode_ptr(gn);
-
-        /* Initialize keyphrase HMMs */
-        tmp_keyphrase = (char *) ckd_salloc(keyphrase->word);
-        n_wrds = str2words(tmp_keyphrase, NULL, 0);
-        wrdptr = (char **) ckd_calloc(n_wrds, sizeof(*wrdptr));
-        str2words(tmp_keyphrase, wrdptr, n_wrds);
-
-        /* count amount of hmms */
-        n_hmms = 0;
-        in_dict = TRUE;
-        for (i = 0; i < n_wrds; i++) {
-            wid = dict_wordid(dict, wrdptr[i]);
-            if (wid == BAD_S3WID) {
-        	E_ERROR("Word '%s' in phrase '%s' is missing in the dictionary\n", wrdptr[i], keyphrase->word);
-        	in_dict = FALSE;
-        	break;
-            }
-            pronlen = dict_pronlen(dict, wid);
-            n_hmms += pronlen;
-        }
-        
-        if (!in_dict) {
-            ckd_free(wrdptr);
-            ckd_free(tmp_keyphrase);
-    	    continue;
-        }
+    E_INFO("Added keyphrase '%s', KWS prefix tree has %d nodes\n",
+           keyphrase, kwss->n_nodes);
+    return 0;
+}
 
-        /* allocate node array */
-        if (keyphrase->hmms)
-            ckd_free(keyphrase->hmms);
-        keyphrase->hmms = (hmm_t *) ckd_calloc(n_hmms, sizeof(hmm_t));
-        keyphrase->n_hmms = n_hmms;
-
-        /* fill node array */
-        j = 0;
-        for (i = 0; i < n_wrds; i++) {
-            wid = dict_wordid(dict, wrdptr[i]);
-            pronlen = dict_pronlen(dict, wid);
-            for (p = 0; p < pronlen; p++) {
-                int32 ci = dict_pron(dict, wid, p);
-                if (p == 0) {
-                    /* first phone of word */
-                    int32 rc =
-                        pronlen > 1 ? dict_pron(dict, wid, 1) : silcipid;
-                    ssid = dict2pid_ldiph_lc(d2p, ci, rc, silcipid);
-                }
-                else if (p == pronlen - 1) {
-                    /* last phone of the word */
-                    int32 lc = dict_pron(dict, wid, p - 1);
-                    xwdssid_t *rssid = dict2pid_rssid(d2p, ci, lc);
-                    int j = rssid->cimap[silcipid];
-                    ssid = rssid->ssid[j];
-                }
-                else {
-                    /* word internal phone */
-                    ssid = dict2pid_internal(d2p, wid, p);
-                }
-                tmatid = bin_mdef_pid2tmatid(mdef, ci);
-                hmm_init(kwss->hmmctx, &keyphrase->hmms[j], FALSE, ssid,
-                         tmatid);
-                j++;
-            }
-        }
+int
+kws_search_remove_keyphrase(ps_search_t * search, const char *keyphrase)
+{
+    kws_search_t *kwss = (kws_search_t *) search;
+    int32 k;
 
-        ckd_free(wrdptr);
-        ckd_free(tmp_keyphrase);
+    if ((k = kws_search_find_keyphrase(kwss, keyphrase)) < 0) {
+        E_ERROR("Keyphrase '%s' is not spotted\n", keyphrase);
+        return -1;
     }
 
-    
+    ckd_free(kwss->keyphrases[k].word);
+    ckd_free(kwss->keyphrases[k].fa);
+    memmove(&kwss->keyphrases[k], &kwss->keyphrases[k + 1],
+            (kwss->n_keyphrases - k - 1) * sizeof(*kwss->keyphrases));
+    kwss->n_keyphrases--;
+    kws_detections_remove_keyphrase(kwss->detections, k);
+
+    /* Nodes of the keyphrase may be shared with others, so the tree is
+     * rebuilt. Spotting starts over for keyphrases partially matched in
+     * the current utterance. */
+    kws_search_build_tree(kwss);
 
     return 0;
 }
@@ -595,12 +951,13 @@ kws_search_start(ps_search_t * search)
     kwss->bestscore = 0;
     kws_detections_reset(kwss->detections);
 
+    /* Drop keyphrase HMMs still active at the end of the last utterance */
+    for (i = 0; i < kwss->n_active; ++i)
+        hmm_clear(kws_node_hmm(kwss, kwss->active[i]));
+    kwss->n_active = 0;
+
     /* Reset and enter all phone-loop HMMs. */
-    for (i = 0; i < kwss->n_pl; ++i) {
-        hmm_t *hmm = (hmm_t *) & kwss->pl_hmms[i];
-        hmm_clear(hmm);
-        hmm_enter(hmm, 0, -1, 0);
-    }
+    phone_loop_start(kwss->pl);
 
     ptmr_reset(&kwss->perf);
     ptmr_start(&kwss->perf);
@@ -623,7 +980,7 @@ kws_search_step(ps_search_t * search, int frame_idx)
     senscr = acmod_score(acmod, &frame_idx);
 
     /* Evaluate hmms in phone loop and in active keyphrase nodes */
-    kws_search_hmm_eval(kwss, senscr);
+    kws_search_hmm_eval(kwss, senscr, frame_idx);
 
     /* Prune hmms with low prob */
     kws_search_hmm_prune(kwss);
@@ -632,6 +989,13 @@ kws_search_step(ps_search_t * search, int frame_idx)
     kws_search_trans(kwss);
 
     ++kwss->frame;
+
+    if (kwss->fa_target > 0 && kwss->frame % KWS_FA_TICK == 0)
+        kws_search_fa_update(kwss, KWS_FA_TICK);
+
+    /* Detections older than the delay can't get any better */
+    kws_detections_finalize(kwss->detections, kwss->frame - kwss->delay);
+
     return 0;
 }
 
@@ -643,6 +1007,10 @@ kws_search_finish(ps_search_t * search)
 
     kwss = (kws_search_t *) search;
 
+    /* Account for the frames since the last threshold update */
+    if (kwss->fa_target > 0 && kwss->frame % KWS_FA_TICK != 0)
+        kws_search_fa_update(kwss, kwss->frame % KWS_FA_TICK);
+
     kwss->n_tot_frame += kwss->frame;
 
     /* Print out some statistics. */
@@ -657,6 +1025,9 @@ kws_search_finish(ps_search_t * search)
         E_INFO("kws %.2f wall %.3f xRT\n",
                kwss->perf.t_elapsed, kwss->perf.t_elapsed / n_speech);
     }
+    if (kwss->verify_scores)
+        E_INFO("kws verification rejected %d detections\n",
+               kwss->detections->n_rejected);
 
     return 0;
 }
@@ -665,34 +1036,69 @@ char const *
 kws_search_hyp(ps_search_t * search, int32 * out_score)
 {
     kws_search_t *kwss = (kws_search_t *) search;
+    const char *hyp_str;
+
     if (out_score)
         *out_score = 0;
 
     if (search->hyp_str)
         ckd_free(search->hyp_str);
-    search->hyp_str = kws_detections_hyp_str(kwss->detections, kwss->frame, kwss->delay);
+    hyp_str = kws_detections_hyp_str(kwss->detections);
+    search->hyp_str = hyp_str ? ckd_salloc(hyp_str) : NULL;
 
     return search->hyp_str;
 }
 
+int
+kws_search_get_threshold(ps_search_t * search, const char *keyphrase,
+                         int32 * out_threshold, float64 * out_fa_rate)
+{
+    kws_search_t *kwss = (kws_search_t *) search;
+    kws_keyphrase_t *kp;
+    int32 k, b;
+
+    if ((k = kws_search_find_keyphrase(kwss, keyphrase)) < 0)
+        return -1;
+    kp = &kwss->keyphrases[k];
+
+    if (out_threshold)
+        *out_threshold = kp->threshold;
+    if (out_fa_rate) {
+        float64 n_above = 0;
+
+        if (kp->fa && kwss->fa_frames > 0) {
+            for (b = 0; b < KWS_FA_BINS; b++)
+                if (kws_search_fa_edge(kwss, kp, b) >= kp->threshold)
+                    n_above += kp->fa->hist[b];
+            n_above *= 3600.0 * cmd_ln_int32_r(ps_search_config(kwss), "-frate")
+                / kwss->fa_frames;
+        }
+        *out_fa_rate = n_above;
+    }
+
+    return 0;
+}
+
 char * 
 kws_search_get_keyphrases(ps_search_t * search)
 {
     int c, len;
     kws_search_t *kwss;
     char* line;
-    gnode_t *gn;
+    int32 i;
 
     kwss = (kws_search_t *) search;
 
     len = 0;
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn))
-        len += strlen(((kws_keyphrase_t *)gnode_ptr(gn))->word) + 1;
+    for (i = 0; i < kwss->n_keyphrases; i++)
+        len += strlen(kwss->keyphrases[i].word) + 1;
+    if (len == 0)
+        return ckd_salloc("");
 
     c = 0;
     line = (char *)ckd_calloc(len, sizeof(*line));
-    for (gn = kwss->keyphrases; gn; gn = gnode_next(gn)) {
-        const char *str = ((kws_keyphrase_t *)gnode_ptr(gn))->word;
+    for (i = 0; i < kwss->n_keyphrases; i++) {
+        const char *str = kwss->keyphrases[i].word;
         memcpy(&line[c], str, strlen(str));
         c += strlen(str);
         line[c++] = '\n';
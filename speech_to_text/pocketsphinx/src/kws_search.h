@@ -46,6 +46,7 @@
 /* Local headers. */
 #include "pocketsphinx_internal.h"
 #include "kws_detections.h"
+#include "phone_loop_search.h"
 #include "hmm.h"
 
 /**
@@ -53,15 +54,33 @@
  */
 typedef struct kws_seg_s {
     ps_seg_t base;       /**< Base structure. */
-    gnode_t *detection;  /**< Keyphrase detection correspondent to segment. */
-    frame_idx_t last_frame; /**< Last frame to raise the detection */
+    int32 pos;           /**< Index of the final detection for this segment. */
 } kws_seg_t;
 
+/** Number of bins in the histogram of keyphrase event scores */
+#define KWS_FA_BINS 64
+
+/**
+ * Score statistics of a keyphrase for adaptive thresholds. An event is a
+ * run of frames in which the keyphrase scores above the lowest allowed
+ * threshold, with gaps of at most -kws_delay frames. Events are assumed
+ * to be false alarms, which holds as long as the keyphrase is said less
+ * often than the target rate.
+ */
+typedef struct kws_fa_stats_s {
+    float32 hist[KWS_FA_BINS];    /**< Decayed counts of event peak scores */
+    int32 peak;                   /**< Best score of the open event */
+    int32 last_frame;             /**< Last frame of the open event, -1 if none */
+    int32 n_events;               /**< Number of events seen */
+} kws_fa_stats_t;
+
 typedef struct kws_keyphrase_s {
     char* word;
-    int32 threshold;
-    hmm_t* hmms;
-    int32 n_hmms;
+    int32 threshold;              /**< Detection threshold checked at last_node */
+    int32 base_threshold;         /**< Threshold configured for the keyphrase */
+    kws_fa_stats_t *fa;           /**< Score statistics, NULL if threshold is fixed */
+    int32 last_node;              /**< Node ending the keyphrase, -1 if not in dictionary */
+    int32 next_phrase;            /**< Next keyphrase ending at last_node, -1 if none */
 } kws_keyphrase_t;
 
 /**
@@ -72,7 +91,24 @@ typedef struct kws_search_s {
 
     hmm_context_t *hmmctx;        /**< HMM context. */
 
-    glist_t keyphrases;          /**< Keyphrases to spot */
+    kws_keyphrase_t *keyphrases;  /**< Keyphrases to spot */
+    int32 n_keyphrases;           /**< Number of keyphrases */
+    int32 n_keyphrases_alloc;     /**< Number of keyphrases allocated */
+
+    /* Prefix tree of keyphrase HMMs. Keyphrases which start with the
+     * same sequence of triphones share the nodes for it. Nodes are
+     * stored as parallel arrays, parents before children. */
+    hmm_t *hmms;                  /**< HMM of each node */
+    int32 *parent;                /**< Predecessor node, -1 if entered from the phone loop */
+    int32 *first_child;           /**< First successor node, -1 if none */
+    int32 *sibling;               /**< Next node with the same parent, -1 if none */
+    int32 *first_phrase;          /**< First keyphrase ending at node, -1 if none */
+    int32 n_nodes;                /**< Number of nodes in use */
+    int32 n_nodes_alloc;          /**< Number of nodes allocated */
+    int32 first_root;             /**< First node entered from the phone loop, -1 if none */
+
+    int32 *active;                /**< Indices of active nodes, unordered */
+    int32 n_active;               /**< Number of active nodes */
 
     kws_detections_t *detections; /**< Keyword spotting history */
     frame_idx_t frame;            /**< Frame index */
@@ -84,8 +120,16 @@ typedef struct kws_search_s {
     int32 def_threshold;          /**< default threshold for p(hyp)/p(altern) ratio */
     int32 delay;                  /**< Delay to wait for best detection score */
 
-    int32 n_pl;                   /**< Number of CI phones */
-    hmm_t *pl_hmms;               /**< Phone loop hmms - hmms of CI phones */
+    float64 fa_target;            /**< Target false alarms per frame, 0 if thresholds are fixed */
+    int32 fa_range;               /**< Largest change of an adaptive threshold */
+    float64 fa_window;            /**< Number of frames the statistics cover */
+    float64 fa_frames;            /**< Decayed number of frames in the statistics */
+
+    phone_loop_t *pl;             /**< Phone loop, shared with searches using the same plp */
+
+    int32 verify_threshold;       /**< Lowest alignment score per frame of a detection */
+    acmod_scores_t *verify_scores; /**< Senone scores for verification, NULL if it is off */
+    int32 verify_warned;          /**< Whether a detection was too old to verify */
 
     ptmr_t perf; /**< Performance counter */
     int32 n_tot_frame;
@@ -134,6 +178,32 @@ int kws_search_finish(ps_search_t * search);
  */
 char const *kws_search_hyp(ps_search_t * search, int32 * out_score);
 
+/**
+ * Add a keyphrase to spot with the given threshold, or update the
+ * threshold of a keyphrase already spotted. Words must be in the
+ * dictionary. Can be called during an utterance.
+ *
+ * @return 0 on success, -1 if a word of the keyphrase is unknown.
+ */
+int kws_search_add_keyphrase(ps_search_t * search, const char *keyphrase,
+                             int32 threshold);
+
+/**
+ * Stop spotting a keyphrase. Can be called during an utterance.
+ *
+ * @return 0 on success, -1 if the keyphrase is not spotted.
+ */
+int kws_search_remove_keyphrase(ps_search_t * search, const char *keyphrase);
+
+/**
+ * Get the threshold of a keyphrase and, with adaptive thresholds, its
+ * estimated false alarms per hour at that threshold.
+ *
+ * @return 0 on success, -1 if the keyphrase is not spotted.
+ */
+int kws_search_get_threshold(ps_search_t * search, const char *keyphrase,
+                             int32 * out_threshold, float64 * out_fa_rate);
+
 /**
  * Get active keyphrases
  */
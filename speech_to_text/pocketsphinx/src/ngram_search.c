@@ -57,15 +57,20 @@
 
 static int ngram_search_start(ps_search_t *search);
 static int ngram_search_step(ps_search_t *search, int frame_idx);
+static void ngram_search_sen_active(ps_search_t *search, int frame_idx);
 static int ngram_search_finish(ps_search_t *search);
 static int ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p);
 static char const *ngram_search_hyp(ps_search_t *search, int32 *out_score);
 static int32 ngram_search_prob(ps_search_t *search);
 static ps_seg_t *ngram_search_seg_iter(ps_search_t *search);
+static void ngram_search_lmcache_flush(ngram_search_t *ngs);
+static void bp_block_append(ngram_search_t *ngs);
+static void ngram_search_bp2itor(ps_seg_t *seg, int bp);
 
 static ps_searchfuncs_t ngram_funcs = {
     /* start: */  ngram_search_start,
     /* step: */   ngram_search_step,
+    /* sen_active: */ ngram_search_sen_active,
     /* finish: */ ngram_search_finish,
     /* reinit: */ ngram_search_reinit,
     /* free: */   ngram_search_free,
@@ -146,13 +151,29 @@ ngram_search_init(const char *name,
 {
     ngram_search_t *ngs;
     static char *lmname = "default";
+    int32 n;
+
+    ngs = ckd_calloc(1, sizeof(*ngs));
+
+    /* Garbage collection of the backpointer table leaves no word
+     * lattice for the other passes to search. */
+    if (cmd_ln_boolean_r(config, "-latgc")) {
+        if (!cmd_ln_boolean_r(config, "-fwdtree"))
+            E_WARN("-latgc requires -fwdtree, ignoring it\n");
+        else {
+            if (cmd_ln_boolean_r(config, "-fwdflat")
+                || cmd_ln_boolean_r(config, "-bestpath"))
+                E_WARN("-latgc disables -fwdflat and -bestpath\n");
+            ngs->latgc = TRUE;
+        }
+    }
 
     /* Make the acmod's feature buffer growable if we are doing two-pass
      * search. */
     acmod_set_grow(acmod, cmd_ln_boolean_r(config, "-fwdflat") &&
-                          cmd_ln_boolean_r(config, "-fwdtree"));
+                          cmd_ln_boolean_r(config, "-fwdtree") &&
+                          !ngs->latgc);
 
-    ngs = ckd_calloc(1, sizeof(*ngs));
     ps_search_init(&ngs->base, &ngram_funcs, PS_SEARCH_TYPE_NGRAM, name, config, acmod, dict, d2p);
 
     ngs->hmmctx = hmm_context_init(bin_mdef_n_emit_state(acmod->mdef),
@@ -177,15 +198,11 @@ ngram_search_init(const char *name,
     ngs->last_ltrans = ckd_calloc(dict_size(dict),
                                   sizeof(*ngs->last_ltrans));
 
-    /* FIXME: All these structures need to be made dynamic with
-     * garbage collection. */
-    ngs->bp_table_size = cmd_ln_int32_r(config, "-latsize");
-    ngs->bp_table = ckd_calloc(ngs->bp_table_size,
-                               sizeof(*ngs->bp_table));
-    /* FIXME: This thing is frickin' huge. */
-    ngs->bscore_stack_size = ngs->bp_table_size * 20;
-    ngs->bscore_stack = ckd_calloc(ngs->bscore_stack_size,
-                                   sizeof(*ngs->bscore_stack));
+    /* Allocate blocks for -latsize backpointers up front, more are
+     * added as needed. */
+    for (n = 0; n < cmd_ln_int32_r(config, "-latsize"); n += NGRAM_BP_BLOCK_SIZE)
+        bp_block_append(ngs);
+    ngs->n_bp_block = 0;
     ngs->n_frame_alloc = 256;
     ngs->bp_table_idx = ckd_calloc(ngs->n_frame_alloc + 1,
                                    sizeof(*ngs->bp_table_idx));
@@ -210,6 +227,16 @@ ngram_search_init(const char *name,
     /* Create word mappings. */
     ngram_search_update_widmap(ngs);
 
+    /* Allocate the LM score cache, rounding its size up to a power of two. */
+    if ((n = cmd_ln_int32_r(config, "-lmcache")) > 0) {
+        int32 size;
+        for (size = 1; size < n; size <<= 1)
+            ;
+        ngs->lmcache = ckd_calloc(size, sizeof(*ngs->lmcache));
+        ngs->lmcache_mask = size - 1;
+        ngram_search_lmcache_flush(ngs);
+    }
+
     /* Initialize fwdtree, fwdflat, bestpath modules if necessary. */
     if (cmd_ln_boolean_r(config, "-fwdtree")) {
         ngram_fwdtree_init(ngs);
@@ -217,13 +244,13 @@ ngram_search_init(const char *name,
         ngs->fwdtree_perf.name = "fwdtree";
         ptmr_init(&ngs->fwdtree_perf);
     }
-    if (cmd_ln_boolean_r(config, "-fwdflat")) {
+    if (cmd_ln_boolean_r(config, "-fwdflat") && !ngs->latgc) {
         ngram_fwdflat_init(ngs);
         ngs->fwdflat = TRUE;
         ngs->fwdflat_perf.name = "fwdflat";
         ptmr_init(&ngs->fwdflat_perf);
     }
-    if (cmd_ln_boolean_r(config, "-bestpath")) {
+    if (cmd_ln_boolean_r(config, "-bestpath") && !ngs->latgc) {
         ngs->bestpath = TRUE;
         ngs->bestpath_perf.name = "bestpath";
         ptmr_init(&ngs->bestpath_perf);
@@ -269,8 +296,9 @@ ngram_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
     /* Update beam widths. */
     ngram_search_calc_beams(ngs);
 
-    /* Update word mappings. */
+    /* Update word mappings, which invalidates the LM score cache. */
     ngram_search_update_widmap(ngs);
+    ngram_search_lmcache_flush(ngs);
 
     /* Now rebuild lextrees. */
     if (ngs->fwdtree) {
@@ -289,7 +317,8 @@ void
 ngram_search_free(ps_search_t *search)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
-    
+    int32 i;
+
     if (ngs->fwdtree)
         ngram_fwdtree_deinit(ngs);
     if (ngs->fwdflat)
@@ -316,19 +345,466 @@ ngram_search_free(ps_search_t *search)
     ckd_free(ngs->word_chan);
     ckd_free(ngs->word_lat_idx);
     bitvec_free(ngs->word_active);
-    ckd_free(ngs->bp_table);
-    ckd_free(ngs->bscore_stack);
+    for (i = 0; i < ngs->n_bp_block_alloc; ++i)
+        ckd_free(ngs->bp_block[i]);
+    ckd_free(ngs->bp_block);
+    for (i = 0; i < ngs->n_bss_block; ++i)
+        ckd_free(ngs->bss_block[i]);
+    ckd_free(ngs->bss_block);
+    ckd_free(ngs->bss_last_bp);
+    ckd_free(ngs->bp_retired);
+    ckd_free(ngs->bp_retired_idx);
+    ckd_free(ngs->bss_retired);
+    ckd_free(ngs->final_seg);
+    ckd_free(ngs->final_hyp);
     if (ngs->bp_table_idx != NULL)
         ckd_free(ngs->bp_table_idx - 1);
     ckd_free_2d(ngs->active_word_list);
     ckd_free(ngs->last_ltrans);
+    ckd_free(ngs->lmcache);
+    ckd_free(ngs->lmbatch_wid);
+    ckd_free(ngs->lmbatch_idx);
+    ckd_free(ngs->lmbatch_score);
     ckd_free(ngs);
 }
 
+/* Blocks are added to the lists of blocks this many at a time. */
+#define BLOCK_LIST_GROW 16
+
+/**
+ * Add a block at the end of the backpointer table, reusing an unused
+ * one if possible.
+ */
+static void
+bp_block_append(ngram_search_t *ngs)
+{
+    if (ngs->n_bp_block == ngs->n_bp_block_alloc) {
+        if (ngs->n_bp_block_alloc % BLOCK_LIST_GROW == 0)
+            ngs->bp_block = ckd_realloc(ngs->bp_block,
+                                        (ngs->n_bp_block_alloc + BLOCK_LIST_GROW)
+                                        * sizeof(*ngs->bp_block));
+        ngs->bp_block[ngs->n_bp_block_alloc++]
+            = ckd_calloc(NGRAM_BP_BLOCK_SIZE, sizeof(**ngs->bp_block));
+    }
+    ++ngs->n_bp_block;
+}
+
+/**
+ * Start a new block of the score stack, for the entry about to be
+ * added to the backpointer table.
+ */
+static void
+bss_block_start(ngram_search_t *ngs)
+{
+    int32 i;
+
+    for (i = 0; i < ngs->n_bss_block; ++i) {
+        if (ngs->bss_last_bp[i] == NO_BP)
+            break;
+    }
+    if (i == ngs->n_bss_block) {
+        if (ngs->n_bss_block % BLOCK_LIST_GROW == 0) {
+            ngs->bss_block = ckd_realloc(ngs->bss_block,
+                                         (ngs->n_bss_block + BLOCK_LIST_GROW)
+                                         * sizeof(*ngs->bss_block));
+            ngs->bss_last_bp = ckd_realloc(ngs->bss_last_bp,
+                                           (ngs->n_bss_block + BLOCK_LIST_GROW)
+                                           * sizeof(*ngs->bss_last_bp));
+        }
+        ngs->bss_block[i] = ckd_calloc(NGRAM_BSS_BLOCK_SIZE,
+                                       sizeof(**ngs->bss_block));
+        ++ngs->n_bss_block;
+    }
+    ngs->bss_last_bp[i] = ngs->bpidx;
+    ngs->bss_head = i << NGRAM_BSS_BLOCK_SHIFT;
+}
+
+void
+ngram_search_reset_bptable(ngram_search_t *ngs)
+{
+    int32 i;
+
+    ngs->bpidx = 0;
+    ngs->bp_floor = 0;
+    ngs->bp_gc_mark = 0;
+    ngs->n_bp_block = 0;
+    ngs->bp_block_base = 0;
+    ngs->n_bp_retired = 0;
+    ngs->n_bss_retired = 0;
+    ngs->bp_frame_base = 0;
+    ngs->final_bp = NO_BP;
+    ngs->n_final_seg = 0;
+    ngs->final_hyp_len = 0;
+    if (ngs->final_hyp)
+        ngs->final_hyp[0] = '\0';
+    for (i = 0; i < ngs->n_bss_block; ++i)
+        ngs->bss_last_bp[i] = NO_BP;
+    bss_block_start(ngs);
+}
+
+static int32
+bp_retired_find(ngram_search_t *ngs, int32 bp)
+{
+    int32 lo, hi;
+
+    lo = 0;
+    hi = ngs->n_bp_retired;
+    while (lo < hi) {
+        int32 mid = (lo + hi) / 2;
+        if (ngs->bp_retired_idx[mid] < bp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == ngs->n_bp_retired || ngs->bp_retired_idx[lo] != bp)
+        return -1;
+    return lo;
+}
+
+bptbl_t *
+ngram_search_retired_bp(ngram_search_t *ngs, int32 bp)
+{
+    int32 i;
+
+    /* Everything that can be reached from later entries is kept. */
+    i = bp_retired_find(ngs, bp);
+    assert(i != -1);
+    return ngs->bp_retired + i;
+}
+
+static int32
+bp_rcsize(ngram_search_t *ngs, bptbl_t *be)
+{
+    if (be->last2_phone == -1)
+        return 0;
+    return dict2pid_rssid(ps_search_dict2pid(ngs),
+                          be->last_phone, be->last2_phone)->n_ssid;
+}
+
+/**
+ * Mark backpointer bp as reachable, if it is before new_floor.  Words
+ * before the last final one are not needed any more.
+ */
+static void
+bp_mark(ngram_search_t *ngs, int32 bp, int32 new_floor,
+        bitvec_t *marked, uint8 *retired_marked)
+{
+    if (bp == NO_BP || bp < ngs->final_bp || bp >= new_floor)
+        return;
+    if (bp >= ngs->bp_floor)
+        bitvec_set(marked, bp - ngs->bp_floor);
+    else
+        retired_marked[bp_retired_find(ngs, bp)] = TRUE;
+}
+
+/**
+ * Move the backpointer table entries before new_floor that later ones
+ * point to into bp_retired, along with their right context scores,
+ * and drop the retired entries that none points to any more.
+ */
+static void
+retire_bptable(ngram_search_t *ngs, int32 new_floor)
+{
+    bitvec_t *marked;
+    uint8 *retired_marked;
+    int32 bp, i, j, n, n_bss, rcsize;
+
+    /* Entries point to earlier ones only, so one backward scan over
+     * the entries that are kept finds all reachable ones. */
+    marked = bitvec_alloc(new_floor - ngs->bp_floor);
+    retired_marked = ckd_calloc(ngs->n_bp_retired + 1, 1);
+    for (bp = new_floor; bp < ngs->bpidx; ++bp)
+        bp_mark(ngs, ngram_search_bp(ngs, bp)->bp, new_floor,
+                marked, retired_marked);
+    n = 0;
+    for (bp = new_floor - 1; bp >= ngs->bp_floor; --bp) {
+        if (bitvec_is_set(marked, bp - ngs->bp_floor)) {
+            bp_mark(ngs, ngram_search_bp(ngs, bp)->bp, new_floor,
+                    marked, retired_marked);
+            ++n;
+        }
+    }
+    for (i = ngs->n_bp_retired - 1; i >= 0; --i) {
+        if (retired_marked[i])
+            bp_mark(ngs, ngs->bp_retired[i].bp, new_floor,
+                    marked, retired_marked);
+    }
+
+    /* Squeeze out the retired entries that are gone. */
+    n_bss = 0;
+    for (i = j = 0; i < ngs->n_bp_retired; ++i) {
+        bptbl_t *be = ngs->bp_retired + i;
+
+        if (!retired_marked[i])
+            continue;
+        if ((rcsize = bp_rcsize(ngs, be)) > 0) {
+            memmove(ngs->bss_retired + n_bss, ngs->bss_retired + be->s_idx,
+                    rcsize * sizeof(*ngs->bss_retired));
+            be->s_idx = n_bss;
+            n_bss += rcsize;
+        }
+        ngs->bp_retired[j] = *be;
+        ngs->bp_retired_idx[j] = ngs->bp_retired_idx[i];
+        ++j;
+    }
+    ngs->n_bp_retired = j;
+    ckd_free(retired_marked);
+
+    /* And add the new ones after them. */
+    if (ngs->n_bp_retired + n > ngs->n_bp_retired_alloc) {
+        ngs->n_bp_retired_alloc = (ngs->n_bp_retired + n) * 2;
+        ngs->bp_retired = ckd_realloc(ngs->bp_retired,
+                                      ngs->n_bp_retired_alloc
+                                      * sizeof(*ngs->bp_retired));
+        ngs->bp_retired_idx = ckd_realloc(ngs->bp_retired_idx,
+                                          ngs->n_bp_retired_alloc
+                                          * sizeof(*ngs->bp_retired_idx));
+    }
+    for (bp = ngs->bp_floor; bp < new_floor; ++bp) {
+        bptbl_t *be, *re;
+
+        if (!bitvec_is_set(marked, bp - ngs->bp_floor))
+            continue;
+        be = ngram_search_bp(ngs, bp);
+        re = ngs->bp_retired + ngs->n_bp_retired;
+        *re = *be;
+        re->retired = TRUE;
+        if ((rcsize = bp_rcsize(ngs, be)) > 0) {
+            if (n_bss + rcsize > ngs->n_bss_retired_alloc) {
+                ngs->n_bss_retired_alloc = (n_bss + rcsize) * 2;
+                ngs->bss_retired = ckd_realloc(ngs->bss_retired,
+                                               ngs->n_bss_retired_alloc
+                                               * sizeof(*ngs->bss_retired));
+            }
+            memcpy(ngs->bss_retired + n_bss, ngram_search_bp_rcss(ngs, be),
+                   rcsize * sizeof(*ngs->bss_retired));
+            re->s_idx = n_bss;
+            n_bss += rcsize;
+        }
+        ngs->bp_retired_idx[ngs->n_bp_retired++] = bp;
+    }
+    ngs->n_bss_retired = n_bss;
+    bitvec_free(marked);
+}
+
+/**
+ * Recycle the part of the backpointer table before the first frame
+ * that the HMMs active in frame_idx can still exit to.
+ */
+static void
+bp_visit_oldest(void *udata, int32 bp)
+{
+    int32 *oldest = (int32 *)udata;
+
+    if (*oldest == NO_BP || bp < *oldest)
+        *oldest = bp;
+}
+
+static void
+gc_bptable(ngram_search_t *ngs, int frame_idx)
+{
+    int32 oldest, first_frame, new_floor, n_free, i;
+
+    oldest = NO_BP;
+    ngram_fwdtree_visit_bp(ngs, frame_idx, bp_visit_oldest, &oldest);
+    if (oldest == NO_BP || oldest < ngs->bp_floor)
+        return;
+    /* Successors of an entry look at all of the others in its frame. */
+    first_frame = ngram_search_bp(ngs, oldest)->frame;
+    new_floor = ngram_search_frame_bp(ngs, first_frame);
+    if (new_floor <= ngs->bp_floor)
+        return;
+
+    retire_bptable(ngs, new_floor);
+
+    /* Move the blocks before new_floor to the unused ones. */
+    n_free = (new_floor >> NGRAM_BP_BLOCK_SHIFT) - ngs->bp_block_base;
+    if (n_free > 0) {
+        bptbl_t **freed = ckd_calloc(n_free, sizeof(*freed));
+        memcpy(freed, ngs->bp_block, n_free * sizeof(*freed));
+        memmove(ngs->bp_block, ngs->bp_block + n_free,
+                (ngs->n_bp_block_alloc - n_free) * sizeof(*ngs->bp_block));
+        memcpy(ngs->bp_block + ngs->n_bp_block_alloc - n_free, freed,
+               n_free * sizeof(*freed));
+        ckd_free(freed);
+        ngs->n_bp_block -= n_free;
+        ngs->bp_block_base += n_free;
+    }
+    ngs->bp_floor = new_floor;
+
+    /* Free the score stack blocks that only earlier entries used. */
+    for (i = 0; i < ngs->n_bss_block; ++i) {
+        if (i != ngs->bss_head >> NGRAM_BSS_BLOCK_SHIFT
+            && ngs->bss_last_bp[i] != NO_BP
+            && ngs->bss_last_bp[i] < new_floor)
+            ngs->bss_last_bp[i] = NO_BP;
+    }
+
+    /* And forget about the frames before first_frame. */
+    memmove(ngs->bp_table_idx - 1,
+            &ngram_search_frame_bp(ngs, first_frame - 1),
+            (frame_idx - first_frame + 2) * sizeof(*ngs->bp_table_idx));
+    ngs->bp_frame_base = first_frame;
+
+    E_DEBUG(1, ("Backpointer table at frame %d: %d entries from frame %d, "
+                "%d retired\n", frame_idx, ngs->bpidx - ngs->bp_floor,
+                first_frame, ngs->n_bp_retired));
+}
+
+/**
+ * State of the search for the last entry that all paths go through.
+ */
+typedef struct final_visit_s {
+    ngram_search_t *ngs;
+    bitvec_t *frames;   /**< Frames whose entries were visited */
+    int32 last_bp;      /**< Backpointer visited last */
+    int32 common;       /**< Last entry common to all visited so far */
+} final_visit_t;
+
+/**
+ * Find the last entry that backpointers a and b both go through, or
+ * final_bp if it comes before that one.
+ */
+static int32
+bp_common(ngram_search_t *ngs, int32 a, int32 b)
+{
+    while (a != b) {
+        if (a < b) {
+            int32 tmp = a;
+            a = b;
+            b = tmp;
+        }
+        /* Nothing before final_bp is kept. */
+        if (a <= ngs->final_bp)
+            return ngs->final_bp;
+        a = ngram_search_bp(ngs, a)->bp;
+    }
+    return a;
+}
+
+static void
+final_visit_frame(final_visit_t *fv, int32 frame)
+{
+    ngram_search_t *ngs = fv->ngs;
+    int32 bp, end_bp;
+
+    if (bitvec_is_set(fv->frames, frame - ngs->bp_frame_base))
+        return;
+    bitvec_set(fv->frames, frame - ngs->bp_frame_base);
+    end_bp = ngram_search_frame_bp(ngs, frame + 1);
+    for (bp = ngram_search_frame_bp(ngs, frame);
+         bp < end_bp && fv->common > ngs->final_bp; ++bp)
+        fv->common = bp_common(ngs, fv->common, bp);
+}
+
+static void
+bp_visit_final(void *udata, int32 bp)
+{
+    final_visit_t *fv = (final_visit_t *)udata;
+
+    if (bp == fv->last_bp || fv->common <= fv->ngs->final_bp)
+        return;
+    fv->last_bp = bp;
+    /* Successors of an entry look at all of the others in its frame. */
+    final_visit_frame(fv, ngram_search_bp(fv->ngs, bp)->frame);
+}
+
+/**
+ * Move the words from the last final entry to final_bp to the final
+ * segments and hypothesis.
+ */
+static void
+finalize_bp(ngram_search_t *ngs, int32 final_bp)
+{
+    dict_t *dict = ps_search_dict(ngs);
+    ps_seg_t seg;
+    int32 bp, i, n;
+
+    n = 0;
+    for (bp = final_bp; bp > ngs->final_bp; bp = ngram_search_bp(ngs, bp)->bp)
+        ++n;
+    if (ngs->n_final_seg + n > ngs->n_final_seg_alloc) {
+        ngs->n_final_seg_alloc = (ngs->n_final_seg + n) * 2;
+        ngs->final_seg = ckd_realloc(ngs->final_seg,
+                                     ngs->n_final_seg_alloc
+                                     * sizeof(*ngs->final_seg));
+    }
+
+    /* Scores as the segment iterator gives them for fwdtree. */
+    memset(&seg, 0, sizeof(seg));
+    seg.search = ps_search_base(ngs);
+    seg.lwf = 1.0;
+    i = ngs->n_final_seg + n;
+    for (bp = final_bp; bp > ngs->final_bp; bp = ngram_search_bp(ngs, bp)->bp) {
+        ngram_final_seg_t *fs = ngs->final_seg + --i;
+
+        ngram_search_bp2itor(&seg, bp);
+        fs->wid = ngram_search_bp(ngs, bp)->wid;
+        fs->sf = seg.sf;
+        fs->ef = seg.ef;
+        fs->ascr = seg.ascr;
+        fs->lscr = seg.lscr;
+        fs->lback = seg.lback;
+    }
+
+    for (i = ngs->n_final_seg; i < ngs->n_final_seg + n; ++i) {
+        char const *word;
+        size_t len;
+
+        if (!dict_real_word(dict, ngs->final_seg[i].wid))
+            continue;
+        word = dict_basestr(dict, ngs->final_seg[i].wid);
+        len = strlen(word);
+        if (ngs->final_hyp_len + len + 2 > ngs->final_hyp_alloc) {
+            ngs->final_hyp_alloc = (ngs->final_hyp_len + len + 2) * 2;
+            ngs->final_hyp = ckd_realloc(ngs->final_hyp, ngs->final_hyp_alloc);
+        }
+        if (ngs->final_hyp_len > 0)
+            ngs->final_hyp[ngs->final_hyp_len++] = ' ';
+        memcpy(ngs->final_hyp + ngs->final_hyp_len, word, len);
+        ngs->final_hyp_len += len;
+        ngs->final_hyp[ngs->final_hyp_len] = '\0';
+    }
+    ngs->n_final_seg += n;
+    ngs->final_bp = final_bp;
+}
+
+/**
+ * Find the last entry that every path still searched in frame_idx
+ * goes through, and make the words up to it final.
+ */
+static void
+find_final_bp(ngram_search_t *ngs, int frame_idx)
+{
+    final_visit_t fv;
+    int32 frame;
+
+    /* Paths end in the HMMs active in frame_idx, or in the last frame
+     * with word exits, where the hypothesis would be taken from. */
+    frame = frame_idx - 1;
+    while (frame >= ngs->bp_frame_base
+           && ngram_search_frame_bp(ngs, frame)
+           == ngram_search_frame_bp(ngs, frame + 1))
+        --frame;
+    if (frame < ngs->bp_frame_base)
+        return;
+
+    fv.ngs = ngs;
+    fv.frames = bitvec_alloc(frame_idx - ngs->bp_frame_base);
+    fv.last_bp = NO_BP;
+    fv.common = ngram_search_frame_bp(ngs, frame);
+    final_visit_frame(&fv, frame);
+    ngram_fwdtree_visit_bp(ngs, frame_idx, bp_visit_final, &fv);
+    bitvec_free(fv.frames);
+
+    if (fv.common > ngs->final_bp)
+        finalize_bp(ngs, fv.common);
+}
+
 int
 ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
 {
-    if (frame_idx >= ngs->n_frame_alloc) {
+    if (frame_idx - ngs->bp_frame_base >= ngs->n_frame_alloc) {
         ngs->n_frame_alloc *= 2;
         ngs->bp_table_idx = ckd_realloc(ngs->bp_table_idx - 1,
                                         (ngs->n_frame_alloc + 1)
@@ -340,7 +816,17 @@ ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx)
         }
         ++ngs->bp_table_idx; /* Make bptableidx[-1] valid */
     }
-    ngs->bp_table_idx[frame_idx] = ngs->bpidx;
+    ngram_search_frame_bp(ngs, frame_idx) = ngs->bpidx;
+
+    if (ngs->latgc) {
+        find_final_bp(ngs, frame_idx);
+        /* Look for entries to recycle every time a block's worth of
+         * them has been added. */
+        if (ngs->bpidx - ngs->bp_gc_mark >= NGRAM_BP_BLOCK_SIZE) {
+            ngs->bp_gc_mark = ngs->bpidx;
+            gc_bptable(ngs, frame_idx);
+        }
+    }
     return ngs->bpidx;
 }
 
@@ -350,11 +836,11 @@ set_real_wid(ngram_search_t *ngs, int32 bp)
     bptbl_t *ent, *prev;
 
     assert(bp != NO_BP);
-    ent = ngs->bp_table + bp;
+    ent = ngram_search_bp(ngs, bp);
     if (ent->bp == NO_BP)
         prev = NULL;
     else
-        prev = ngs->bp_table + ent->bp;
+        prev = ngram_search_bp(ngs, ent->bp);
 
     /* Propagate lm state for fillers, rotate it for words. */
     if (dict_filler_word(ps_search_dict(ngs), ent->wid)) {
@@ -390,32 +876,34 @@ ngram_search_save_bp(ngram_search_t *ngs, int frame_idx,
      * triphone, but of course that happens quite frequently. */
     bp = ngs->word_lat_idx[w];
     if (bp != NO_BP) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
+        bptbl_t *pbe = path == NO_BP ? NULL : ngram_search_bp(ngs, path);
 
-        if (frame_idx - ngs->bp_table[path].frame > NGRAM_HISTORY_LONG_WORD) {
+        if (pbe && frame_idx - pbe->frame > NGRAM_HISTORY_LONG_WORD) {
     	    E_WARN("Word '%s' survived for %d frames, potential overpruning\n", dict_wordstr(ps_search_dict(ngs), w),
-	    	    frame_idx - ngs->bp_table[path].frame);
+	    	    frame_idx - pbe->frame);
 	}
 
         /* Keep only the best scoring one, we will reconstruct the
          * others from the right context scores - usually the history
          * is not lost. */
-        if (ngs->bp_table[bp].score WORSE_THAN score) {
+        if (be->score WORSE_THAN score) {
             assert(path != bp); /* Pathological. */
-            if (ngs->bp_table[bp].bp != path) {
+            if (be->bp != path) {
                 int32 bplh[2], newlh[2];
                 /* But, sometimes, the history *is* lost.  If we wanted to
                  * do exact language model scoring we'd have to preserve
                  * these alternate histories. */
                 E_DEBUG(2,("Updating path history %d => %d frame %d\n",
-                           ngs->bp_table[bp].bp, path, frame_idx));
-                bplh[0] = ngs->bp_table[bp].bp == -1
-                    ? -1 : ngs->bp_table[ngs->bp_table[bp].bp].prev_real_wid;
-                bplh[1] = ngs->bp_table[bp].bp == -1
-                    ? -1 : ngs->bp_table[ngs->bp_table[bp].bp].real_wid;
+                           be->bp, path, frame_idx));
+                bplh[0] = be->bp == -1
+                    ? -1 : ngram_search_bp(ngs, be->bp)->prev_real_wid;
+                bplh[1] = be->bp == -1
+                    ? -1 : ngram_search_bp(ngs, be->bp)->real_wid;
                 newlh[0] = path == -1
-                    ? -1 : ngs->bp_table[path].prev_real_wid;
+                    ? -1 : pbe->prev_real_wid;
                 newlh[1] = path == -1
-                    ? -1 : ngs->bp_table[path].real_wid;
+                    ? -1 : pbe->real_wid;
                 /* Actually it's worth checking how often the actual
                  * language model state changes. */
                 if (bplh[0] != newlh[0] || bplh[1] != newlh[1]) {
@@ -430,18 +918,18 @@ ngram_search_save_bp(ngram_search_t *ngs, int frame_idx,
                                 frame_idx));
                     set_real_wid(ngs, bp);
                 }
-                ngs->bp_table[bp].bp = path;
+                be->bp = path;
             }
-            ngs->bp_table[bp].score = score;
+            be->score = score;
         }
         /* But do keep track of scores for all right contexts, since
          * we need them to determine the starting path scores for any
          * successors of this word exit. */
-        if (ngs->bp_table[bp].s_idx != -1)
-            ngs->bscore_stack[ngs->bp_table[bp].s_idx + rc] = score;
+        if (be->s_idx != -1)
+            ngram_search_bp_rcss(ngs, be)[rc] = score;
     }
     else {
-        int32 i, rcsize;
+        int32 i, rcsize, *rcss;
         bptbl_t *be;
 
         /* This might happen if recognition fails. */
@@ -450,31 +938,24 @@ ngram_search_save_bp(ngram_search_t *ngs, int frame_idx,
             return;
         }
 
-        /* Expand the backpointer tables if necessary. */
-        if (ngs->bpidx >= ngs->bp_table_size) {
-            ngs->bp_table_size *= 2;
-            ngs->bp_table = ckd_realloc(ngs->bp_table,
-                                        ngs->bp_table_size
-                                        * sizeof(*ngs->bp_table));
-            E_INFO("Resized backpointer table to %d entries\n", ngs->bp_table_size);
-        }
-        if (ngs->bss_head >= ngs->bscore_stack_size
-            - bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef)) {
-            ngs->bscore_stack_size *= 2;
-            ngs->bscore_stack = ckd_realloc(ngs->bscore_stack,
-                                            ngs->bscore_stack_size
-                                            * sizeof(*ngs->bscore_stack));
-            E_INFO("Resized score stack to %d entries\n", ngs->bscore_stack_size);
-        }
+        /* Start new blocks of the backpointer table and score stack
+         * if necessary; the scores of an entry are never split. */
+        if ((ngs->bpidx >> NGRAM_BP_BLOCK_SHIFT) - ngs->bp_block_base
+            >= ngs->n_bp_block)
+            bp_block_append(ngs);
+        if ((ngs->bss_head & NGRAM_BSS_BLOCK_MASK)
+            + bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef) >= NGRAM_BSS_BLOCK_SIZE)
+            bss_block_start(ngs);
 
         ngs->word_lat_idx[w] = ngs->bpidx;
-        be = &(ngs->bp_table[ngs->bpidx]);
+        be = ngram_search_bp(ngs, ngs->bpidx);
         be->wid = w;
         be->frame = frame_idx;
         be->bp = path;
         be->score = score;
         be->s_idx = ngs->bss_head;
         be->valid = TRUE;
+        be->retired = FALSE;
         assert(path != ngs->bpidx);
 
         /* DICT2PID */
@@ -491,10 +972,13 @@ ngram_search_save_bp(ngram_search_t *ngs, int frame_idx,
                                     be->last_phone, be->last2_phone)->n_ssid;
         }
         /* Allocate some space on the bscore_stack for all of these triphones. */
-        for (i = 0; i < rcsize; ++i)
-            ngs->bscore_stack[ngs->bss_head + i] = WORST_SCORE;
-        if (rcsize)
-            ngs->bscore_stack[ngs->bss_head + rc] = score;
+        if (rcsize) {
+            rcss = ngram_search_bp_rcss(ngs, be);
+            for (i = 0; i < rcsize; ++i)
+                rcss[i] = WORST_SCORE;
+            rcss[rc] = score;
+            ngs->bss_last_bp[ngs->bss_head >> NGRAM_BSS_BLOCK_SHIFT] = ngs->bpidx;
+        }
         set_real_wid(ngs, ngs->bpidx);
 
         ngs->bpidx++;
@@ -516,27 +1000,32 @@ ngram_search_find_exit(ngram_search_t *ngs, int frame_idx, int32 *out_best_score
 
     if (frame_idx == -1 || frame_idx >= ngs->n_frame)
         frame_idx = ngs->n_frame - 1;
-    end_bpidx = ngs->bp_table_idx[frame_idx];
+    /* Frames before bp_frame_base were garbage collected. */
+    if (frame_idx < ngs->bp_frame_base)
+        return NO_BP;
+    end_bpidx = ngram_search_frame_bp(ngs, frame_idx);
 
     best_score = WORST_SCORE;
     best_exit = NO_BP;
 
     /* Scan back to find a frame with some backpointers in it. */
-    while (frame_idx >= 0 && ngs->bp_table_idx[frame_idx] == end_bpidx)
+    while (frame_idx >= ngs->bp_frame_base
+           && ngram_search_frame_bp(ngs, frame_idx) == end_bpidx)
         --frame_idx;
     /* This is NOT an error, it just means there is no hypothesis yet. */
-    if (frame_idx < 0)
+    if (frame_idx < ngs->bp_frame_base)
         return NO_BP;
 
     /* Now find the entry for </s> OR the best scoring entry. */
-    assert(end_bpidx < ngs->bp_table_size);
-    for (bp = ngs->bp_table_idx[frame_idx]; bp < end_bpidx; ++bp) {
-        if (ngs->bp_table[bp].wid == ps_search_finish_wid(ngs)
-            || ngs->bp_table[bp].score BETTER_THAN best_score) {
-            best_score = ngs->bp_table[bp].score;
+    assert(end_bpidx <= ngs->bpidx);
+    for (bp = ngram_search_frame_bp(ngs, frame_idx); bp < end_bpidx; ++bp) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
+        if (be->wid == ps_search_finish_wid(ngs)
+            || be->score BETTER_THAN best_score) {
+            best_score = be->score;
             best_exit = bp;
         }
-        if (ngs->bp_table[bp].wid == ps_search_finish_wid(ngs))
+        if (be->wid == ps_search_finish_wid(ngs))
             break;
     }
 
@@ -546,6 +1035,16 @@ ngram_search_find_exit(ngram_search_t *ngs, int frame_idx, int32 *out_best_score
     return best_exit;
 }
 
+char const *
+ngram_search_final_hyp(ngram_search_t *ngs, int32 *out_frame)
+{
+    if (out_frame) {
+        *out_frame = ngs->n_final_seg > 0
+            ? ngs->final_seg[ngs->n_final_seg - 1].ef + 1 : 0;
+    }
+    return ngs->final_hyp_len > 0 ? ngs->final_hyp : NULL;
+}
+
 char const *
 ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
 {
@@ -557,15 +1056,19 @@ ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
     if (bpidx == NO_BP)
         return NULL;
 
+    /* The words up to final_bp are already in final_hyp. */
     bp = bpidx;
     len = 0;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
+    while (bp > ngs->final_bp) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
         bp = be->bp;
         if (dict_real_word(ps_search_dict(ngs), be->wid))
             len += strlen(dict_basestr(ps_search_dict(ngs), be->wid)) + 1;
     }
 
+    if (ngs->final_hyp_len > 0)
+        len += ngs->final_hyp_len + 1;
+
     ckd_free(base->hyp_str);
     if (len == 0) {
 	base->hyp_str = NULL;
@@ -575,8 +1078,8 @@ ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
 
     bp = bpidx;
     c = base->hyp_str + len - 1;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
+    while (bp > ngs->final_bp) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
         size_t len;
 
         bp = be->bp;
@@ -590,6 +1093,8 @@ ngram_search_bp_hyp(ngram_search_t *ngs, int bpidx)
             }
         }
     }
+    if (ngs->final_hyp_len > 0)
+        memcpy(base->hyp_str, ngs->final_hyp, ngs->final_hyp_len);
 
     return base->hyp_str;
 }
@@ -674,8 +1179,159 @@ ngram_search_exit_score(ngram_search_t *ngs, bptbl_t *pbe, int rcphone)
                                pbe->last_phone, pbe->last2_phone);
         /* This may be WORST_SCORE, which means that there was no exit
          * with rcphone as right context. */
-        return ngs->bscore_stack[pbe->s_idx + rssid->cimap[rcphone]];
+        return ngram_search_bp_rcss(ngs, pbe)[rssid->cimap[rcphone]];
+    }
+}
+
+/* Number of entries probed for a key before giving up. */
+#define LMCACHE_PROBE 4
+
+/**
+ * Look up (w3, w2, w1) in the LM score cache.  Returns its entry, or
+ * NULL if it is not cached, in which case *out_slot is set to the
+ * entry to store it in.
+ */
+static lmcache_ent_t *
+lmcache_find(ngram_search_t *ngs, int32 w3, int32 w2, int32 w1,
+             lmcache_ent_t **out_slot)
+{
+    lmcache_ent_t *ent;
+    uint32 h;
+    int32 i;
+
+    h = (uint32)w3 * 0x9e3779b1 ^ (uint32)w2 * 0x85ebca6b
+        ^ (uint32)w1 * 0xc2b2ae35;
+    h ^= h >> 16;
+    /* Entries are never removed one at a time, so the key cannot be
+     * past the first empty entry. */
+    for (i = 0; i < LMCACHE_PROBE; ++i) {
+        ent = ngs->lmcache + ((h + i) & ngs->lmcache_mask);
+        if (ent->w3 == -1) {
+            *out_slot = ent;
+            return NULL;
+        }
+        if (ent->w3 == w3 && ent->w2 == w2 && ent->w1 == w1)
+            return ent;
+    }
+    /* Replace the first entry probed if all of them are in use. */
+    *out_slot = ngs->lmcache + (h & ngs->lmcache_mask);
+    return NULL;
+}
+
+int32
+ngram_search_lm_score(ngram_search_t *ngs, int32 w3, int32 w2, int32 w1)
+{
+    lmcache_ent_t *ent;
+    int32 n_used;
+
+    if (ngs->lmcache == NULL)
+        return ngram_tg_score(ngs->lmset, w3, w2, w1, &n_used);
+
+    ++ngs->st.n_lmcache_lookup;
+    if (lmcache_find(ngs, w3, w2, w1, &ent) != NULL) {
+        ++ngs->st.n_lmcache_hit;
+        return ent->score;
     }
+    ent->w3 = w3;
+    ent->w2 = w2;
+    ent->w1 = w1;
+    ent->score = ngram_tg_score(ngs->lmset, w3, w2, w1, &n_used);
+    return ent->score;
+}
+
+void
+ngram_search_lmbatch_alloc(ngram_search_t *ngs, int32 n)
+{
+    if (n <= ngs->n_lmbatch_alloc)
+        return;
+    ngs->n_lmbatch_alloc = n;
+    ngs->lmbatch_wid = ckd_realloc(ngs->lmbatch_wid,
+                                   n * sizeof(*ngs->lmbatch_wid));
+    ngs->lmbatch_idx = ckd_realloc(ngs->lmbatch_idx,
+                                   n * sizeof(*ngs->lmbatch_idx));
+    ngs->lmbatch_score = ckd_realloc(ngs->lmbatch_score,
+                                     n * sizeof(*ngs->lmbatch_score));
+}
+
+void
+ngram_search_lm_scores(ngram_search_t *ngs, int32 n_wid, int32 w2, int32 w1)
+{
+    int32 *wid = ngs->lmbatch_wid;
+    int32 *idx = ngs->lmbatch_idx;
+    int32 *score = ngs->lmbatch_score;
+    lmcache_ent_t *ent, *slot;
+    int32 hist[2];
+    int32 i, n_miss, tmp;
+
+    hist[0] = w2;
+    hist[1] = w1;
+    if (ngs->lmcache == NULL) {
+        ngram_ng_scores(ngs->lmset, wid, n_wid, hist, 2, score);
+        return;
+    }
+
+    /* Take cached scores, moving the words without one to the front. */
+    n_miss = 0;
+    for (i = 0; i < n_wid; ++i) {
+        ++ngs->st.n_lmcache_lookup;
+        if ((ent = lmcache_find(ngs, wid[i], w2, w1, &slot)) != NULL) {
+            ++ngs->st.n_lmcache_hit;
+            score[i] = ent->score;
+            continue;
+        }
+        tmp = wid[n_miss];
+        wid[n_miss] = wid[i];
+        wid[i] = tmp;
+        tmp = idx[n_miss];
+        idx[n_miss] = idx[i];
+        idx[i] = tmp;
+        score[i] = score[n_miss];
+        ++n_miss;
+    }
+    if (n_miss == 0)
+        return;
+
+    ngram_ng_scores(ngs->lmset, wid, n_miss, hist, 2, score);
+    for (i = 0; i < n_miss; ++i) {
+        /* A word may be in the batch more than once. */
+        if ((ent = lmcache_find(ngs, wid[i], w2, w1, &slot)) == NULL) {
+            ent = slot;
+            ent->w3 = wid[i];
+            ent->w2 = w2;
+            ent->w1 = w1;
+        }
+        ent->score = score[i];
+    }
+}
+
+static void
+ngram_search_lmcache_flush(ngram_search_t *ngs)
+{
+    if (ngs->lmcache == NULL)
+        return;
+    ngs->lmcache_lw = ngram_model_get_weights(ngs->lmset,
+                                              &ngs->lmcache_log_wip);
+    ngs->lmcache_cur = ngram_model_set_lookup(ngs->lmset, NULL);
+    ngs->lmcache_weights_gen = ngram_model_set_weights_generation(ngs->lmset);
+    memset(ngs->lmcache, -1, (ngs->lmcache_mask + 1) * sizeof(*ngs->lmcache));
+}
+
+void
+ngram_search_lmcache_check(ngram_search_t *ngs)
+{
+    float32 lw;
+    int32 log_wip;
+
+    if (ngs->lmcache == NULL)
+        return;
+    lw = ngram_model_get_weights(ngs->lmset, &log_wip);
+    /* The model may also have been switched or reweighted through
+     * ps_get_lm(). */
+    if (lw != ngs->lmcache_lw || log_wip != ngs->lmcache_log_wip
+        || ngram_model_set_lookup(ngs->lmset, NULL) != ngs->lmcache_cur
+        || (ngram_model_set_weights_generation(ngs->lmset)
+            != ngs->lmcache_weights_gen))
+        ngram_search_lmcache_flush(ngs);
 }
 
 /*
@@ -696,7 +1352,7 @@ ngram_compute_seg_score(ngram_search_t *ngs, bptbl_t *be, float32 lwf,
     }
 
     /* Otherwise, calculate lscr and ascr. */
-    pbe = ngs->bp_table + be->bp;
+    pbe = ngram_search_bp(ngs, be->bp);
     start_score = ngram_search_exit_score(ngs, pbe,
                                  dict_first_phone(ps_search_dict(ngs),be->wid));
     assert(start_score BETTER_THAN WORST_SCORE);
@@ -730,6 +1386,7 @@ ngram_search_start(ps_search_t *search)
 
     ngs->done = FALSE;
     ngram_model_flush(ngs->lmset);
+    ngram_search_lmcache_flush(ngs);
     if (ngs->fwdtree)
         ngram_fwdtree_start(ngs);
     else if (ngs->fwdflat)
@@ -744,6 +1401,8 @@ ngram_search_step(ps_search_t *search, int frame_idx)
 {
     ngram_search_t *ngs = (ngram_search_t *)search;
 
+    /* Weights may have been changed between frames. */
+    ngram_search_lmcache_check(ngs);
     if (ngs->fwdtree)
         return ngram_fwdtree_search(ngs, frame_idx);
     else if (ngs->fwdflat)
@@ -752,19 +1411,35 @@ ngram_search_step(ps_search_t *search, int frame_idx)
         return -1;
 }
 
+static void
+ngram_search_sen_active(ps_search_t *search, int frame_idx)
+{
+    ngram_search_t *ngs = (ngram_search_t *)search;
+
+    if (ngs->fwdtree)
+        ngram_fwdtree_sen_active(ngs, frame_idx);
+    else if (ngs->fwdflat)
+        ngram_fwdflat_sen_active(ngs, frame_idx);
+}
+
 void
 dump_bptable(ngram_search_t *ngs)
 {
     int i;
     E_INFO("Backpointer table (%d entries):\n", ngs->bpidx);
     for (i = 0; i < ngs->bpidx; ++i) {
-        bptbl_t *bpe = ngs->bp_table + i;
+        bptbl_t *bpe;
         int j, rcsize;
 
+        /* Skip garbage collected entries. */
+        if (i < ngs->bp_floor && bp_retired_find(ngs, i) == -1)
+            continue;
+        bpe = ngram_search_bp(ngs, i);
+
         E_INFO_NOFN("%-5d %-10s start %-3d end %-3d score %-8d bp %-3d real_wid %-5d prev_real_wid %-5d",
                     i, dict_wordstr(ps_search_dict(ngs), bpe->wid),
                     (bpe->bp == -1
-                     ? 0 : ngs->bp_table[bpe->bp].frame + 1),
+                     ? 0 : ngram_search_bp(ngs, bpe->bp)->frame + 1),
                     bpe->frame, bpe->score, bpe->bp,
                     bpe->real_wid, bpe->prev_real_wid);
 
@@ -776,8 +1451,8 @@ dump_bptable(ngram_search_t *ngs)
         if (rcsize) {
             E_INFOCONT("\tbss");
             for (j = 0; j < rcsize; ++j)
-                if (ngs->bscore_stack[bpe->s_idx + j] != WORST_SCORE)
-                    E_INFOCONT(" %d", bpe->score - ngs->bscore_stack[bpe->s_idx + j]);
+                if (ngram_search_bp_rcss(ngs, bpe)[j] != WORST_SCORE)
+                    E_INFOCONT(" %d", bpe->score - ngram_search_bp_rcss(ngs, bpe)[j]);
         }
         E_INFOCONT("\n");
     }
@@ -893,8 +1568,8 @@ ngram_search_bp2itor(ps_seg_t *seg, int bp)
     ngram_search_t *ngs = (ngram_search_t *)seg->search;
     bptbl_t *be, *pbe;
 
-    be = &ngs->bp_table[bp];
-    pbe = be->bp == -1 ? NULL : &ngs->bp_table[be->bp];
+    be = ngram_search_bp(ngs, bp);
+    pbe = be->bp == -1 ? NULL : ngram_search_bp(ngs, be->bp);
     seg->word = dict_wordstr(ps_search_dict(ngs), be->wid);
     seg->ef = be->frame;
     seg->sf = pbe ? pbe->frame + 1 : 0;
@@ -939,17 +1614,38 @@ ngram_bp_seg_free(ps_seg_t *seg)
     ckd_free(itor);
 }
 
+static void
+ngram_bp_seg_fill(bptbl_seg_t *itor)
+{
+    ngram_search_t *ngs = (ngram_search_t *)itor->base.search;
+    ngram_final_seg_t *fs;
+
+    if (itor->cur >= itor->n_final) {
+        ngram_search_bp2itor(&itor->base,
+                             itor->bpidx[itor->cur - itor->n_final]);
+        return;
+    }
+    fs = ngs->final_seg + itor->cur;
+    itor->base.word = dict_wordstr(ps_search_dict(ngs), fs->wid);
+    itor->base.sf = fs->sf;
+    itor->base.ef = fs->ef;
+    itor->base.ascr = fs->ascr;
+    itor->base.lscr = fs->lscr;
+    itor->base.lback = fs->lback;
+    itor->base.prob = 0; /* Bogus value... */
+}
+
 static ps_seg_t *
 ngram_bp_seg_next(ps_seg_t *seg)
 {
     bptbl_seg_t *itor = (bptbl_seg_t *)seg;
 
-    if (++itor->cur == itor->n_bpidx) {
+    if (++itor->cur == itor->n_final + itor->n_bpidx) {
         ngram_bp_seg_free(seg);
         return NULL;
     }
 
-    ngram_search_bp2itor(seg, itor->bpidx[itor->cur]);
+    ngram_bp_seg_fill(itor);
     return seg;
 }
 
@@ -972,29 +1668,32 @@ ngram_search_bp_iter(ngram_search_t *ngs, int bpidx, float32 lwf)
     itor->base.vt = &ngram_bp_segfuncs;
     itor->base.search = ps_search_base(ngs);
     itor->base.lwf = lwf;
+    /* The words up to final_bp are already in final_seg. */
+    itor->n_final = ngs->n_final_seg;
     itor->n_bpidx = 0;
     bp = bpidx;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
+    while (bp > ngs->final_bp) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
         bp = be->bp;
         ++itor->n_bpidx;
     }
-    if (itor->n_bpidx == 0) {
+    if (itor->n_final + itor->n_bpidx == 0) {
         ckd_free(itor);
         return NULL;
     }
-    itor->bpidx = ckd_calloc(itor->n_bpidx, sizeof(*itor->bpidx));
+    if (itor->n_bpidx > 0)
+        itor->bpidx = ckd_calloc(itor->n_bpidx, sizeof(*itor->bpidx));
     cur = itor->n_bpidx - 1;
     bp = bpidx;
-    while (bp != NO_BP) {
-        bptbl_t *be = &ngs->bp_table[bp];
+    while (bp > ngs->final_bp) {
+        bptbl_t *be = ngram_search_bp(ngs, bp);
         itor->bpidx[cur] = bp;
         bp = be->bp;
         --cur;
     }
 
     /* Fill in relevant fields for first element. */
-    ngram_search_bp2itor((ps_seg_t *)itor, itor->bpidx[0]);
+    ngram_bp_seg_fill(itor);
 
     return (ps_seg_t *)itor;
 }
@@ -1072,15 +1771,16 @@ create_dag_nodes(ngram_search_t *ngs, ps_lattice_t *dag)
     bptbl_t *bp_ptr;
     int32 i;
 
-    for (i = 0, bp_ptr = ngs->bp_table; i < ngs->bpidx; ++i, ++bp_ptr) {
+    for (i = 0; i < ngs->bpidx; ++i) {
         int32 sf, ef, wid;
         ps_latnode_t *node;
 
+        bp_ptr = ngram_search_bp(ngs, i);
         /* Skip invalid backpointers (these result from -maxwpf pruning) */
         if (!bp_ptr->valid)
             continue;
 
-        sf = (bp_ptr->bp < 0) ? 0 : ngs->bp_table[bp_ptr->bp].frame + 1;
+        sf = (bp_ptr->bp < 0) ? 0 : ngram_search_bp(ngs, bp_ptr->bp)->frame + 1;
         ef = bp_ptr->frame;
         wid = bp_ptr->wid;
 
@@ -1150,7 +1850,7 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
 
     /* Find final node </s>.last_frame; nothing can follow this node */
     for (node = dag->nodes; node; node = node->next) {
-        int32 lef = ngs->bp_table[node->lef].frame;
+        int32 lef = ngram_search_bp(ngs, node->lef)->frame;
         if ((node->wid == ps_search_finish_wid(ngs))
             && (lef == dag->n_frames - 1))
             break;
@@ -1162,7 +1862,7 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
      * find the node corresponding to the best exit. */
     /* Find the last frame containing a word exit. */
     for (ef = dag->n_frames - 1;
-         ef >= 0 && ngs->bp_table_idx[ef] == ngs->bpidx;
+         ef >= 0 && ngram_search_frame_bp(ngs, ef) == ngs->bpidx;
          --ef);
     if (ef < 0) {
         E_ERROR("Empty backpointer table: can not build DAG.\n");
@@ -1172,10 +1872,12 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
     /* Find best word exit in that frame. */
     bestscore = WORST_SCORE;
     bestbp = NO_BP;
-    for (bp = ngs->bp_table_idx[ef]; bp < ngs->bp_table_idx[ef + 1]; ++bp) {
+    for (bp = ngram_search_frame_bp(ngs, ef);
+         bp < ngram_search_frame_bp(ngs, ef + 1); ++bp) {
         int32 n_used, l_scr, wid, prev_wid;
-        wid = ngs->bp_table[bp].real_wid;
-        prev_wid = ngs->bp_table[bp].prev_real_wid;
+        bptbl_t *be = ngram_search_bp(ngs, bp);
+        wid = be->real_wid;
+        prev_wid = be->prev_real_wid;
         /* Always prefer </s>, of which there will only be one per frame. */
         if (wid == ps_search_finish_wid(ngs)) {
             bestbp = bp;
@@ -1184,8 +1886,8 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
         l_scr = ngram_tg_score(ngs->lmset, ps_search_finish_wid(ngs),
                                wid, prev_wid, &n_used) >>SENSCR_SHIFT;
         l_scr = l_scr * lwf;
-        if (ngs->bp_table[bp].score + l_scr BETTER_THAN bestscore) {
-            bestscore = ngs->bp_table[bp].score + l_scr;
+        if (be->score + l_scr BETTER_THAN bestscore) {
+            bestscore = be->score + l_scr;
             bestbp = bp;
         }
     }
@@ -1194,7 +1896,7 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
         return NULL;
     }
     E_INFO("</s> not found in last frame, using %s.%d instead\n",
-           dict_basestr(ps_search_dict(ngs), ngs->bp_table[bestbp].wid), ef);
+           dict_basestr(ps_search_dict(ngs), ngram_search_bp(ngs, bestbp)->wid), ef);
 
     /* Now find the node that corresponds to it. */
     for (node = dag->nodes; node; node = node->next) {
@@ -1204,7 +1906,7 @@ find_end_node(ngram_search_t *ngs, ps_lattice_t *dag, float32 lwf)
 
     /* FIXME: This seems to happen a lot! */
     E_ERROR("Failed to find DAG node corresponding to %s\n",
-           dict_basestr(ps_search_dict(ngs), ngs->bp_table[bestbp].wid));
+           dict_basestr(ps_search_dict(ngs), ngram_search_bp(ngs, bestbp)->wid));
     return NULL;
 }
 
@@ -1224,6 +1926,13 @@ ngram_search_lattice(ps_search_t *search)
     ngs = (ngram_search_t *)search;
     min_endfr = cmd_ln_int32_r(ps_search_config(search), "-min_endfr");
 
+    /* The lattice is gone if the backpointer table was garbage
+     * collected. */
+    if (ngs->latgc) {
+        E_ERROR("No word lattice is kept with -latgc\n");
+        return NULL;
+    }
+
     /* If the best score is WORST_SCORE or worse, there is no way to
      * make a lattice. */
     if (ngs->best_score == WORST_SCORE || ngs->best_score WORSE_THAN WORST_SCORE)
@@ -1249,7 +1958,7 @@ ngram_search_lattice(ps_search_t *search)
            dict_wordstr(search->dict, dag->start->wid), dag->start->sf,
            dict_wordstr(search->dict, dag->end->wid), dag->end->sf);
 
-    ngram_compute_seg_score(ngs, ngs->bp_table + dag->end->lef, lwf,
+    ngram_compute_seg_score(ngs, ngram_search_bp(ngs, dag->end->lef), lwf,
                             &dag->final_node_ascr, &lscr);
 
     /*
@@ -1285,8 +1994,8 @@ ngram_search_lattice(ps_search_t *search)
 
         /* Prune nodes with too few endpoints - heuristic
            borrowed from Sphinx3 */
-        fef = ngs->bp_table[to->fef].frame;
-        lef = ngs->bp_table[to->lef].frame;
+        fef = ngram_search_bp(ngs, to->fef)->frame;
+        lef = ngram_search_bp(ngs, to->lef)->frame;
         if (to != dag->end && lef - fef < min_endfr) {
             to->reachable = FALSE;
             continue;
@@ -1296,8 +2005,8 @@ ngram_search_lattice(ps_search_t *search)
         for (from = to->next; from; from = from->next) {
             bptbl_t *from_bpe;
 
-            fef = ngs->bp_table[from->fef].frame;
-            lef = ngs->bp_table[from->lef].frame;
+            fef = ngram_search_bp(ngs, from->fef)->frame;
+            lef = ngram_search_bp(ngs, from->lef)->frame;
 
             if ((to->sf <= fef) || (to->sf > lef + 1))
                 continue;
@@ -1307,9 +2016,8 @@ ngram_search_lattice(ps_search_t *search)
             }
 
             /* Find bptable entry for "from" that exactly precedes "to" */
-            i = from->fef;
-            from_bpe = ngs->bp_table + i;
-            for (; i <= from->lef; i++, from_bpe++) {
+            for (i = from->fef; i <= from->lef; i++) {
+                from_bpe = ngram_search_bp(ngs, i);
                 if (from_bpe->wid != from->wid)
                     continue;
                 if (from_bpe->frame >= to->sf - 1)
@@ -1360,8 +2068,8 @@ ngram_search_lattice(ps_search_t *search)
 
     for (node = dag->nodes; node; node = node->next) {
         /* Change node->{fef,lef} from bptbl indices to frames. */
-        node->fef = ngs->bp_table[node->fef].frame;
-        node->lef = ngs->bp_table[node->lef].frame;
+        node->fef = ngram_search_bp(ngs, node->fef)->frame;
+        node->lef = ngram_search_bp(ngs, node->lef)->frame;
         /* Find base wid for nodes. */
         node->basewid = dict_basewid(search->dict, node->wid);
     }
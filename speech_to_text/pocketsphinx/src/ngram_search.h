@@ -110,6 +110,7 @@ typedef struct bptbl_s {
     frame_idx_t  frame;		/**< start or end frame */
     uint8    valid;		/**< For absolute pruning */
     uint8    refcnt;            /**< Reference count (number of successors) */
+    uint8    retired;           /**< Kept in bp_retired, see ngram_search_bp() */
     int32    wid;		/**< Word index */
     int32    bp;		/**< Back Pointer */
     int32    score;		/**< Score (best among all right contexts) */
@@ -126,10 +127,27 @@ typedef struct bptbl_s {
 typedef struct bptbl_seg_s {
     ps_seg_t base;  /**< Base structure. */
     int32 *bpidx;   /**< Sequence of backpointer IDs. */
-    int16 n_bpidx;  /**< Number of backpointer IDs. */
-    int16 cur;      /**< Current position in bpidx. */
+    int32 n_bpidx;  /**< Number of backpointer IDs. */
+    int32 n_final;  /**< Number of final segments, which come first. */
+    int32 cur;      /**< Current position in final segments, then bpidx. */
 } bptbl_seg_t;
 
+/**
+ * Word that can no longer change, see ngram_search_t::final_bp.
+ */
+typedef struct ngram_final_seg_s {
+    int32 wid;      /**< Word index */
+    int32 sf, ef;   /**< Start and end frames */
+    int32 ascr;     /**< Acoustic score */
+    int32 lscr;     /**< Language model score */
+    int32 lback;    /**< Language model backoff */
+} ngram_final_seg_t;
+
+/**
+ * Function called on backpointer indices, see ngram_fwdtree_visit_bp().
+ */
+typedef void (*ngram_bp_visit_f)(void *udata, int32 bp);
+
 /*
  * Candidates words for entering their last phones.  Cleared and rebuilt in each
  * frame.
@@ -174,6 +192,28 @@ typedef struct bestbp_rc_s {
 
 #define NO_BP		-1
 
+/**
+ * The backpointer table and the right context score stack are
+ * allocated in blocks of these many (as a power of two) entries,
+ * which are never moved once allocated.
+ */
+#define NGRAM_BP_BLOCK_SHIFT	12
+#define NGRAM_BP_BLOCK_SIZE	(1 << NGRAM_BP_BLOCK_SHIFT)
+#define NGRAM_BP_BLOCK_MASK	(NGRAM_BP_BLOCK_SIZE - 1)
+#define NGRAM_BSS_BLOCK_SHIFT	16
+#define NGRAM_BSS_BLOCK_SIZE	(1 << NGRAM_BSS_BLOCK_SHIFT)
+#define NGRAM_BSS_BLOCK_MASK	(NGRAM_BSS_BLOCK_SIZE - 1)
+
+/**
+ * Entry in the language model score cache.
+ */
+typedef struct lmcache_ent_s {
+    int32 w3;                   /**< Word, or -1 if the entry is unused */
+    int32 w2;                   /**< Previous word */
+    int32 w1;                   /**< Word before w2 */
+    int32 score;                /**< ngram_tg_score() for w3 given w2, w1 */
+} lmcache_ent_t;
+
 /**
  * Various statistics for profiling.
  */
@@ -188,6 +228,8 @@ typedef struct ngram_search_stats_s {
     int32 n_fwdflat_words;
     int32 n_fwdflat_word_transition;
     int32 n_senone_active_utt;
+    int32 n_lmcache_lookup;
+    int32 n_lmcache_hit;
 } ngram_search_stats_t;
 
 
@@ -199,6 +241,28 @@ struct ngram_search_s {
     ngram_model_t *lmset;  /**< Set of language models. */
     hmm_context_t *hmmctx; /**< HMM context. */
 
+    /**
+     * Cache of trigram scores for word transitions, with open
+     * addressing over a power of two number of entries.  Word exits
+     * in the same and nearby frames share histories, so the same
+     * (word, history) pairs come up over and over again.
+     */
+    lmcache_ent_t *lmcache;
+    int32 lmcache_mask;      /**< Number of entries in lmcache minus one */
+    float32 lmcache_lw;      /**< Language weight of the cached scores */
+    int32 lmcache_log_wip;   /**< Log word insertion penalty of the cached scores */
+    ngram_model_t *lmcache_cur; /**< Submodel selected for them, NULL if interpolated */
+    int32 lmcache_weights_gen;  /**< Generation of the interpolation weights */
+
+    /**
+     * Words to score with ngram_search_lm_scores(), the caller's
+     * index for each of them, and their scores.
+     */
+    int32 *lmbatch_wid;
+    int32 *lmbatch_idx;
+    int32 *lmbatch_score;
+    int32 n_lmbatch_alloc;   /**< Allocated size of the lmbatch arrays */
+
     /* Flags to quickly indicate which passes are enabled. */
     uint8 fwdtree;
     uint8 fwdflat;
@@ -297,16 +361,65 @@ struct ngram_search_s {
     cand_sf_t *cand_sf;
     bestbp_rc_t *bestbp_rc;
 
-    bptbl_t *bp_table;       /* Forward pass lattice */
+    /**
+     * Backpointer table (forward pass lattice).
+     *
+     * Entries are numbered in the order they are created, and kept in
+     * blocks of NGRAM_BP_BLOCK_SIZE, so that the table grows without
+     * ever copying it.  Use ngram_search_bp() to find an entry.  With
+     * -latgc, the blocks before the first frame that active HMMs can
+     * still reach are recycled (see ngram_search_mark_bptable()), and
+     * the few entries before bp_floor that later ones still point to
+     * are moved to bp_retired.
+     */
+    bptbl_t **bp_block;      /**< Blocks, the first one holding bp_floor */
+    int32 n_bp_block;        /**< Number of blocks in use */
+    int32 n_bp_block_alloc;  /**< Number of blocks, the unused ones last */
+    int32 bp_block_base;     /**< Block number of bp_block[0] */
+    int32 bp_floor;          /**< First entry in bp_block */
     int32 bpidx;             /* First free BPTable entry */
-    int32 bp_table_size;
-    int32 *bscore_stack;     /* Score stack for all possible right contexts */
+    int32 bp_gc_mark;        /**< bpidx at the last garbage collection */
+
+    bptbl_t *bp_retired;     /**< Entries before bp_floor still reachable */
+    int32 *bp_retired_idx;   /**< Backpointer index of each of them, ascending */
+    int32 n_bp_retired;
+    int32 n_bp_retired_alloc;
+    int32 *bss_retired;      /**< Right context scores of bp_retired */
+    int32 n_bss_retired;
+    int32 n_bss_retired_alloc;
+
+    /**
+     * Score stack for all possible right contexts, in blocks of
+     * NGRAM_BSS_BLOCK_SIZE.  The scores of an entry never straddle
+     * two blocks, and their index (s_idx) is the number of the block
+     * shifted left by NGRAM_BSS_BLOCK_SHIFT plus their offset in it,
+     * so block numbers are reused once the entries in them are gone.
+     */
+    int32 **bss_block;
+    int32 *bss_last_bp;      /**< Last entry with scores in each block, or NO_BP if free */
+    int32 n_bss_block;       /**< Number of blocks allocated */
     int32 bss_head;          /* First free BScoreStack entry */
-    int32 bscore_stack_size;
+
+    uint8 latgc;             /**< Garbage collect the backpointer table */
+
+    /**
+     * Words that can no longer change.  With -latgc, every path still
+     * searched goes through final_bp, so the words up to it are moved
+     * here as soon as it is found, and the entries before it are freed
+     * (ngram_search_bp_hyp() and the segment iterator stop there).
+     */
+    int32 final_bp;          /**< Last final entry, or NO_BP */
+    ngram_final_seg_t *final_seg;
+    int32 n_final_seg;
+    int32 n_final_seg_alloc;
+    char *final_hyp;         /**< Final words, or NULL if none */
+    size_t final_hyp_len;
+    size_t final_hyp_alloc;
 
     int32 n_frame_alloc; /**< Number of frames allocated in bp_table_idx and friends. */
     int32 n_frame;       /**< Number of frames actually present. */
-    int32 *bp_table_idx; /* First BPTable entry for each frame */
+    int32 bp_frame_base; /**< First frame in bp_table_idx (always 0 without -latgc) */
+    int32 *bp_table_idx; /* First BPTable entry for each frame, see ngram_search_frame_bp() */
     int32 *word_lat_idx; /* BPTable index for any word in current frame;
                             cleared before each frame */
 
@@ -357,6 +470,31 @@ struct ngram_search_s {
 };
 typedef struct ngram_search_s ngram_search_t;
 
+/**
+ * Get the backpointer table entry with index bp.
+ */
+#define ngram_search_bp(ngs, bp)                                        \
+    ((bp) >= (ngs)->bp_floor                                            \
+     ? (ngs)->bp_block[((bp) >> NGRAM_BP_BLOCK_SHIFT) - (ngs)->bp_block_base] \
+     + ((bp) & NGRAM_BP_BLOCK_MASK)                                     \
+     : ngram_search_retired_bp(ngs, bp))
+
+/**
+ * Get the right context scores of backpointer table entry be (only
+ * for entries of multi-phone words, which have some).
+ */
+#define ngram_search_bp_rcss(ngs, be)                                   \
+    ((be)->retired                                                      \
+     ? (ngs)->bss_retired + (be)->s_idx                                 \
+     : (ngs)->bss_block[(be)->s_idx >> NGRAM_BSS_BLOCK_SHIFT]           \
+     + ((be)->s_idx & NGRAM_BSS_BLOCK_MASK))
+
+/**
+ * First backpointer table entry for frame f (an lvalue).
+ */
+#define ngram_search_frame_bp(ngs, f)                   \
+    ((ngs)->bp_table_idx[(f) - (ngs)->bp_frame_base])
+
 /**
  * Initialize the N-Gram search module.
  */
@@ -375,10 +513,33 @@ void ngram_search_free(ps_search_t *ngs);
 /**
  * Record the current frame's index in the backpointer table.
  *
+ * With -latgc, this also finds the words that have become final, and
+ * recycles the part of the table that the active HMMs of this frame
+ * can no longer reach.
+ *
  * @return the current backpointer index.
  */
 int ngram_search_mark_bptable(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Empty the backpointer table, for the start of a new pass.
+ */
+void ngram_search_reset_bptable(ngram_search_t *ngs);
+
+/**
+ * Find an entry that is not in a block of the backpointer table any
+ * more (use ngram_search_bp() instead).
+ */
+bptbl_t *ngram_search_retired_bp(ngram_search_t *ngs, int32 bp);
+
+/**
+ * Get the words that can no longer change (see ngram_search_t::final_bp).
+ *
+ * @param out_frame Output: frame after the last of them.  Can be NULL.
+ * @return the words, or NULL if there are none yet.
+ */
+char const *ngram_search_final_hyp(ngram_search_t *ngs, int32 *out_frame);
+
 /**
  * Enter a word in the backpointer table.
  */
@@ -424,6 +585,33 @@ ps_lattice_t *ngram_search_lattice(ps_search_t *search);
  */
 int32 ngram_search_exit_score(ngram_search_t *ngs, bptbl_t *pbe, int rcphone);
 
+/**
+ * Get the trigram score for w3 given w2, w1, through the LM score cache.
+ */
+int32 ngram_search_lm_score(ngram_search_t *ngs, int32 w3, int32 w2, int32 w1);
+
+/**
+ * Make room for n words in the lmbatch arrays.
+ */
+void ngram_search_lmbatch_alloc(ngram_search_t *ngs, int32 n);
+
+/**
+ * Get the trigram scores of the first n_wid words in lmbatch_wid, all
+ * given w2, w1, into lmbatch_score.
+ *
+ * Words whose scores are not cached are scored together with
+ * ngram_ng_scores().  The entries of lmbatch_wid and lmbatch_idx may
+ * be reordered, so callers should use lmbatch_idx to find their words.
+ */
+void ngram_search_lm_scores(ngram_search_t *ngs, int32 n_wid,
+                            int32 w2, int32 w1);
+
+/**
+ * Empty the LM score cache if the language weights have changed since
+ * it was filled.
+ */
+void ngram_search_lmcache_check(ngram_search_t *ngs);
+
 /**
  * Sets the global language model.
  *
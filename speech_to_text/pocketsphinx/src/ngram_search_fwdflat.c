@@ -238,8 +238,9 @@ build_fwdflat_wordlist(ngram_search_t *ngs)
 
     /* Scan the backpointer table for all active words and record
      * their exit frames. */
-    for (i = 0, bp = ngs->bp_table; i < ngs->bpidx; i++, bp++) {
-        sf = (bp->bp < 0) ? 0 : ngs->bp_table[bp->bp].frame + 1;
+    for (i = 0; i < ngs->bpidx; i++) {
+        bp = ngram_search_bp(ngs, i);
+        sf = (bp->bp < 0) ? 0 : ngram_search_bp(ngs, bp->bp)->frame + 1;
         ef = bp->frame;
         wid = bp->wid;
 
@@ -381,8 +382,7 @@ ngram_fwdflat_start(ngram_search_t *ngs)
     build_fwdflat_wordlist(ngs);
     build_fwdflat_chan(ngs);
 
-    ngs->bpidx = 0;
-    ngs->bss_head = 0;
+    ngram_search_reset_bptable(ngs);
 
     for (i = 0; i < ps_search_n_words(ngs); i++)
         ngs->word_lat_idx[i] = NO_BP;
@@ -414,6 +414,8 @@ ngram_fwdflat_start(ngram_search_t *ngs)
     ngs->st.n_fwdflat_words = 0;
     ngs->st.n_fwdflat_word_transition = 0;
     ngs->st.n_senone_active_utt = 0;
+    ngs->st.n_lmcache_lookup = 0;
+    ngs->st.n_lmcache_hit = 0;
 }
 
 static void
@@ -645,7 +647,8 @@ get_expand_wordlist(ngram_search_t *ngs, int32 frm, int32 win)
 static void
 fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
 {
-    int32 cf, nf, b, thresh, pip, i, nw, w, newscore;
+    int32 cf, nf, b, thresh, pip, i, k, nw, w, newscore;
+    int32 n_wid;
     int32 best_silrc_score = 0, best_silrc_bp = 0;      /* FIXME: good defaults? */
     bptbl_t *bp;
     int32 *rcss;
@@ -665,13 +668,14 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
     /* Search for all words starting within a window of this frame.
      * These are the successors for words exiting now. */
     get_expand_wordlist(ngs, cf, ngs->max_sf_win);
+    ngram_search_lmbatch_alloc(ngs, ngs->n_expand_words);
 
     /* Scan words exited in current frame */
-    for (b = ngs->bp_table_idx[cf]; b < ngs->bpidx; b++) {
+    for (b = ngram_search_frame_bp(ngs, cf); b < ngs->bpidx; b++) {
         xwdssid_t *rssid;
         int32 silscore;
 
-        bp = ngs->bp_table + b;
+        bp = ngram_search_bp(ngs, b);
         ngs->word_lat_idx[bp->wid] = NO_BP;
 
         if (bp->wid == ps_search_finish_wid(ngs))
@@ -680,16 +684,19 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
         /* DICT2PID location */
         /* Get the mapping from right context phone ID to index in the
          * right context table and the bscore_stack. */
-        rcss = ngs->bscore_stack + bp->s_idx;
-        if (bp->last2_phone == -1)
+        if (bp->last2_phone == -1) {
+            rcss = NULL;
             rssid = NULL;
-        else
+        }
+        else {
+            rcss = ngram_search_bp_rcss(ngs, bp);
             rssid = dict2pid_rssid(d2p, bp->last_phone, bp->last2_phone);
+        }
 
-        /* Transition to all successor words. */
+        /* Collect the successor words reachable from this exit, so
+         * their LM scores can be looked up together. */
+        n_wid = 0;
         for (i = 0; ngs->expand_word_list[i] >= 0; i++) {
-            int32 n_used;
-
             w = ngs->expand_word_list[i];
 
             /* Get the exit score we recorded in save_bwd_ptr(), or
@@ -700,13 +707,22 @@ fwdflat_word_transition(ngram_search_t *ngs, int frame_idx)
                 newscore = bp->score;
             if (newscore == WORST_SCORE)
                 continue;
+            ngs->lmbatch_wid[n_wid] = dict_basewid(dict, w);
+            ngs->lmbatch_idx[n_wid] = i;
+            ++n_wid;
+        }
+        if (n_wid > 0)
+            ngram_search_lm_scores(ngs, n_wid, bp->real_wid, bp->prev_real_wid);
+
+        /* Transition to all successor words. */
+        for (k = 0; k < n_wid; k++) {
+            w = ngs->expand_word_list[ngs->lmbatch_idx[k]];
+            if (rssid)
+                newscore = rcss[rssid->cimap[dict_first_phone(dict, w)]];
+            else
+                newscore = bp->score;
             /* FIXME: Floating point... */
-            newscore += lwf
-                * (ngram_tg_score(ngs->lmset,
-                                  dict_basewid(dict, w),
-                                  bp->real_wid,
-                                  bp->prev_real_wid,
-                                  &n_used) >> SENSCR_SHIFT);
+            newscore += lwf * (ngs->lmbatch_score[k] >> SENSCR_SHIFT);
             newscore += pip;
 
             /* Enter the next word */
@@ -812,6 +828,12 @@ fwdflat_renormalize_scores(ngram_search_t *ngs, int frame_idx, int32 norm)
     ngs->renormalized = TRUE;
 }
 
+void
+ngram_fwdflat_sen_active(ngram_search_t *ngs, int frame_idx)
+{
+    compute_fwdflat_sen_active(ngs, frame_idx);
+}
+
 int
 ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx)
 {
@@ -955,6 +977,10 @@ ngram_fwdflat_finish(ngram_search_t *ngs)
         E_INFO("%8d word transitions (%d/fr)\n",
                ngs->st.n_fwdflat_word_transition,
                ngs->st.n_fwdflat_word_transition / (cf + 1));
+        if (ngs->st.n_lmcache_lookup > 0)
+            E_INFO("%8d LM score lookups, %.1f%% cache hits\n",
+                   ngs->st.n_lmcache_lookup,
+                   100.0 * ngs->st.n_lmcache_hit / ngs->st.n_lmcache_lookup);
         E_INFO("fwdflat %.2f CPU %.3f xRT\n",
                ngs->fwdflat_perf.t_cpu,
                ngs->fwdflat_perf.t_cpu / n_speech);
@@ -72,6 +72,11 @@ void ngram_fwdflat_start(ngram_search_t *ngs);
  */
 int ngram_fwdflat_search(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Mark the senones needed to search a frame as active.
+ */
+void ngram_fwdflat_sen_active(ngram_search_t *ngs, int frame_idx);
+
 /**
  * Finish fwdflat decoding for an utterance.
  */
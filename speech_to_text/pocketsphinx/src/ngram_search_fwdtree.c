@@ -482,8 +482,7 @@ ngram_fwdtree_start(ngram_search_t *ngs)
     ptmr_start(&ngs->fwdtree_perf);
 
     /* Reset backpointer table. */
-    ngs->bpidx = 0;
-    ngs->bss_head = 0;
+    ngram_search_reset_bptable(ngs);
 
     /* Reset word lattice. */
     for (i = 0; i < n_words; ++i)
@@ -907,7 +906,7 @@ last_phone_transition(ngram_search_t *ngs, int frame_idx)
         if (candp->bp == -1)
             continue;
         /* Backpointer entry for it. */
-        bpe = &(ngs->bp_table[candp->bp]);
+        bpe = ngram_search_bp(ngs, candp->bp);
 
         /* Subtract starting score for candidate, leave it with only word score */
         start_score = ngram_search_exit_score
@@ -964,28 +963,46 @@ last_phone_transition(ngram_search_t *ngs, int frame_idx)
     }
 
     /* Compute best LM score and bp for new cands entered in the sorted lists above */
+    ngram_search_lmbatch_alloc(ngs, ngs->n_lastphn_cand);
     for (i = 0; i < n_cand_sf; i++) {
         /* For the i-th unique end frame... */
-        bp = ngs->bp_table_idx[ngs->cand_sf[i].bp_ef];
-        bpend = ngs->bp_table_idx[ngs->cand_sf[i].bp_ef + 1];
-        for (bpe = &(ngs->bp_table[bp]); bp < bpend; bp++, bpe++) {
+        bp = ngram_search_frame_bp(ngs, ngs->cand_sf[i].bp_ef);
+        bpend = ngram_search_frame_bp(ngs, ngs->cand_sf[i].bp_ef + 1);
+        for (; bp < bpend; bp++) {
+            int32 n_wid;
+
+            bpe = ngram_search_bp(ngs, bp);
             if (!bpe->valid)
                 continue;
-            /* For each candidate at the start frame find bp->cand transition-score */
+            /* For each candidate at the start frame find bp->cand
+             * transition-score, collecting the ones which need an LM
+             * score to look them up together. */
+            n_wid = 0;
             for (j = ngs->cand_sf[i].cand; j >= 0; j = candp->next) {
-                int32 n_used;
                 candp = &(ngs->lastphn_cand[j]);
                 dscr = 
                     ngram_search_exit_score
                     (ngs, bpe, dict_first_phone(ps_search_dict(ngs), candp->wid));
                 if (dscr BETTER_THAN WORST_SCORE) {
                     assert(!dict_filler_word(ps_search_dict(ngs), candp->wid));
-                    dscr += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(ps_search_dict(ngs), candp->wid),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+                    ngs->lmbatch_wid[n_wid] = dict_basewid(ps_search_dict(ngs), candp->wid);
+                    ngs->lmbatch_idx[n_wid] = j;
+                    ++n_wid;
+                }
+                else if (dscr BETTER_THAN ngs->last_ltrans[candp->wid].dscr) {
+                    ngs->last_ltrans[candp->wid].dscr = dscr;
+                    ngs->last_ltrans[candp->wid].bp = bp;
                 }
+            }
+            if (n_wid == 0)
+                continue;
+            ngram_search_lm_scores(ngs, n_wid, bpe->real_wid, bpe->prev_real_wid);
+            for (k = 0; k < n_wid; k++) {
+                candp = &(ngs->lastphn_cand[ngs->lmbatch_idx[k]]);
+                dscr = 
+                    ngram_search_exit_score
+                    (ngs, bpe, dict_first_phone(ps_search_dict(ngs), candp->wid))
+                    + (ngs->lmbatch_score[k] >> SENSCR_SHIFT);
 
                 if (dscr BETTER_THAN ngs->last_ltrans[candp->wid].dscr) {
                     ngs->last_ltrans[candp->wid].dscr = dscr;
@@ -1200,8 +1217,8 @@ bptable_maxwpf(ngram_search_t *ngs, int frame_idx)
     bestscr = (int32) 0x80000000;
     bestbpe = NULL;
     n = 0;
-    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
-        bpe = &(ngs->bp_table[bp]);
+    for (bp = ngram_search_frame_bp(ngs, frame_idx); bp < ngs->bpidx; bp++) {
+        bpe = ngram_search_bp(ngs, bp);
         if (dict_filler_word(ps_search_dict(ngs), bpe->wid)) {
             if (bpe->score BETTER_THAN bestscr) {
                 bestscr = bpe->score;
@@ -1219,13 +1236,13 @@ bptable_maxwpf(ngram_search_t *ngs, int frame_idx)
 
     /* Allow up to maxwpf best entries to survive; mark the remaining with valid = 0 */
     n = (ngs->bpidx
-         - ngs->bp_table_idx[frame_idx]) - n;  /* No. of entries after limiting fillers */
+         - ngram_search_frame_bp(ngs, frame_idx)) - n;  /* No. of entries after limiting fillers */
     for (; n > ngs->maxwpf; --n) {
         /* Find worst BPTable entry */
         worstscr = (int32) 0x7fffffff;
         worstbpe = NULL;
-        for (bp = ngs->bp_table_idx[frame_idx]; (bp < ngs->bpidx); bp++) {
-            bpe = &(ngs->bp_table[bp]);
+        for (bp = ngram_search_frame_bp(ngs, frame_idx); (bp < ngs->bpidx); bp++) {
+            bpe = ngram_search_bp(ngs, bp);
             if (bpe->valid && (bpe->score WORSE_THAN worstscr)) {
                 worstscr = bpe->score;
                 worstbpe = bpe;
@@ -1262,8 +1279,8 @@ word_transition(ngram_search_t *ngs, int frame_idx)
     pls = (phone_loop_search_t *)ps_search_lookahead(ngs);
     /* Ugh, this is complicated.  Scan all word exits for this frame
      * (they have already been created by prune_word_chan()). */
-    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
-        bpe = &(ngs->bp_table[bp]);
+    for (bp = ngram_search_frame_bp(ngs, frame_idx); bp < ngs->bpidx; bp++) {
+        bpe = ngram_search_bp(ngs, bp);
         ngs->word_lat_idx[bpe->wid] = NO_BP;
 
         if (bpe->wid == ps_search_finish_wid(ngs))
@@ -1288,7 +1305,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         }
         else {
             xwdssid_t *rssid = dict2pid_rssid(d2p, bpe->last_phone, bpe->last2_phone);
-            int32 *rcss = &(ngs->bscore_stack[bpe->s_idx]);
+            int32 *rcss = ngram_search_bp_rcss(ngs, bpe);
             for (rc = 0; rc < bin_mdef_n_ciphone(ps_search_acmod(ngs)->mdef); ++rc) {
                 if (rcss[rssid->cimap[rc]] BETTER_THAN ngs->bestbp_rc[rc].score) {
                     E_DEBUG(4,("bestbp_rc[%d] = %d lc %d\n",
@@ -1337,24 +1354,28 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         w = ngs->single_phone_wid[i];
         ngs->last_ltrans[w].dscr = (int32) 0x80000000;
     }
-    for (bp = ngs->bp_table_idx[frame_idx]; bp < ngs->bpidx; bp++) {
-        bpe = &(ngs->bp_table[bp]);
+    ngram_search_lmbatch_alloc(ngs, ngs->n_1ph_LMwords);
+    for (bp = ngram_search_frame_bp(ngs, frame_idx); bp < ngs->bpidx; bp++) {
+        int32 n_wid;
+
+        bpe = ngram_search_bp(ngs, bp);
         if (!bpe->valid)
             continue;
 
+        n_wid = 0;
         for (i = 0; i < ngs->n_1ph_LMwords; i++) {
-            int32 n_used;
             w = ngs->single_phone_wid[i];
             newscore = ngram_search_exit_score
                 (ngs, bpe, dict_first_phone(dict, w));
             E_DEBUG(4, ("initial newscore for %s: %d\n",
                         dict_wordstr(dict, w), newscore));
-            if (newscore != WORST_SCORE)
-                newscore += ngram_tg_score(ngs->lmset,
-                                           dict_basewid(dict, w),
-                                           bpe->real_wid,
-                                           bpe->prev_real_wid,
-                                           &n_used)>>SENSCR_SHIFT;
+            if (newscore != WORST_SCORE) {
+                /* Look up the LM scores for this history together. */
+                ngs->lmbatch_wid[n_wid] = dict_basewid(dict, w);
+                ngs->lmbatch_idx[n_wid] = i;
+                ++n_wid;
+                continue;
+            }
 
             /* FIXME: Not sure how WORST_SCORE could be better, but it
              * apparently happens. */
@@ -1363,6 +1384,19 @@ word_transition(ngram_search_t *ngs, int frame_idx)
                 ngs->last_ltrans[w].bp = bp;
             }
         }
+        if (n_wid == 0)
+            continue;
+        ngram_search_lm_scores(ngs, n_wid, bpe->real_wid, bpe->prev_real_wid);
+        for (k = 0; k < n_wid; k++) {
+            w = ngs->single_phone_wid[ngs->lmbatch_idx[k]];
+            newscore = ngram_search_exit_score
+                (ngs, bpe, dict_first_phone(dict, w))
+                + (ngs->lmbatch_score[k] >> SENSCR_SHIFT);
+            if (newscore BETTER_THAN ngs->last_ltrans[w].dscr) {
+                ngs->last_ltrans[w].dscr = newscore;
+                ngs->last_ltrans[w].bp = bp;
+            }
+        }
     }
 
     /* Now transition to in-LM single phone words */
@@ -1376,7 +1410,7 @@ word_transition(ngram_search_t *ngs, int frame_idx)
         newscore = ngs->last_ltrans[w].dscr + ngs->pip;
 	pl_newscore = newscore + phone_loop_search_score(pls, rhmm->ciphone);
         if (pl_newscore BETTER_THAN thresh) {
-            bpe = ngs->bp_table + ngs->last_ltrans[w].bp;
+            bpe = ngram_search_bp(ngs, ngs->last_ltrans[w].bp);
             if ((hmm_frame(&rhmm->hmm) < frame_idx)
                 || (newscore BETTER_THAN hmm_in_score(&rhmm->hmm))) {
                 hmm_enter(&rhmm->hmm,
@@ -1451,6 +1485,12 @@ deactivate_channels(ngram_search_t *ngs, int frame_idx)
     }
 }
 
+void
+ngram_fwdtree_sen_active(ngram_search_t *ngs, int frame_idx)
+{
+    compute_sen_active(ngs, frame_idx);
+}
+
 int
 ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx)
 {
@@ -1559,6 +1599,10 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
                ngs->st.n_word_lastchan_eval / (cf + 1));
         E_INFO("%8d candidate words for entering last phone (%d/fr)\n",
                ngs->st.n_lastphn_cand_utt, ngs->st.n_lastphn_cand_utt / (cf + 1));
+        if (ngs->st.n_lmcache_lookup > 0)
+            E_INFO("%8d LM score lookups, %.1f%% cache hits\n",
+                   ngs->st.n_lmcache_lookup,
+                   100.0 * ngs->st.n_lmcache_hit / ngs->st.n_lmcache_lookup);
         E_INFO("fwdtree %.2f CPU %.3f xRT\n",
                ngs->fwdtree_perf.t_cpu,
                ngs->fwdtree_perf.t_cpu / n_speech);
@@ -1568,3 +1612,48 @@ ngram_fwdtree_finish(ngram_search_t *ngs)
     }
     /* dump_bptable(ngs); */
 }
+
+static void
+hmm_visit_bp(hmm_t *hmm, ngram_bp_visit_f func, void *udata)
+{
+    int32 i;
+
+    for (i = 0; i < hmm_n_emit_state(hmm); ++i) {
+        if (hmm_history(hmm, i) != NO_BP)
+            (*func)(udata, hmm_history(hmm, i));
+    }
+    if (hmm_out_history(hmm) != NO_BP)
+        (*func)(udata, hmm_out_history(hmm));
+}
+
+void
+ngram_fwdtree_visit_bp(ngram_search_t *ngs, int frame_idx,
+                       ngram_bp_visit_f func, void *udata)
+{
+    root_chan_t *rhmm;
+    chan_t *hmm, **acl;
+    int32 i, w, *awl;
+
+    /* Same channels as renormalize_scores(), and every state of them,
+     * since histories only move between states of the same HMM. */
+    for (i = ngs->n_root_chan, rhmm = ngs->root_chan; i > 0; --i, rhmm++) {
+        if (hmm_frame(&rhmm->hmm) == frame_idx)
+            hmm_visit_bp(&rhmm->hmm, func, udata);
+    }
+    i = ngs->n_active_chan[frame_idx & 0x1];
+    acl = ngs->active_chan_list[frame_idx & 0x1];
+    for (hmm = *(acl++); i > 0; --i, hmm = *(acl++))
+        hmm_visit_bp(&hmm->hmm, func, udata);
+    i = ngs->n_active_word[frame_idx & 0x1];
+    awl = ngs->active_word_list[frame_idx & 0x1];
+    for (w = *(awl++); i > 0; --i, w = *(awl++)) {
+        for (hmm = ngs->word_chan[w]; hmm; hmm = hmm->next)
+            hmm_visit_bp(&hmm->hmm, func, udata);
+    }
+    for (i = 0; i < ngs->n_1ph_words; i++) {
+        w = ngs->single_phone_wid[i];
+        rhmm = (root_chan_t *) ngs->word_chan[w];
+        if (hmm_frame(&rhmm->hmm) == frame_idx)
+            hmm_visit_bp(&rhmm->hmm, func, udata);
+    }
+}
@@ -74,10 +74,22 @@ void ngram_fwdtree_start(ngram_search_t *ngs);
  */
 int ngram_fwdtree_search(ngram_search_t *ngs, int frame_idx);
 
+/**
+ * Mark the senones needed to search a frame as active.
+ */
+void ngram_fwdtree_sen_active(ngram_search_t *ngs, int frame_idx);
+
 /**
  * Finish fwdtree decoding for an utterance.
  */
 void ngram_fwdtree_finish(ngram_search_t *ngs);
 
+/**
+ * Call a function on every backpointer that the HMMs active in a frame
+ * can still exit to (many times over for most of them).
+ */
+void ngram_fwdtree_visit_bp(ngram_search_t *ngs, int frame_idx,
+                            ngram_bp_visit_f func, void *udata);
+
 
 #endif /* __NGRAM_SEARCH_FWDTREE_H__ */
@@ -55,6 +55,7 @@ static ps_seg_t *phone_loop_search_seg_iter(ps_search_t *search);
 static ps_searchfuncs_t phone_loop_search_funcs = {
     /* start: */  phone_loop_search_start,
     /* step: */   phone_loop_search_step,
+    /* sen_active: */ NULL,
     /* finish: */ phone_loop_search_finish,
     /* reinit: */ phone_loop_search_reinit,
     /* free: */   phone_loop_search_free,
@@ -64,6 +65,140 @@ static ps_searchfuncs_t phone_loop_search_funcs = {
     /* seg_iter: */ phone_loop_search_seg_iter,
 };
 
+phone_loop_t *
+phone_loop_get(acmod_t *acmod, int32 pip)
+{
+    phone_loop_t *pl;
+    gnode_t *gn;
+    int i;
+
+    for (gn = acmod->phone_loops; gn; gn = gnode_next(gn)) {
+        pl = (phone_loop_t *)gnode_ptr(gn);
+        if (pl->pip == pip) {
+            ++pl->refcount;
+            return pl;
+        }
+    }
+
+    pl = (phone_loop_t *)ckd_calloc(1, sizeof(*pl));
+    pl->refcount = 1;
+    pl->acmod = acmod;
+    pl->pip = pip;
+    pl->frame = -1;
+    pl->hmmctx = hmm_context_init(bin_mdef_n_emit_state(acmod->mdef),
+                                  acmod->tmat->tp, NULL, acmod->mdef->sseq);
+    if (pl->hmmctx == NULL) {
+        ckd_free(pl);
+        return NULL;
+    }
+    pl->n_phones = bin_mdef_n_ciphone(acmod->mdef);
+    pl->hmms = (hmm_t *)ckd_calloc(pl->n_phones, sizeof(*pl->hmms));
+    for (i = 0; i < pl->n_phones; ++i) {
+        hmm_init(pl->hmmctx, &pl->hmms[i],
+                 FALSE,
+                 bin_mdef_pid2ssid(acmod->mdef, i),
+                 bin_mdef_pid2tmatid(acmod->mdef, i));
+    }
+    acmod->phone_loops = glist_add_ptr(acmod->phone_loops, pl);
+
+    return pl;
+}
+
+int
+phone_loop_free(phone_loop_t *pl)
+{
+    gnode_t *gn, *prev;
+    int i;
+
+    if (pl == NULL)
+        return 0;
+    if (--pl->refcount > 0)
+        return pl->refcount;
+
+    for (gn = pl->acmod->phone_loops, prev = NULL; gn;
+         prev = gn, gn = gnode_next(gn)) {
+        if (gnode_ptr(gn) == pl) {
+            if (prev)
+                gnode_free(gn, prev);
+            else
+                pl->acmod->phone_loops = gnode_free(gn, NULL);
+            break;
+        }
+    }
+
+    for (i = 0; i < pl->n_phones; ++i)
+        hmm_deinit(&pl->hmms[i]);
+    ckd_free(pl->hmms);
+    hmm_context_free(pl->hmmctx);
+    ckd_free(pl);
+    return 0;
+}
+
+void
+phone_loop_start(phone_loop_t *pl)
+{
+    int i;
+
+    for (i = 0; i < pl->n_phones; ++i) {
+        hmm_clear(&pl->hmms[i]);
+        hmm_enter(&pl->hmms[i], 0, -1, 0);
+    }
+    pl->best_score = 0;
+    pl->best_out_score = WORST_SCORE;
+    pl->frame = -1;
+}
+
+void
+phone_loop_activate(phone_loop_t *pl)
+{
+    int i;
+
+    for (i = 0; i < pl->n_phones; ++i)
+        acmod_activate_hmm(pl->acmod, &pl->hmms[i]);
+}
+
+void
+phone_loop_step(phone_loop_t *pl, int16 const *senscr, int frame_idx)
+{
+    hmm_t *best_hmm = NULL;
+    int32 bs = WORST_SCORE;
+    int i;
+
+    /* Another search already did this frame */
+    if (pl->frame == frame_idx)
+        return;
+    pl->frame = frame_idx;
+
+    hmm_context_set_senscore(pl->hmmctx, senscr);
+    for (i = 0; i < pl->n_phones; ++i) {
+        int32 score = hmm_vit_eval(&pl->hmms[i]);
+        if (score BETTER_THAN bs)
+            bs = score;
+    }
+    pl->best_score = bs;
+
+    /* Select the best phone exit to be a predecessor */
+    pl->best_out_score = WORST_SCORE;
+    for (i = 0; i < pl->n_phones; ++i) {
+        if (hmm_out_score(&pl->hmms[i]) BETTER_THAN pl->best_out_score) {
+            pl->best_out_score = hmm_out_score(&pl->hmms[i]);
+            best_hmm = &pl->hmms[i];
+        }
+    }
+
+    /* Out probs are not ready yet */
+    if (best_hmm == NULL)
+        return;
+
+    for (i = 0; i < pl->n_phones; ++i) {
+        if (pl->best_out_score + pl->pip BETTER_THAN
+            hmm_in_score(&pl->hmms[i])) {
+            hmm_enter(&pl->hmms[i], pl->best_out_score + pl->pip,
+                      hmm_out_history(best_hmm), frame_idx + 1);
+        }
+    }
+}
+
 static int
 phone_loop_search_reinit(ps_search_t *search, dict_t *dict, dict2pid_t *d2p)
 {
@@ -89,6 +89,58 @@ struct phone_loop_search_s {
 };
 typedef struct phone_loop_search_s phone_loop_search_t;
 
+/**
+ * Phone loop shared between searches.
+ *
+ * A loop over all CI phones, entered from the best phone exit in each
+ * frame.  Searches stepping over the same senone scores get the same one
+ * from phone_loop_get() and it is only evaluated once per frame, by
+ * whichever of them steps first.
+ */
+struct phone_loop_s {
+    int refcount;                      /**< Number of searches using it. */
+    acmod_t *acmod;                    /**< Acoustic model it is attached to. */
+    hmm_context_t *hmmctx;             /**< HMM context structure. */
+    hmm_t *hmms;                       /**< HMMs of CI phones. */
+    int32 n_phones;                    /**< Size of phone array. */
+    int32 pip;                         /**< Phone insertion penalty. */
+    int32 best_score;                  /**< Best Viterbi score in current frame. */
+    int32 best_out_score;              /**< Best phone exit score in current frame. */
+    int frame;                         /**< Last frame evaluated, -1 if none. */
+};
+typedef struct phone_loop_s phone_loop_t;
+
+/**
+ * Get the phone loop of an acoustic model with the given insertion
+ * penalty, creating it if no search uses one yet.
+ *
+ * @return a phone loop to release with phone_loop_free(), or NULL on error.
+ */
+phone_loop_t *phone_loop_get(acmod_t *acmod, int32 pip);
+
+/**
+ * Release a phone loop.
+ *
+ * @return new reference count (0 if freed).
+ */
+int phone_loop_free(phone_loop_t *pl);
+
+/**
+ * Reset and enter all phones for a new utterance.
+ */
+void phone_loop_start(phone_loop_t *pl);
+
+/**
+ * Mark the senones of all phones as active.
+ */
+void phone_loop_activate(phone_loop_t *pl);
+
+/**
+ * Evaluate a frame and do phone transitions, unless that was already done
+ * for the frame.
+ */
+void phone_loop_step(phone_loop_t *pl, int16 const *senscr, int frame_idx);
+
 ps_search_t *phone_loop_search_init(cmd_ln_t *config,
                                     acmod_t *acmod,
                                     dict_t *dict);
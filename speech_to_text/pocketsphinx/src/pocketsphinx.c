@@ -170,10 +170,50 @@ ps_free_searches(ps_decoder_t *ps)
         hash_table_free(ps->searches);
     }
 
+    glist_free(ps->concurrent);
+    ps->concurrent = NULL;
     ps->searches = NULL;
     ps->search = NULL;
 }
 
+/* Phoneme lookahead is only used by N-Gram search */
+static void
+ps_update_pl_window(ps_decoder_t *ps)
+{
+    gnode_t *gn;
+    int ngram;
+
+    ngram = ps->search
+        && !strcmp(PS_SEARCH_TYPE_NGRAM, ps_search_type(ps->search));
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        if (!strcmp(PS_SEARCH_TYPE_NGRAM, ps_search_type(gnode_ptr(gn))))
+            ngram = TRUE;
+
+    if (ngram)
+        ps->pl_window = cmd_ln_int32_r(ps->config, "-pl_window");
+    else
+        ps->pl_window = 0;
+}
+
+/* Drop a search from the concurrent ones, returns TRUE if it was there */
+static int
+ps_remove_concurrent(ps_decoder_t *ps, ps_search_t *search)
+{
+    gnode_t *gn, *prev;
+
+    for (gn = ps->concurrent, prev = NULL; gn;
+         prev = gn, gn = gnode_next(gn)) {
+        if (gnode_ptr(gn) == search) {
+            if (prev)
+                gnode_free(gn, prev);
+            else
+                ps->concurrent = gnode_free(gn, NULL);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 static ps_search_t *
 ps_find_search(ps_decoder_t *ps, char const *name)
 {
@@ -478,12 +518,9 @@ ps_set_search(ps_decoder_t *ps, const char *name)
     }
 
     ps->search = search;
+    ps_remove_concurrent(ps, search);
     /* Set pl window depending on the search */
-    if (!strcmp(PS_SEARCH_TYPE_NGRAM, ps_search_type(search))) {
-        ps->pl_window = cmd_ln_int32_r(ps->config, "-pl_window");
-    } else {
-        ps->pl_window = 0;
-    }
+    ps_update_pl_window(ps);
 
     return 0;
 }
@@ -497,6 +534,7 @@ ps_get_search(ps_decoder_t *ps)
         search_it = hash_table_iter_next(search_it)) {
         if (hash_entry_val(search_it->ent) == ps->search) {
             name = hash_entry_key(search_it->ent);
+            hash_table_iter_free(search_it);
             break;
         }
     }
@@ -511,10 +549,62 @@ ps_unset_search(ps_decoder_t *ps, const char *name)
         return -1;
     if (ps->search == search)
         ps->search = NULL;
+    if (ps_remove_concurrent(ps, search))
+        ps_update_pl_window(ps);
     ps_search_free(search);
     return 0;
 }
 
+int
+ps_add_concurrent_search(ps_decoder_t *ps, const char *name)
+{
+    ps_search_t *search;
+    gnode_t *gn;
+
+    if (ps->acmod->state != ACMOD_ENDED && ps->acmod->state != ACMOD_IDLE) {
+        E_ERROR("Cannot change search while decoding, end utterance first\n");
+        return -1;
+    }
+
+    if (!(search = ps_find_search(ps, name))) {
+        E_ERROR("No search '%s'\n", name);
+        return -1;
+    }
+    if (search->vt->sen_active == NULL) {
+        E_ERROR("Search '%s' of type %s can't run concurrently\n",
+                name, ps_search_type(search));
+        return -1;
+    }
+    if (search == ps->search)
+        return 0;
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        if (gnode_ptr(gn) == search)
+            return 0;
+
+    ps->concurrent = glist_add_ptr(ps->concurrent, search);
+    ps_update_pl_window(ps);
+    return 0;
+}
+
+int
+ps_remove_concurrent_search(ps_decoder_t *ps, const char *name)
+{
+    ps_search_t *search;
+
+    if (ps->acmod->state != ACMOD_ENDED && ps->acmod->state != ACMOD_IDLE) {
+        E_ERROR("Cannot change search while decoding, end utterance first\n");
+        return -1;
+    }
+
+    if (!(search = ps_find_search(ps, name))
+        || !ps_remove_concurrent(ps, search)) {
+        E_ERROR("Search '%s' is not running concurrently\n", name);
+        return -1;
+    }
+    ps_update_pl_window(ps);
+    return 0;
+}
+
 ps_search_iter_t *
 ps_search_iter(ps_decoder_t *ps)
 {
@@ -576,8 +666,15 @@ set_search_internal(ps_decoder_t *ps, ps_search_t *search)
 
     search->pls = ps->phone_loop;
     old_search = (ps_search_t *) hash_table_replace(ps->searches, ps_search_name(search), search);
-    if (old_search != search)
+    if (old_search != search) {
+        gnode_t *gn;
+
+        /* Keep running the new search in place of the old one */
+        for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+            if (gnode_ptr(gn) == old_search)
+                gnode_ptr(gn) = search;
         ps_search_free(old_search);
+    }
 
     return 0;
 }
@@ -644,6 +741,71 @@ ps_set_keyphrase(ps_decoder_t *ps, const char *name, const char *keyphrase)
     return set_search_internal(ps, search);
 }
 
+static ps_search_t *
+find_kws_search(ps_decoder_t *ps, const char *name)
+{
+    ps_search_t *search;
+
+    search = name ? ps_find_search(ps, name) : ps->search;
+    if (search == NULL || strcmp(PS_SEARCH_TYPE_KWS, ps_search_type(search))) {
+        E_ERROR("No keyphrase search '%s'\n", name ? name : "(current)");
+        return NULL;
+    }
+    return search;
+}
+
+int
+ps_add_keyphrase(ps_decoder_t *ps, const char *name,
+                 const char *keyphrase, double threshold)
+{
+    ps_search_t *search;
+    int32 thresh;
+
+    if ((search = find_kws_search(ps, name)) == NULL)
+        return -1;
+
+    if (threshold > 0)
+        thresh = (int32) logmath_log(ps->acmod->lmath, threshold) >> SENSCR_SHIFT;
+    else
+        thresh = ((kws_search_t *) search)->def_threshold;
+
+    return kws_search_add_keyphrase(search, keyphrase, thresh);
+}
+
+int
+ps_remove_keyphrase(ps_decoder_t *ps, const char *name, const char *keyphrase)
+{
+    ps_search_t *search;
+
+    if ((search = find_kws_search(ps, name)) == NULL)
+        return -1;
+
+    return kws_search_remove_keyphrase(search, keyphrase);
+}
+
+int
+ps_get_kws_threshold(ps_decoder_t *ps, const char *name,
+                     const char *keyphrase, double *out_threshold,
+                     double *out_fa_rate)
+{
+    ps_search_t *search;
+    int32 thresh;
+    float64 fa_rate;
+
+    if ((search = find_kws_search(ps, name)) == NULL)
+        return -1;
+
+    if (kws_search_get_threshold(search, keyphrase, &thresh, &fa_rate) < 0) {
+        E_ERROR("No keyphrase '%s' in search\n", keyphrase);
+        return -1;
+    }
+    if (out_threshold)
+        *out_threshold = logmath_exp(ps->acmod->lmath, thresh << SENSCR_SHIFT);
+    if (out_fa_rate)
+        *out_fa_rate = fa_rate;
+    return 0;
+}
+
 int
 ps_set_fsg(ps_decoder_t *ps, const char *name, fsg_model_t *fsg)
 {
@@ -929,10 +1091,23 @@ ps_start_stream(ps_decoder_t *ps)
     return 0;
 }
 
+/* Remove the word lattice and hypothesis of the last utterance. */
+static void
+ps_search_clear_results(ps_search_t *search)
+{
+    ps_lattice_free(search->dag);
+    search->dag = NULL;
+    search->last_link = NULL;
+    search->post = 0;
+    ckd_free(search->hyp_str);
+    search->hyp_str = NULL;
+}
+
 int
 ps_start_utt(ps_decoder_t *ps)
 {
     int rv;
+    gnode_t *gn;
     char uttid[16];
     
     if (ps->acmod->state == ACMOD_STARTED || ps->acmod->state == ACMOD_PROCESSING) {
@@ -953,12 +1128,9 @@ ps_start_utt(ps_decoder_t *ps)
     ++ps->uttno;
 
     /* Remove any residual word lattice and hypothesis. */
-    ps_lattice_free(ps->search->dag);
-    ps->search->dag = NULL;
-    ps->search->last_link = NULL;
-    ps->search->post = 0;
-    ckd_free(ps->search->hyp_str);
-    ps->search->hyp_str = NULL;
+    ps_search_clear_results(ps->search);
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        ps_search_clear_results((ps_search_t *)gnode_ptr(gn));
     if ((rv = acmod_start_utt(ps->acmod)) < 0)
         return rv;
 
@@ -1007,9 +1179,41 @@ ps_start_utt(ps_decoder_t *ps)
     if (ps->phone_loop)
         ps_search_start(ps->phone_loop);
 
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        if (ps_search_start((ps_search_t *)gnode_ptr(gn)) < 0)
+            return -1;
+
     return ps_search_start(ps->search);
 }
 
+/**
+ * Step the current search, and those running alongside it over the same
+ * senone scores.
+ */
+static int
+ps_search_step_all(ps_decoder_t *ps, int frame_idx)
+{
+    gnode_t *gn;
+    int k;
+
+    if (ps->concurrent == NULL)
+        return ps_search_step(ps->search, frame_idx);
+
+    /* Senones needed by any search are scored together */
+    acmod_begin_shared_frame(ps->acmod);
+    if (!ps->acmod->compallsen) {
+        ps_search_sen_active(ps->search, frame_idx);
+        for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+            ps_search_sen_active((ps_search_t *)gnode_ptr(gn), frame_idx);
+    }
+    k = ps_search_step(ps->search, frame_idx);
+    for (gn = ps->concurrent; k >= 0 && gn; gn = gnode_next(gn))
+        k = ps_search_step((ps_search_t *)gnode_ptr(gn), frame_idx);
+    acmod_end_shared_frame(ps->acmod);
+
+    return k;
+}
+
 static int
 ps_search_forward(ps_decoder_t *ps)
 {
@@ -1022,8 +1226,8 @@ ps_search_forward(ps_decoder_t *ps)
             if ((k = ps_search_step(ps->phone_loop, ps->acmod->output_frame)) < 0)
                 return k;
         if (ps->acmod->output_frame >= ps->pl_window)
-            if ((k = ps_search_step(ps->search,
-                                    ps->acmod->output_frame - ps->pl_window)) < 0)
+            if ((k = ps_search_step_all(ps,
+                                        ps->acmod->output_frame - ps->pl_window)) < 0)
                 return k;
         acmod_advance(ps->acmod);
         ++ps->n_frame;
@@ -1032,6 +1236,55 @@ ps_search_forward(ps_decoder_t *ps)
     return nfr;
 }
 
+int
+ps_set_replay(ps_decoder_t *ps, int replay)
+{
+    return acmod_set_grow(ps->acmod, replay);
+}
+
+int
+ps_replay_search(ps_decoder_t *ps, const char *name, int frame_idx)
+{
+    ps_search_t *search;
+    gnode_t *gn;
+    int n_replay;
+
+    if (ps->acmod->state != ACMOD_STARTED && ps->acmod->state != ACMOD_PROCESSING) {
+        E_ERROR("Utterance is not started\n");
+        return -1;
+    }
+    if (!(search = ps_find_search(ps, name)))
+        return -1;
+
+    /* Frames are given relative to the stream, as by ps_seg_frames(). */
+    frame_idx -= acmod_stream_offset(ps->acmod);
+    n_replay = ps->acmod->output_frame - frame_idx;
+    if (acmod_rewind_to(ps->acmod, frame_idx) < 0)
+        return -1;
+    /* Frames decoded again were already counted. */
+    if (n_replay > 0)
+        ps->n_frame -= n_replay;
+
+    ps->search = search;
+    ps_remove_concurrent(ps, search);
+    ps_update_pl_window(ps);
+
+    ps_search_clear_results(ps->search);
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        ps_search_clear_results((ps_search_t *)gnode_ptr(gn));
+
+    if (ps->phone_loop)
+        ps_search_start(ps->phone_loop);
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn))
+        if (ps_search_start((ps_search_t *)gnode_ptr(gn)) < 0)
+            return -1;
+    if (ps_search_start(ps->search) < 0)
+        return -1;
+
+    /* Catch up with the frames available. */
+    return ps_search_forward(ps) < 0 ? -1 : 0;
+}
+
 int
 ps_decode_senscr(ps_decoder_t *ps, FILE *senfh)
 {
@@ -1124,6 +1377,7 @@ int
 ps_end_utt(ps_decoder_t *ps)
 {
     int rv, i;
+    gnode_t *gn;
 
     if (ps->acmod->state == ACMOD_ENDED || ps->acmod->state == ACMOD_IDLE) {
 	E_ERROR("Utterance is not started\n");
@@ -1147,13 +1401,20 @@ ps_end_utt(ps_decoder_t *ps)
     if (ps->acmod->output_frame >= ps->pl_window) {
         for (i = ps->acmod->output_frame - ps->pl_window;
              i < ps->acmod->output_frame; ++i)
-            ps_search_step(ps->search, i);
+            ps_search_step_all(ps, i);
     }
     /* Finish main search. */
     if ((rv = ps_search_finish(ps->search)) < 0) {
         ptmr_stop(&ps->perf);
         return rv;
     }
+    /* Finish searches running alongside it. */
+    for (gn = ps->concurrent; gn; gn = gnode_next(gn)) {
+        if ((rv = ps_search_finish((ps_search_t *)gnode_ptr(gn))) < 0) {
+            ptmr_stop(&ps->perf);
+            return rv;
+        }
+    }
     ptmr_stop(&ps->perf);
 
     /* Log a backtrace if requested. */
@@ -1197,6 +1458,17 @@ ps_get_hyp(ps_decoder_t *ps, int32 *out_best_score)
     return hyp;
 }
 
+char const *
+ps_get_final_hyp(ps_decoder_t *ps, int32 *out_frame)
+{
+    if (out_frame)
+        *out_frame = 0;
+    if (ps->search == NULL
+        || strcmp(PS_SEARCH_TYPE_NGRAM, ps_search_type(ps->search)))
+        return NULL;
+    return ngram_search_final_hyp((ngram_search_t *)ps->search, out_frame);
+}
+
 int32
 ps_get_prob(ps_decoder_t *ps)
 {
@@ -1219,6 +1491,38 @@ ps_seg_iter(ps_decoder_t *ps)
     return itor;
 }
 
+char const *
+ps_get_search_hyp(ps_decoder_t *ps, const char *name, int32 *out_best_score)
+{
+    ps_search_t *search;
+    char const *hyp;
+
+    if (!(search = ps_find_search(ps, name))) {
+        E_ERROR("No search '%s'\n", name);
+        return NULL;
+    }
+    ptmr_start(&ps->perf);
+    hyp = ps_search_hyp(search, out_best_score);
+    ptmr_stop(&ps->perf);
+    return hyp;
+}
+
+ps_seg_t *
+ps_get_search_seg_iter(ps_decoder_t *ps, const char *name)
+{
+    ps_search_t *search;
+    ps_seg_t *itor;
+
+    if (!(search = ps_find_search(ps, name))) {
+        E_ERROR("No search '%s'\n", name);
+        return NULL;
+    }
+    ptmr_start(&ps->perf);
+    itor = ps_search_seg_iter(search);
+    ptmr_stop(&ps->perf);
+    return itor;
+}
+
 ps_seg_t *
 ps_seg_next(ps_seg_t *seg)
 {
@@ -82,6 +82,7 @@ typedef struct ps_search_s ps_search_t;
 typedef struct ps_searchfuncs_s {
     int (*start)(ps_search_t *search);
     int (*step)(ps_search_t *search, int frame_idx);
+    void (*sen_active)(ps_search_t *search, int frame_idx);
     int (*finish)(ps_search_t *search);
     int (*reinit)(ps_search_t *search, dict_t *dict, dict2pid_t *d2p);
     void (*free)(ps_search_t *search);
@@ -134,6 +135,7 @@ struct ps_search_s {
 #define ps_search_name(s) ps_search_base(s)->name
 #define ps_search_start(s) (*(ps_search_base(s)->vt->start))(s)
 #define ps_search_step(s,i) (*(ps_search_base(s)->vt->step))(s,i)
+#define ps_search_sen_active(s,i) (*(ps_search_base(s)->vt->sen_active))(s,i)
 #define ps_search_finish(s) (*(ps_search_base(s)->vt->finish))(s)
 #define ps_search_reinit(s,d,d2p) (*(ps_search_base(s)->vt->reinit))(s,d,d2p)
 #define ps_search_free(s) (*(ps_search_base(s)->vt->free))(s)
@@ -216,6 +218,7 @@ struct ps_decoder_s {
     ps_search_t *search;     /**< Currently active search module. */
     ps_search_t *phone_loop; /**< Phone loop search for lookahead. */
     int pl_window;           /**< Window size for phoneme lookahead. */
+    glist_t concurrent;      /**< Searches run alongside the current one. */
 
     /* Utterance-processing related stuff. */
     uint32 uttno;       /**< Utterance counter. */
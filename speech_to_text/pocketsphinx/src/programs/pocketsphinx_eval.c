@@ -0,0 +1,285 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2026 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * \file pocketsphinx_eval.c
+ * Recognition accuracy and speed evaluation tool.
+ *
+ * Decodes a list of raw audio files and aligns each hypothesis with its
+ * reference transcription, then prints the word error rate and the real
+ * time factor. Running it from a fixed-point and from a floating-point
+ * build on the same files compares the two.
+ */
+#include <pocketsphinx.h>
+#include <cmdln_macro.h>
+
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/pio.h>
+#include <sphinxbase/strfuncs.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const arg_t defn[] = {
+    POCKETSPHINX_OPTIONS,
+
+    { "-ctl",
+      REQARG_STRING,
+      NULL,
+      "Control file listing raw audio files (16-bit mono PCM) to decode, one per line (required)" },
+
+    { "-lsn",
+      REQARG_STRING,
+      NULL,
+      "Reference transcriptions, one per line of -ctl, with an optional (uttid) at the end (required)" },
+
+    CMDLN_EMPTY_OPTION
+};
+
+/* Word errors of one alignment, or of all of them. */
+typedef struct word_errors_s {
+    int32 n_ref;  /* Words in the reference */
+    int32 n_sub;  /* Substitutions */
+    int32 n_del;  /* Deletions */
+    int32 n_ins;  /* Insertions */
+} word_errors_t;
+
+/*
+ * Splits a transcription into words, in place, dropping sentence markers
+ * and a trailing utterance ID.  Returns the number of words.
+ */
+static int32
+split_words(char *line, char ***out_words)
+{
+    char **words;
+    int32 i, n, n_kept;
+
+    if ((n = str2words(line, NULL, 0)) <= 0) {
+        *out_words = NULL;
+        return 0;
+    }
+    words = ckd_calloc(n, sizeof(*words));
+    str2words(line, words, n);
+
+    if (words[n - 1][0] == '('
+        && words[n - 1][strlen(words[n - 1]) - 1] == ')')
+        --n;
+
+    for (i = n_kept = 0; i < n; ++i) {
+        if (0 == strcmp(words[i], "<s>")
+            || 0 == strcmp(words[i], "</s>")
+            || 0 == strcmp(words[i], "<sil>"))
+            continue;
+        words[n_kept++] = words[i];
+    }
+
+    *out_words = words;
+    return n_kept;
+}
+
+/*
+ * Aligns a hypothesis with its reference by minimum edit distance and
+ * counts the errors of that alignment.
+ */
+static void
+align_words(char **ref, int32 n_ref, char **hyp, int32 n_hyp,
+            word_errors_t *errs)
+{
+    int32 **cost;
+    int32 i, j;
+
+    cost = (int32 **) ckd_calloc_2d(n_ref + 1, n_hyp + 1, sizeof(**cost));
+    for (i = 0; i <= n_ref; ++i)
+        cost[i][0] = i;
+    for (j = 0; j <= n_hyp; ++j)
+        cost[0][j] = j;
+    for (i = 1; i <= n_ref; ++i) {
+        for (j = 1; j <= n_hyp; ++j) {
+            int32 best;
+
+            best = cost[i - 1][j - 1] + (strcmp(ref[i - 1], hyp[j - 1]) != 0);
+            if (cost[i - 1][j] + 1 < best)
+                best = cost[i - 1][j] + 1;
+            if (cost[i][j - 1] + 1 < best)
+                best = cost[i][j - 1] + 1;
+            cost[i][j] = best;
+        }
+    }
+
+    /* Walk back from the end, preferring matches and substitutions. */
+    errs->n_ref = n_ref;
+    errs->n_sub = errs->n_del = errs->n_ins = 0;
+    i = n_ref;
+    j = n_hyp;
+    while (i > 0 || j > 0) {
+        if (i > 0 && j > 0
+            && cost[i][j] == cost[i - 1][j - 1]
+                             + (strcmp(ref[i - 1], hyp[j - 1]) != 0)) {
+            if (cost[i][j] != cost[i - 1][j - 1])
+                ++errs->n_sub;
+            --i;
+            --j;
+        }
+        else if (i > 0 && cost[i][j] == cost[i - 1][j] + 1) {
+            ++errs->n_del;
+            --i;
+        }
+        else {
+            ++errs->n_ins;
+            --j;
+        }
+    }
+
+    ckd_free_2d(cost);
+}
+
+static void
+print_errors(char const *name, word_errors_t *errs)
+{
+    int32 n_err = errs->n_sub + errs->n_del + errs->n_ins;
+
+    printf("%s: %d words, %d errors (%d sub, %d del, %d ins), ",
+           name, errs->n_ref, n_err, errs->n_sub, errs->n_del, errs->n_ins);
+    if (errs->n_ref > 0)
+        printf("WER %.2f%%\n", 100.0 * n_err / errs->n_ref);
+    else
+        printf("WER n/a\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    cmd_ln_t *config;
+    ps_decoder_t *ps;
+    FILE *ctlfh, *lsnfh;
+    lineiter_t *ctl, *lsn;
+    word_errors_t total;
+    double speech, cpu, wall;
+    int32 n_utt, verbose;
+
+    if ((config = cmd_ln_parse_r(NULL, defn, argc, argv, TRUE)) == NULL)
+        return 1;
+    ps_default_search_args(config);
+    /* The front-end's -verbose ("Show input filenames") also prints the
+     * results of each file. */
+    verbose = cmd_ln_boolean_r(config, "-verbose");
+
+    if ((ps = ps_init(config)) == NULL) {
+        cmd_ln_free_r(config);
+        E_FATAL("Failed to initialize the decoder\n");
+    }
+
+    if ((ctlfh = fopen(cmd_ln_str_r(config, "-ctl"), "r")) == NULL)
+        E_FATAL_SYSTEM("Failed to open %s", cmd_ln_str_r(config, "-ctl"));
+    if ((lsnfh = fopen(cmd_ln_str_r(config, "-lsn"), "r")) == NULL)
+        E_FATAL_SYSTEM("Failed to open %s", cmd_ln_str_r(config, "-lsn"));
+
+    memset(&total, 0, sizeof(total));
+    n_utt = 0;
+    /* Not lineiter_start_clean(), as the reference of a file where nothing
+     * is said is an empty line, which would put both lists out of step. */
+    for (ctl = lineiter_start(ctlfh), lsn = lineiter_start(lsnfh);
+         ctl != NULL && lsn != NULL;
+         ctl = lineiter_next(ctl), lsn = lineiter_next(lsn)) {
+        FILE *rawfh;
+        char *hypstr;
+        char **ref, **hyp;
+        int32 n_ref, n_hyp;
+        word_errors_t errs;
+
+        string_trim(ctl->buf, STRING_BOTH);
+        if (ctl->buf[0] == '\0')
+            continue;
+        if ((rawfh = fopen(ctl->buf, "rb")) == NULL) {
+            E_ERROR_SYSTEM("Failed to open %s", ctl->buf);
+            continue;
+        }
+        ps_decode_raw(ps, rawfh, -1);
+        fclose(rawfh);
+
+        hypstr = ckd_salloc(ps_get_hyp(ps, NULL) ? ps_get_hyp(ps, NULL) : "");
+        if (verbose)
+            printf("%s: %s\n", ctl->buf, hypstr);
+
+        n_hyp = split_words(hypstr, &hyp);
+        n_ref = split_words(lsn->buf, &ref);
+        align_words(ref, n_ref, hyp, n_hyp, &errs);
+
+        if (verbose) {
+            ps_get_utt_time(ps, &speech, &cpu, &wall);
+            print_errors(ctl->buf, &errs);
+            printf("%s: %.2f sec speech, %.2f sec CPU, %.3f xRT\n",
+                   ctl->buf, speech, cpu, speech > 0 ? cpu / speech : 0.0);
+        }
+
+        total.n_ref += errs.n_ref;
+        total.n_sub += errs.n_sub;
+        total.n_del += errs.n_del;
+        total.n_ins += errs.n_ins;
+        ++n_utt;
+
+        ckd_free(ref);
+        ckd_free(hyp);
+        ckd_free(hypstr);
+    }
+    if (ctl != NULL || lsn != NULL)
+        E_WARN("-ctl and -lsn have a different number of lines, "
+               "only the first %d were evaluated\n", n_utt);
+    lineiter_free(ctl);
+    lineiter_free(lsn);
+    fclose(ctlfh);
+    fclose(lsnfh);
+
+    ps_get_all_time(ps, &speech, &cpu, &wall);
+#ifdef FIXED_POINT
+    printf("Build: fixed-point\n");
+#else
+    printf("Build: floating-point\n");
+#endif
+    printf("Files: %d\n", n_utt);
+    print_errors("Total", &total);
+    printf("Total: %.2f sec speech, %.2f sec CPU, %.2f sec wall, "
+           "%.3f xRT (CPU), %.3f xRT (wall)\n",
+           speech, cpu, wall,
+           speech > 0 ? cpu / speech : 0.0,
+           speech > 0 ? wall / speech : 0.0);
+
+    ps_free(ps);
+    cmd_ln_free_r(config);
+    return 0;
+}
@@ -1221,10 +1221,12 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
     ps_latlink_t *bestend;
     latlink_list_t *x;
     logmath_t *lmath;
+    ngram_query_t *lmq;
     int32 bestescr;
 
     search = dag->search;
     lmath = dag->lmath;
+    lmq = lmset ? ngram_query_init(lmset) : NULL;
 
     /* Initialize path scores for all links exiting dag->start, and
      * set all other scores to the minimum.  Also initialize alphas to
@@ -1244,7 +1246,7 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
         /* Best path points to dag->start, obviously. */
         x->link->path_scr = x->link->ascr;
         if (lmset && !to_is_fil)
-            x->link->path_scr += (ngram_bg_score(lmset, x->link->to->basewid,
+            x->link->path_scr += (ngram_bg_score_r(lmq, x->link->to->basewid,
                                 ps_search_start_wid(search), &n_used) >> SENSCR_SHIFT) * lwf;
         x->link->best_prev = NULL;
         /* No predecessors for start links. */
@@ -1283,7 +1285,7 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
 
         /* Calculate common bigram probability for all alphas. */
         if (lmset && !w3_is_fil && !w2_is_fil)
-            bprob = ngram_ng_prob(lmset, w2_wid, &w3_wid, 1, &n_used);
+            bprob = ngram_ng_prob_r(lmq, w2_wid, &w3_wid, 1, &n_used);
         else
             bprob = 0;
         /* Add in this link's acoustic score, which was a constant
@@ -1322,10 +1324,10 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
             if (lmset && !w1_is_fil && !w2_is_fil) {
                 if (w3_is_fil)
                     /* partial context available */
-                    score += (ngram_bg_score(lmset, w1_wid, w2_wid, &n_used) >> SENSCR_SHIFT) * lwf;
+                    score += (ngram_bg_score_r(lmq, w1_wid, w2_wid, &n_used) >> SENSCR_SHIFT) * lwf;
                 else
                     /* full context available */
-                    score += (ngram_tg_score(lmset, w1_wid, w2_wid, w3_wid, &n_used) >> SENSCR_SHIFT) * lwf;
+                    score += (ngram_tg_score_r(lmq, w1_wid, w2_wid, w3_wid, &n_used) >> SENSCR_SHIFT) * lwf;
             }
 
             if (score BETTER_THAN x->link->path_scr) {
@@ -1363,9 +1365,9 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
         }
 
         if (lmset && !from_is_fil)
-            bprob = ngram_ng_prob(lmset,
-                                  x->link->to->basewid,
-                                  &from_wid, 1, &n_used);
+            bprob = ngram_ng_prob_r(lmq,
+                                    x->link->to->basewid,
+                                    &from_wid, 1, &n_used);
         else
             bprob = 0;
         dag->norm = logmath_add(lmath, dag->norm, x->link->alpha + bprob);
@@ -1376,6 +1378,7 @@ ps_lattice_bestpath(ps_lattice_t *dag, ngram_model_t *lmset,
     }
     /* FIXME: floating point... */
     dag->norm += (int32)(dag->final_node_ascr << SENSCR_SHIFT) * ascale;
+    ngram_query_free(lmq);
 
     E_INFO("Bestpath score: %d\n", bestescr);
     E_INFO("Normalizer P(O) = alpha(%s:%d:%d) = %d\n",
@@ -1451,9 +1454,11 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
     ps_latlink_t *link;
     latlink_list_t *x;
     ps_latlink_t *bestend;
+    ngram_query_t *lmq;
     int32 bestescr;
 
     lmath = dag->lmath;
+    lmq = lmset ? ngram_query_init(lmset) : NULL;
 
     /* Reset all betas to zero. */
     for (node = dag->nodes; node; node = node->next) {
@@ -1491,7 +1496,7 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
 
         /* Calculate LM probability. */
         if (lmset && !from_is_fil && !to_is_fil)
-            bprob = ngram_ng_prob(lmset, to_wid, &from_wid, 1, &n_used);
+            bprob = ngram_ng_prob_r(lmq, to_wid, &from_wid, 1, &n_used);
         else
             bprob = 0;
 
@@ -1515,6 +1520,7 @@ ps_lattice_posterior(ps_lattice_t *dag, ngram_model_t *lmset,
             }
         }
     }
+    ngram_query_free(lmq);
 
     /* Return P(S|O) = P(O,S)/P(O) */
     return ps_lattice_joint(dag, bestend, ascale) - dag->norm;
@@ -1592,8 +1598,8 @@ best_rem_score(ps_astar_t *nbest, ps_latnode_t * from)
         score = best_rem_score(nbest, x->link->to);
         score += x->link->ascr;
         if (nbest->lmset)
-            score += (ngram_bg_score(nbest->lmset, x->link->to->basewid,
-                                     from->basewid, &n_used) >> SENSCR_SHIFT)
+            score += (ngram_bg_score_r(nbest->lmq, x->link->to->basewid,
+                                       from->basewid, &n_used) >> SENSCR_SHIFT)
                       * nbest->lwf;
         if (score BETTER_THAN bestscore)
             bestscore = score;
@@ -1676,15 +1682,15 @@ path_extend(ps_astar_t *nbest, ps_latpath_t * path)
         if (nbest->lmset) {
             if (path->parent) {
                 newpath->score += nbest->lwf
-                    * (ngram_tg_score(nbest->lmset, newpath->node->basewid,
-                                      path->node->basewid,
-                                      path->parent->node->basewid, &n_used)
+                    * (ngram_tg_score_r(nbest->lmq, newpath->node->basewid,
+                                        path->node->basewid,
+                                        path->parent->node->basewid, &n_used)
                        >> SENSCR_SHIFT);
             }
             else 
                 newpath->score += nbest->lwf
-                    * (ngram_bg_score(nbest->lmset, newpath->node->basewid,
-                                      path->node->basewid, &n_used)
+                    * (ngram_bg_score_r(nbest->lmq, newpath->node->basewid,
+                                        path->node->basewid, &n_used)
                        >> SENSCR_SHIFT);
         }
 
@@ -1721,6 +1727,7 @@ ps_astar_start(ps_lattice_t *dag,
     nbest = ckd_calloc(1, sizeof(*nbest));
     nbest->dag = dag;
     nbest->lmset = lmset;
+    nbest->lmq = lmset ? ngram_query_init(lmset) : NULL;
     nbest->lwf = lwf;
     nbest->sf = sf;
     if (ef < 0)
@@ -1755,8 +1762,8 @@ ps_astar_start(ps_lattice_t *dag,
             if (nbest->lmset)
                 path->score = nbest->lwf *
                     ((w1 < 0)
-                    ? ngram_bg_score(nbest->lmset, node->basewid, w2, &n_used)
-                    : ngram_tg_score(nbest->lmset, node->basewid, w2, w1, &n_used));
+                    ? ngram_bg_score_r(nbest->lmq, node->basewid, w2, &n_used)
+                    : ngram_tg_score_r(nbest->lmq, node->basewid, w2, w1, &n_used));
             else
                 path->score = 0;
             path->score >>= SENSCR_SHIFT;
@@ -1933,6 +1940,7 @@ ps_astar_finish(ps_astar_t *nbest)
     glist_free(nbest->hyps);
     /* Free all paths. */
     listelem_alloc_free(nbest->latpath_alloc);
+    ngram_query_free(nbest->lmq);
     /* Free the Henge. */
     ckd_free(nbest);
 }
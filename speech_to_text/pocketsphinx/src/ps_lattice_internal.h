@@ -163,6 +163,7 @@ typedef struct ps_latpath_s {
 typedef struct ps_astar_s {
     ps_lattice_t *dag;
     ngram_model_t *lmset;
+    ngram_query_t *lmq;    /**< Query state for lmset, private to this search */
     float32 lwf;
 
     frame_idx_t sf;
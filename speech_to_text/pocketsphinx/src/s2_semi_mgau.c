@@ -1301,8 +1301,10 @@ s2_semi_mgau_init(acmod_t *acmod)
     }
     E_INFOCONT("\n");
 
-    /* Top-N scores from recent frames */
-    s->n_topn_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2;
+    /* Top-N scores from recent frames, including the -lookback ones
+     * which can be scored again */
+    s->n_topn_hist = cmd_ln_int32_r(s->config, "-pl_window") + 2
+        + cmd_ln_int32_r(s->config, "-lookback");
     s->topn_hist = (vqFeature_t ***)
         ckd_calloc_3d(s->n_topn_hist, n_feat, s->max_topn,
                       sizeof(***s->topn_hist));
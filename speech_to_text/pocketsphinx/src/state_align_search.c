@@ -174,7 +174,11 @@ state_align_search_step(ps_search_t *search, int frame_idx)
     /* Calculate senone scores. */
     for (i = 0; i < sas->n_phones; ++i)
         acmod_activate_hmm(acmod, sas->hmms + i);
-    senscr = acmod_score(acmod, &frame_idx);
+    if ((senscr = acmod_score(acmod, &frame_idx)) == NULL)
+        return -1;
+
+    /* Tokens and HMMs count frames from the first one aligned. */
+    frame_idx -= sas->start_frame;
 
     /* Renormalize here if needed. */
     /* FIXME: Make sure to (unit-)test this!!! */
@@ -242,6 +246,7 @@ state_align_search_finish(ps_search_t *search)
     ent = ps_alignment_iter_get(itor);
     ent->start = 0;
     ent->duration = last_frame;
+    ent->score = last.score;
     E_DEBUG(1,("state %d start %d end %d\n", 0,
                ent->start, last_frame));
     ps_alignment_iter_free(itor);
@@ -271,6 +276,7 @@ state_align_search_free(ps_search_t *search)
 static ps_searchfuncs_t state_align_search_funcs = {
     /* start: */  state_align_search_start,
     /* step: */   state_align_search_step,
+    /* sen_active: */ NULL,
     /* finish: */ state_align_search_finish,
     /* reinit: */ state_align_search_reinit,
     /* free: */   state_align_search_free,
@@ -280,6 +286,13 @@ static ps_searchfuncs_t state_align_search_funcs = {
     /* seg_iter: */ NULL,
 };
 
+void
+state_align_search_set_start(ps_search_t *search, int frame_idx)
+{
+    state_align_search_t *sas = (state_align_search_t *)search;
+    sas->start_frame = frame_idx;
+}
+
 ps_search_t *
 state_align_search_init(const char *name,
                         cmd_ln_t *config,
@@ -71,6 +71,7 @@ struct state_align_search_s {
     int n_phones;	    /**< Number of HMMs (phones). */
 
     int frame;              /**< Current frame being processed. */
+    int start_frame;        /**< First frame aligned, alignment frames count from it. */
     int32 best_score;       /**< Best score in current frame. */
 
     int n_emit_state;       /**< Number of emitting states (tokens per frame) */
@@ -84,4 +85,12 @@ ps_search_t *state_align_search_init(const char *name,
                                      acmod_t *acmod,
                                      ps_alignment_t *al);
 
+/**
+ * Align the frames from @a frame_idx on, instead of the whole utterance.
+ *
+ * Frames before it are not searched, and frames of the alignment are
+ * counted from it.  Must be called before the search is started.
+ */
+void state_align_search_set_start(ps_search_t *search, int frame_idx);
+
 #endif /* __STATE_ALIGN_SEARCH_H__ */
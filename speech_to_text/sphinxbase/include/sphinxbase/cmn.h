@@ -131,6 +131,8 @@ typedef struct {
     mfcc_t *sum;        /**< The sum of the cmn frames */
     int32 nframe;	/**< Number of frames */
     int32 veclen;	/**< Length of cepstral vector */
+    int32 decay_win;	/**< Live CMN exponential decay window in frames,
+                           or 0 for the classic update between utterances */
 } cmn_t;
 
 SPHINXBASE_EXPORT
@@ -162,6 +164,15 @@ void cmn_live(cmn_t *cmn,        /**< In/Out: cmn normalization, which contains
 	       int32 nfr         /**< Number of incoming frames */
     );
 
+/**
+ * Switch live CMN to an exponentially decaying mean, updated in constant time
+ * for every incoming frame, over roughly the last \a win frames.  A window of
+ * 0 restores the classic behaviour, where the mean is only recomputed from
+ * the accumulated sums by cmn_live_update().
+ */
+SPHINXBASE_EXPORT
+void cmn_live_set_decay(cmn_t *cmn, int32 win);
+
 /**
  * Update live mean based on observed data
  */
@@ -180,6 +191,24 @@ void cmn_live_set(cmn_t *cmn, mfcc_t const *vec);
 SPHINXBASE_EXPORT
 void cmn_live_get(cmn_t *cmn, mfcc_t *vec);
 
+/**
+ * Save the whole live CMN state, so that it can be restored later with
+ * cmn_live_restore() instead of converging again from the initial mean.
+ *
+ * @param mean Output: current mean, veclen values.
+ * @param sum Output: accumulated sums, veclen values.
+ * @return Number of frames the sums were accumulated over.
+ */
+SPHINXBASE_EXPORT
+int32 cmn_live_snapshot(cmn_t *cmn, mfcc_t *mean, mfcc_t *sum);
+
+/**
+ * Restore a live CMN state saved with cmn_live_snapshot().
+ */
+SPHINXBASE_EXPORT
+void cmn_live_restore(cmn_t *cmn, mfcc_t const *mean, mfcc_t const *sum,
+                      int32 nframe);
+
 /* RAH, free previously allocated memory */
 SPHINXBASE_EXPORT
 void cmn_free (cmn_t *cmn);
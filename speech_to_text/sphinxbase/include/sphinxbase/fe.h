@@ -401,6 +401,26 @@ void fe_get_input_size(fe_t *fe, int *out_frame_shift,
 SPHINXBASE_EXPORT
 uint8 fe_get_vad_state(fe_t *fe);
 
+/**
+ * Save the noise and signal floor estimates learned so far, so that a later
+ * session can start from them instead of learning them again.
+ *
+ * @param fe Front-end object.
+ * @param out_state Output: saved values, or NULL to only query their number.
+ * @return Number of values in the state, or 0 if there is no noise tracking
+ *         or nothing was learned yet.
+ */
+SPHINXBASE_EXPORT
+int32 fe_get_noise_state(fe_t *fe, float64 *out_state);
+
+/**
+ * Restore noise and signal floor estimates saved with fe_get_noise_state().
+ *
+ * @return 0 for success, <0 if the state doesn't match this front-end.
+ */
+SPHINXBASE_EXPORT
+int fe_set_noise_state(fe_t *fe, float64 const *state, int32 n_state);
+
 /**
  * Finish processing an utterance.
  *
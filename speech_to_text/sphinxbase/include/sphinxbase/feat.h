@@ -82,6 +82,10 @@ extern "C" {
       ARG_STRING,                                                       \
       "40,3,-1",                                                        \
       "Initial values (comma-separated) for cepstral mean when 'live' is used" }, \
+{ "-cmnwin",                                                            \
+      ARG_INT32,                                                        \
+      "0",                                                              \
+      "Window (frames) of a per-frame, exponentially decaying live CMN (0 to update between utterances)" }, \
 { "-varnorm",                                                           \
       ARG_BOOLEAN,                                                      \
       "no",                                                             \
@@ -146,6 +150,13 @@ typedef struct feat_s {
      * speech input must be feature vector itself.
      **/
     void (*compute_feat)(struct feat_s *fcb, mfcc_t **input, mfcc_t **feat);
+    /**
+     * Computes \a nfr consecutive feature vectors at once: feat[k] is computed
+     * from input[k-window_size..k+window_size].  Feature types with
+     * dynamic coefficients share work between neighbouring frames here.
+     **/
+    void (*compute_feat_block)(struct feat_s *fcb, mfcc_t **input, int32 nfr,
+                               mfcc_t ***feat);
     cmn_t *cmn_struct;	/**< Structure that stores the temporary variables for cepstral 
                            means normalization*/
     agc_t *agc_struct;	/**< Structure that stores the temporary variables for acoustic
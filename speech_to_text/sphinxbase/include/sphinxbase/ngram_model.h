@@ -70,6 +70,17 @@ typedef struct ngram_model_s ngram_model_t;
  */
 typedef struct ngram_class_s ngram_class_t;
 
+/**
+ * Abstract type representing the state of one caller's queries to an
+ * N-Gram model.
+ *
+ * Scoring caches the backoff weights of the last history, and the
+ * functions that take no query state keep this cache in the model
+ * itself.  To score one model from several threads, give each thread
+ * its own query state and use the _r functions.
+ */
+typedef struct ngram_query_s ngram_query_t;
+
 /**
  * File types for N-Gram files
  */
@@ -214,9 +225,8 @@ float32 ngram_model_get_weights(ngram_model_t *model, int32 *out_log_wip);
  *
  * This is not the function to use in decoding, because it has some
  * overhead for looking up words.  Use ngram_ng_score(),
- * ngram_tg_score(), or ngram_bg_score() instead.  In the future there
- * will probably be a version that takes a general language model
- * state object, to support suffix-array LM and things like that.
+ * ngram_tg_score(), or ngram_bg_score() instead, or their _r
+ * versions which take a query state.
  *
  * If one of the words is not in the LM's vocabulary, the result will
  * depend on whether this is an open or closed vocabulary language
@@ -257,6 +267,76 @@ SPHINXBASE_EXPORT
 int32 ngram_ng_score(ngram_model_t *model, int32 wid, int32 *history,
                      int32 n_hist, int32 *n_used);
 
+/**
+ * Create a query state for a model.
+ *
+ * The query state retains a reference to the model.  Any number of
+ * threads may score the same model at once, each through its own
+ * query state, as long as none of them modifies the model.
+ */
+SPHINXBASE_EXPORT
+ngram_query_t *ngram_query_init(ngram_model_t *model);
+
+/**
+ * Release a query state and its reference to the model.
+ *
+ * @return new reference count of the model (0 if it was freed)
+ */
+SPHINXBASE_EXPORT
+int ngram_query_free(ngram_query_t *query);
+
+/**
+ * Flush any cached N-Gram information in a query state.
+ */
+SPHINXBASE_EXPORT
+void ngram_query_flush(ngram_query_t *query);
+
+/**
+ * Quick general N-Gram score lookup through a query state.
+ */
+SPHINXBASE_EXPORT
+int32 ngram_ng_score_r(ngram_query_t *query, int32 wid, int32 *history,
+                       int32 n_hist, int32 *n_used);
+
+/**
+ * Score several words given the same history.
+ *
+ * This is faster than calling ngram_ng_score() for each word, since
+ * the work which depends only on the history is done once.
+ *
+ * @param wids Words to score.
+ * @param n_wids Number of words in wids.
+ * @param history History of all the words, as for ngram_ng_score().
+ * @param n_hist Number of words in history.
+ * @param out_scores Output: score of each word, as from ngram_ng_score().
+ */
+SPHINXBASE_EXPORT
+void ngram_ng_scores(ngram_model_t *model, const int32 *wids, int32 n_wids,
+                     int32 *history, int32 n_hist, int32 *out_scores);
+
+/**
+ * Score several words given the same history, through a query state.
+ */
+SPHINXBASE_EXPORT
+void ngram_ng_scores_r(ngram_query_t *query, const int32 *wids, int32 n_wids,
+                       int32 *history, int32 n_hist, int32 *out_scores);
+
+/**
+ * Quick trigram score lookup through a query state.
+ */
+SPHINXBASE_EXPORT
+int32 ngram_tg_score_r(ngram_query_t *query,
+                       int32 w3, int32 w2, int32 w1,
+                       int32 *n_used);
+
+/**
+ * Quick bigram score lookup through a query state.
+ */
+SPHINXBASE_EXPORT
+int32 ngram_bg_score_r(ngram_query_t *query,
+                       int32 w2, int32 w1,
+                       int32 *n_used);
+
 /**
  * Get the "raw" log-probability for a general N-Gram.
  *
@@ -293,6 +373,14 @@ SPHINXBASE_EXPORT
 int32 ngram_ng_prob(ngram_model_t *model, int32 wid, int32 *history,
                     int32 n_hist, int32 *n_used);
 
+/**
+ * Quick "raw" probability lookup for a general N-Gram through a query
+ * state.
+ */
+SPHINXBASE_EXPORT
+int32 ngram_ng_prob_r(ngram_query_t *query, int32 wid, int32 *history,
+                      int32 n_hist, int32 *n_used);
+
 /**
  * Convert score to "raw" log-probability.
  *
@@ -626,6 +714,16 @@ ngram_model_t *ngram_model_set_interp(ngram_model_t *set,
                                       const char **names,
                                       const float32 *weights);
 
+/**
+ * Get the generation of the interpolation weights of a set.
+ *
+ * This changes every time the weights do (ngram_model_set_interp(),
+ * ngram_model_set_add() and ngram_model_set_remove()), so that
+ * interpolated scores cached outside the set can be flushed.
+ */
+SPHINXBASE_EXPORT
+int32 ngram_model_set_weights_generation(ngram_model_t *set);
+
 /**
  * Add a language model to a set.
  *
@@ -637,6 +735,9 @@ ngram_model_t *ngram_model_set_interp(ngram_model_t *set,
  * @param reuse_widmap Reuse the existing word-ID mapping in
  * <code>set</code>.  Any new words present in <code>model</code>
  * will not be added to the word-ID mapping in this case.
+ *
+ * Query states of the set other than its own must then be updated
+ * with ngram_model_set_query_update().
  */
 SPHINXBASE_EXPORT
 ngram_model_t *ngram_model_set_add(ngram_model_t *set,
@@ -652,12 +753,28 @@ ngram_model_t *ngram_model_set_add(ngram_model_t *set,
  * @param name The name associated with the model to remove.
  * @param reuse_widmap Reuse the existing word-ID mapping in
  *                     <code>set</code>.
+ *
+ * Query states of the set other than its own must then be updated
+ * with ngram_model_set_query_update().
  */
 SPHINXBASE_EXPORT
 ngram_model_t *ngram_model_set_remove(ngram_model_t *set,
                                       const char *name,
                                       int reuse_widmap);
 
+/**
+ * Bring a query state of a set up to date with its submodels.
+ *
+ * A query state of a set holds one for each submodel, all created
+ * along with it, so that scoring through it never changes the
+ * reference counts of the submodels, which other threads may share.
+ * After ngram_model_set_add() or ngram_model_set_remove(), the query
+ * states created with ngram_query_init() must be updated with this
+ * before they are used again, and it releases the removed submodel.
+ */
+SPHINXBASE_EXPORT
+void ngram_model_set_query_update(ngram_query_t *query);
+
 /**
  * Set the word-to-ID mapping for this model set.
  */
@@ -690,7 +807,7 @@ SPHINXBASE_EXPORT
 int32 ngram_model_set_known_wid(ngram_model_t *set, int32 set_wid);
 
 /**
- * Flush any cached N-Gram information
+ * Flush any cached N-Gram information in the model's own query state.
  */
 SPHINXBASE_EXPORT
 void ngram_model_flush(ngram_model_t *lm);
@@ -282,7 +282,9 @@ fe_init_auto_r(cmd_ln_t *config)
         fe->noise_stats = fe_init_noisestats(fe->mel_fb->num_filters);
 
     fe->vad_data = (vad_data_t*)ckd_calloc(1, sizeof(*fe->vad_data));
-    prespch_frame_len = fe->log_spec != RAW_LOG_SPEC ? fe->num_cepstra : fe->mel_fb->num_filters;
+    /* Frames are computed in place in this buffer, so it must hold a whole
+     * output frame (num_filters for both raw and smoothed log spectra). */
+    prespch_frame_len = fe->feature_dimension;
     fe->vad_data->prespch_buf = fe_prespch_init(fe->pre_speech + 1, prespch_frame_len, fe->frame_shift);
 
     /* Create temporary FFT, spectrum and mel-spectrum buffers. */
@@ -373,6 +375,18 @@ fe_get_vad_state(fe_t *fe)
     return fe->vad_data->in_speech;
 }
 
+int32
+fe_get_noise_state(fe_t *fe, float64 *out_state)
+{
+    return fe_save_noisestats(fe->noise_stats, out_state);
+}
+
+int
+fe_set_noise_state(fe_t *fe, float64 const *state, int32 n_state)
+{
+    return fe_load_noisestats(fe->noise_stats, state, n_state);
+}
+
 int
 fe_process_frames(fe_t *fe,
                   int16 const **inout_spch,
@@ -610,10 +624,16 @@ fe_end_utt(fe_t * fe, mfcc_t * cepvector, int32 * nframes)
     /* Process any remaining data, not very accurate for the VAD */
     *nframes = 0;
     if (fe->num_overflow_samps > 0) {
+        mfcc_t *feat;
+
         fe_read_frame(fe, fe->overflow_samps, fe->num_overflow_samps);
-        fe_write_frame(fe, cepvector, FALSE);
-        if (fe->vad_data->in_speech)
+        feat = fe_write_frame(fe, cepvector, FALSE);
+        if (fe->vad_data->in_speech) {
+            /* This frame started speech, so it went to the prespeech buffer */
+            if (feat != cepvector)
+                memcpy(cepvector, feat, fe->feature_dimension * sizeof(*cepvector));
             *nframes = 1;
+        }
     }
 
     /* reset overflow buffers... */
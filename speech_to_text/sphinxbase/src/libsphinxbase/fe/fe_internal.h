@@ -181,7 +181,9 @@ int fe_read_frame(fe_t *fe, int16 const *in, int32 len);
 int fe_shift_frame(fe_t *fe, int16 const *in, int32 len);
 
 /* Process a frame of data into features. */
-void fe_write_frame(fe_t *fe, mfcc_t *feat, int32 store_pcm);
+/* Returns where the frame was actually stored: feat, or a slot of the
+ * prespeech buffer if the VAD was not in speech */
+mfcc_t *fe_write_frame(fe_t *fe, mfcc_t *feat, int32 store_pcm);
 
 /* Initialization functions. */
 int32 fe_build_melfilters(melfb_t *MEL_FB);
@@ -301,6 +301,49 @@ fe_reset_noisestats(noise_stats_t * noise_stats)
         noise_stats->undefined = TRUE;
 }
 
+int32
+fe_save_noisestats(noise_stats_t * noise_stats, float64 * state)
+{
+    uint32 i, n;
+
+    if (noise_stats == NULL || noise_stats->undefined)
+        return 0;
+
+    n = noise_stats->num_filters;
+    if (state) {
+        for (i = 0; i < n; i++) {
+            state[i] = noise_stats->power[i];
+            state[n + i] = noise_stats->noise[i];
+            state[2 * n + i] = noise_stats->floor[i];
+            state[3 * n + i] = noise_stats->peak[i];
+        }
+        state[4 * n] = noise_stats->slow_peak_sum;
+    }
+    return 4 * n + 1;
+}
+
+int
+fe_load_noisestats(noise_stats_t * noise_stats, float64 const *state,
+                   int32 n_state)
+{
+    uint32 i, n;
+
+    if (noise_stats == NULL
+        || n_state != (int32)(4 * noise_stats->num_filters + 1))
+        return -1;
+
+    n = noise_stats->num_filters;
+    for (i = 0; i < n; i++) {
+        noise_stats->power[i] = (powspec_t) state[i];
+        noise_stats->noise[i] = (powspec_t) state[n + i];
+        noise_stats->floor[i] = (powspec_t) state[2 * n + i];
+        noise_stats->peak[i] = (powspec_t) state[3 * n + i];
+    }
+    noise_stats->slow_peak_sum = (powspec_t) state[4 * n];
+    noise_stats->undefined = FALSE;
+    return 0;
+}
+
 void
 fe_free_noisestats(noise_stats_t * noise_stats)
 {
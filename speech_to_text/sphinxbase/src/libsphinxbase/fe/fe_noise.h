@@ -49,6 +49,13 @@ noise_stats_t *fe_init_noisestats(int num_filters);
 /* Resets collected noise statistics */
 void fe_reset_noisestats(noise_stats_t * noise_stats);
 
+/* Saves collected noise statistics, returns number of values (0 if none) */
+int32 fe_save_noisestats(noise_stats_t * noise_stats, float64 * state);
+
+/* Restores noise statistics saved with fe_save_noisestats */
+int fe_load_noisestats(noise_stats_t * noise_stats, float64 const *state,
+                       int32 n_state);
+
 /* Frees allocated data */
 void fe_free_noisestats(noise_stats_t * noise_stats);
 
@@ -49,12 +49,12 @@
 #include "fe_prespch_buf.h"
 
 struct prespch_buf_s {
-    /* saved mfcc frames */
-    mfcc_t **cep_buf;
-    /* saved pcm audio */
+    /* saved mfcc frames, one contiguous ring of num_frames_cep rows */
+    mfcc_t *cep_buf;
+    /* saved pcm audio, allocated on first write */
     int16 *pcm_buf;
 
-    /* flag for pcm buffer initialization */
+    /* write pointer for cep buffer */
     int16 cep_write_ptr;
     /* read pointer for cep buffer */
     int16 cep_read_ptr;
@@ -62,9 +62,9 @@ struct prespch_buf_s {
     int16 ncep;
     
 
-    /* flag for pcm buffer initialization */
+    /* write pointer for pcm buffer */
     int16 pcm_write_ptr;
-    /* read pointer for cep buffer */
+    /* read pointer for pcm buffer */
     int16 pcm_read_ptr;
     /* Count */
     int16 npcm;
@@ -89,7 +89,7 @@ fe_prespch_init(int num_frames, int num_cepstra, int num_samples)
     prespch_buf->num_cepstra = num_cepstra;
     prespch_buf->num_frames_cep = num_frames;
     prespch_buf->num_samples = num_samples;
-    prespch_buf->num_frames_pcm = 0;
+    prespch_buf->num_frames_pcm = num_frames;
 
     prespch_buf->cep_write_ptr = 0;
     prespch_buf->cep_read_ptr = 0;
@@ -99,13 +99,12 @@ fe_prespch_init(int num_frames, int num_cepstra, int num_samples)
     prespch_buf->pcm_read_ptr = 0;
     prespch_buf->npcm = 0;
 
-    prespch_buf->cep_buf = (mfcc_t **)
-        ckd_calloc_2d(num_frames, num_cepstra,
-                      sizeof(**prespch_buf->cep_buf));
+    prespch_buf->cep_buf = (mfcc_t *)
+        ckd_calloc(num_frames * num_cepstra, sizeof(*prespch_buf->cep_buf));
 
-    prespch_buf->pcm_buf = (int16 *)
-        ckd_calloc(prespch_buf->num_frames_pcm * prespch_buf->num_samples,
-                   sizeof(int16));
+    /* Only needed when voiced audio is requested, which is rare, so
+     * don't pay for it with long -vad_prespeech values until then. */
+    prespch_buf->pcm_buf = NULL;
 
     return prespch_buf;
 }
@@ -116,18 +115,27 @@ fe_prespch_read_cep(prespch_buf_t * prespch_buf, mfcc_t * feat)
 {
     if (prespch_buf->ncep == 0)
         return 0;
-    memcpy(feat, prespch_buf->cep_buf[prespch_buf->cep_read_ptr],
+    memcpy(feat, prespch_buf->cep_buf + prespch_buf->cep_read_ptr * prespch_buf->num_cepstra,
            sizeof(mfcc_t) * prespch_buf->num_cepstra);
     prespch_buf->cep_read_ptr = (prespch_buf->cep_read_ptr + 1) % prespch_buf->num_frames_cep;
     prespch_buf->ncep--;
     return 1;
 }
 
+mfcc_t *
+fe_prespch_next_cep(prespch_buf_t * prespch_buf)
+{
+    return prespch_buf->cep_buf + prespch_buf->cep_write_ptr * prespch_buf->num_cepstra;
+}
+
 void
 fe_prespch_write_cep(prespch_buf_t * prespch_buf, mfcc_t * feat)
 {
-    memcpy(prespch_buf->cep_buf[prespch_buf->cep_write_ptr], feat,
-           sizeof(mfcc_t) * prespch_buf->num_cepstra);
+    mfcc_t *slot = fe_prespch_next_cep(prespch_buf);
+
+    /* Frames computed in place (see fe_prespch_next_cep) need no copy */
+    if (feat != slot)
+        memcpy(slot, feat, sizeof(mfcc_t) * prespch_buf->num_cepstra);
     prespch_buf->cep_write_ptr = (prespch_buf->cep_write_ptr + 1) % prespch_buf->num_frames_cep;
     if (prespch_buf->ncep < prespch_buf->num_frames_cep) {
         prespch_buf->ncep++;	
@@ -159,6 +167,11 @@ fe_prespch_write_pcm(prespch_buf_t * prespch_buf, int16 * samples)
 {
     int32 sample_ptr;
 
+    if (prespch_buf->pcm_buf == NULL)
+        prespch_buf->pcm_buf = (int16 *)
+            ckd_calloc(prespch_buf->num_frames_pcm * prespch_buf->num_samples,
+                       sizeof(int16));
+
     sample_ptr = prespch_buf->pcm_write_ptr * prespch_buf->num_samples;
     memcpy(&prespch_buf->pcm_buf[sample_ptr], samples,
            prespch_buf->num_samples * sizeof(int16));
@@ -193,7 +206,7 @@ fe_prespch_free(prespch_buf_t * prespch_buf)
     if (!prespch_buf)
 	return;
     if (prespch_buf->cep_buf)
-        ckd_free_2d((void **) prespch_buf->cep_buf);
+        ckd_free(prespch_buf->cep_buf);
     if (prespch_buf->pcm_buf)
         ckd_free(prespch_buf->pcm_buf);
     ckd_free(prespch_buf);
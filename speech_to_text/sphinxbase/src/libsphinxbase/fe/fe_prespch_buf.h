@@ -51,6 +51,10 @@ prespch_buf_t *fe_prespch_init(int num_frames, int num_cepstra,
 /* Reads mfcc frame from prespeech buffer */
 int fe_prespch_read_cep(prespch_buf_t * prespch_buf, mfcc_t * fea);
 
+/* Returns the slot the next written mfcc frame will occupy, so that it can be
+ * computed in place and written without a copy */
+mfcc_t *fe_prespch_next_cep(prespch_buf_t * prespch_buf);
+
 /* Writes mfcc frame to prespeech buffer */
 void fe_prespch_write_cep(prespch_buf_t * prespch_buf, mfcc_t * fea);
 
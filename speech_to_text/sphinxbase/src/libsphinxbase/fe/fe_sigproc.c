@@ -1179,17 +1179,24 @@ fe_dct3(fe_t * fe, const mfcc_t * mfcep, powspec_t * mflogspec)
     }
 }
 
-void
+mfcc_t *
 fe_write_frame(fe_t * fe, mfcc_t * feat, int32 store_pcm)
 {
     int32 is_speech;
 
+    /* Outside of speech the frame ends up in the prespeech buffer, so
+     * compute it there directly instead of copying it afterwards. */
+    if (!fe->vad_data->in_speech)
+        feat = fe_prespch_next_cep(fe->vad_data->prespch_buf);
+
     fe_spec_magnitude(fe);
     fe_mel_spec(fe);
     fe_track_snr(fe, &is_speech);
     fe_mel_cep(fe, feat);
     fe_lifter(fe, feat);
     fe_vad_hangover(fe, feat, is_speech, store_pcm);
+
+    return feat;
 }
 
 
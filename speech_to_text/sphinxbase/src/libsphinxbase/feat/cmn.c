@@ -91,6 +91,7 @@ cmn_init(int32 veclen)
     cmn->cmn_var = (mfcc_t *) ckd_calloc(veclen, sizeof(mfcc_t));
     cmn->sum = (mfcc_t *) ckd_calloc(veclen, sizeof(mfcc_t));
     cmn->nframe = 0;
+    cmn->decay_win = 0;
 
     return cmn;
 }
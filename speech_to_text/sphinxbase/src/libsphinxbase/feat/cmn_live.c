@@ -43,6 +43,8 @@
 #pragma warning (disable: 4244)
 #endif
 
+#include <string.h>
+
 #include "sphinxbase/ckd_alloc.h"
 #include "sphinxbase/err.h"
 #include "sphinxbase/cmn.h"
@@ -62,6 +64,8 @@ cmn_live_set(cmn_t *cmn, mfcc_t const * vec)
         cmn->sum[i] = vec[i] * CMN_WIN;
     }
     cmn->nframe = CMN_WIN;
+    if (cmn->decay_win > 0 && cmn->nframe > cmn->decay_win)
+        cmn->nframe = cmn->decay_win;
 
     E_INFO("Update to   < ");
     for (i = 0; i < cmn->veclen; i++)
@@ -79,6 +83,42 @@ cmn_live_get(cmn_t *cmn, mfcc_t * vec)
 
 }
 
+void
+cmn_live_set_decay(cmn_t *cmn, int32 win)
+{
+    int32 i;
+
+    cmn->decay_win = win > 0 ? win : 0;
+    if (cmn->decay_win == 0
+        || (cmn->nframe > 0 && cmn->nframe <= cmn->decay_win))
+        return;
+
+    /* Keep the current mean (e.g. from -cmninit), as if it had been seen
+     * over a full window, rather than replacing it with the first frame */
+    cmn->nframe = cmn->decay_win;
+    for (i = 0; i < cmn->veclen; i++)
+        cmn->sum[i] = cmn->cmn_mean[i] * cmn->nframe;
+}
+
+int32
+cmn_live_snapshot(cmn_t *cmn, mfcc_t *mean, mfcc_t *sum)
+{
+    memcpy(mean, cmn->cmn_mean, cmn->veclen * sizeof(*mean));
+    memcpy(sum, cmn->sum, cmn->veclen * sizeof(*sum));
+    return cmn->nframe;
+}
+
+void
+cmn_live_restore(cmn_t *cmn, mfcc_t const *mean, mfcc_t const *sum,
+                 int32 nframe)
+{
+    memcpy(cmn->cmn_mean, mean, cmn->veclen * sizeof(*mean));
+    memcpy(cmn->sum, sum, cmn->veclen * sizeof(*sum));
+    cmn->nframe = nframe;
+    if (cmn->decay_win > 0 && cmn->nframe > cmn->decay_win)
+        cmn_live_set_decay(cmn, cmn->decay_win);
+}
+
 static void
 cmn_live_shiftwin(cmn_t *cmn)
 {
@@ -114,7 +154,8 @@ cmn_live_update(cmn_t *cmn)
     mfcc_t sf;
     int32 i;
 
-    if (cmn->nframe <= 0)
+    /* The decaying mean is already up to date */
+    if (cmn->nframe <= 0 || cmn->decay_win > 0)
         return;
 
     E_INFO("Update from < ");
@@ -141,6 +182,45 @@ cmn_live_update(cmn_t *cmn)
     E_INFOCONT(">\n");
 }
 
+/*
+ * Exponentially decaying mean, updated for every frame.  Once the window is
+ * full, the gain is the constant 1/decay_win, so each frame costs one
+ * subtraction and one multiply-add per coefficient, with no division and no
+ * periodic rescaling of the sums.
+ */
+static void
+cmn_live_decay(cmn_t *cmn, mfcc_t **incep, int32 nfr)
+{
+    mfcc_t *mean = cmn->cmn_mean;
+    mfcc_t *sum = cmn->sum;
+    mfcc_t sf, d;
+    int32 i, j;
+
+    sf = FLOAT2MFCC(1.0) / cmn->decay_win;
+    for (i = 0; i < nfr; i++) {
+        mfcc_t *cep = incep[i];
+
+	/* Skip zero energy frames */
+	if (cep[0] < 0)
+	    continue;
+
+        if (cmn->nframe < cmn->decay_win) {
+            ++cmn->nframe;
+            sf = FLOAT2MFCC(1.0) / cmn->nframe;
+        }
+
+        for (j = 0; j < cmn->veclen; j++) {
+            d = cep[j] - mean[j];
+            cep[j] = d;
+            mean[j] += MFCCMUL(d, sf);
+        }
+    }
+
+    /* Keep the sums consistent for cmn_live_snapshot() and mode switches */
+    for (j = 0; j < cmn->veclen; j++)
+        sum[j] = mean[j] * cmn->nframe;
+}
+
 void
 cmn_live(cmn_t *cmn, mfcc_t **incep, int32 varnorm, int32 nfr)
 {
@@ -153,6 +233,11 @@ cmn_live(cmn_t *cmn, mfcc_t **incep, int32 varnorm, int32 nfr)
         E_FATAL
             ("Variance normalization not implemented in live mode decode\n");
 
+    if (cmn->decay_win > 0) {
+        cmn_live_decay(cmn, incep, nfr);
+        return;
+    }
+
     for (i = 0; i < nfr; i++) {
 
 	/* Skip zero energy frames */
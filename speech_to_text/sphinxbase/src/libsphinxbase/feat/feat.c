@@ -537,6 +537,55 @@ feat_s3_1x39_cep2feat(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
     }
 }
 
+/*
+ * Block version of feat_s3_1x39_cep2feat(), for nfr consecutive frames.  The
+ * second order difference (mfc[3] - mfc[-1]) - (mfc[1] - mfc[-3]) is the
+ * difference between the first order ones of the next and previous frames, so
+ * all DCEP values are computed first and reused for D2CEP.
+ */
+static void
+feat_s3_1x39_cep2feat_block(feat_t * fcb, mfcc_t ** mfc, int32 nfr,
+                            mfcc_t *** feat)
+{
+    mfcc_t *f, *d1, *d_1;
+    mfcc_t const *w, *_w;
+    int32 i, k;
+
+    assert(fcb);
+    assert(feat_cepsize(fcb) == 13);
+    assert(feat_n_stream(fcb) == 1);
+    assert(feat_stream_len(fcb, 0) == 39);
+    assert(feat_window_size(fcb) == 3);
+
+    /* CEP (skipping C0), DCEP, C0 and DC0 */
+    for (k = 0; k < nfr; k++) {
+        f = feat[k][0];
+        w = mfc[k + 2];
+        _w = mfc[k - 2];
+
+        memcpy(f, mfc[k] + 1, 12 * sizeof(mfcc_t));
+        for (i = 1; i < 13; i++)
+            f[11 + i] = w[i] - _w[i];
+        f[24] = mfc[k][0];
+        f[25] = w[0] - _w[0];
+    }
+
+    /* D2C0 and D2CEP; edge frames lack a neighbour in the block */
+    for (k = 0; k < nfr; k++) {
+        if (k == 0 || k == nfr - 1) {
+            feat_s3_1x39_cep2feat(fcb, mfc + k, feat[k]);
+            continue;
+        }
+        f = feat[k][0];
+        d1 = feat[k + 1][0];
+        d_1 = feat[k - 1][0];
+
+        f[26] = d1[25] - d_1[25];
+        for (i = 27; i < 39; i++)
+            f[i] = d1[i - 15] - d_1[i - 15];
+    }
+}
+
 
 static void
 feat_s3_cep(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
@@ -621,6 +670,54 @@ feat_1s_c_d_dd_cep2feat(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
     }
 }
 
+/*
+ * Block version of feat_1s_c_d_dd_cep2feat(), for nfr consecutive frames.
+ * D2CEP for frame k equals DCEP[k+1] - DCEP[k-1], so the DCEP of the whole
+ * block is computed first, in plain loops over contiguous coefficients that
+ * the compiler can vectorize, and then reused.
+ */
+static void
+feat_1s_c_d_dd_cep2feat_block(feat_t * fcb, mfcc_t ** mfc, int32 nfr,
+                              mfcc_t *** feat)
+{
+    mfcc_t *f, *d1, *d_1;
+    mfcc_t const *w, *_w;
+    int32 i, k, cepsize;
+
+    assert(fcb);
+    assert(feat_n_stream(fcb) == 1);
+    assert(feat_stream_len(fcb, 0) == feat_cepsize(fcb) * 3);
+    assert(feat_window_size(fcb) == FEAT_DCEP_WIN + 1);
+
+    cepsize = feat_cepsize(fcb);
+
+    /* CEP and DCEP */
+    for (k = 0; k < nfr; k++) {
+        f = feat[k][0];
+        w = mfc[k + FEAT_DCEP_WIN];
+        _w = mfc[k - FEAT_DCEP_WIN];
+
+        memcpy(f, mfc[k], cepsize * sizeof(mfcc_t));
+        f += cepsize;
+        for (i = 0; i < cepsize; i++)
+            f[i] = w[i] - _w[i];
+    }
+
+    /* D2CEP; edge frames lack a neighbour in the block */
+    for (k = 0; k < nfr; k++) {
+        if (k == 0 || k == nfr - 1) {
+            feat_1s_c_d_dd_cep2feat(fcb, mfc + k, feat[k]);
+            continue;
+        }
+        f = feat[k][0] + 2 * cepsize;
+        d1 = feat[k + 1][0] + cepsize;
+        d_1 = feat[k - 1][0] + cepsize;
+
+        for (i = 0; i < cepsize; i++)
+            f[i] = d1[i] - d_1[i];
+    }
+}
+
 static void
 feat_1s_c_d_ld_dd_cep2feat(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
 {
@@ -701,6 +798,18 @@ feat_copy(feat_t * fcb, mfcc_t ** mfc, mfcc_t ** feat)
     }
 }
 
+/*
+ * Block computation for feature types without a specialized version.
+ */
+static void
+feat_cep2feat_block(feat_t * fcb, mfcc_t ** mfc, int32 nfr, mfcc_t *** feat)
+{
+    int32 k;
+
+    for (k = 0; k < nfr; k++)
+        fcb->compute_feat(fcb, mfc + k, feat[k]);
+}
+
 feat_t *
 feat_init(char const *type, cmn_type_t cmn, int32 varnorm,
           agc_type_t agc, int32 breport, int32 cepsize)
@@ -749,6 +858,7 @@ feat_init(char const *type, cmn_type_t cmn, int32 varnorm,
         fcb->out_dim = 39;
         fcb->window_size = 3;
         fcb->compute_feat = feat_s3_1x39_cep2feat;
+        fcb->compute_feat_block = feat_s3_1x39_cep2feat_block;
     }
     else if (strncmp(type, "1s_c_d_dd", 9) == 0) {
         fcb->cepsize = cepsize;
@@ -758,6 +868,7 @@ feat_init(char const *type, cmn_type_t cmn, int32 varnorm,
         fcb->out_dim = cepsize * 3;
         fcb->window_size = FEAT_DCEP_WIN + 1; /* ddcep needs the extra 1 */
         fcb->compute_feat = feat_1s_c_d_dd_cep2feat;
+        fcb->compute_feat_block = feat_1s_c_d_dd_cep2feat_block;
     }
     else if (strncmp(type, "1s_c_d_ld_dd", 12) == 0) {
         fcb->cepsize = cepsize;
@@ -862,6 +973,9 @@ feat_init(char const *type, cmn_type_t cmn, int32 varnorm,
         ckd_free(wd);
     }
 
+    if (fcb->compute_feat_block == NULL)
+        fcb->compute_feat_block = feat_cep2feat_block;
+
     if (cmn != CMN_NONE)
         fcb->cmn_struct = cmn_init(feat_cepsize(fcb));
     fcb->cmn = cmn;
@@ -966,14 +1080,11 @@ feat_agc(feat_t *fcb, mfcc_t **mfc, int32 nfr, int32 beginutt, int32 endutt)
 static void
 feat_compute_utt(feat_t *fcb, mfcc_t **mfc, int32 nfr, int32 win, mfcc_t ***feat)
 {
-    int32 i;
-
     cep_dump_dbg(fcb, mfc, nfr, "Incoming features (after padding)");
 
     /* Create feature vectors */
-    for (i = win; i < nfr - win; i++) {
-        fcb->compute_feat(fcb, mfc + i, feat[i - win]);
-    }
+    if (nfr > win * 2)
+        fcb->compute_feat_block(fcb, mfc + win, nfr - win * 2, feat);
 
     feat_print_dbg(fcb, feat, nfr - win * 2, "After dynamic feature computation");
 
@@ -1309,7 +1420,7 @@ feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
 		     int32 beginutt, int32 endutt, mfcc_t *** ofeat)
 {
     int32 win, cepsize, nbufcep;
-    int32 i, j, nfeatvec;
+    int32 i, j, nfeatvec, nblock;
     int32 zero = 0;
 
     /* Avoid having to check this everywhere. */
@@ -1392,7 +1503,7 @@ feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
     if (nfeatvec <= 0)
         return 0; /* Do nothing. */
 
-    for (i = 0; i < nfeatvec; ++i) {
+    for (i = 0; i < nfeatvec; i += nblock) {
         /* Handle wraparound cases. */
         if (fcb->curpos - win < 0 || fcb->curpos + win >= LIVEBUFBLOCKSIZE) {
             /* Use tmpcepbuf for this case.  Actually, we just need the pointers. */
@@ -1402,12 +1513,18 @@ feat_s2mfc2feat_live(feat_t * fcb, mfcc_t ** uttcep, int32 *inout_ncep,
 		fcb->tmpcepbuf[win + j] = fcb->cepbuf[tmppos];
             }
             fcb->compute_feat(fcb, fcb->tmpcepbuf + win, ofeat[i]);
+            nblock = 1;
         }
         else {
-            fcb->compute_feat(fcb, fcb->cepbuf + fcb->curpos, ofeat[i]);
+            /* All frames up to the end of the buffer can be done at once. */
+            nblock = LIVEBUFBLOCKSIZE - win - fcb->curpos;
+            if (nblock > nfeatvec - i)
+                nblock = nfeatvec - i;
+            fcb->compute_feat_block(fcb, fcb->cepbuf + fcb->curpos, nblock,
+                                    ofeat + i);
         }
 	/* Move the read pointer forward. */
-        ++fcb->curpos;
+        fcb->curpos += nblock;
         fcb->curpos %= LIVEBUFBLOCKSIZE;
     }
 
@@ -43,11 +43,14 @@
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/err.h>
 #include <sphinxbase/priority_queue.h>
+#include <sphinxbase/sbthread.h>
 
 #include "lm_trie.h"
 #include "lm_trie_quant.h"
 
 static void lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order);
+static void lm_trie_ngram_size(lm_trie_t * trie, uint32 * counts, int order);
+static void lm_trie_init_ngram(lm_trie_t * trie, uint32 * counts, int order);
 
 static uint32
 base_size(uint32 entries, uint32 max_vocab, uint8 remaining_bits)
@@ -60,10 +63,156 @@ base_size(uint32 entries, uint32 max_vocab, uint8 remaining_bits)
     return ((1 + entries) * total_bits + 7) / 8 + sizeof(uint64);
 }
 
+/* Round size up to a multiple of 8 bytes, to keep ef_seq_t arrays aligned. */
+#define ef_align(n) (((n) + 7) & ~7U)
+
+#if defined(__GNUC__)
+#define ef_popcount(x) __builtin_popcountll(x)
+#define ef_ctz(x) __builtin_ctzll(x)
+#else
+static int
+ef_popcount(uint64 x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int) ((x * 0x0101010101010101ULL) >> 56);
+}
+
+static int
+ef_ctz(uint64 x)
+{
+    return ef_popcount((x & (~x + 1)) - 1);
+}
+#endif
+
+/* Low bits per value for n values up to max_value, floor(log2(max_value / n)) */
+static uint8
+ef_low_bits(uint32 n, uint32 max_value)
+{
+    uint8 bits = 0;
+    while (((uint64) n << (bits + 1)) <= max_value)
+        bits++;
+    return bits;
+}
+
+static uint32
+ef_high_words(uint32 n, uint32 max_value, uint8 low_bits)
+{
+    /* One bit per value plus one per possible high part, rounded up. */
+    return (n + (max_value >> low_bits) + 64) / 64;
+}
+
+static uint32
+ef_samples(uint32 n)
+{
+    return (n + LM_TRIE_EF_SAMPLE - 1) / LM_TRIE_EF_SAMPLE;
+}
+
+static uint32
+ef_size(uint32 n, uint32 max_value)
+{
+    uint8 low_bits = ef_low_bits(n, max_value);
+    /* +sizeof(uint64) for bitarr_read_int25() as in base_size() */
+    return ef_align(ef_samples(n) * sizeof(uint32))
+        + ef_high_words(n, max_value, low_bits) * sizeof(uint64)
+        + ef_align(((uint64) n * low_bits + 7) / 8 + sizeof(uint64));
+}
+
+static void
+ef_init(ef_seq_t * seq, uint8 * mem, uint32 n, uint32 max_value)
+{
+    seq->low_bits = ef_low_bits(n, max_value);
+    seq->low_mask = (1U << seq->low_bits) - 1U;
+    seq->samples = (uint32 *) mem;
+    mem += ef_align(ef_samples(n) * sizeof(uint32));
+    seq->high = (uint64 *) mem;
+    mem += ef_high_words(n, max_value, seq->low_bits) * sizeof(uint64);
+    seq->low = mem;
+}
+
+/* Sets value i, which must not be less than value i - 1, in zeroed memory. */
+static void
+ef_set(ef_seq_t * seq, uint32 i, uint32 value)
+{
+    uint32 pos = (value >> seq->low_bits) + i;
+
+    if (seq->low_bits > 0) {
+        bitarr_address_t address;
+        address.base = seq->low;
+        address.offset = i * seq->low_bits;
+        bitarr_write_int25(address, seq->low_bits, value & seq->low_mask);
+    }
+    seq->high[pos / 64] |= (uint64) 1 << (pos % 64);
+    if (i % LM_TRIE_EF_SAMPLE == 0)
+        seq->samples[i / LM_TRIE_EF_SAMPLE] = pos;
+}
+
+static uint32
+ef_low(ef_seq_t * seq, uint32 i)
+{
+    bitarr_address_t address;
+
+    if (seq->low_bits == 0)
+        return 0;
+    address.base = seq->low;
+    address.offset = i * seq->low_bits;
+    return bitarr_read_int25(address, seq->low_bits, seq->low_mask);
+}
+
+/* Position in high of the bit set for value i. */
+static uint32
+ef_select(ef_seq_t * seq, uint32 i)
+{
+    uint32 pos = seq->samples[i / LM_TRIE_EF_SAMPLE];
+    uint32 left = i % LM_TRIE_EF_SAMPLE;
+    uint32 word_idx = pos / 64;
+    uint64 word = seq->high[word_idx] & (~(uint64) 0 << (pos % 64));
+    uint32 ones;
+
+    while (left >= (ones = ef_popcount(word))) {
+        left -= ones;
+        word = seq->high[++word_idx];
+    }
+    while (left-- > 0)
+        word &= word - 1;
+    return word_idx * 64 + ef_ctz(word);
+}
+
+/* Position in high of the first bit set after pos. */
+static uint32
+ef_next_one(ef_seq_t * seq, uint32 pos)
+{
+    uint32 word_idx;
+    uint64 word;
+
+    pos++;
+    word_idx = pos / 64;
+    word = seq->high[word_idx] & (~(uint64) 0 << (pos % 64));
+    while (word == 0)
+        word = seq->high[++word_idx];
+    return word_idx * 64 + ef_ctz(word);
+}
+
+/* Values i and i + 1, as the range of entries they delimit. */
+static void
+ef_get_range(ef_seq_t * seq, uint32 i, node_range_t * range)
+{
+    uint32 pos = ef_select(seq, i);
+    range->begin = ((pos - i) << seq->low_bits) | ef_low(seq, i);
+    pos = ef_next_one(seq, pos);
+    range->end = ((pos - i - 1) << seq->low_bits) | ef_low(seq, i + 1);
+}
+
 uint32
 middle_size(uint8 quant_bits, uint32 entries, uint32 max_vocab,
-            uint32 max_ptr)
+            uint32 max_ptr, uint8 next_ef)
 {
+    /* Elias-Fano coded next pointers follow the entries, one more than
+     * entries for the end of the last one. */
+    if (next_ef)
+        return ef_align(base_size(entries, max_vocab, quant_bits))
+            + ef_size(entries + 1, max_ptr);
     return base_size(entries, max_vocab,
                      quant_bits + bitarr_required_bits(max_ptr));
 }
@@ -94,17 +243,27 @@ base_init(base_t * base, void *base_mem, uint32 max_vocab,
 void
 middle_init(middle_t * middle, void *base_mem, uint8 quant_bits,
             uint32 entries, uint32 max_vocab, uint32 max_next,
-            void *next_source)
+            uint8 next_ef, void *next_source)
 {
     middle->quant_bits = quant_bits;
     bitarr_mask_from_max(&middle->next_mask, max_next);
+    middle->next_ef = next_ef;
     middle->next_source = next_source;
     if (entries + 1 >= (1U << 25) || (max_next >= (1U << 25)))
         E_ERROR
             ("Sorry, this does not support more than %d n-grams of a particular order.  Edit util/bit_packing.hh and fix the bit packing functions\n",
              (1U << 25));
-    base_init(&middle->base, base_mem, max_vocab,
-              quant_bits + middle->next_mask.bits);
+    if (next_ef) {
+        base_init(&middle->base, base_mem, max_vocab, quant_bits);
+        ef_init(&middle->next_seq,
+                (uint8 *) base_mem
+                + ef_align(base_size(entries, max_vocab, quant_bits)),
+                entries + 1, max_next);
+    }
+    else {
+        base_init(&middle->base, base_mem, max_vocab,
+                  quant_bits + middle->next_mask.bits);
+    }
 }
 
 void
@@ -134,7 +293,10 @@ middle_insert(middle_t * middle, uint32 word, int order, int max_order)
         next = ((middle_t *) middle->next_source)->base.insert_index;
     }
 
-    bitarr_write_int25(address, middle->next_mask.bits, next);
+    if (middle->next_ef)
+        ef_set(&middle->next_seq, middle->base.insert_index, next);
+    else
+        bitarr_write_int25(address, middle->next_mask.bits, next);
     middle->base.insert_index++;
     address.offset = at_pointer;
     return address;
@@ -157,6 +319,11 @@ static void
 middle_finish_loading(middle_t * middle, uint32 next_end)
 {
     bitarr_address_t address;
+
+    if (middle->next_ef) {
+        ef_set(&middle->next_seq, middle->base.insert_index, next_end);
+        return;
+    }
     address.base = middle->base.base;
     address.offset =
         (middle->base.insert_index + 1) * middle->base.total_bits -
@@ -164,6 +331,28 @@ middle_finish_loading(middle_t * middle, uint32 next_end)
     bitarr_write_int25(address, middle->next_mask.bits, next_end);
 }
 
+/* Range of the entries of the next order that extend entry index. */
+static void
+middle_next_range(middle_t * middle, uint32 index, node_range_t * range)
+{
+    bitarr_address_t address;
+
+    if (middle->next_ef) {
+        ef_get_range(&middle->next_seq, index, range);
+        return;
+    }
+    address.base = middle->base.base;
+    address.offset =
+        (index + 1) * middle->base.total_bits - middle->next_mask.bits;
+    range->begin =
+        bitarr_read_int25(address, middle->next_mask.bits,
+                          middle->next_mask.mask);
+    address.offset += middle->base.total_bits;
+    range->end =
+        bitarr_read_int25(address, middle->next_mask.bits,
+                          middle->next_mask.mask);
+}
+
 static uint32
 unigram_next(lm_trie_t * trie, int order)
 {
@@ -356,8 +545,6 @@ lm_trie_init(uint32 unigram_count)
     lm_trie_t *trie;
 
     trie = (lm_trie_t *) ckd_calloc(1, sizeof(*trie));
-    memset(trie->hist_cache, -1, sizeof(trie->hist_cache)); /* prepare request history */
-    memset(trie->backoff_cache, 0, sizeof(trie->backoff_cache));
     trie->unigrams =
         (unigram_t *) ckd_calloc((unigram_count + 1),
                                  sizeof(*trie->unigrams));
@@ -366,11 +553,13 @@ lm_trie_init(uint32 unigram_count)
 }
 
 lm_trie_t *
-lm_trie_create(uint32 unigram_count, int order)
+lm_trie_create(uint32 unigram_count, int order, int prob_bits, int bo_bits,
+               int next_ef)
 {
     lm_trie_t *trie = lm_trie_init(unigram_count);
+    trie->next_ef = next_ef;
     trie->quant =
-        (order > 1) ? lm_trie_quant_create(order) : 0;
+        (order > 1) ? lm_trie_quant_create(order, prob_bits, bo_bits) : 0;
     return trie;
 }
 
@@ -387,51 +576,132 @@ lm_trie_read_bin(uint32 * counts, int order, FILE * fp)
     return trie;
 }
 
+lm_trie_t *
+lm_trie_map_bin(uint32 * counts, int order, int prob_bits, int bo_bits,
+                int next_ef, uint8 * mem, size_t size)
+{
+    lm_trie_t *trie;
+    size_t unigrams_size, ngram_offset, offset;
+
+    trie = (lm_trie_t *) ckd_calloc(1, sizeof(*trie));
+    trie->next_ef = next_ef;
+    offset = 0;
+    if (order > 1) {
+        trie->quant = lm_trie_quant_map_bin(mem, order, prob_bits, bo_bits);
+        offset += lm_trie_align(lm_trie_quant_bin_size(trie->quant));
+    }
+    unigrams_size = (counts[0] + 1) * sizeof(*trie->unigrams);
+    trie->unigrams = (unigram_t *) (mem + offset);
+    trie->unigrams_in_place = TRUE;
+    offset += lm_trie_align(unigrams_size);
+    if (order > 1) {
+        lm_trie_ngram_size(trie, counts, order);
+        ngram_offset = offset;
+        offset += lm_trie_align(trie->ngram_mem_size);
+    }
+    if (offset != size) {
+        E_ERROR("Binary trie has %lu bytes, %lu expected from ngram counts\n",
+                (unsigned long) size, (unsigned long) offset);
+        lm_trie_free(trie);
+        return NULL;
+    }
+    if (order > 1) {
+        trie->ngram_mem = mem + ngram_offset;
+        trie->ngram_in_place = TRUE;
+        lm_trie_init_ngram(trie, counts, order);
+    }
+    return trie;
+}
+
+static void
+write_padding(size_t size, FILE * fp)
+{
+    static const uint8 zeros[LM_TRIE_ALIGN];
+    fwrite(zeros, 1, lm_trie_align(size) - size, fp);
+}
+
 void
 lm_trie_write_bin(lm_trie_t * trie, uint32 unigram_count, FILE * fp)
 {
+    size_t unigrams_size = (unigram_count + 1) * sizeof(*trie->unigrams);
 
-    if (trie->quant)
+    if (trie->quant) {
         lm_trie_quant_write_bin(trie->quant, fp);
-    fwrite(trie->unigrams, sizeof(*trie->unigrams), (unigram_count + 1),
-           fp);
-    if (trie->ngram_mem)
+        write_padding(lm_trie_quant_bin_size(trie->quant), fp);
+    }
+    fwrite(trie->unigrams, 1, unigrams_size, fp);
+    write_padding(unigrams_size, fp);
+    if (trie->ngram_mem) {
         fwrite(trie->ngram_mem, 1, trie->ngram_mem_size, fp);
+        write_padding(trie->ngram_mem_size, fp);
+    }
+}
+
+size_t
+lm_trie_bin_size(lm_trie_t * trie, uint32 unigram_count)
+{
+    size_t size;
+
+    size = lm_trie_align((unigram_count + 1) * sizeof(*trie->unigrams));
+    if (trie->quant)
+        size += lm_trie_align(lm_trie_quant_bin_size(trie->quant));
+    if (trie->ngram_mem)
+        size += lm_trie_align(trie->ngram_mem_size);
+    return size;
 }
 
 void
 lm_trie_free(lm_trie_t * trie)
 {
     if (trie->ngram_mem) {
-        ckd_free(trie->ngram_mem);
+        if (!trie->ngram_in_place)
+            ckd_free(trie->ngram_mem);
         ckd_free(trie->middle_begin);
         ckd_free(trie->longest);
     }
     if (trie->quant)
         lm_trie_quant_free(trie->quant);
-    ckd_free(trie->unigrams);
+    if (!trie->unigrams_in_place)
+        ckd_free(trie->unigrams);
+    ckd_free(trie->bin_mem);
     ckd_free(trie);
 }
 
 static void
 lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
+{
+    lm_trie_ngram_size(trie, counts, order);
+    trie->ngram_mem =
+        (uint8 *) ckd_calloc(trie->ngram_mem_size,
+                             sizeof(*trie->ngram_mem));
+    lm_trie_init_ngram(trie, counts, order);
+}
+
+/* Compute the size of the arrays of all orders above unigrams. */
+static void
+lm_trie_ngram_size(lm_trie_t * trie, uint32 * counts, int order)
 {
     int i;
-    uint8 *mem_ptr;
-    uint8 **middle_starts;
 
     trie->ngram_mem_size = 0;
     for (i = 1; i < order - 1; i++) {
         trie->ngram_mem_size +=
             middle_size(lm_trie_quant_msize(trie->quant), counts[i],
-                        counts[0], counts[i + 1]);
+                        counts[0], counts[i + 1], trie->next_ef);
     }
     trie->ngram_mem_size +=
         longest_size(lm_trie_quant_lsize(trie->quant), counts[order - 1],
                      counts[0]);
-    trie->ngram_mem =
-        (uint8 *) ckd_calloc(trie->ngram_mem_size,
-                             sizeof(*trie->ngram_mem));
+}
+
+/* Point the arrays of each order into ngram_mem. */
+static void
+lm_trie_init_ngram(lm_trie_t * trie, uint32 * counts, int order)
+{
+    int i;
+    uint8 *mem_ptr;
+    uint8 **middle_starts;
+
     mem_ptr = trie->ngram_mem;
     trie->middle_begin =
         (middle_t *) ckd_calloc(order - 2, sizeof(*trie->middle_begin));
@@ -442,7 +712,7 @@ lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
         middle_starts[i - 2] = mem_ptr;
         mem_ptr +=
             middle_size(lm_trie_quant_msize(trie->quant), counts[i - 1],
-                        counts[0], counts[i]);
+                        counts[0], counts[i], trie->next_ef);
     }
     trie->longest = (longest_t *) ckd_calloc(1, sizeof(*trie->longest));
     /* Crazy backwards thing so we initialize using pointers to ones that have already been initialized */
@@ -450,7 +720,7 @@ lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
         middle_t *middle_ptr = &trie->middle_begin[i - 2];
         middle_init(middle_ptr, middle_starts[i - 2],
                     lm_trie_quant_msize(trie->quant), counts[i - 1],
-                    counts[0], counts[i],
+                    counts[0], counts[i], trie->next_ef,
                     (i ==
                      order -
                      1) ? (void *) trie->longest : (void *) &trie->
@@ -461,23 +731,66 @@ lm_trie_alloc_ngram(lm_trie_t * trie, uint32 * counts, int order)
                  counts[0]);
 }
 
+typedef struct quant_train_job_s {
+    lm_trie_quant_t *quant;
+    int order;
+    int max_order;
+    uint32 count;
+    ngram_raw_t *raw_ngrams;
+} quant_train_job_t;
+
+static void
+quant_train(quant_train_job_t * job)
+{
+    if (job->order == job->max_order)
+        lm_trie_quant_train_prob(job->quant, job->order, job->count,
+                                 job->raw_ngrams);
+    else
+        lm_trie_quant_train(job->quant, job->order, job->count,
+                            job->raw_ngrams);
+}
+
+static int
+quant_train_thread(sbthread_t * th)
+{
+    quant_train((quant_train_job_t *) sbthread_arg(th));
+    return 0;
+}
+
 void
 lm_trie_build(lm_trie_t * trie, ngram_raw_t ** raw_ngrams, uint32 * counts, uint32 *out_counts,
-              int order)
+              int order, int n_threads)
 {
+    quant_train_job_t jobs[NGRAM_MAX_ORDER - 1];
+    sbthread_t *threads[NGRAM_MAX_ORDER - 1];
     int i;
 
-    lm_trie_fix_counts(raw_ngrams, counts, out_counts, order);
-    lm_trie_alloc_ngram(trie, out_counts, order);
-    
     if (order > 1)
         E_INFO("Training quantizer\n");
-    for (i = 2; i < order; i++) {
-        lm_trie_quant_train(trie->quant, i, counts[i - 1],
-                            raw_ngrams[i - 2]);
+    /* Each order has its own quantization tables, so they can be
+     * trained at the same time, and while the counts are fixed up. */
+    for (i = 2; i <= order; i++) {
+        quant_train_job_t *job = &jobs[i - 2];
+
+        job->quant = trie->quant;
+        job->order = i;
+        job->max_order = order;
+        job->count = counts[i - 1];
+        job->raw_ngrams = raw_ngrams[i - 2];
+        threads[i - 2] = NULL;
+        if (n_threads > 1)
+            threads[i - 2] = sbthread_start(NULL, quant_train_thread, job);
+    }
+
+    lm_trie_fix_counts(raw_ngrams, counts, out_counts, order);
+    lm_trie_alloc_ngram(trie, out_counts, order);
+
+    for (i = 2; i <= order; i++) {
+        if (threads[i - 2] != NULL)
+            sbthread_free(threads[i - 2]);
+        else
+            quant_train(&jobs[i - 2]);
     }
-    lm_trie_quant_train_prob(trie->quant, order, counts[order - 1],
-                             raw_ngrams[order - 2]);
 
     E_INFO("Building LM trie\n");
     recursive_insert(trie, raw_ngrams, counts, order);
@@ -560,18 +873,10 @@ middle_find(middle_t * middle, uint32 word, node_range_t * range)
         return address;
     }
 
+    middle_next_range(middle, at_pointer, range);
     address.base = middle->base.base;
-    at_pointer *= middle->base.total_bits;
-    at_pointer += middle->base.word_bits;
-    address.offset = at_pointer + middle->quant_bits;
-    range->begin =
-        bitarr_read_int25(address, middle->next_mask.bits,
-                          middle->next_mask.mask);
-    address.offset += middle->base.total_bits;
-    range->end =
-        bitarr_read_int25(address, middle->next_mask.bits,
-                          middle->next_mask.mask);
-    address.offset = at_pointer;
+    address.offset =
+        at_pointer * middle->base.total_bits + middle->base.word_bits;
 
     return address;
 }
@@ -688,8 +993,8 @@ lm_trie_nobo_score(lm_trie_t * trie, int32 wid, int32 * hist,
 }
 
 static float
-lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
-                   int32 * n_used)
+lm_trie_hist_score(lm_trie_t * trie, lm_trie_state_t * state, int32 wid,
+                   int32 * hist, int32 n_hist, int32 * n_used)
 {
     float prob;
     int i, j;
@@ -704,7 +1009,7 @@ lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
         address = middle_find(&trie->middle_begin[i], hist[i], &node);
         if (address.base == NULL) {
             for (j = i; j < n_hist; j++) {
-                prob += trie->backoff_cache[j];
+                prob += state->backoff_cache[j];
             }
             return prob;
         }
@@ -715,7 +1020,7 @@ lm_trie_hist_score(lm_trie_t * trie, int32 wid, int32 * hist, int32 n_hist,
     }
     address = longest_find(trie->longest, hist[n_hist - 1], &node);
     if (address.base == NULL) {
-        return prob + trie->backoff_cache[n_hist - 1];
+        return prob + state->backoff_cache[n_hist - 1];
     }
     else {
         (*n_used)++;
@@ -736,38 +1041,197 @@ history_matches(int32 * hist, int32 * prev_hist, int32 n_hist)
 }
 
 static void
-update_backoff(lm_trie_t * trie, int32 * hist, int32 n_hist)
+update_backoff(lm_trie_t * trie, lm_trie_state_t * state, int32 * hist,
+               int32 n_hist)
 {
     int i;
     node_range_t node;
     bitarr_address_t address;
 
-    memset(trie->backoff_cache, 0, sizeof(trie->backoff_cache));
-    trie->backoff_cache[0] = unigram_find(trie->unigrams, hist[0], &node)->bo;
+    memset(state->backoff_cache, 0, sizeof(state->backoff_cache));
+    state->backoff_cache[0] = unigram_find(trie->unigrams, hist[0], &node)->bo;
     for (i = 1; i < n_hist; i++) {
         address = middle_find(&trie->middle_begin[i - 1], hist[i], &node);
         if (address.base == NULL) {
             break;
         }
-        trie->backoff_cache[i] =
+        state->backoff_cache[i] =
             lm_trie_quant_mboread(trie->quant, address, i - 1);
     }
-    memcpy(trie->hist_cache, hist, n_hist * sizeof(*hist));
+    memcpy(state->hist_cache, hist, n_hist * sizeof(*hist));
+}
+
+void
+lm_trie_state_reset(lm_trie_state_t * state)
+{
+    memset(state->hist_cache, -1, sizeof(state->hist_cache));
+    memset(state->backoff_cache, 0, sizeof(state->backoff_cache));
 }
 
 float
-lm_trie_score(lm_trie_t * trie, int order, int32 wid, int32 * hist,
-              int32 n_hist, int32 * n_used)
+lm_trie_score(lm_trie_t * trie, lm_trie_state_t * state, int order,
+              int32 wid, int32 * hist, int32 n_hist, int32 * n_used)
 {
     if (n_hist < order - 1) {
         return lm_trie_nobo_score(trie, wid, hist, order, n_hist, n_used);
     }
     else {
         assert(n_hist == order - 1);
-        if (!history_matches(hist, (int32 *) trie->hist_cache, n_hist)) {
-            update_backoff(trie, hist, n_hist);
+        if (!history_matches(hist, (int32 *) state->hist_cache, n_hist)) {
+            update_backoff(trie, state, hist, n_hist);
+        }
+        return lm_trie_hist_score(trie, state, wid, hist, n_hist, n_used);
+    }
+}
+
+void
+lm_trie_scores(lm_trie_t * trie, lm_trie_state_t * state, int order,
+               const int32 * wids, int32 n_wids, int32 * hist,
+               int32 n_hist, int32 * out_scores)
+{
+    int32 i, n_used;
+
+    if (n_hist < order - 1) {
+        /* Backoff weight to add when only the first n history words
+         * are found with a word, for each n. */
+        float backoff[NGRAM_MAX_ORDER];
+
+        for (i = 1; i <= n_hist; i++)
+            backoff[i] = get_available_backoff(trie, i, hist, n_hist);
+        for (i = 0; i < n_wids; i++) {
+            float prob = get_available_prob(trie, wids[i], hist, order,
+                                            n_hist, &n_used);
+            if (n_used <= n_hist)
+                prob += backoff[n_used];
+            out_scores[i] = (int32) prob;
+        }
+    }
+    else {
+        assert(n_hist == order - 1);
+        if (!history_matches(hist, (int32 *) state->hist_cache, n_hist)) {
+            update_backoff(trie, state, hist, n_hist);
+        }
+        for (i = 0; i < n_wids; i++)
+            out_scores[i] = (int32) lm_trie_hist_score(trie, state, wids[i],
+                                                       hist, n_hist,
+                                                       &n_used);
+    }
+}
+
+/* update_backoff() for the tries whose update is set, one order at a time. */
+static void
+update_backoff_lockstep(lm_trie_t ** tries, lm_trie_state_t ** states,
+                        int32 * const *hists, const int32 * n_hists,
+                        uint8 * update, int32 n_tries)
+{
+    node_range_t node[LM_TRIE_LOCKSTEP];
+    int32 n_active, i, t;
+
+    n_active = 0;
+    for (t = 0; t < n_tries; t++) {
+        if (!update[t])
+            continue;
+        memset(states[t]->backoff_cache, 0,
+               sizeof(states[t]->backoff_cache));
+        states[t]->backoff_cache[0] =
+            unigram_find(tries[t]->unigrams, hists[t][0], &node[t])->bo;
+        memcpy(states[t]->hist_cache, hists[t],
+               n_hists[t] * sizeof(*hists[t]));
+        if (n_hists[t] > 1)
+            n_active++;
+        else
+            update[t] = FALSE;
+    }
+    for (i = 1; n_active > 0; i++) {
+        for (t = 0; t < n_tries; t++) {
+            bitarr_address_t address;
+
+            if (!update[t])
+                continue;
+            address = middle_find(&tries[t]->middle_begin[i - 1],
+                                  hists[t][i], &node[t]);
+            if (address.base != NULL)
+                states[t]->backoff_cache[i] =
+                    lm_trie_quant_mboread(tries[t]->quant, address, i - 1);
+            if (address.base == NULL || i == n_hists[t] - 1) {
+                update[t] = FALSE;
+                n_active--;
+            }
+        }
+    }
+}
+
+void
+lm_trie_score_lockstep(lm_trie_t ** tries, lm_trie_state_t ** states,
+                       const int32 * orders, int32 n_tries,
+                       const int32 * wids, int32 * const *hists,
+                       const int32 * n_hists, float *out_scores,
+                       int32 * n_used)
+{
+    node_range_t node[LM_TRIE_LOCKSTEP];
+    uint8 active[LM_TRIE_LOCKSTEP];
+    int32 n_active, i, t;
+
+    assert(n_tries <= LM_TRIE_LOCKSTEP);
+    /* Backoff weights of full histories that changed. */
+    for (t = 0; t < n_tries; t++) {
+        active[t] = n_hists[t] > 0 && n_hists[t] == orders[t] - 1
+            && !history_matches(hists[t], (int32 *) states[t]->hist_cache,
+                                n_hists[t]);
+    }
+    update_backoff_lockstep(tries, states, hists, n_hists, active, n_tries);
+    /* Unigrams. */
+    n_active = 0;
+    for (t = 0; t < n_tries; t++) {
+        if (n_hists[t] == 0 || n_hists[t] < orders[t] - 1) {
+            out_scores[t] = lm_trie_score(tries[t], states[t], orders[t],
+                                          wids[t], hists[t], n_hists[t],
+                                          &n_used[t]);
+            continue;
+        }
+        n_used[t] = 1;
+        out_scores[t] =
+            unigram_find(tries[t]->unigrams, wids[t], &node[t])->prob;
+        active[t] = TRUE;
+        n_active++;
+    }
+    /* Then one order at a time in all tries, as lm_trie_hist_score()
+     * does in one. */
+    for (i = 0; n_active > 0; i++) {
+        for (t = 0; t < n_tries; t++) {
+            lm_trie_t *trie = tries[t];
+            bitarr_address_t address;
+            int32 j;
+
+            if (!active[t])
+                continue;
+            if (i < n_hists[t] - 1) {
+                address = middle_find(&trie->middle_begin[i], hists[t][i],
+                                      &node[t]);
+                if (address.base != NULL) {
+                    n_used[t]++;
+                    out_scores[t] =
+                        lm_trie_quant_mpread(trie->quant, address, i);
+                    continue;
+                }
+                for (j = i; j < n_hists[t]; j++)
+                    out_scores[t] += states[t]->backoff_cache[j];
+            }
+            else {
+                address = longest_find(trie->longest, hists[t][i],
+                                       &node[t]);
+                if (address.base != NULL) {
+                    n_used[t]++;
+                    out_scores[t] =
+                        lm_trie_quant_lpread(trie->quant, address);
+                }
+                else {
+                    out_scores[t] += states[t]->backoff_cache[i];
+                }
+            }
+            active[t] = FALSE;
+            n_active--;
         }
-        return lm_trie_hist_score(trie, wid, hist, n_hist, n_used);
     }
 }
 
@@ -803,16 +1267,7 @@ lm_trie_fill_raw_ngram(lm_trie_t * trie,
                 bitarr_read_int25(address, middle->base.word_bits,
                                   middle->base.word_mask);
             hist[n_hist] = new_word;
-            address.offset += middle->base.word_bits + middle->quant_bits;
-            node.begin =
-                bitarr_read_int25(address, middle->next_mask.bits,
-                                  middle->next_mask.mask);
-            address.offset =
-                (ptr + 1) * middle->base.total_bits +
-                middle->base.word_bits + middle->quant_bits;
-            node.end =
-                bitarr_read_int25(address, middle->next_mask.bits,
-                                  middle->next_mask.mask);
+            middle_next_range(middle, ptr, &node);
             lm_trie_fill_raw_ngram(trie, raw_ngrams, raw_ngram_idx, counts,
                            node, hist, n_hist + 1, order, max_order);
         }
@@ -64,10 +64,28 @@ typedef struct base_s {
     uint32 max_vocab;
 } base_t;
 
+/**
+ * Non-decreasing sequence coded with Elias-Fano: the low_bits low bits of
+ * each value are bit-packed in low, and the rest of value i sets bit
+ * (value >> low_bits) + i of high.
+ */
+typedef struct ef_seq_s {
+    uint32 *samples;            /**< Position in high of every LM_TRIE_EF_SAMPLE'th value */
+    uint64 *high;
+    uint8 *low;
+    uint8 low_bits;
+    uint32 low_mask;
+} ef_seq_t;
+
+/** Values of an ef_seq_t between select samples */
+#define LM_TRIE_EF_SAMPLE 64
+
 typedef struct middle_s {
     base_t base;
-    bitarr_mask_t next_mask;
+    bitarr_mask_t next_mask;    /**< Unused if next pointers are in next_seq */
     uint8 quant_bits;
+    uint8 next_ef;              /**< Whether next pointers are in next_seq */
+    ef_seq_t next_seq;
     void *next_source;
 } middle_t;
 
@@ -76,39 +94,117 @@ typedef struct longest_s {
     uint8 quant_bits;
 } longest_t;
 
+/** Alignment of the sections of binary trie files, see lm_trie_write_bin() */
+#define LM_TRIE_ALIGN 64
+/** Round size up to a multiple of LM_TRIE_ALIGN */
+#define lm_trie_align(n) (((n) + LM_TRIE_ALIGN - 1) / LM_TRIE_ALIGN * LM_TRIE_ALIGN)
+
 typedef struct lm_trie_s {
     uint8 *ngram_mem;
     size_t ngram_mem_size;
+    uint8 *bin_mem;             /**< Binary trie read into memory, NULL if mapped or built */
+    uint8 ngram_in_place;       /**< Whether ngram_mem and quant point into a binary trie */
+    uint8 unigrams_in_place;    /**< Whether unigrams do, until a word is added */
     unigram_t *unigrams;
     middle_t *middle_begin;
     middle_t *middle_end;
     longest_t *longest;
     lm_trie_quant_t *quant;
-
-    float backoff_cache[NGRAM_MAX_ORDER];
-    uint32 hist_cache[NGRAM_MAX_ORDER - 1];
+    uint8 next_ef;              /**< Whether middle_begin..middle_end keep
+                                   next pointers Elias-Fano coded */
 } lm_trie_t;
 
+/**
+ * History cache for lm_trie_score(), kept by each caller so that one
+ * trie can be scored from several threads.
+ */
+typedef struct lm_trie_state_s {
+    float backoff_cache[NGRAM_MAX_ORDER];   /**< Backoff weights of hist_cache */
+    uint32 hist_cache[NGRAM_MAX_ORDER - 1]; /**< Last full-order history */
+} lm_trie_state_t;
+
 /**
  * Creates lm_trie structure. Fills it if binary file with correspondent data is provided
+ * Probabilities and backoffs of N-grams above unigrams are quantized to
+ * prob_bits and bo_bits bits.  If next_ef is TRUE, the pointers from
+ * N-grams to their extensions are Elias-Fano coded instead of stored in
+ * every entry, which takes less memory but makes lookups slower.
  */
-lm_trie_t *lm_trie_create(uint32 unigram_count, int order);
+lm_trie_t *lm_trie_create(uint32 unigram_count, int order, int prob_bits,
+                          int bo_bits, int next_ef);
 
+/**
+ * Reads trie from binary file written without alignment.
+ */
 lm_trie_t *lm_trie_read_bin(uint32 * counts, int order, FILE * fp);
 
+/**
+ * Creates trie which uses a binary trie of @a size bytes at @a mem in
+ * place, for instance in a memory mapped file. Arrays are not copied and
+ * must outlive the trie. Returns NULL if counts don't fit in size.
+ * prob_bits, bo_bits and next_ef are those the trie was created with.
+ */
+lm_trie_t *lm_trie_map_bin(uint32 * counts, int order, int prob_bits,
+                           int bo_bits, int next_ef, uint8 * mem,
+                           size_t size);
+
+/**
+ * Writes trie to binary file: quantization tables, unigrams and ngram
+ * arrays, each padded to a multiple of LM_TRIE_ALIGN bytes, so that they
+ * stay aligned when the file is mapped at an aligned offset.
+ */
 void lm_trie_write_bin(lm_trie_t * trie, uint32 unigram_count, FILE * fp);
 
+/**
+ * Number of bytes lm_trie_write_bin() writes.
+ */
+size_t lm_trie_bin_size(lm_trie_t * trie, uint32 unigram_count);
+
 void lm_trie_free(lm_trie_t * trie);
 
+/**
+ * Builds the trie from raw ngrams sorted by ngram_ord_comparator.  With
+ * n_threads > 1 the quantizer of each order is trained in a thread of
+ * its own; insertion into the trie itself is sequential.
+ */
 void lm_trie_build(lm_trie_t * trie, ngram_raw_t ** raw_ngrams,
-                   uint32 * counts, uint32 *out_counts, int order);
+                   uint32 * counts, uint32 *out_counts, int order,
+                   int n_threads);
+
+/** Most tries lm_trie_score_lockstep() walks together */
+#define LM_TRIE_LOCKSTEP 8
+
+/**
+ * Scores wids[t] after hists[t] in each of n_tries (at most
+ * LM_TRIE_LOCKSTEP) tries, using states[t] as the history cache of
+ * tries[t], as lm_trie_score() would.  The tries are walked together,
+ * one order at a time, so that their lookups don't wait for each other.
+ */
+void lm_trie_score_lockstep(lm_trie_t ** tries, lm_trie_state_t ** states,
+                            const int32 * orders, int32 n_tries,
+                            const int32 * wids, int32 * const *hists,
+                            const int32 * n_hists, float *out_scores,
+                            int32 * n_used);
 
 void lm_trie_fill_raw_ngram(lm_trie_t * trie,
 			    ngram_raw_t * raw_ngrams, uint32 * raw_ngram_idx,
             	            uint32 * counts, node_range_t range, uint32 * hist,
     	                    int n_hist, int order, int max_order);
 
-float lm_trie_score(lm_trie_t * trie, int order, int32 wid, int32 * hist,
-                    int32 n_hist, int32 * n_used);
+/**
+ * Clears the history cache in state.
+ */
+void lm_trie_state_reset(lm_trie_state_t * state);
+
+float lm_trie_score(lm_trie_t * trie, lm_trie_state_t * state, int order,
+                    int32 wid, int32 * hist, int32 n_hist, int32 * n_used);
+
+/**
+ * Scores n_wids words given the same history, computing the backoff
+ * weights of the history only once.
+ */
+void lm_trie_scores(lm_trie_t * trie, lm_trie_state_t * state, int order,
+                    const int32 * wids, int32 n_wids, int32 * hist,
+                    int32 n_hist, int32 * out_scores);
 
 #endif                          /* __LM_TRIE_H__ */
@@ -56,6 +56,7 @@ struct lm_trie_quant_s {
     bins_t *longest;
     uint8 *mem;
     size_t mem_size;
+    uint8 mem_in_place;
     uint8 prob_bits;
     uint8 bo_bits;
     uint32 prob_mask;
@@ -109,29 +110,26 @@ bins_decode(bins_t * bins, size_t off)
 }
 
 static size_t
-quant_size(int order)
+quant_size(int order, int prob_bits, int bo_bits)
 {
-    int prob_bits = 16;
-    int bo_bits = 16;
     size_t longest_table = (1U << prob_bits) * sizeof(float);
     size_t middle_table = (1U << bo_bits) * sizeof(float) + longest_table;
     /* unigrams are currently not quantized so no need for a table. */
     return (order - 2) * middle_table + longest_table;
 }
 
-lm_trie_quant_t *
-lm_trie_quant_create(int order)
+static lm_trie_quant_t *
+quant_init(int order, int prob_bits, int bo_bits, uint8 * mem)
 {
     float *start;
     int i;
     lm_trie_quant_t *quant =
         (lm_trie_quant_t *) ckd_calloc(1, sizeof(*quant));
-    quant->mem_size = quant_size(order);
-    quant->mem =
-        (uint8 *) ckd_calloc(quant->mem_size, sizeof(*quant->mem));
+    quant->mem_size = quant_size(order, prob_bits, bo_bits);
+    quant->mem = mem;
 
-    quant->prob_bits = 16;
-    quant->bo_bits = 16;
+    quant->prob_bits = prob_bits;
+    quant->bo_bits = bo_bits;
     quant->prob_mask = (1U << quant->prob_bits) - 1;
     quant->bo_mask = (1U << quant->bo_bits) - 1;
 
@@ -147,15 +145,35 @@ lm_trie_quant_create(int order)
     return quant;
 }
 
+lm_trie_quant_t *
+lm_trie_quant_create(int order, int prob_bits, int bo_bits)
+{
+    return quant_init(order, prob_bits, bo_bits,
+                      (uint8 *) ckd_calloc(quant_size(order, prob_bits,
+                                                      bo_bits),
+                                           sizeof(uint8)));
+}
+
+lm_trie_quant_t *
+lm_trie_quant_map_bin(uint8 * mem, int order, int prob_bits, int bo_bits)
+{
+    lm_trie_quant_t *quant = quant_init(order, prob_bits, bo_bits, mem);
+    quant->mem_in_place = TRUE;
+    return quant;
+}
+
 
 lm_trie_quant_t *
 lm_trie_quant_read_bin(FILE * fp, int order)
 {
+    /* Files written without alignment start with the type of
+     * quantization, which is always the same */
     int dummy;
     lm_trie_quant_t *quant;
 
     fread(&dummy, sizeof(dummy), 1, fp);
-    quant = lm_trie_quant_create(order);
+    quant = lm_trie_quant_create(order, LM_TRIE_QUANT_DEFAULT_BITS,
+                                 LM_TRIE_QUANT_DEFAULT_BITS);
     fread(quant->mem, sizeof(*quant->mem), quant->mem_size, fp);
 
     return quant;
@@ -164,16 +182,19 @@ lm_trie_quant_read_bin(FILE * fp, int order)
 void
 lm_trie_quant_write_bin(lm_trie_quant_t * quant, FILE * fp)
 {
-    /* Before it was quantization type */
-    int dummy = 1;
-    fwrite(&dummy, sizeof(dummy), 1, fp);
     fwrite(quant->mem, sizeof(*quant->mem), quant->mem_size, fp);
 }
 
+size_t
+lm_trie_quant_bin_size(lm_trie_quant_t * quant)
+{
+    return quant->mem_size;
+}
+
 void
 lm_trie_quant_free(lm_trie_quant_t * quant)
 {
-    if (quant->mem)
+    if (quant->mem && !quant->mem_in_place)
         ckd_free(quant->mem);
     ckd_free(quant);
 }
@@ -181,13 +202,25 @@ lm_trie_quant_free(lm_trie_quant_t * quant)
 uint8
 lm_trie_quant_msize(lm_trie_quant_t * quant)
 {
-    return 32;
+    return quant->prob_bits + quant->bo_bits;
 }
 
 uint8
 lm_trie_quant_lsize(lm_trie_quant_t * quant)
 {
-    return 16;
+    return quant->prob_bits;
+}
+
+int
+lm_trie_quant_prob_bits(lm_trie_quant_t * quant)
+{
+    return quant->prob_bits;
+}
+
+int
+lm_trie_quant_bo_bits(lm_trie_quant_t * quant)
+{
+    return quant->bo_bits;
 }
 
 static int
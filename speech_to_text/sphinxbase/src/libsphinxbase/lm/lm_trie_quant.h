@@ -43,21 +43,41 @@
 
 typedef struct lm_trie_quant_s lm_trie_quant_t;
 
+/** Bits per quantized probability or backoff unless chosen otherwise */
+#define LM_TRIE_QUANT_DEFAULT_BITS 16
+/** Largest number of bits per quantized probability or backoff */
+#define LM_TRIE_QUANT_MAX_BITS 16
+
 /**
- * Create qunatizing
+ * Create qunatizing, with 2^prob_bits probability and 2^bo_bits
+ * backoff bins per order
  */
-lm_trie_quant_t *lm_trie_quant_create(int order);
+lm_trie_quant_t *lm_trie_quant_create(int order, int prob_bits,
+                                      int bo_bits);
 
 /**
- * Write quant data to binary file
+ * Read quant data from binary file without alignment
  */
 lm_trie_quant_t *lm_trie_quant_read_bin(FILE * fp, int order);
 
 /**
- * Write quant data to binary file
+ * Create quant which uses tables written by lm_trie_quant_write_bin() in
+ * place, for instance in a memory mapped file. Tables are not copied
+ * and must outlive quant.
+ */
+lm_trie_quant_t *lm_trie_quant_map_bin(uint8 * mem, int order,
+                                       int prob_bits, int bo_bits);
+
+/**
+ * Write quant tables to binary file
  */
 void lm_trie_quant_write_bin(lm_trie_quant_t * quant, FILE * fp);
 
+/**
+ * Number of bytes lm_trie_quant_write_bin() writes
+ */
+size_t lm_trie_quant_bin_size(lm_trie_quant_t * quant);
+
 /**
  * Free quant
  */
@@ -75,6 +95,16 @@ uint8 lm_trie_quant_msize(lm_trie_quant_t * quant);
  */
 uint8 lm_trie_quant_lsize(lm_trie_quant_t * quant);
 
+/**
+ * Bits per quantized probability
+ */
+int lm_trie_quant_prob_bits(lm_trie_quant_t * quant);
+
+/**
+ * Bits per quantized backoff
+ */
+int lm_trie_quant_bo_bits(lm_trie_quant_t * quant);
+
 /**
  * Trains prob and backoff quantizer for specified ngram order on provided raw ngram list
  */
@@ -143,8 +143,10 @@ ngram_model_read(cmd_ln_t * config,
             return NULL;
         }
     case NGRAM_ARPA:
-        model = ngram_model_trie_read_arpa(config, file_name, lmath);
-        break;
+        if ((model =
+             ngram_model_trie_read_arpa(config, file_name, lmath)) != NULL)
+            break;
+        return NULL;
     case NGRAM_BIN:
         if ((model =
              ngram_model_trie_read_bin(config, file_name, lmath)) != NULL)
@@ -241,6 +243,9 @@ ngram_model_init(ngram_model_t * base,
     else
         base->wid = hash_table_new(n_unigram, FALSE);
     base->n_counts[0] = base->n_1g_alloc = base->n_words = n_unigram;
+    /* Default query state, which does not hold a reference. */
+    if (base->query == NULL)
+        base->query = (*funcs->query_init) (base);
 
     return 0;
 }
@@ -255,8 +260,47 @@ ngram_model_retain(ngram_model_t * model)
 void
 ngram_model_flush(ngram_model_t * model)
 {
-    if (model->funcs && model->funcs->flush)
-        (*model->funcs->flush) (model);
+    if (model->query)
+        ngram_query_flush(model->query);
+}
+
+static void
+query_free(ngram_query_t * query)
+{
+    ckd_free(query->wids);
+    ckd_free(query->scores);
+    (*query->model->funcs->query_free) (query);
+}
+
+ngram_query_t *
+ngram_query_init(ngram_model_t * model)
+{
+    ngram_query_t *query;
+
+    query = (*model->funcs->query_init) (model);
+    ngram_model_retain(model);
+    return query;
+}
+
+void
+ngram_query_flush(ngram_query_t * query)
+{
+    ngram_model_t *model = query->model;
+
+    if (model->funcs->flush)
+        (*model->funcs->flush) (query);
+}
+
+int
+ngram_query_free(ngram_query_t * query)
+{
+    ngram_model_t *model;
+
+    if (query == NULL)
+        return 0;
+    model = query->model;
+    query_free(query);
+    return ngram_model_free(model);
 }
 
 int
@@ -268,6 +312,8 @@ ngram_model_free(ngram_model_t * model)
         return 0;
     if (--model->refcount > 0)
         return model->refcount;
+    if (model->query)
+        query_free(model->query);
     if (model->funcs && model->funcs->free)
         (*model->funcs->free) (model);
     if (model->writable) {
@@ -375,6 +421,14 @@ int32
 ngram_ng_score(ngram_model_t * model, int32 wid, int32 * history,
                int32 n_hist, int32 * n_used)
 {
+    return ngram_ng_score_r(model->query, wid, history, n_hist, n_used);
+}
+
+int32
+ngram_ng_score_r(ngram_query_t * query, int32 wid, int32 * history,
+                 int32 n_hist, int32 * n_used)
+{
+    ngram_model_t *model = query->model;
     int32 score, class_weight = 0;
     int i;
 
@@ -397,12 +451,75 @@ ngram_ng_score(ngram_model_t * model, int32 wid, int32 * history,
             history[i] =
                 model->classes[NGRAM_CLASSID(history[i])]->tag_wid;
     }
-    score = (*model->funcs->score) (model, wid, history, n_hist, n_used);
+    score = (*model->funcs->score) (model, query, wid, history, n_hist,
+                                    n_used);
 
     /* Multiply by unigram in-class weight. */
     return score + class_weight;
 }
 
+void
+ngram_ng_scores(ngram_model_t * model, const int32 * wids, int32 n_wids,
+                int32 * history, int32 n_hist, int32 * out_scores)
+{
+    ngram_ng_scores_r(model->query, wids, n_wids, history, n_hist,
+                      out_scores);
+}
+
+void
+ngram_ng_scores_r(ngram_query_t * query, const int32 * wids, int32 n_wids,
+                  int32 * history, int32 n_hist, int32 * out_scores)
+{
+    ngram_model_t *model = query->model;
+    int32 i, n, n_used;
+
+    if (model->funcs->scores == NULL) {
+        for (i = 0; i < n_wids; ++i)
+            out_scores[i] = ngram_ng_score_r(query, wids[i], history,
+                                             n_hist, &n_used);
+        return;
+    }
+
+    /* "Declassify" history, once for all words */
+    for (i = 0; i < n_hist; ++i) {
+        if (history[i] != NGRAM_INVALID_WID
+            && NGRAM_IS_CLASSWID(history[i]))
+            history[i] =
+                model->classes[NGRAM_CLASSID(history[i])]->tag_wid;
+    }
+    for (i = 0; i < n_wids; ++i) {
+        if (wids[i] == NGRAM_INVALID_WID || NGRAM_IS_CLASSWID(wids[i]))
+            break;
+    }
+    if (i == n_wids) {
+        (*model->funcs->scores) (model, query, wids, n_wids,
+                                 history, n_hist, out_scores);
+        return;
+    }
+
+    /* Score the plain words together and the others one by one. */
+    if (n_wids > query->n_alloc) {
+        query->n_alloc = n_wids;
+        query->wids = ckd_realloc(query->wids,
+                                  n_wids * sizeof(*query->wids));
+        query->scores = ckd_realloc(query->scores,
+                                    n_wids * sizeof(*query->scores));
+    }
+    for (i = n = 0; i < n_wids; ++i) {
+        if (wids[i] != NGRAM_INVALID_WID && !NGRAM_IS_CLASSWID(wids[i]))
+            query->wids[n++] = wids[i];
+    }
+    (*model->funcs->scores) (model, query, query->wids, n,
+                             history, n_hist, query->scores);
+    for (i = n = 0; i < n_wids; ++i) {
+        if (wids[i] != NGRAM_INVALID_WID && !NGRAM_IS_CLASSWID(wids[i]))
+            out_scores[i] = query->scores[n++];
+        else
+            out_scores[i] = ngram_ng_score_r(query, wids[i], history,
+                                             n_hist, &n_used);
+    }
+}
+
 int32
 ngram_score(ngram_model_t * model, const char *word, ...)
 {
@@ -450,10 +567,34 @@ ngram_bg_score(ngram_model_t * model, int32 w2, int32 w1, int32 * n_used)
     return ngram_ng_score(model, w2, &w1, 1, n_used);
 }
 
+int32
+ngram_tg_score_r(ngram_query_t * query, int32 w3, int32 w2, int32 w1,
+                 int32 * n_used)
+{
+    int32 hist[2];
+    hist[0] = w2;
+    hist[1] = w1;
+    return ngram_ng_score_r(query, w3, hist, 2, n_used);
+}
+
+int32
+ngram_bg_score_r(ngram_query_t * query, int32 w2, int32 w1, int32 * n_used)
+{
+    return ngram_ng_score_r(query, w2, &w1, 1, n_used);
+}
+
 int32
 ngram_ng_prob(ngram_model_t * model, int32 wid, int32 * history,
               int32 n_hist, int32 * n_used)
 {
+    return ngram_ng_prob_r(model->query, wid, history, n_hist, n_used);
+}
+
+int32
+ngram_ng_prob_r(ngram_query_t * query, int32 wid, int32 * history,
+                int32 n_hist, int32 * n_used)
+{
+    ngram_model_t *model = query->model;
     int32 prob, class_weight = 0;
     int i;
 
@@ -476,7 +617,7 @@ ngram_ng_prob(ngram_model_t * model, int32 wid, int32 * history,
             history[i] =
                 model->classes[NGRAM_CLASSID(history[i])]->tag_wid;
     }
-    prob = (*model->funcs->raw_score) (model, wid, history,
+    prob = (*model->funcs->raw_score) (model, query, wid, history,
                                        n_hist, n_used);
     /* Multiply by unigram in-class weight. */
     return prob + class_weight;
@@ -73,6 +73,21 @@ struct ngram_model_s {
     int32 *tmp_wids;    /**< Temporary array of word IDs for ngram_model_get_ngram() */
     struct ngram_class_s **classes; /**< Word class definitions. */
     struct ngram_funcs_s *funcs;   /**< Implementation-specific methods. */
+    struct ngram_query_s *query;   /**< Query state used by the functions
+                                        that do not take one. */
+};
+
+/**
+ * Common implementation of ngram_query_t.
+ *
+ * Implementations extend this with the caches their score functions
+ * update, so that these are never written through the shared model.
+ */
+struct ngram_query_s {
+    ngram_model_t *model;   /**< Model this state queries. */
+    int32 *wids;            /**< Scratch words for ngram_ng_scores_r(). */
+    int32 *scores;          /**< Scratch scores for ngram_ng_scores_r(). */
+    int32 n_alloc;          /**< Allocated size of wids and scores. */
 };
 
 /**
@@ -120,6 +135,7 @@ typedef struct ngram_funcs_s {
      * Implementation-specific function for querying language model score.
      */
      int32(*score) (ngram_model_t * model,
+                    struct ngram_query_s * query,
                     int32 wid,
                     int32 * history, int32 n_hist, int32 * n_used);
     /**
@@ -127,8 +143,19 @@ typedef struct ngram_funcs_s {
      * model probability.
      */
      int32(*raw_score) (ngram_model_t * model,
+                        struct ngram_query_s * query,
                         int32 wid,
                         int32 * history, int32 n_hist, int32 * n_used);
+    /**
+     * Implementation-specific function for querying the language model
+     * scores of several words given one history.  The words are all
+     * valid, non-class words.  May be NULL, in which case score is
+     * used for each word.
+     */
+    void (*scores) (ngram_model_t * model,
+                    struct ngram_query_s * query,
+                    const int32 * wids, int32 n_wids,
+                    int32 * history, int32 n_hist, int32 * out_scores);
     /**
      * Implementation-specific function for adding unigrams.
      *
@@ -143,9 +170,18 @@ typedef struct ngram_funcs_s {
      int32(*add_ug) (ngram_model_t * model, int32 wid, int32 lweight);
 
     /**
-     * Implementation-specific function for purging N-Gram cache
+     * Implementation-specific function for purging the N-Gram cache
+     * of a query state.
+     */
+    void (*flush) (struct ngram_query_s * query);
+    /**
+     * Implementation-specific function for allocating a query state.
+     */
+    struct ngram_query_s *(*query_init) (ngram_model_t * model);
+    /**
+     * Implementation-specific function for freeing a query state.
      */
-    void (*flush) (ngram_model_t * model);
+    void (*query_free) (struct ngram_query_s * query);
 } ngram_funcs_t;
 
 /**
@@ -41,6 +41,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <assert.h>
 
 #include "sphinxbase/err.h"
 #include "sphinxbase/ckd_alloc.h"
@@ -48,6 +49,7 @@
 #include "sphinxbase/filename.h"
 
 #include "ngram_model_set.h"
+#include "ngram_model_trie.h"
 
 static ngram_funcs_t ngram_model_set_funcs;
 
@@ -173,9 +175,6 @@ ngram_model_set_init(cmd_ln_t * config,
         if (models[i]->n > n)
             n = models[i]->n;
     }
-    /* Allocate the history mapping table. */
-    model->maphist = ckd_calloc(n - 1, sizeof(*model->maphist));
-
     /* Now build the word-ID mapping and merged vocabulary. */
     build_widmap(base, lmath, n);
     return base;
@@ -517,9 +516,18 @@ ngram_model_set_interp(ngram_model_t * base,
     }
     /* Otherwise just enable existing weights. */
     set->cur = -1;
+    ++set->weights_gen;
     return base;
 }
 
+int32
+ngram_model_set_weights_generation(ngram_model_t * base)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *) base;
+
+    return set->weights_gen;
+}
+
 ngram_model_t *
 ngram_model_set_add(ngram_model_t * base,
                     ngram_model_t * model,
@@ -536,12 +544,8 @@ ngram_model_set_add(ngram_model_t * base,
     set->names =
         ckd_realloc(set->names, set->n_models * sizeof(*set->names));
     set->names[set->n_models - 1] = ckd_salloc(name);
-    /* Expand the history mapping table if necessary. */
-    if (model->n > base->n) {
+    if (model->n > base->n)
         base->n = model->n;
-        set->maphist = ckd_realloc(set->maphist,
-                                   (model->n - 1) * sizeof(*set->maphist));
-    }
 
     /* Renormalize the interpolation weights. */
     fprob = weight * 1.0f / set->n_models;
@@ -554,6 +558,7 @@ ngram_model_set_add(ngram_model_t * base,
     scale = logmath_log(base->lmath, 1.0 - fprob);
     for (i = 0; i < set->n_models - 1; ++i)
         set->lweights[i] += scale;
+    ++set->weights_gen;
 
     /* Reuse the old word ID mapping if requested. */
     if (reuse_widmap) {
@@ -576,6 +581,7 @@ ngram_model_set_add(ngram_model_t * base,
     else {
         build_widmap(base, base->lmath, base->n);
     }
+    ngram_model_set_query_update(base->query);
     return model;
 }
 
@@ -619,7 +625,7 @@ ngram_model_set_remove(ngram_model_t * base,
     /* There's no need to shrink these arrays. */
     set->lms[set->n_models] = NULL;
     set->lweights[set->n_models] = base->log_zero;
-    /* No need to shrink maphist either. */
+    ++set->weights_gen;
 
     /* Reuse the existing word ID mapping if requested. */
     if (reuse_widmap) {
@@ -632,6 +638,7 @@ ngram_model_set_remove(ngram_model_t * base,
     else {
         build_widmap(base, base->lmath, n);
     }
+    ngram_model_set_query_update(base->query);
     return submodel;
 }
 
@@ -677,14 +684,89 @@ ngram_model_set_apply_weights(ngram_model_t * base, float32 lw,
     /* Apply weights to each sub-model. */
     for (i = 0; i < set->n_models; ++i)
         ngram_model_apply_weights(set->lms[i], lw, wip);
+    /* And remember them, for ngram_model_get_weights(). */
+    base->lw = lw;
+    base->log_wip = logmath_log(base->lmath, wip);
     return 0;
 }
 
+/**
+ * Get the query state for submodel i.  This never creates or frees
+ * one, since that would change the submodel's reference count, which
+ * other threads' query states share (see ngram_model_set_query_update()).
+ */
+static ngram_query_t *
+set_query_lm(ngram_query_set_t * setq, ngram_model_set_t * set, int32 i)
+{
+    assert(i < setq->n_queries && setq->queries[i]->model == set->lms[i]);
+    return setq->queries[i];
+}
+
+/**
+ * Whether all submodels are trie models without classes, which
+ * set_score_lockstep() can interpolate.
+ */
+static int
+set_can_lockstep(ngram_model_set_t * set)
+{
+    int32 i;
+
+    for (i = 0; i < set->n_models; ++i) {
+        if (!ngram_model_is_trie(set->lms[i]) || set->lms[i]->n_classes > 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Interpolate the score (or raw probability) of wid in all submodels,
+ * mapping word and history to all of them at once and walking their
+ * tries together instead of one after the other.
+ */
+static int32
+set_score_lockstep(ngram_model_set_t * set, ngram_query_set_t * setq,
+                   int32 wid, int32 * history, int32 n_hist, int raw,
+                   int32 * n_used)
+{
+    ngram_model_t *base = &set->base;
+    int32 score;
+    int32 i, j;
+
+    assert(setq->n_queries == set->n_models);
+    for (i = 0; i < set->n_models; ++i) {
+        assert(setq->queries[i]->model == set->lms[i]);
+        setq->sub_wids[i] = set->widmap[wid][i];
+    }
+    /* The submodel IDs of each word are next to each other in widmap. */
+    for (j = 0; j < n_hist; ++j) {
+        int32 *hist = setq->sub_hists + j;
+
+        if (history[j] == NGRAM_INVALID_WID) {
+            for (i = 0; i < set->n_models; ++i)
+                hist[i * (NGRAM_MAX_ORDER - 1)] = NGRAM_INVALID_WID;
+        }
+        else {
+            for (i = 0; i < set->n_models; ++i)
+                hist[i * (NGRAM_MAX_ORDER - 1)] = set->widmap[history[j]][i];
+        }
+    }
+    ngram_model_trie_score_lockstep(set->lms, setq->queries, set->n_models,
+                                    setq->sub_wids, setq->sub_hists,
+                                    n_hist, raw, setq->sub_scores, n_used);
+    score = base->log_zero;
+    for (i = 0; i < set->n_models; ++i)
+        score = logmath_add(base->lmath, score,
+                            set->lweights[i] + setq->sub_scores[i]);
+    return score;
+}
+
 static int32
-ngram_model_set_score(ngram_model_t * base, int32 wid,
-                      int32 * history, int32 n_hist, int32 * n_used)
+ngram_model_set_score(ngram_model_t * base, ngram_query_t * query,
+                      int32 wid, int32 * history, int32 n_hist,
+                      int32 * n_used)
 {
     ngram_model_set_t *set = (ngram_model_set_t *) base;
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
     int32 mapwid;
     int32 score;
     int32 i;
@@ -694,7 +776,11 @@ ngram_model_set_score(ngram_model_t * base, int32 wid,
         n_hist = base->n - 1;
 
     /* Interpolate if there is no current. */
-    if (set->cur == -1) {
+    if (set->cur == -1 && set_can_lockstep(set)) {
+        score = set_score_lockstep(set, setq, wid, history, n_hist,
+                                   FALSE, n_used);
+    }
+    else if (set->cur == -1) {
         score = base->log_zero;
         for (i = 0; i < set->n_models; ++i) {
             int32 j;
@@ -702,15 +788,15 @@ ngram_model_set_score(ngram_model_t * base, int32 wid,
             mapwid = set->widmap[wid][i];
             for (j = 0; j < n_hist; ++j) {
                 if (history[j] == NGRAM_INVALID_WID)
-                    set->maphist[j] = NGRAM_INVALID_WID;
+                    setq->maphist[j] = NGRAM_INVALID_WID;
                 else
-                    set->maphist[j] = set->widmap[history[j]][i];
+                    setq->maphist[j] = set->widmap[history[j]][i];
             }
             score = logmath_add(base->lmath, score,
                                 set->lweights[i] +
-                                ngram_ng_score(set->lms[i],
-                                               mapwid, set->maphist,
-                                               n_hist, n_used));
+                                ngram_ng_score_r(set_query_lm(setq, set, i),
+                                                 mapwid, setq->maphist,
+                                                 n_hist, n_used));
         }
     }
     else {
@@ -719,22 +805,24 @@ ngram_model_set_score(ngram_model_t * base, int32 wid,
         mapwid = set->widmap[wid][set->cur];
         for (j = 0; j < n_hist; ++j) {
             if (history[j] == NGRAM_INVALID_WID)
-                set->maphist[j] = NGRAM_INVALID_WID;
+                setq->maphist[j] = NGRAM_INVALID_WID;
             else
-                set->maphist[j] = set->widmap[history[j]][set->cur];
+                setq->maphist[j] = set->widmap[history[j]][set->cur];
         }
-        score = ngram_ng_score(set->lms[set->cur],
-                               mapwid, set->maphist, n_hist, n_used);
+        score = ngram_ng_score_r(set_query_lm(setq, set, set->cur),
+                                 mapwid, setq->maphist, n_hist, n_used);
     }
 
     return score;
 }
 
 static int32
-ngram_model_set_raw_score(ngram_model_t * base, int32 wid,
-                          int32 * history, int32 n_hist, int32 * n_used)
+ngram_model_set_raw_score(ngram_model_t * base, ngram_query_t * query,
+                          int32 wid, int32 * history, int32 n_hist,
+                          int32 * n_used)
 {
     ngram_model_set_t *set = (ngram_model_set_t *) base;
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
     int32 mapwid;
     int32 score;
     int32 i;
@@ -744,7 +832,11 @@ ngram_model_set_raw_score(ngram_model_t * base, int32 wid,
         n_hist = base->n - 1;
 
     /* Interpolate if there is no current. */
-    if (set->cur == -1) {
+    if (set->cur == -1 && set_can_lockstep(set)) {
+        score = set_score_lockstep(set, setq, wid, history, n_hist,
+                                   TRUE, n_used);
+    }
+    else if (set->cur == -1) {
         score = base->log_zero;
         for (i = 0; i < set->n_models; ++i) {
             int32 j;
@@ -752,15 +844,15 @@ ngram_model_set_raw_score(ngram_model_t * base, int32 wid,
             mapwid = set->widmap[wid][i];
             for (j = 0; j < n_hist; ++j) {
                 if (history[j] == NGRAM_INVALID_WID)
-                    set->maphist[j] = NGRAM_INVALID_WID;
+                    setq->maphist[j] = NGRAM_INVALID_WID;
                 else
-                    set->maphist[j] = set->widmap[history[j]][i];
+                    setq->maphist[j] = set->widmap[history[j]][i];
             }
             score = logmath_add(base->lmath, score,
                                 set->lweights[i] +
-                                ngram_ng_prob(set->lms[i],
-                                              mapwid, set->maphist, n_hist,
-                                              n_used));
+                                ngram_ng_prob_r(set_query_lm(setq, set, i),
+                                                mapwid, setq->maphist,
+                                                n_hist, n_used));
         }
     }
     else {
@@ -769,17 +861,81 @@ ngram_model_set_raw_score(ngram_model_t * base, int32 wid,
         mapwid = set->widmap[wid][set->cur];
         for (j = 0; j < n_hist; ++j) {
             if (history[j] == NGRAM_INVALID_WID)
-                set->maphist[j] = NGRAM_INVALID_WID;
+                setq->maphist[j] = NGRAM_INVALID_WID;
             else
-                set->maphist[j] = set->widmap[history[j]][set->cur];
+                setq->maphist[j] = set->widmap[history[j]][set->cur];
         }
-        score = ngram_ng_prob(set->lms[set->cur],
-                              mapwid, set->maphist, n_hist, n_used);
+        score = ngram_ng_prob_r(set_query_lm(setq, set, set->cur),
+                                mapwid, setq->maphist, n_hist, n_used);
     }
 
     return score;
 }
 
+/**
+ * Map history and words to submodel lmidx for ngram_model_set_scores().
+ */
+static void
+set_map_words(ngram_model_set_t * set, ngram_query_set_t * setq,
+              int32 lmidx, const int32 * wids, int32 n_wids,
+              int32 * history, int32 n_hist)
+{
+    int32 j;
+
+    for (j = 0; j < n_hist; ++j) {
+        if (history[j] == NGRAM_INVALID_WID)
+            setq->maphist[j] = NGRAM_INVALID_WID;
+        else
+            setq->maphist[j] = set->widmap[history[j]][lmidx];
+    }
+    for (j = 0; j < n_wids; ++j)
+        setq->mapwids[j] = set->widmap[wids[j]][lmidx];
+}
+
+static void
+ngram_model_set_scores(ngram_model_t * base, ngram_query_t * query,
+                       const int32 * wids, int32 n_wids,
+                       int32 * history, int32 n_hist, int32 * out_scores)
+{
+    ngram_model_set_t *set = (ngram_model_set_t *) base;
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
+    int32 i, j;
+
+    /* Truncate the history. */
+    if (n_hist > base->n - 1)
+        n_hist = base->n - 1;
+
+    if (n_wids > setq->n_mapwids_alloc) {
+        setq->n_mapwids_alloc = n_wids;
+        setq->mapwids = ckd_realloc(setq->mapwids,
+                                    n_wids * sizeof(*setq->mapwids));
+        setq->subscores = ckd_realloc(setq->subscores,
+                                      n_wids * sizeof(*setq->subscores));
+    }
+
+    /* Interpolate if there is no current. */
+    if (set->cur == -1) {
+        for (j = 0; j < n_wids; ++j)
+            out_scores[j] = base->log_zero;
+        for (i = 0; i < set->n_models; ++i) {
+            set_map_words(set, setq, i, wids, n_wids, history, n_hist);
+            ngram_ng_scores_r(set_query_lm(setq, set, i),
+                              setq->mapwids, n_wids, setq->maphist,
+                              n_hist, setq->subscores);
+            for (j = 0; j < n_wids; ++j)
+                out_scores[j] = logmath_add(base->lmath, out_scores[j],
+                                            set->lweights[i] +
+                                            setq->subscores[j]);
+        }
+    }
+    else {
+        set_map_words(set, setq, set->cur, wids, n_wids, history, n_hist);
+        ngram_ng_scores_r(set_query_lm(setq, set, set->cur),
+                          setq->mapwids, n_wids, setq->maphist,
+                          n_hist, out_scores);
+    }
+}
+
 static int32
 ngram_model_set_add_ug(ngram_model_t * base, int32 wid, int32 lweight)
 {
@@ -853,14 +1009,99 @@ ngram_model_set_free(ngram_model_t * base)
         ckd_free(set->names[i]);
     ckd_free(set->names);
     ckd_free(set->lweights);
-    ckd_free(set->maphist);
     ckd_free_2d((void **) set->widmap);
 }
 
+static void
+ngram_model_set_flush(ngram_query_t * query)
+{
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
+    int32 i;
+
+    for (i = 0; i < setq->n_queries; ++i)
+        if (setq->queries[i])
+            ngram_query_flush(setq->queries[i]);
+}
+
+void
+ngram_model_set_query_update(ngram_query_t * query)
+{
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
+    ngram_model_set_t *set = (ngram_model_set_t *) query->model;
+    ngram_query_t **queries;
+    int32 i, j;
+
+    /* Keep the query states of the submodels still in the set, and
+     * create the missing ones. */
+    queries = NULL;
+    if (set->n_models > 0)
+        queries = ckd_calloc(set->n_models, sizeof(*queries));
+    for (i = 0; i < set->n_models; ++i) {
+        for (j = 0; j < setq->n_queries; ++j) {
+            if (setq->queries[j] && setq->queries[j]->model == set->lms[i]) {
+                queries[i] = setq->queries[j];
+                setq->queries[j] = NULL;
+                break;
+            }
+        }
+        if (queries[i] == NULL)
+            queries[i] = ngram_query_init(set->lms[i]);
+    }
+    /* And release the removed submodels. */
+    for (j = 0; j < setq->n_queries; ++j)
+        ngram_query_free(setq->queries[j]);
+    ckd_free(setq->queries);
+    setq->queries = queries;
+    setq->n_queries = set->n_models;
+
+    if (set->n_models > setq->n_sub_alloc) {
+        setq->n_sub_alloc = set->n_models;
+        setq->sub_wids = ckd_realloc(setq->sub_wids, set->n_models
+                                     * sizeof(*setq->sub_wids));
+        setq->sub_hists = ckd_realloc(setq->sub_hists, set->n_models
+                                      * (NGRAM_MAX_ORDER - 1)
+                                      * sizeof(*setq->sub_hists));
+        setq->sub_scores = ckd_realloc(setq->sub_scores, set->n_models
+                                       * sizeof(*setq->sub_scores));
+    }
+}
+
+static ngram_query_t *
+ngram_model_set_query_init(ngram_model_t * base)
+{
+    ngram_query_set_t *setq;
+
+    setq = (ngram_query_set_t *) ckd_calloc(1, sizeof(*setq));
+    setq->base.model = base;
+    ngram_model_set_query_update(&setq->base);
+    return &setq->base;
+}
+
+static void
+ngram_model_set_query_free(ngram_query_t * query)
+{
+    ngram_query_set_t *setq = (ngram_query_set_t *) query;
+    int32 i;
+
+    for (i = 0; i < setq->n_queries; ++i)
+        ngram_query_free(setq->queries[i]);
+    ckd_free(setq->queries);
+    ckd_free(setq->mapwids);
+    ckd_free(setq->subscores);
+    ckd_free(setq->sub_wids);
+    ckd_free(setq->sub_hists);
+    ckd_free(setq->sub_scores);
+    ckd_free(setq);
+}
+
 static ngram_funcs_t ngram_model_set_funcs = {
     ngram_model_set_free,       /* free */
     ngram_model_set_apply_weights,      /* apply_weights */
     ngram_model_set_score,      /* score */
     ngram_model_set_raw_score,  /* raw_score */
+    ngram_model_set_scores,     /* scores */
     ngram_model_set_add_ug,     /* add_ug */
+    ngram_model_set_flush,      /* flush */
+    ngram_model_set_query_init, /* query_init */
+    ngram_model_set_query_free  /* query_free */
 };
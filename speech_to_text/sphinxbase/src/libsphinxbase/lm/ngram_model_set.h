@@ -55,10 +55,31 @@ typedef struct ngram_model_set_s {
     ngram_model_t **lms; /**< Language models in this set. */
     char **names;        /**< Names for language models. */
     int32 *lweights;     /**< Log interpolation weights. */
+    int32 weights_gen;   /**< Changed along with lweights. */
     int32 **widmap;      /**< Word ID mapping for submodels. */
-    int32 *maphist;      /**< Word ID mapping for N-Gram history. */
 } ngram_model_set_t;
 
+/**
+ * Query state for a model set.
+ */
+typedef struct ngram_query_set_s {
+    ngram_query_t base;       /**< Base ngram_query_t structure. */
+    int32 n_queries;          /**< Number of entries in queries. */
+    ngram_query_t **queries;  /**< Query states for submodels, see
+                                   ngram_model_set_query_update(). */
+    int32 maphist[NGRAM_MAX_ORDER - 1]; /**< Word ID mapping for N-Gram history. */
+    int32 *mapwids;           /**< Word ID mapping for ngram_ng_scores_r(). */
+    int32 *subscores;         /**< Submodel scores for ngram_ng_scores_r(). */
+    int32 n_mapwids_alloc;    /**< Allocated size of mapwids and subscores. */
+    int32 *sub_wids;          /**< Word mapped to each submodel, for
+                                   set_score_lockstep(). */
+    int32 *sub_hists;         /**< History mapped to each submodel,
+                                   NGRAM_MAX_ORDER - 1 words apart. */
+    int32 *sub_scores;        /**< Score in each submodel. */
+    int32 n_sub_alloc;        /**< Submodels allocated in sub_wids,
+                                   sub_hists and sub_scores. */
+} ngram_query_set_t;
+
 /**
  * Iterator over a model set.
  */
@@ -43,11 +43,36 @@
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/byteorder.h>
+#include <sphinxbase/profile.h>
 
 #include "ngram_model_trie.h"
+#include "lm_trie_quant.h"
 
 static const char trie_hdr[] = "Trie Language Model";
 static const char dmp_hdr[] = "Darpa Trigram LM";
+
+/* Binary files start with trie_hdr. In older files the order follows
+ * it, in newer ones a NUL and the rest of trie_bin_hdr_t. The trie and
+ * the word strings then start at aligned offsets, so that the file can
+ * be memory mapped and used in place. */
+#define TRIE_BIN_VERSION 3
+#define TRIE_BIN_BYTE_ORDER 0x11223344
+
+typedef struct trie_bin_hdr_s {
+    char magic[24];             /**< trie_hdr, padded with NUL */
+    uint64 trie_offset;         /**< Where lm_trie_write_bin() output starts */
+    uint64 trie_size;
+    uint64 word_str_offset;     /**< Where NUL terminated words start */
+    uint64 word_str_size;
+    uint32 byte_order;          /**< TRIE_BIN_BYTE_ORDER as written */
+    uint32 version;             /**< TRIE_BIN_VERSION when written */
+    uint32 order;
+    uint32 counts[NGRAM_MAX_ORDER];
+    uint32 quant_prob_bits;     /**< Zero before version 2, meaning */
+    uint32 quant_bo_bits;       /**< LM_TRIE_QUANT_DEFAULT_BITS */
+    uint32 next_ef;             /**< Whether next pointers are Elias-Fano
+                                   coded, zero before version 3 */
+} trie_bin_hdr_t;
 static ngram_funcs_t ngram_model_trie_funcs;
 
 /*
@@ -160,6 +185,41 @@ read_1grams_arpa(lineiter_t ** li, uint32 count, ngram_model_t * base,
     return 0;
 }
 
+/* Number of threads to load a model with, from -lmthreads if present. */
+static int
+load_threads(cmd_ln_t * config)
+{
+    if (config && cmd_ln_exists_r(config, "-lmthreads")
+        && cmd_ln_int32_r(config, "-lmthreads") > 1)
+        return cmd_ln_int32_r(config, "-lmthreads");
+    return 1;
+}
+
+/* Bits to quantize N-gram weights with, from option name if present. */
+static int
+quant_bits(cmd_ln_t * config, const char *name)
+{
+    int bits;
+
+    if (config == NULL || !cmd_ln_exists_r(config, name))
+        return LM_TRIE_QUANT_DEFAULT_BITS;
+    bits = cmd_ln_int32_r(config, name);
+    if (bits < 1 || bits > LM_TRIE_QUANT_MAX_BITS) {
+        E_WARN("%s must be between 1 and %d, using %d\n", name,
+               LM_TRIE_QUANT_MAX_BITS, LM_TRIE_QUANT_DEFAULT_BITS);
+        return LM_TRIE_QUANT_DEFAULT_BITS;
+    }
+    return bits;
+}
+
+/* Whether to Elias-Fano code the next pointers of the trie. */
+static int
+next_ef(cmd_ln_t * config)
+{
+    return config && cmd_ln_exists_r(config, "-lmeliasfano")
+        && cmd_ln_boolean_r(config, "-lmeliasfano");
+}
+
 ngram_model_t *
 ngram_model_trie_read_arpa(cmd_ln_t * config,
                            const char *path, logmath_t * lmath)
@@ -171,6 +231,8 @@ ngram_model_trie_read_arpa(cmd_ln_t * config,
     ngram_raw_t **raw_ngrams;
     int32 is_pipe;
     uint32 counts[NGRAM_MAX_ORDER];
+    ptmr_t tm_read, tm_sort, tm_build;
+    int n_threads;
     int order;
     int i;
 
@@ -180,6 +242,12 @@ ngram_model_trie_read_arpa(cmd_ln_t * config,
         return NULL;
     }
 
+    n_threads = load_threads(config);
+    ptmr_init(&tm_read);
+    ptmr_init(&tm_sort);
+    ptmr_init(&tm_build);
+    ptmr_start(&tm_read);
+
     model = (ngram_model_trie_t *) ckd_calloc(1, sizeof(*model));
     li = lineiter_start_clean(fp);
     /* Read n-gram counts from file */
@@ -200,7 +268,10 @@ ngram_model_trie_read_arpa(cmd_ln_t * config,
                      (int32) counts[0]);
     base->writable = TRUE;
 
-    model->trie = lm_trie_create(counts[0], order);
+    model->trie = lm_trie_create(counts[0], order,
+                                 quant_bits(config, "-lmprobbits"),
+                                 quant_bits(config, "-lmbobits"),
+                                 next_ef(config));
     if (read_1grams_arpa(&li, counts[0], base, model->trie->unigrams) < 0) {
 	ngram_model_free(base);
         lineiter_free(li);
@@ -211,20 +282,34 @@ ngram_model_trie_read_arpa(cmd_ln_t * config,
     if (order > 1) {
         raw_ngrams =
             ngrams_raw_read_arpa(&li, base->lmath, counts, order,
-                                 base->wid);
+                                 base->wid, n_threads);
         if (raw_ngrams == NULL) {
             ngram_model_free(base);
             lineiter_free(li);
             fclose_comp(fp, is_pipe);
             return NULL;
         }
-        lm_trie_build(model->trie, raw_ngrams, counts, base->n_counts, order);
+        ptmr_stop(&tm_read);
+        ptmr_start(&tm_sort);
+        ngrams_raw_sort(raw_ngrams, counts, order, n_threads);
+        ptmr_stop(&tm_sort);
+        ptmr_start(&tm_build);
+        lm_trie_build(model->trie, raw_ngrams, counts, base->n_counts, order,
+                      n_threads);
         ngrams_raw_free(raw_ngrams, counts, order);
+        ptmr_stop(&tm_build);
+    }
+    else {
+        ptmr_stop(&tm_read);
     }
 
     lineiter_free(li);
     fclose_comp(fp, is_pipe);
 
+    E_INFO("Loaded LM with %d thread(s): read %.2f s, sort %.2f s, "
+           "build %.2f s (wall)\n", n_threads, tm_read.t_elapsed,
+           tm_sort.t_elapsed, tm_build.t_elapsed);
+
     return base;
 }
 
@@ -302,16 +387,11 @@ ngram_model_trie_write_arpa(ngram_model_t * base, const char *path)
 }
 
 static void
-read_word_str(ngram_model_t * base, FILE * fp)
+set_word_str(ngram_model_t * base, const char *tmp_word_str, int32 k)
 {
-    int32 k;
     uint32 i, j;
-    char *tmp_word_str;
-    /* read ascii word strings */
+
     base->writable = TRUE;
-    fread(&k, sizeof(k), 1, fp);
-    tmp_word_str = (char *) ckd_calloc((size_t) k, 1);
-    fread(tmp_word_str, 1, (size_t) k, fp);
 
     /* First make sure string just read contains n_counts[0] words (PARANOIA!!) */
     for (i = 0, j = 0; i < (uint32) k; i++)
@@ -334,7 +414,145 @@ read_word_str(ngram_model_t * base, FILE * fp)
         }
         j += strlen(base->word_str[i]) + 1;
     }
-    free(tmp_word_str);
+}
+
+static void
+read_word_str(ngram_model_t * base, FILE * fp)
+{
+    int32 k;
+    char *tmp_word_str;
+    /* read ascii word strings */
+    fread(&k, sizeof(k), 1, fp);
+    tmp_word_str = (char *) ckd_calloc((size_t) k, 1);
+    fread(tmp_word_str, 1, (size_t) k, fp);
+    set_word_str(base, tmp_word_str, k);
+    ckd_free(tmp_word_str);
+}
+
+/* Read up to offset pos, which works on pipes too. */
+static int
+skip_to(FILE * fp, size_t * pos, size_t offset)
+{
+    char buf[LM_TRIE_ALIGN];
+
+    while (*pos < offset) {
+        size_t n = offset - *pos < sizeof(buf) ? offset - *pos : sizeof(buf);
+        if (fread(buf, 1, n, fp) != n)
+            return -1;
+        *pos += n;
+    }
+    return *pos == offset ? 0 : -1;
+}
+
+/* Read the rest of a binary file written with alignment, after the
+ * first byte following trie_hdr. */
+static ngram_model_t *
+read_bin_aligned(cmd_ln_t * config, const char *path, logmath_t * lmath,
+                 FILE * fp, int32 is_pipe)
+{
+    trie_bin_hdr_t hdr;
+    ngram_model_trie_t *model;
+    ngram_model_t *base;
+    uint8 *mem;
+    char *word_str;
+    size_t pos;
+    int do_mmap;
+    uint32 i;
+
+    pos = strlen(trie_hdr) + 1;
+    memset(&hdr, 0, sizeof(hdr));
+    if (fread((char *) &hdr + pos, 1, sizeof(hdr) - pos, fp)
+        != sizeof(hdr) - pos) {
+        E_ERROR("Truncated binary LM header in %s\n", path);
+        return NULL;
+    }
+    pos = sizeof(hdr);
+    if (hdr.byte_order != TRIE_BIN_BYTE_ORDER) {
+        E_ERROR("%s was written with other byte order\n", path);
+        return NULL;
+    }
+    if (hdr.version > TRIE_BIN_VERSION || hdr.order < 1
+        || hdr.order > NGRAM_MAX_ORDER || hdr.trie_offset < pos
+        || hdr.word_str_offset < hdr.trie_offset + hdr.trie_size
+        || hdr.quant_prob_bits > LM_TRIE_QUANT_MAX_BITS
+        || hdr.quant_bo_bits > LM_TRIE_QUANT_MAX_BITS) {
+        E_ERROR("Unsupported binary LM version %u or bad header in %s\n",
+                hdr.version, path);
+        return NULL;
+    }
+    if (hdr.quant_prob_bits == 0)
+        hdr.quant_prob_bits = LM_TRIE_QUANT_DEFAULT_BITS;
+    if (hdr.quant_bo_bits == 0)
+        hdr.quant_bo_bits = LM_TRIE_QUANT_DEFAULT_BITS;
+    if (!is_pipe) {
+        fseek(fp, 0, SEEK_END);
+        if ((uint64) ftell(fp) < hdr.word_str_offset + hdr.word_str_size) {
+            E_ERROR("Binary LM %s is truncated\n", path);
+            return NULL;
+        }
+        fseek(fp, pos, SEEK_SET);
+    }
+
+    model = (ngram_model_trie_t *) ckd_calloc(1, sizeof(*model));
+    base = &model->base;
+    ngram_model_init(base, &ngram_model_trie_funcs, lmath, hdr.order,
+                     (int32) hdr.counts[0]);
+    for (i = 0; i < hdr.order; i++) {
+        base->n_counts[i] = hdr.counts[i];
+    }
+
+    /* Use the file in place if possible, otherwise read it in. */
+    do_mmap = !is_pipe;
+    if (config && cmd_ln_exists_r(config, "-mmap"))
+        do_mmap = do_mmap && cmd_ln_boolean_r(config, "-mmap");
+    if (do_mmap)
+        model->filemap = mmio_file_read(path);
+    if (model->filemap) {
+        E_INFO("Memory mapping binary LM\n");
+        mem = (uint8 *) mmio_file_ptr(model->filemap);
+        model->trie = lm_trie_map_bin(hdr.counts, hdr.order,
+                                      hdr.quant_prob_bits, hdr.quant_bo_bits,
+                                      hdr.next_ef != 0,
+                                      mem + hdr.trie_offset,
+                                      (size_t) hdr.trie_size);
+        word_str = (char *) mem + hdr.word_str_offset;
+    }
+    else {
+        mem = (uint8 *) ckd_malloc((size_t) hdr.trie_size);
+        word_str = (char *) ckd_malloc((size_t) hdr.word_str_size);
+        if (skip_to(fp, &pos, (size_t) hdr.trie_offset) < 0
+            || fread(mem, 1, (size_t) hdr.trie_size, fp) != hdr.trie_size
+            || (pos += (size_t) hdr.trie_size,
+                skip_to(fp, &pos, (size_t) hdr.word_str_offset) < 0)
+            || fread(word_str, 1, (size_t) hdr.word_str_size, fp)
+               != hdr.word_str_size) {
+            E_ERROR("Failed to read binary LM %s\n", path);
+            model->trie = NULL;
+        }
+        else
+            model->trie = lm_trie_map_bin(hdr.counts, hdr.order,
+                                          hdr.quant_prob_bits,
+                                          hdr.quant_bo_bits,
+                                          hdr.next_ef != 0, mem,
+                                          (size_t) hdr.trie_size);
+        if (model->trie)
+            model->trie->bin_mem = mem;
+        else
+            ckd_free(mem);
+    }
+    if (model->trie == NULL) {
+        if (model->filemap == NULL)
+            ckd_free(word_str);
+        ngram_model_free(base);
+        return NULL;
+    }
+
+    /* Words are copied, so that more can be added */
+    set_word_str(base, word_str, (int32) hdr.word_str_size);
+    if (model->filemap == NULL)
+        ckd_free(word_str);
+
+    return base;
 }
 
 ngram_model_t *
@@ -366,9 +584,15 @@ ngram_model_trie_read_bin(cmd_ln_t * config,
         fclose_comp(fp, is_pipe);
         return NULL;
     }
+    fread(&order, sizeof(order), 1, fp);
+    if (order == 0) {
+        base = read_bin_aligned(config, path, lmath, fp, is_pipe);
+        fclose_comp(fp, is_pipe);
+        return base;
+    }
+
     model = (ngram_model_trie_t *) ckd_calloc(1, sizeof(*model));
     base = &model->base;
-    fread(&order, sizeof(order), 1, fp);
     for (i = 0; i < order; i++) {
         fread(&counts[i], sizeof(counts[i]), 1, fp);
     }
@@ -385,40 +609,43 @@ ngram_model_trie_read_bin(cmd_ln_t * config,
     return base;
 }
 
-static void
-write_word_str(FILE * fp, ngram_model_t * model)
-{
-    int32 k;
-    uint32 i;
-
-    k = 0;
-    for (i = 0; i < model->n_counts[0]; i++)
-        k += strlen(model->word_str[i]) + 1;
-    fwrite(&k, sizeof(k), 1, fp);
-    for (i = 0; i < model->n_counts[0]; i++)
-        fwrite(model->word_str[i], 1, strlen(model->word_str[i]) + 1, fp);
-}
-
 int
 ngram_model_trie_write_bin(ngram_model_t * base, const char *path)
 {
+    static const uint8 zeros[LM_TRIE_ALIGN];
     int i;
     int32 is_pipe;
     ngram_model_trie_t *model = (ngram_model_trie_t *) base;
+    trie_bin_hdr_t hdr;
     FILE *fp = fopen_comp(path, "wb", &is_pipe);
     if (!fp) {
         E_ERROR("Unable to open %s to write binary trie LM\n", path);
         return -1;
     }
 
-    fwrite(trie_hdr, sizeof(*trie_hdr), strlen(trie_hdr), fp);
-    fwrite(&model->base.n, sizeof(model->base.n), 1, fp);
-    for (i = 0; i < model->base.n; i++) {
-        fwrite(&model->base.n_counts[i], sizeof(model->base.n_counts[i]),
-               1, fp);
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, trie_hdr);
+    hdr.byte_order = TRIE_BIN_BYTE_ORDER;
+    hdr.version = TRIE_BIN_VERSION;
+    hdr.order = base->n;
+    for (i = 0; i < base->n; i++)
+        hdr.counts[i] = base->n_counts[i];
+    if (model->trie->quant) {
+        hdr.quant_prob_bits = lm_trie_quant_prob_bits(model->trie->quant);
+        hdr.quant_bo_bits = lm_trie_quant_bo_bits(model->trie->quant);
     }
+    hdr.next_ef = model->trie->next_ef;
+    hdr.trie_offset = lm_trie_align(sizeof(hdr));
+    hdr.trie_size = lm_trie_bin_size(model->trie, base->n_counts[0]);
+    hdr.word_str_offset = hdr.trie_offset + hdr.trie_size;
+    for (i = 0; i < (int) base->n_counts[0]; i++)
+        hdr.word_str_size += strlen(base->word_str[i]) + 1;
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(zeros, 1, (size_t) hdr.trie_offset - sizeof(hdr), fp);
     lm_trie_write_bin(model->trie, base->n_counts[0], fp);
-    write_word_str(fp, base);
+    for (i = 0; i < (int) base->n_counts[0]; i++)
+        fwrite(base->word_str[i], 1, strlen(base->word_str[i]) + 1, fp);
     fclose_comp(fp, is_pipe);
     return 0;
 }
@@ -537,7 +764,10 @@ ngram_model_trie_read_dmp(cmd_ln_t * config,
     ngram_model_init(base, &ngram_model_trie_funcs, lmath, order,
                      (int32) counts[0]);
 
-    model->trie = lm_trie_create(counts[0], order);
+    model->trie = lm_trie_create(counts[0], order,
+                                 quant_bits(config, "-lmprobbits"),
+                                 quant_bits(config, "-lmbobits"),
+                                 next_ef(config));
 
     unigram_next =
         (uint32 *) ckd_calloc((int32) counts[0] + 1, sizeof(unigram_next));
@@ -574,7 +804,8 @@ ngram_model_trie_read_dmp(cmd_ln_t * config,
             fclose_comp(fp, is_pipe);
             return NULL;
         }
-        lm_trie_build(model->trie, raw_ngrams, counts, base->n_counts, order);        
+        lm_trie_build(model->trie, raw_ngrams, counts, base->n_counts, order,
+                      load_threads(config));
         ngrams_raw_free(raw_ngrams, counts, order);
     }
     
@@ -592,7 +823,10 @@ static void
 ngram_model_trie_free(ngram_model_t * base)
 {
     ngram_model_trie_t *model = (ngram_model_trie_t *) base;
-    lm_trie_free(model->trie);
+    if (model->trie)
+        lm_trie_free(model->trie);
+    if (model->filemap)
+        mmio_file_unmap(model->filemap);
 }
 
 static int
@@ -610,33 +844,143 @@ weight_score(ngram_model_t * base, int32 score)
     return (int32) (score * base->lw + base->log_wip);
 }
 
+static ngram_query_t *
+ngram_model_trie_query_init(ngram_model_t * base)
+{
+    ngram_query_trie_t *query;
+
+    query = (ngram_query_trie_t *) ckd_calloc(1, sizeof(*query));
+    query->base.model = base;
+    lm_trie_state_reset(&query->state);
+    return &query->base;
+}
+
+static void
+ngram_model_trie_query_free(ngram_query_t * query)
+{
+    ckd_free(query);
+}
+
+/**
+ * Length of the part of hist usable for scoring, which ends at the
+ * model order or the first invalid word.
+ */
 static int32
-ngram_model_trie_raw_score(ngram_model_t * base, int32 wid, int32 * hist,
-                           int32 n_hist, int32 * n_used)
+usable_hist(ngram_model_t * base, int32 * hist, int32 n_hist)
 {
     int32 i;
-    ngram_model_trie_t *model = (ngram_model_trie_t *) base;
 
-    if (n_hist > model->base.n - 1)
-        n_hist = model->base.n - 1;
+    if (n_hist > base->n - 1)
+        n_hist = base->n - 1;
     for (i = 0; i < n_hist; i++) {
-        if (hist[i] < 0) {
-            n_hist = i;
-            break;
-        }
+        if (hist[i] < 0)
+            return i;
     }
+    return n_hist;
+}
+
+static int32
+ngram_model_trie_raw_score(ngram_model_t * base, ngram_query_t * query,
+                           int32 wid, int32 * hist, int32 n_hist,
+                           int32 * n_used)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *) base;
 
-    return (int32) lm_trie_score(model->trie, model->base.n, wid, hist,
-                                 n_hist, n_used);
+    n_hist = usable_hist(base, hist, n_hist);
+    return (int32) lm_trie_score(model->trie,
+                                 &((ngram_query_trie_t *) query)->state,
+                                 model->base.n, wid, hist, n_hist, n_used);
 }
 
 static int32
-ngram_model_trie_score(ngram_model_t * base, int32 wid, int32 * hist,
-                       int32 n_hist, int32 * n_used)
+ngram_model_trie_score(ngram_model_t * base, ngram_query_t * query,
+                       int32 wid, int32 * hist, int32 n_hist,
+                       int32 * n_used)
 {
     return weight_score(base,
-                        ngram_model_trie_raw_score(base, wid, hist, n_hist,
-                                                   n_used));
+                        ngram_model_trie_raw_score(base, query, wid, hist,
+                                                   n_hist, n_used));
+}
+
+static void
+ngram_model_trie_scores(ngram_model_t * base, ngram_query_t * query,
+                        const int32 * wids, int32 n_wids,
+                        int32 * hist, int32 n_hist, int32 * out_scores)
+{
+    ngram_model_trie_t *model = (ngram_model_trie_t *) base;
+    int32 i;
+
+    n_hist = usable_hist(base, hist, n_hist);
+    lm_trie_scores(model->trie, &((ngram_query_trie_t *) query)->state,
+                   model->base.n, wids, n_wids, hist, n_hist, out_scores);
+    for (i = 0; i < n_wids; i++)
+        out_scores[i] = weight_score(base, out_scores[i]);
+}
+
+int
+ngram_model_is_trie(ngram_model_t * base)
+{
+    return base->funcs == &ngram_model_trie_funcs;
+}
+
+/* Scores the n words gathered by ngram_model_trie_score_lockstep(). */
+static void
+score_lockstep(ngram_model_t ** models, lm_trie_t ** tries,
+               lm_trie_state_t ** states, const int32 * orders,
+               const int32 * idx, int32 n, const int32 * wids,
+               int32 * const *hists, const int32 * n_hists, int raw,
+               int32 * out_scores, int32 * n_used)
+{
+    float scores[LM_TRIE_LOCKSTEP];
+    int32 used[LM_TRIE_LOCKSTEP];
+    int32 i;
+
+    lm_trie_score_lockstep(tries, states, orders, n, wids, hists, n_hists,
+                           scores, used);
+    for (i = 0; i < n; i++) {
+        out_scores[idx[i]] = raw ? (int32) scores[i]
+            : weight_score(models[idx[i]], (int32) scores[i]);
+    }
+    *n_used = used[n - 1];
+}
+
+void
+ngram_model_trie_score_lockstep(ngram_model_t ** models,
+                                ngram_query_t ** queries, int32 n_models,
+                                const int32 * wids, int32 * hists,
+                                int32 n_hist, int raw, int32 * out_scores,
+                                int32 * n_used)
+{
+    lm_trie_t *tries[LM_TRIE_LOCKSTEP];
+    lm_trie_state_t *states[LM_TRIE_LOCKSTEP];
+    int32 *thists[LM_TRIE_LOCKSTEP];
+    int32 orders[LM_TRIE_LOCKSTEP], twids[LM_TRIE_LOCKSTEP];
+    int32 n_hists[LM_TRIE_LOCKSTEP], idx[LM_TRIE_LOCKSTEP];
+    int32 i, n;
+
+    n = 0;
+    for (i = 0; i < n_models; i++) {
+        /* Closed vocabulary, as in ngram_ng_score_r(). */
+        if (wids[i] == NGRAM_INVALID_WID) {
+            out_scores[i] = models[i]->log_zero;
+            continue;
+        }
+        tries[n] = ((ngram_model_trie_t *) models[i])->trie;
+        states[n] = &((ngram_query_trie_t *) queries[i])->state;
+        orders[n] = models[i]->n;
+        twids[n] = wids[i];
+        thists[n] = hists + i * (NGRAM_MAX_ORDER - 1);
+        n_hists[n] = usable_hist(models[i], thists[n], n_hist);
+        idx[n] = i;
+        if (++n == LM_TRIE_LOCKSTEP) {
+            score_lockstep(models, tries, states, orders, idx, n, twids,
+                           thists, n_hists, raw, out_scores, n_used);
+            n = 0;
+        }
+    }
+    if (n > 0)
+        score_lockstep(models, tries, states, orders, idx, n, twids,
+                       thists, n_hists, raw, out_scores, n_used);
 }
 
 static int32
@@ -647,7 +991,16 @@ lm_trie_add_ug(ngram_model_t * base, int32 wid, int32 lweight)
     /* This would be very bad if this happened! */
     assert(!NGRAM_IS_CLASSWID(wid));
 
-    /* Reallocate unigram array. */
+    /* Reallocate unigram array, moving it out of the binary file. */
+    if (model->trie->unigrams_in_place) {
+        unigram_t *unigrams = model->trie->unigrams;
+        model->trie->unigrams =
+            (unigram_t *) ckd_calloc(base->n_counts[0] + 1,
+                                     sizeof(*unigrams));
+        memcpy(model->trie->unigrams, unigrams,
+               (base->n_counts[0] + 1) * sizeof(*unigrams));
+        model->trie->unigrams_in_place = FALSE;
+    }
     model->trie->unigrams =
         (unigram_t *) ckd_realloc(model->trie->unigrams,
                                   sizeof(*model->trie->unigrams) *
@@ -674,13 +1027,9 @@ lm_trie_add_ug(ngram_model_t * base, int32 wid, int32 lweight)
 }
 
 static void
-lm_trie_flush(ngram_model_t * base)
+lm_trie_flush(ngram_query_t * query)
 {
-    ngram_model_trie_t *model = (ngram_model_trie_t *) base;
-    lm_trie_t *trie = model->trie;
-    memset(trie->hist_cache, -1, sizeof(trie->hist_cache));
-    memset(trie->backoff_cache, 0, sizeof(trie->backoff_cache));
-    return;
+    lm_trie_state_reset(&((ngram_query_trie_t *) query)->state);
 }
 
 static ngram_funcs_t ngram_model_trie_funcs = {
@@ -688,6 +1037,9 @@ static ngram_funcs_t ngram_model_trie_funcs = {
     trie_apply_weights,         /* apply_weights */
     ngram_model_trie_score,     /* score */
     ngram_model_trie_raw_score, /* raw_score */
+    ngram_model_trie_scores,    /* scores */
     lm_trie_add_ug,             /* add_ug */
-    lm_trie_flush               /* flush */
+    lm_trie_flush,              /* flush */
+    ngram_model_trie_query_init,        /* query_init */
+    ngram_model_trie_query_free /* query_free */
 };
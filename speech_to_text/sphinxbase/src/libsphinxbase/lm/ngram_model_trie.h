@@ -39,6 +39,7 @@
 
 #include <sphinxbase/prim_type.h>
 #include <sphinxbase/logmath.h>
+#include <sphinxbase/mmio.h>
 
 #include "ngram_model_internal.h"
 #include "lm_trie.h"
@@ -46,8 +47,17 @@
 typedef struct ngram_model_trie_s {
     ngram_model_t base;  /**< Base ngram_model_t structure */
     lm_trie_t *trie;     /**< Trie structure that stores ngram relations and weights */
+    mmio_file_t *filemap; /**< Binary file the trie uses in place, if mapped */
 } ngram_model_trie_t;
 
+/**
+ * Query state for a trie model.
+ */
+typedef struct ngram_query_trie_s {
+    ngram_query_t base;     /**< Base ngram_query_t structure */
+    lm_trie_state_t state;  /**< History cache for lm_trie_score() */
+} ngram_query_trie_t;
+
 /**
  * Read N-Gram model from and ARPABO text file and arrange it in trie structure
  */
@@ -61,14 +71,16 @@ ngram_model_t *ngram_model_trie_read_arpa(cmd_ln_t * config,
 int ngram_model_trie_write_arpa(ngram_model_t * base, const char *path);
 
 /**
- * Read N-Gram model from the binary file and arrange it in a trie structure
+ * Read N-Gram model from the binary file and arrange it in a trie structure.
+ * Files written by ngram_model_trie_write_bin() are memory mapped and used
+ * in place unless -mmap is off in config or the file is compressed.
  */
 ngram_model_t *ngram_model_trie_read_bin(cmd_ln_t * config,
                                          const char *path,
                                          logmath_t * lmath);
 
 /**
- * Write trie to binary file
+ * Write trie to binary file, in a layout which can be memory mapped
  */
 int ngram_model_trie_write_bin(ngram_model_t * model, const char *path);
 
@@ -79,4 +91,24 @@ ngram_model_t *ngram_model_trie_read_dmp(cmd_ln_t * config,
                                          const char *file_name,
                                          logmath_t * lmath);
 
+/**
+ * Whether base is a trie model, which ngram_model_trie_score_lockstep()
+ * can score.
+ */
+int ngram_model_is_trie(ngram_model_t * base);
+
+/**
+ * Scores wids[i] in each of n_models trie models without classes, with
+ * the query states in queries, and the history of n_hist words at
+ * hists + i * (NGRAM_MAX_ORDER - 1).  Gives the same scores as
+ * ngram_ng_score_r() (or ngram_ng_prob_r() if raw is TRUE) in each
+ * model, but looks them up in all tries at once.  n_used is set as by
+ * the last model in which the word is known.
+ */
+void ngram_model_trie_score_lockstep(ngram_model_t ** models,
+                                     ngram_query_t ** queries,
+                                     int32 n_models, const int32 * wids,
+                                     int32 * hists, int32 n_hist, int raw,
+                                     int32 * out_scores, int32 * n_used);
+
 #endif                          /* __NGRAM_MODEL_TRIE_H__ */
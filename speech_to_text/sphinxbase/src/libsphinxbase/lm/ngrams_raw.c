@@ -36,16 +36,101 @@
  */
 
 #include <string.h>
+#include <float.h>
 
 #include <sphinxbase/err.h>
 #include <sphinxbase/pio.h>
 #include <sphinxbase/strfuncs.h>
 #include <sphinxbase/ckd_alloc.h>
 #include <sphinxbase/byteorder.h>
+#include <sphinxbase/sbthread.h>
 
 #include "ngram_model_internal.h"
 #include "ngrams_raw.h"
 
+/*
+ * Lines of an N-gram section handed to each thread at a time.  The
+ * calling thread reads the next block from the file while the others
+ * parse the current one.
+ */
+#define NGRAMS_RAW_BLOCK_LINES 16384
+
+/* Sections with fewer N-grams than this per thread are sorted serially. */
+#define NGRAMS_RAW_SORT_MIN 8192
+
+/*
+ * A unit of work run by start_jobs() and finish_jobs(); the structures
+ * for each kind of job begin with this.
+ */
+typedef struct ngram_job_s {
+    void (*run)(struct ngram_job_s *job);
+} ngram_job_t;
+
+/* Lines read from one N-gram section, stored back to back. */
+typedef struct ngram_block_s {
+    char *buf;
+    size_t buf_size;
+    size_t buf_alloc;
+    size_t *line_off;
+    uint32 n_lines;
+} ngram_block_t;
+
+typedef struct ngram_parse_job_s {
+    ngram_job_t base;
+    ngram_block_t *blk;
+    uint32 first;               /* first line of blk to parse */
+    uint32 n_lines;
+    uint32 n_parsed;            /* lines parsed before a format error */
+    ngram_raw_t *raw_ngrams;    /* output for line first */
+    hash_table_t *wid;
+    logmath_t *lmath;
+    sbmtx_t *mtx;
+    int order;
+    int order_max;
+} ngram_parse_job_t;
+
+typedef struct ngram_sort_job_s {
+    ngram_job_t base;
+    ngram_raw_t *src;
+    ngram_raw_t *dst;           /* NULL to sort src in place */
+    uint32 n_left;              /* first sorted run of src */
+    uint32 n_right;             /* second sorted run of src */
+} ngram_sort_job_t;
+
+static int
+ngram_job_thread(sbthread_t * th)
+{
+    ngram_job_t *job = (ngram_job_t *) sbthread_arg(th);
+    job->run(job);
+    return 0;
+}
+
+/*
+ * Starts a thread for each of jobs.  threads[i] is left NULL for a job
+ * whose thread could not be started; finish_jobs() runs those instead.
+ */
+static void
+start_jobs(ngram_job_t ** jobs, sbthread_t ** threads, int n_jobs)
+{
+    int i;
+
+    for (i = 0; i < n_jobs; i++)
+        threads[i] = sbthread_start(NULL, ngram_job_thread, jobs[i]);
+}
+
+static void
+finish_jobs(ngram_job_t ** jobs, sbthread_t ** threads, int n_jobs)
+{
+    int i;
+
+    for (i = 0; i < n_jobs; i++) {
+        if (threads[i] == NULL)
+            jobs[i]->run(jobs[i]);
+        else
+            sbthread_free(threads[i]);
+    }
+}
+
 int
 ngram_ord_comparator(const void *a_raw, const void *b_raw)
 {
@@ -67,10 +152,42 @@ ngram_ord_comparator(const void *a_raw, const void *b_raw)
     return a->order - b->order;
 }
 
+/*
+ * sb_strtod() keeps its big number cache in static storage, so only
+ * numbers it converts on its exact fast path (at most DBL_DIG digits and
+ * no exponent) may be parsed concurrently; others take mtx.
+ */
+static double
+ngram_atof(char const *str, sbmtx_t * mtx)
+{
+    char const *c;
+    int n_digits;
+    double rv;
+
+    if (mtx == NULL)
+        return atof_c(str);
+    for (n_digits = 0, c = str; *c; ++c) {
+        if (*c >= '0' && *c <= '9')
+            ++n_digits;
+        else if (*c == 'e' || *c == 'E')
+            break;
+    }
+    if (*c == '\0' && n_digits <= DBL_DIG)
+        return atof_c(str);
+    sbmtx_lock(mtx);
+    rv = atof_c(str);
+    sbmtx_unlock(mtx);
+    return rv;
+}
+
+/*
+ * Parses one line of an N-gram section.  Modifies buf.  Safe to call
+ * from several threads at once given a mutex for ngram_atof().
+ */
 static int
-read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
-                    logmath_t * lmath, int order, int order_max,
-                    ngram_raw_t * raw_ngram)
+parse_ngram_line(char *buf, hash_table_t * wid, logmath_t * lmath,
+                 int order, int order_max, sbmtx_t * mtx,
+                 ngram_raw_t * raw_ngram)
 {
     int n;
     int words_expected;
@@ -78,25 +195,17 @@ read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
     char *wptr[NGRAM_MAX_ORDER + 1];
     uint32 *word_out;
 
-    if (*li) 
-        *li = lineiter_next(*li);
-    if (*li == NULL) {
-        E_ERROR("Unexpected end of ARPA file. Failed to read %d-gram\n",
-                order);
-        return -1;
-    }
     words_expected = order + 1;
     if ((n =
-         str2words((*li)->buf, wptr,
-                   NGRAM_MAX_ORDER + 1)) < words_expected) {
-        E_ERROR("Format error; %d-gram ignored: %s\n", order, (*li)->buf);
+         str2words(buf, wptr, NGRAM_MAX_ORDER + 1)) < words_expected) {
+        E_ERROR("Format error; %d-gram ignored: %s\n", order, buf);
         return -1;
     }
 
     raw_ngram->order = order;
 
     if (order == order_max) {
-        raw_ngram->prob = atof_c(wptr[0]);
+        raw_ngram->prob = ngram_atof(wptr[0], mtx);
         if (raw_ngram->prob > 0) {
             E_WARN("%d-gram '%s' has positive probability\n", order, wptr[1]);
             raw_ngram->prob = 0.0f;
@@ -107,7 +216,7 @@ read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
     else {
         float weight, backoff;
 
-        weight = atof_c(wptr[0]);
+        weight = ngram_atof(wptr[0], mtx);
         if (weight > 0) {
             E_WARN("%d-gram '%s' has positive probability\n", order, wptr[1]);
             raw_ngram->prob = 0.0f;
@@ -121,7 +230,7 @@ read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
             raw_ngram->backoff = 0.0f;
         }
         else {
-            backoff = atof_c(wptr[order + 1]);
+            backoff = ngram_atof(wptr[order + 1], mtx);
             raw_ngram->backoff =
                 logmath_log10_to_log_float(lmath, backoff);
         }
@@ -135,10 +244,263 @@ read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
     return 0;
 }
 
+static int
+read_ngram_instance(lineiter_t ** li, hash_table_t * wid,
+                    logmath_t * lmath, int order, int order_max,
+                    ngram_raw_t * raw_ngram)
+{
+    if (*li) 
+        *li = lineiter_next(*li);
+    if (*li == NULL) {
+        E_ERROR("Unexpected end of ARPA file. Failed to read %d-gram\n",
+                order);
+        return -1;
+    }
+    return parse_ngram_line((*li)->buf, wid, lmath, order, order_max,
+                            NULL, raw_ngram);
+}
+
+static void
+parse_ngram_job(ngram_job_t * base)
+{
+    ngram_parse_job_t *job = (ngram_parse_job_t *) base;
+
+    for (job->n_parsed = 0; job->n_parsed < job->n_lines; ++job->n_parsed) {
+        char *buf = job->blk->buf
+            + job->blk->line_off[job->first + job->n_parsed];
+        if (parse_ngram_line(buf, job->wid, job->lmath, job->order,
+                             job->order_max, job->mtx,
+                             &job->raw_ngrams[job->n_parsed]) < 0)
+            break;
+    }
+}
+
+/*
+ * Copies up to n_lines lines of an N-gram section into blk.  Returns
+ * the number of lines read, which is short only at the end of the file.
+ */
+static uint32
+read_ngram_block(lineiter_t ** li, ngram_block_t * blk, uint32 n_lines,
+                 int order)
+{
+    blk->n_lines = 0;
+    blk->buf_size = 0;
+    blk->line_off = (size_t *) ckd_realloc(blk->line_off,
+                                           n_lines * sizeof(*blk->line_off));
+    while (blk->n_lines < n_lines) {
+        size_t len;
+
+        if (*li)
+            *li = lineiter_next(*li);
+        if (*li == NULL) {
+            E_ERROR("Unexpected end of ARPA file. Failed to read %d-gram\n",
+                    order);
+            break;
+        }
+        len = strlen((*li)->buf) + 1;
+        if (blk->buf_size + len > blk->buf_alloc) {
+            blk->buf_alloc = (blk->buf_size + len) * 2;
+            blk->buf = (char *) ckd_realloc(blk->buf, blk->buf_alloc);
+        }
+        memcpy(blk->buf + blk->buf_size, (*li)->buf, len);
+        blk->line_off[blk->n_lines++] = blk->buf_size;
+        blk->buf_size += len;
+    }
+    return blk->n_lines;
+}
+
+/*
+ * Reads count N-grams into raw_ngrams, splitting each block of lines
+ * among n_threads threads while the next block is read from the file.
+ * Like the serial reader, stops at the first bad line and leaves the
+ * N-grams after it empty.
+ */
+static void
+read_ngrams_threaded(ngram_raw_t * raw_ngrams, lineiter_t ** li,
+                     hash_table_t * wid, logmath_t * lmath, uint32 count,
+                     int order, int order_max, int n_threads)
+{
+    ngram_block_t blk[2];
+    ngram_parse_job_t *jobs;
+    ngram_job_t **job_ptrs;
+    sbthread_t **threads;
+    sbmtx_t *mtx;
+    uint32 block_lines, n_done, n_read;
+    int cur, i;
+
+    memset(blk, 0, sizeof(blk));
+    jobs = (ngram_parse_job_t *) ckd_calloc(n_threads, sizeof(*jobs));
+    job_ptrs = (ngram_job_t **) ckd_calloc(n_threads, sizeof(*job_ptrs));
+    threads = (sbthread_t **) ckd_calloc(n_threads, sizeof(*threads));
+    mtx = sbmtx_init();
+    block_lines = n_threads * NGRAMS_RAW_BLOCK_LINES;
+
+    n_done = 0;
+    cur = 0;
+    n_read = read_ngram_block(li, &blk[cur],
+                              count < block_lines ? count : block_lines,
+                              order);
+    while (n_read > 0) {
+        uint32 per_job, n_next, remaining;
+        int n_jobs;
+
+        per_job = (n_read + n_threads - 1) / n_threads;
+        for (n_jobs = 0; (uint32) n_jobs * per_job < n_read; ++n_jobs) {
+            ngram_parse_job_t *job = &jobs[n_jobs];
+
+            job->base.run = parse_ngram_job;
+            job->blk = &blk[cur];
+            job->first = n_jobs * per_job;
+            job->n_lines = n_read - job->first;
+            if (job->n_lines > per_job)
+                job->n_lines = per_job;
+            job->raw_ngrams = raw_ngrams + n_done + job->first;
+            job->wid = wid;
+            job->lmath = lmath;
+            job->mtx = mtx;
+            job->order = order;
+            job->order_max = order_max;
+            job_ptrs[n_jobs] = &job->base;
+        }
+        start_jobs(job_ptrs, threads, n_jobs);
+
+        /* Read the next block while this one is parsed. */
+        remaining = count - n_done - n_read;
+        n_next = 0;
+        if (remaining > 0 && *li != NULL)
+            n_next = read_ngram_block(li, &blk[!cur],
+                                      remaining < block_lines
+                                      ? remaining : block_lines, order);
+        finish_jobs(job_ptrs, threads, n_jobs);
+
+        for (i = 0; i < n_jobs; i++) {
+            if (jobs[i].n_parsed < jobs[i].n_lines)
+                break;
+        }
+        if (i < n_jobs) {
+            /* Throw away what was parsed after the first bad line. */
+            ngram_raw_t *bad = jobs[i].raw_ngrams + jobs[i].n_parsed;
+            ngram_raw_t *end = raw_ngrams + n_done + n_read;
+            for (; bad < end; ++bad) {
+                ckd_free(bad->words);
+                memset(bad, 0, sizeof(*bad));
+            }
+            break;
+        }
+        n_done += n_read;
+        n_read = n_next;
+        cur = !cur;
+    }
+
+    sbmtx_free(mtx);
+    ckd_free(threads);
+    ckd_free(job_ptrs);
+    ckd_free(jobs);
+    for (i = 0; i < 2; i++) {
+        ckd_free(blk[i].buf);
+        ckd_free(blk[i].line_off);
+    }
+}
+
+static void
+sort_ngram_job(ngram_job_t * base)
+{
+    ngram_sort_job_t *job = (ngram_sort_job_t *) base;
+    ngram_raw_t *left, *left_end, *right, *right_end, *out;
+
+    if (job->dst == NULL) {
+        qsort(job->src, job->n_left, sizeof(*job->src),
+              &ngram_ord_comparator);
+        return;
+    }
+    left = job->src;
+    left_end = right = job->src + job->n_left;
+    right_end = right + job->n_right;
+    out = job->dst;
+    while (left < left_end && right < right_end) {
+        if (ngram_ord_comparator(right, left) < 0)
+            *out++ = *right++;
+        else
+            *out++ = *left++;
+    }
+    while (left < left_end)
+        *out++ = *left++;
+    while (right < right_end)
+        *out++ = *right++;
+}
+
+/*
+ * Sorts count N-grams by splitting them into a run per thread, sorting
+ * the runs in parallel and then merging pairs of runs in parallel.
+ */
+static void
+sort_ngrams_threaded(ngram_raw_t * raw_ngrams, uint32 count, int n_threads)
+{
+    ngram_sort_job_t *jobs;
+    ngram_job_t **job_ptrs;
+    sbthread_t **threads;
+    ngram_raw_t *src, *dst, *tmp;
+    uint32 *bounds;
+    int i, n_runs;
+
+    jobs = (ngram_sort_job_t *) ckd_calloc(n_threads, sizeof(*jobs));
+    job_ptrs = (ngram_job_t **) ckd_calloc(n_threads, sizeof(*job_ptrs));
+    threads = (sbthread_t **) ckd_calloc(n_threads, sizeof(*threads));
+    bounds = (uint32 *) ckd_calloc(n_threads + 1, sizeof(*bounds));
+
+    n_runs = n_threads;
+    for (i = 0; i <= n_runs; i++)
+        bounds[i] = (uint32) ((uint64) count * i / n_runs);
+    for (i = 0; i < n_runs; i++) {
+        jobs[i].base.run = sort_ngram_job;
+        jobs[i].src = raw_ngrams + bounds[i];
+        jobs[i].dst = NULL;
+        jobs[i].n_left = bounds[i + 1] - bounds[i];
+        job_ptrs[i] = &jobs[i].base;
+    }
+    start_jobs(job_ptrs, threads, n_runs);
+    finish_jobs(job_ptrs, threads, n_runs);
+
+    tmp = (ngram_raw_t *) ckd_calloc(count, sizeof(*tmp));
+    src = raw_ngrams;
+    dst = tmp;
+    while (n_runs > 1) {
+        int n_jobs = 0;
+
+        for (i = 0; i < n_runs; i += 2) {
+            ngram_sort_job_t *job = &jobs[n_jobs];
+
+            job->src = src + bounds[i];
+            job->dst = dst + bounds[i];
+            job->n_left = bounds[i + 1] - bounds[i];
+            job->n_right = (i + 1 < n_runs) ? bounds[i + 2] - bounds[i + 1] : 0;
+            job_ptrs[n_jobs++] = &job->base;
+        }
+        start_jobs(job_ptrs, threads, n_jobs);
+        finish_jobs(job_ptrs, threads, n_jobs);
+        for (i = 0; i < n_jobs; i++)
+            bounds[i] = bounds[2 * i];
+        bounds[n_jobs] = count;
+        n_runs = n_jobs;
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    if (src != raw_ngrams) {
+        memcpy(raw_ngrams, src, count * sizeof(*raw_ngrams));
+        dst = src;
+    }
+    ckd_free(dst);
+    ckd_free(bounds);
+    ckd_free(threads);
+    ckd_free(job_ptrs);
+    ckd_free(jobs);
+}
+
 static int
 ngrams_raw_read_order(ngram_raw_t ** raw_ngrams, lineiter_t ** li,
                       hash_table_t * wid, logmath_t * lmath, uint32 count,
-                      int order, int order_max)
+                      int order, int order_max, int n_threads)
 {
     char expected_header[20];
     uint32 i;
@@ -154,19 +516,22 @@ ngrams_raw_read_order(ngram_raw_t ** raw_ngrams, lineiter_t ** li,
     }
     
     *raw_ngrams = (ngram_raw_t *) ckd_calloc(count, sizeof(ngram_raw_t));
+    if (n_threads > 1) {
+        read_ngrams_threaded(*raw_ngrams, li, wid, lmath, count,
+                             order, order_max, n_threads);
+        return 0;
+    }
     for (i = 0; i < count; i++) {
         if (read_ngram_instance(li, wid, lmath, order, order_max,
                             &((*raw_ngrams)[i])) < 0)
             break;
     }
-
-    qsort(*raw_ngrams, count, sizeof(ngram_raw_t), &ngram_ord_comparator);
     return 0;
 }
 
 ngram_raw_t **
 ngrams_raw_read_arpa(lineiter_t ** li, logmath_t * lmath, uint32 * counts,
-                     int order, hash_table_t * wid)
+                     int order, hash_table_t * wid, int n_threads)
 {
     ngram_raw_t **raw_ngrams;
     int order_it;
@@ -176,7 +541,8 @@ ngrams_raw_read_arpa(lineiter_t ** li, logmath_t * lmath, uint32 * counts,
 
     for (order_it = 2; order_it <= order; order_it++) {
         if (ngrams_raw_read_order(&raw_ngrams[order_it - 2], li, wid, lmath,
-                              counts[order_it - 1], order_it, order) < 0)
+                              counts[order_it - 1], order_it, order,
+                              n_threads) < 0)
         break;
     }
 
@@ -197,6 +563,24 @@ ngrams_raw_read_arpa(lineiter_t ** li, logmath_t * lmath, uint32 * counts,
     return raw_ngrams;
 }
 
+void
+ngrams_raw_sort(ngram_raw_t ** raw_ngrams, uint32 * counts, int order,
+                int n_threads)
+{
+    int order_it;
+
+    for (order_it = 2; order_it <= order; order_it++) {
+        uint32 count = counts[order_it - 1];
+
+        if (n_threads > 1 && count / n_threads >= NGRAMS_RAW_SORT_MIN)
+            sort_ngrams_threaded(raw_ngrams[order_it - 2], count,
+                                 n_threads);
+        else
+            qsort(raw_ngrams[order_it - 2], count, sizeof(ngram_raw_t),
+                  &ngram_ord_comparator);
+    }
+}
+
 static void
 read_dmp_weight_array(FILE * fp, logmath_t * lmath, uint8 do_swap,
                       int32 counts, ngram_raw_t * raw_ngrams,
@@ -63,16 +63,29 @@ int ngram_ord_comparator(const void *a_raw, const void *b_raw);
 
 /**
  * Read ngrams of order > 1 from ARPA file
- * @param li     [in] sphinxbase file line iterator that point to bigram description in ARPA file
- * @param wid    [in] hashtable that maps string word representation to id
- * @param lmath  [in] log math used for log convertions
- * @param counts [in] amount of ngrams for each order
- * @param order  [in] maximum order of ngrams
- * @return            raw ngrams of order bigger than 1
+ * @param li        [in] sphinxbase file line iterator that point to bigram description in ARPA file
+ * @param wid       [in] hashtable that maps string word representation to id
+ * @param lmath     [in] log math used for log convertions
+ * @param counts    [in] amount of ngrams for each order
+ * @param order     [in] maximum order of ngrams
+ * @param n_threads [in] number of threads to parse ngrams with
+ * @return               raw ngrams of order bigger than 1, in file order.
+ *                       Sort them with ngrams_raw_sort().
  */
 ngram_raw_t **ngrams_raw_read_arpa(lineiter_t ** li, logmath_t * lmath,
                                    uint32 * counts, int order,
-                                   hash_table_t * wid);
+                                   hash_table_t * wid, int n_threads);
+
+/**
+ * Sorts raw ngrams of each order with ngram_ord_comparator, as needed
+ * to build a reverse trie.
+ * @param raw_ngrams [in,out] raw ngrams of order bigger than 1
+ * @param counts     [in] amount of ngrams for each order
+ * @param order      [in] maximum order of ngrams
+ * @param n_threads  [in] number of threads to sort with
+ */
+void ngrams_raw_sort(ngram_raw_t ** raw_ngrams, uint32 * counts,
+                     int order, int n_threads);
 
 /**
  * Reads ngrams of order > 1 from DMP file.
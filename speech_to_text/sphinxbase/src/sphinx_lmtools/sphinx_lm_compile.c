@@ -0,0 +1,499 @@
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/* ====================================================================
+ * Copyright (c) 2026 Carnegie Mellon University.  All rights 
+ * reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer. 
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * This work was supported in part by funding from the Defense Advanced 
+ * Research Projects Agency and the National Science Foundation of the 
+ * United States of America, and the CMU Sphinx Speech Consortium.
+ *
+ * THIS SOFTWARE IS PROVIDED BY CARNEGIE MELLON UNIVERSITY ``AS IS'' AND 
+ * ANY EXPRESSED OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY
+ * NOR ITS EMPLOYEES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT 
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, 
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY 
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ====================================================================
+ *
+ */
+/**
+ * \file sphinx_lm_compile.c
+ * Language model compiler.
+ *
+ * Turns an ARPA or DMP language model into the quantized binary trie
+ * format once, offline, so that decoders only have to memory map it at
+ * startup instead of parsing the text and training the quantizer.
+ */
+#include <sphinxbase/logmath.h>
+#include <sphinxbase/ngram_model.h>
+#include <sphinxbase/cmd_ln.h>
+#include <sphinxbase/ckd_alloc.h>
+#include <sphinxbase/err.h>
+#include <sphinxbase/pio.h>
+#include <sphinxbase/strfuncs.h>
+#include <sphinxbase/profile.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/* Problems reported individually before only counting them. */
+#define MAX_REPORTED 20
+
+static const arg_t defn[] = {
+  { "-help",
+    ARG_BOOLEAN,
+    "no",
+    "Shows the usage of the tool"},
+
+  { "-logbase",
+    ARG_FLOAT64,
+    "1.0001",
+    "Base in which all log-likelihoods calculated" },
+
+  { "-i",
+    REQARG_STRING,
+    NULL,
+    "Input ARPA or DMP language model file (required)"},
+
+  { "-o",
+    REQARG_STRING,
+    NULL,
+    "Output binary language model file (required)"},
+
+  { "-ifmt",
+    ARG_STRING,
+    NULL,
+    "Input language model format (will guess if not specified)"},
+
+  { "-lmprobbits",
+    ARG_INT32,
+    "16",
+    "Bits per quantized N-gram probability (1 to 16)"},
+
+  { "-lmbobits",
+    ARG_INT32,
+    "16",
+    "Bits per quantized N-gram backoff weight (1 to 16)"},
+
+  { "-lmeliasfano",
+    ARG_BOOLEAN,
+    "no",
+    "Elias-Fano code the pointers between N-gram orders: smaller, but slower to look up"},
+
+  { "-lmthreads",
+    ARG_INT32,
+    "1",
+    "Number of threads used to parse, sort and build ARPA language models"},
+
+  { "-validate",
+    ARG_BOOLEAN,
+    "yes",
+    "Read the output back and check it against the input model"},
+
+  { "-valtol",
+    ARG_FLOAT64,
+    "0.05",
+    "Largest error allowed in a quantized probability, in log10"},
+
+  { "-mmap",
+    ARG_BOOLEAN,
+    "yes",
+    "Use memory-mapped I/O to read the output back for validation"},
+
+  { "-bench",
+    ARG_INT32,
+    "0",
+    "Time this many passes of looking up every N-gram of the ARPA input in the output model"},
+
+  { "-debug",
+    ARG_INT32,
+    NULL,
+    "Verbosity level for debugging messages"
+  },
+
+  { NULL, 0, NULL, NULL }
+};
+
+static void
+usagemsg(char *pgm)
+{
+    E_INFO("Usage: %s -i <input.lm> \\\n", pgm);
+    E_INFOCONT("\t[-ifmt arpa] [-lmprobbits 16] [-lmbobits 16]\n");
+    E_INFOCONT("\t[-lmeliasfano no] [-bench 0]\n");
+    E_INFOCONT("\t-o <output.lm.bin>\n");
+
+    exit(0);
+}
+
+/*
+ * Checks that the compiled model has the same order, N-gram counts and
+ * vocabulary as the input model.  Returns the number of differences.
+ */
+static int
+validate_structure(ngram_model_t *lm, ngram_model_t *out_lm)
+{
+    uint32 const *counts, *out_counts;
+    int32 i, n, n_bad;
+
+    n_bad = 0;
+    n = ngram_model_get_size(lm);
+    if (ngram_model_get_size(out_lm) != n) {
+        E_ERROR("Output model has order %d, input %d\n",
+                ngram_model_get_size(out_lm), n);
+        return 1;
+    }
+    counts = ngram_model_get_counts(lm);
+    out_counts = ngram_model_get_counts(out_lm);
+    for (i = 0; i < n; i++) {
+        if (counts[i] != out_counts[i]) {
+            E_ERROR("Output model has %u %d-grams, input %u\n",
+                    out_counts[i], i + 1, counts[i]);
+            ++n_bad;
+        }
+    }
+    for (i = 0; i < (int32) counts[0]; i++) {
+        if (strcmp(ngram_word(lm, i), ngram_word(out_lm, i)) != 0
+            && n_bad++ < MAX_REPORTED)
+            E_ERROR("Word %d is '%s' in output model, '%s' in input\n",
+                    i, ngram_word(out_lm, i), ngram_word(lm, i));
+    }
+    return n_bad;
+}
+
+/*
+ * Looks up every N-gram listed in the ARPA file path in the compiled
+ * model and compares its probability with the one in the file.  Returns
+ * the number of N-grams missing from the model or off by more than tol.
+ */
+static int
+validate_arpa(ngram_model_t *out_lm, logmath_t *lmath, const char *path,
+              double tol)
+{
+    FILE *fp;
+    int32 is_pipe;
+    lineiter_t *li;
+    char **wptr;
+    int32 *hist;
+    double *max_err, *sum_err;
+    uint32 *n_checked;
+    int32 max_order, order, n_bad;
+
+    if ((fp = fopen_comp(path, "r", &is_pipe)) == NULL) {
+        E_ERROR("Failed to open %s for validation\n", path);
+        return 1;
+    }
+    max_order = ngram_model_get_size(out_lm);
+    wptr = (char **) ckd_calloc(max_order + 2, sizeof(*wptr));
+    hist = (int32 *) ckd_calloc(max_order, sizeof(*hist));
+    max_err = (double *) ckd_calloc(max_order, sizeof(*max_err));
+    sum_err = (double *) ckd_calloc(max_order, sizeof(*sum_err));
+    n_checked = (uint32 *) ckd_calloc(max_order, sizeof(*n_checked));
+
+    n_bad = 0;
+    order = 0;
+    for (li = lineiter_start_clean(fp); li; li = lineiter_next(li)) {
+        int32 wid, prob, n_used, n, i;
+        double expected, err;
+
+        if (li->buf[0] == '\\') {
+            /* Section headers; only N-gram sections are checked. */
+            if (sscanf(li->buf, "\\%d-grams:", &order) != 1
+                || order < 1 || order > max_order)
+                order = 0;
+            continue;
+        }
+        if (order == 0)
+            continue;
+        if ((n = str2words(li->buf, wptr, max_order + 2)) < order + 1) {
+            if (n_bad++ < MAX_REPORTED)
+                E_ERROR("Format error in %d-gram: %s\n", order, li->buf);
+            continue;
+        }
+        expected = atof_c(wptr[0]);
+        /* Positive probabilities are clamped when loading. */
+        if (expected > 0)
+            expected = 0;
+        wid = ngram_wid(out_lm, wptr[order]);
+        for (i = 0; i < order - 1; i++)
+            hist[i] = ngram_wid(out_lm, wptr[order - 1 - i]);
+        prob = ngram_ng_prob(out_lm, wid, hist, order - 1, &n_used);
+        if (n_used != order) {
+            if (n_bad++ < MAX_REPORTED) {
+                E_ERROR("%d-gram missing from output model:", order);
+                for (i = 1; i <= order; i++)
+                    E_INFOCONT(" %s", wptr[i]);
+                E_INFOCONT("\n");
+            }
+            continue;
+        }
+        err = fabs(logmath_log_to_log10(lmath, prob) - expected);
+        if (err > tol && n_bad++ < MAX_REPORTED) {
+            E_ERROR("%d-gram off by %.4f (log10):", order, err);
+            for (i = 1; i <= order; i++)
+                E_INFOCONT(" %s", wptr[i]);
+            E_INFOCONT("\n");
+        }
+        if (err > max_err[order - 1])
+            max_err[order - 1] = err;
+        sum_err[order - 1] += err;
+        ++n_checked[order - 1];
+    }
+    fclose_comp(fp, is_pipe);
+
+    for (order = 1; order <= max_order; order++) {
+        E_INFO("%d-grams: %u checked, max error %.5f, mean error %.5f (log10)\n",
+               order, n_checked[order - 1], max_err[order - 1],
+               n_checked[order - 1]
+               ? sum_err[order - 1] / n_checked[order - 1] : 0.0);
+    }
+    ckd_free(n_checked);
+    ckd_free(sum_err);
+    ckd_free(max_err);
+    ckd_free(hist);
+    ckd_free(wptr);
+    return n_bad;
+}
+
+/*
+ * Reads the N-grams listed in the ARPA file path as word ids of lm, each
+ * as its order followed by the word and its history, most recent first.
+ * Returns the number of N-grams read and their ids in *out_ids.
+ */
+static uint32
+read_arpa_ids(ngram_model_t *lm, const char *path, int32 **out_ids)
+{
+    FILE *fp;
+    int32 is_pipe;
+    lineiter_t *li;
+    char **wptr;
+    int32 *ids;
+    uint32 n_ngrams;
+    size_t n_ids, n_alloc;
+    int32 max_order, order;
+
+    *out_ids = NULL;
+    if ((fp = fopen_comp(path, "r", &is_pipe)) == NULL) {
+        E_ERROR("Failed to open %s\n", path);
+        return 0;
+    }
+    max_order = ngram_model_get_size(lm);
+    wptr = (char **) ckd_calloc(max_order + 2, sizeof(*wptr));
+    n_alloc = 1024;
+    ids = (int32 *) ckd_calloc(n_alloc, sizeof(*ids));
+    n_ids = 0;
+    n_ngrams = 0;
+    order = 0;
+    for (li = lineiter_start_clean(fp); li; li = lineiter_next(li)) {
+        int32 i;
+
+        if (li->buf[0] == '\\') {
+            if (sscanf(li->buf, "\\%d-grams:", &order) != 1
+                || order < 1 || order > max_order)
+                order = 0;
+            continue;
+        }
+        if (order == 0 || str2words(li->buf, wptr, max_order + 2) < order + 1)
+            continue;
+        if (n_ids + order + 1 > n_alloc) {
+            n_alloc *= 2;
+            ids = (int32 *) ckd_realloc(ids, n_alloc * sizeof(*ids));
+        }
+        ids[n_ids++] = order;
+        for (i = order; i >= 1; i--)
+            ids[n_ids++] = ngram_wid(lm, wptr[i]);
+        ++n_ngrams;
+    }
+    fclose_comp(fp, is_pipe);
+    ckd_free(wptr);
+    *out_ids = ids;
+    return n_ngrams;
+}
+
+/*
+ * Times n_passes lookups of every N-gram listed in the ARPA file path in
+ * lm, and reports the average time per lookup.
+ */
+static void
+bench_arpa(ngram_model_t *lm, const char *path, int32 n_passes)
+{
+    ptmr_t tm;
+    int32 *ids;
+    uint32 n_ngrams, i;
+    int32 pass, n_used;
+    int64 sum;
+
+    if ((n_ngrams = read_arpa_ids(lm, path, &ids)) == 0) {
+        ckd_free(ids);
+        return;
+    }
+    ptmr_init(&tm);
+    ptmr_start(&tm);
+    sum = 0;
+    for (pass = 0; pass < n_passes; pass++) {
+        int32 *id = ids;
+        for (i = 0; i < n_ngrams; i++) {
+            sum += ngram_ng_score(lm, id[1], id + 2, id[0] - 1, &n_used);
+            id += id[0] + 1;
+        }
+    }
+    ptmr_stop(&tm);
+    /* Print the sum so that lookups can't be optimized away. */
+    E_INFO("Looked up %u N-grams %d times in %.3f s: %.1f ns per lookup (checksum %ld)\n",
+           n_ngrams, n_passes, tm.t_cpu,
+           tm.t_cpu * 1e9 / ((double) n_ngrams * n_passes), (long) sum);
+    ckd_free(ids);
+}
+
+/* Size of file path in bytes, or -1 if it can't be opened. */
+static long
+file_size(const char *path)
+{
+    FILE *fp;
+    long size;
+
+    if ((fp = fopen(path, "rb")) == NULL)
+        return -1;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+int
+main(int argc, char *argv[])
+{
+    cmd_ln_t *config;
+    ngram_model_t *lm = NULL;
+    ngram_model_t *out_lm = NULL;
+    logmath_t *lmath;
+    char const *infile, *outfile;
+    int itype, n_bad;
+
+    if ((config = cmd_ln_parse_r(NULL, defn, argc, argv, TRUE)) == NULL)
+        return 1;
+
+    if (cmd_ln_boolean_r(config, "-help")) {
+        usagemsg(argv[0]);
+    }
+
+    err_set_debug_level(cmd_ln_int32_r(config, "-debug"));
+
+    /* Create log math object. */
+    if ((lmath = logmath_init
+         (cmd_ln_float64_r(config, "-logbase"), 0, 0)) == NULL) {
+        E_FATAL("Failed to initialize log math\n");
+    }
+
+    infile = cmd_ln_str_r(config, "-i");
+    outfile = cmd_ln_str_r(config, "-o");
+    if (infile == NULL || outfile == NULL) {
+        E_ERROR("Please specify both input and output models\n");
+        goto error_out;
+    }
+    if (cmd_ln_int32_r(config, "-lmprobbits") < 1
+        || cmd_ln_int32_r(config, "-lmprobbits") > 16
+        || cmd_ln_int32_r(config, "-lmbobits") < 1
+        || cmd_ln_int32_r(config, "-lmbobits") > 16) {
+        E_ERROR("-lmprobbits and -lmbobits must be between 1 and 16\n");
+        goto error_out;
+    }
+
+    /* Guess or set the input language model type.  Default to ARPA
+     * (catches .lm and other things). */
+    if (cmd_ln_str_r(config, "-ifmt")) {
+        if ((itype = ngram_str_to_type(cmd_ln_str_r(config, "-ifmt")))
+            == NGRAM_INVALID) {
+            E_ERROR("Invalid input type %s\n", cmd_ln_str_r(config, "-ifmt"));
+            goto error_out;
+        }
+    }
+    else if ((itype = ngram_file_name_to_type(infile)) == NGRAM_INVALID) {
+        itype = NGRAM_ARPA;
+    }
+
+    /* Load and quantize the input language model. */
+    if ((lm = ngram_model_read(config, infile, itype, lmath)) == NULL) {
+        E_ERROR("Failed to read the model from the file '%s'\n", infile);
+        goto error_out;
+    }
+    if (ngram_model_write(lm, outfile, NGRAM_BIN) != 0) {
+        E_ERROR("Failed to write binary language model to %s\n", outfile);
+        goto error_out;
+    }
+    E_INFO("Wrote %s (%ld bytes) with %d bit probabilities and %d bit backoff weights%s\n",
+           outfile, file_size(outfile), cmd_ln_int32_r(config, "-lmprobbits"),
+           cmd_ln_int32_r(config, "-lmbobits"),
+           cmd_ln_boolean_r(config, "-lmeliasfano")
+           ? ", Elias-Fano coded pointers" : "");
+
+    if (cmd_ln_boolean_r(config, "-validate")) {
+        /* Read the output the way a decoder would. */
+        if ((out_lm = ngram_model_read(config, outfile, NGRAM_BIN,
+                                       lmath)) == NULL) {
+            E_ERROR("Failed to read back %s\n", outfile);
+            goto error_out;
+        }
+        n_bad = validate_structure(lm, out_lm);
+        if (n_bad == 0 && itype == NGRAM_ARPA)
+            n_bad = validate_arpa(out_lm, lmath, infile,
+                                  cmd_ln_float64_r(config, "-valtol"));
+        else if (n_bad == 0)
+            E_INFO("Input is not ARPA text, checked counts and vocabulary only\n");
+        if (n_bad > 0) {
+            E_ERROR("Validation of %s failed: %d problems\n", outfile, n_bad);
+            goto error_out;
+        }
+        E_INFO("Validated %s\n", outfile);
+    }
+
+    if (cmd_ln_int32_r(config, "-bench") > 0) {
+        if (itype != NGRAM_ARPA) {
+            E_ERROR("-bench needs an ARPA input model\n");
+            goto error_out;
+        }
+        if (out_lm == NULL
+            && (out_lm = ngram_model_read(config, outfile, NGRAM_BIN,
+                                          lmath)) == NULL) {
+            E_ERROR("Failed to read back %s\n", outfile);
+            goto error_out;
+        }
+        bench_arpa(out_lm, infile, cmd_ln_int32_r(config, "-bench"));
+    }
+
+    /* That's all folks! */
+    ngram_model_free(out_lm);
+    ngram_model_free(lm);
+    logmath_free(lmath);
+    cmd_ln_free_r(config);
+    return 0;
+
+error_out:
+    ngram_model_free(out_lm);
+    ngram_model_free(lm);
+    if (lmath) {
+        logmath_free(lmath);
+    }
+    if (config) {
+        cmd_ln_free_r(config);
+    }
+    return 1;
+}
@@ -45,6 +45,7 @@
 #include <sphinxbase/err.h>
 #include <sphinxbase/pio.h>
 #include <sphinxbase/strfuncs.h>
+#include <sphinxbase/profile.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -110,7 +111,12 @@ static const arg_t defn[] = {
     "no",
     "Print details of perplexity calculation" },
 
-  /* FIXME: Support -lmstartsym, -lmendsym, -lmctlfn, -ctl_lm */
+  { "-bench",
+    ARG_INT32,
+    "0",
+    "Time this many passes of looking up every word of -lsn in the model" },
+
+  /* FIXME: Support -lmstartsym, -lmendsym, -ctl_lm */
   { NULL, 0, NULL, NULL }
 };
 
@@ -277,13 +283,95 @@ evaluate_string(ngram_model_t *lm, logmath_t *lmath, const char *text)
 	ckd_free(words);
 }
 
+/*
+ * Time n_passes lookups of every word of the transcription file lsnfn,
+ * as calc_entropy() does them, and report the time per lookup.  For a
+ * set of models interpolated with -lmctlfn, this is the time per
+ * interpolated lookup.
+ */
+static void
+bench_file(ngram_model_t *lm, const char *lsnfn, int32 n_passes)
+{
+	FILE *fh;
+	lineiter_t *litor;
+	int32 **sents, *sent_len;
+	int32 n_sents, n_alloc, startwid, unk, i, j, pass;
+	int64 n_lookups, sum;
+	ptmr_t tm;
+
+	if ((fh = fopen(lsnfn, "r")) == NULL)
+		E_FATAL_SYSTEM("failed to open transcript file %s", lsnfn);
+
+	/* Word IDs of each sentence, reversed as in calc_entropy(). */
+	n_sents = 0;
+	n_alloc = 128;
+	sents = ckd_calloc(n_alloc, sizeof(*sents));
+	sent_len = ckd_calloc(n_alloc, sizeof(*sent_len));
+	for (litor = lineiter_start(fh); litor; litor = lineiter_next(litor)) {
+		char **words;
+		int32 n;
+
+		if ((n = str2words(litor->buf, NULL, 0)) <= 0)
+			continue;
+		words = ckd_calloc(n, sizeof(*words));
+		str2words(litor->buf, words, n);
+		if (words[n-1][0] == '('
+		    && words[n-1][strlen(words[n-1])-1] == ')')
+			n = n - 1;
+		if (n_sents == n_alloc) {
+			n_alloc *= 2;
+			sents = ckd_realloc(sents, n_alloc * sizeof(*sents));
+			sent_len = ckd_realloc(sent_len, n_alloc * sizeof(*sent_len));
+		}
+		sents[n_sents] = ckd_calloc(n > 0 ? n : 1, sizeof(**sents));
+		for (i = 0; i < n; ++i)
+			sents[n_sents][n-i-1] = ngram_wid(lm, words[i]);
+		sent_len[n_sents++] = n;
+		ckd_free(words);
+	}
+	fclose(fh);
+
+	startwid = ngram_wid(lm, "<s>");
+	unk = ngram_unknown_wid(lm);
+	n_lookups = sum = 0;
+	ptmr_init(&tm);
+	ptmr_start(&tm);
+	for (pass = 0; pass < n_passes; ++pass) {
+		for (i = 0; i < n_sents; ++i) {
+			int32 *wids = sents[i];
+			int32 n = sent_len[i];
+
+			for (j = 0; j < n; ++j) {
+				int32 n_used;
+
+				if (wids[j] == startwid || wids[j] == NGRAM_INVALID_WID
+				    || wids[j] == unk)
+					continue;
+				sum += ngram_ng_score(lm, wids[j], wids + j + 1,
+						      n - j - 1, &n_used);
+				++n_lookups;
+			}
+		}
+	}
+	ptmr_stop(&tm);
+	if (n_lookups > 0)
+		printf("%ld lookups in %.3f s: %.1f ns per lookup (checksum %ld)\n",
+		       (long) n_lookups, tm.t_cpu,
+		       tm.t_cpu * 1e9 / n_lookups, (long) sum);
+
+	for (i = 0; i < n_sents; ++i)
+		ckd_free(sents[i]);
+	ckd_free(sents);
+	ckd_free(sent_len);
+}
+
 int
 main(int argc, char *argv[])
 {
 	cmd_ln_t *config;
 	ngram_model_t *lm = NULL;
 	logmath_t *lmath;
-	const char *lmfn, *probdefn, *lsnfn, *text;
+	const char *lmfn, *lmctlfn, *probdefn, *lsnfn, *text;
 
 	if ((config = cmd_ln_parse_r(NULL, defn, argc, argv, TRUE)) == NULL)
 		return 1;
@@ -296,9 +384,25 @@ main(int argc, char *argv[])
 		E_FATAL("Failed to initialize log math\n");
 	}
 
-	/* Load the language model. */
+	/* Load the language model, or the set of them. */
 	lmfn = cmd_ln_str_r(config, "-lm");
-	if (lmfn == NULL
+	lmctlfn = cmd_ln_str_r(config, "-lmctlfn");
+	if (lmctlfn) {
+		if ((lm = ngram_model_set_read(config, lmctlfn, lmath)) == NULL)
+			E_FATAL("Failed to load language models from %s\n",
+				lmctlfn);
+		/* Interpolate all of them unless one is named. */
+		if (cmd_ln_str_r(config, "-lmname")) {
+			if (ngram_model_set_select(lm, cmd_ln_str_r(config, "-lmname"))
+			    == NULL)
+				E_FATAL("No language model named %s in %s\n",
+					cmd_ln_str_r(config, "-lmname"), lmctlfn);
+		}
+		else {
+			ngram_model_set_interp(lm, NULL, NULL);
+		}
+	}
+	else if (lmfn == NULL
 	    || (lm = ngram_model_read(config, lmfn,
 				      NGRAM_AUTO, lmath)) == NULL) {
 		E_FATAL("Failed to load language model from %s\n",
@@ -315,6 +419,8 @@ main(int argc, char *argv[])
 	text = cmd_ln_str_r(config, "-text");
 	if (lsnfn) {
 		evaluate_file(lm, lmath, lsnfn);
+		if (cmd_ln_int32_r(config, "-bench") > 0)
+			bench_file(lm, lsnfn, cmd_ln_int32_r(config, "-bench"));
 	}
 	else if (text) {
 		evaluate_string(lm, lmath, text);
@@ -22,6 +22,22 @@ static arg_t cont_args_def[] = {
 	CMDLN_EMPTY_OPTION
 };
 
+/*
+ * Converts a String to a multibyte C string (String -> wchar_t * -> char *), as
+ * done for the model filenames. Returns NULL if it can't be converted, otherwise
+ * the string must be released with memfree().
+ */
+static char *to_multibyte(const String &str) {
+	int len = wcstombs(NULL, str.c_str(), 0);
+	if (len == -1)
+		return NULL;
+
+	char *result = (char *) memalloc((len + 1) * sizeof(char));
+	if (result != NULL)
+		wcstombs(result, str.c_str(), len + 1);
+	return result;
+}
+
 STTError::Error STTConfig::init() {
 	// Check if files were set
 	if (hmm_dirname == "" || dict_filename == "" || kws_filename == "") {
@@ -47,7 +63,9 @@ STTError::Error STTConfig::init() {
 	// Copy config files to STT directory in user://
 	if (!FileDirUtil::copy_dir_recursive(hmm_dirname, user_dirname) ||
 			!FileDirUtil::copy_file(dict_filename, user_dirname) ||
-			!FileDirUtil::copy_file(kws_filename, user_dirname)) {
+			!FileDirUtil::copy_file(kws_filename, user_dirname) ||
+			(command_filename != "" &&
+			 !FileDirUtil::copy_file(command_filename, user_dirname))) {
 		STT_ERR_PRINTS(STTError::USER_DIR_COPY_ERR);
 		return STTError::USER_DIR_COPY_ERR;
 	}
@@ -102,6 +120,10 @@ STTError::Error STTConfig::init() {
 		STT_ERR_PRINTS(STTError::CONFIG_CREATE_ERR);
 		return STTError::CONFIG_CREATE_ERR;
 	}
+	cmd_ln_set_float64_r(conf, "-kws_fa_target", fa_target);
+	cmd_ln_set_float64_r(conf, "-kws_verify", verify_threshold);
+	if (command_filename != "" || verify_threshold > 0)
+		cmd_ln_set_int32_r(conf, "-lookback", DECODED_LOOKBACK);
 
 	// Update basic configuration with custom one for mic
 	conf = cmd_ln_init(conf, cont_args_def, TRUE, NULL);
@@ -109,6 +131,17 @@ STTError::Error STTConfig::init() {
 		STT_ERR_PRINTS(STTError::CONFIG_CREATE_ERR);
 		return STTError::CONFIG_CREATE_ERR;
 	}
+	if (device_name != "") {
+		char *device = to_multibyte(device_name);
+		if (device == NULL) {
+			cmd_ln_free_r(conf);
+			conf = NULL;
+			STT_ERR_PRINTS(STTError::MULTIBYTE_STR_ERR);
+			return STTError::MULTIBYTE_STR_ERR;
+		}
+		cmd_ln_set_str_r(conf, "-adcdev", device);
+		memfree(device);
+	}
 
 	// Create recorder variable
 	recorder = ad_open_dev(cmd_ln_str_r(conf, "-adcdev"),
@@ -116,6 +149,7 @@ STTError::Error STTConfig::init() {
 
 	if (recorder == NULL) {
 		cmd_ln_free_r(conf);
+		conf = NULL;
 		STT_ERR_PRINTS(STTError::REC_CREATE_ERR);
 		return STTError::REC_CREATE_ERR;
 	}
@@ -126,10 +160,38 @@ STTError::Error STTConfig::init() {
 	if (decoder == NULL) {
 		cmd_ln_free_r(conf);
 		ad_close(recorder);
+		conf = NULL;
+		recorder = NULL;
 		STT_ERR_PRINTS(STTError::DECODER_CREATE_ERR);
 		return STTError::DECODER_CREATE_ERR;
 	}
 
+	// Optional second stage, recognizing commands after a wake word
+	has_command = false;
+	if (command_filename != "") {
+		char *path = to_multibyte(_convert_to_data_path(command_filename));
+		int rv = -1;
+		if (path != NULL) {
+			if (command_filename.extension() == "gram")
+				rv = ps_set_jsgf_file(decoder, STT_COMMAND_SEARCH, path);
+			else
+				rv = ps_set_lm_file(decoder, STT_COMMAND_SEARCH, path);
+			memfree(path);
+		}
+
+		if (rv < 0) {
+			ps_free(decoder);
+			ad_close(recorder);
+			cmd_ln_free_r(conf);
+			decoder = NULL;
+			recorder = NULL;
+			conf = NULL;
+			STT_ERR_PRINTS(STTError::COMMAND_LOAD_ERR);
+			return STTError::COMMAND_LOAD_ERR;
+		}
+		has_command = true;
+	}
+
 	return STTError::OK;
 }
 
@@ -166,12 +228,362 @@ String STTConfig::get_kws_filename() const {
 	return kws_filename;
 }
 
+void STTConfig::set_command_filename(const String &command_filename) {
+	if (command_filename == "" || FileAccess::exists(command_filename))
+		this->command_filename = command_filename;
+	else
+		ERR_PRINTS("File '" + command_filename + "' not found!");
+}
+
+String STTConfig::get_command_filename() const {
+	return command_filename;
+}
+
+void STTConfig::set_device_name(const String &device_name) {
+	this->device_name = device_name;
+}
+
+String STTConfig::get_device_name() const {
+	return device_name;
+}
+
+void STTConfig::set_false_alarm_target(float fa_target) {
+	if (fa_target >= 0)
+		this->fa_target = fa_target;
+	else
+		ERR_PRINT("False alarm target can't be negative!");
+}
+
+float STTConfig::get_false_alarm_target() const {
+	return fa_target;
+}
+
+void STTConfig::set_verify_threshold(float threshold) {
+	if (threshold >= 0 && threshold <= 1)
+		verify_threshold = threshold;
+	else
+		ERR_PRINT("Verification threshold must be between 0 and 1!");
+}
+
+float STTConfig::get_verify_threshold() const {
+	return verify_threshold;
+}
+
+STTError::Error STTConfig::save_adaptation() {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+
+	if (!FileDirUtil::create_dir_safe("user://", STT_ADAPT_DIRNAME)) {
+		STT_ERR_PRINTS(STTError::ADAPT_SAVE_ERR);
+		return STTError::ADAPT_SAVE_ERR;
+	}
+
+	FileAccess *f = FileAccess::open(_get_adaptation_path(), FileAccess::WRITE);
+	if (f == NULL) {
+		STT_ERR_PRINTS(STTError::ADAPT_SAVE_ERR);
+		return STTError::ADAPT_SAVE_ERR;
+	}
+
+	feat_t *fcb = ps_get_feat(decoder);
+	f->store_32(ADAPT_FILE_VERSION);
+
+	// Cepstral mean normalization
+	cmn_t *cmn = fcb->cmn_struct;
+	int veclen = cmn != NULL ? cmn->veclen : 0;
+	f->store_32(veclen);
+	if (veclen > 0) {
+		mfcc_t *mean = (mfcc_t *) memalloc(2 * veclen * sizeof(mfcc_t));
+		mfcc_t *sum = mean + veclen;
+
+		f->store_32(cmn_live_snapshot(cmn, mean, sum));
+		for (int i = 0; i < 2 * veclen; i++)
+			f->store_float(MFCC2FLOAT(mean[i]));
+		memfree(mean);
+	}
+
+	// Automatic gain control
+	agc_t *agc = fcb->agc_struct;
+	f->store_8(agc != NULL);
+	if (agc != NULL) {
+		f->store_float(MFCC2FLOAT(agc->max));
+		f->store_float(MFCC2FLOAT(agc->obs_max_sum));
+		f->store_32(agc->obs_utt);
+	}
+
+	// Noise and signal floor estimates
+	fe_t *fe = ps_get_fe(decoder);
+	int n_noise = fe_get_noise_state(fe, NULL);
+	f->store_32(n_noise);
+	if (n_noise > 0) {
+		float64 *noise = (float64 *) memalloc(n_noise * sizeof(float64));
+		fe_get_noise_state(fe, noise);
+		for (int i = 0; i < n_noise; i++)
+			f->store_double(noise[i]);
+		memfree(noise);
+	}
+
+	memdelete(f);
+	return STTError::OK;
+}
+
+STTError::Error STTConfig::load_adaptation() {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+
+	String path = _get_adaptation_path();
+	if (!FileAccess::exists(path))
+		return STTError::OK;
+
+	FileAccess *f = FileAccess::open(path, FileAccess::READ);
+	if (f == NULL || f->get_32() != ADAPT_FILE_VERSION) {
+		if (f != NULL) memdelete(f);
+		STT_ERR_PRINTS(STTError::ADAPT_LOAD_ERR);
+		return STTError::ADAPT_LOAD_ERR;
+	}
+
+	feat_t *fcb = ps_get_feat(decoder);
+	STTError::Error err = STTError::OK;
+
+	// Cepstral mean normalization
+	cmn_t *cmn = fcb->cmn_struct;
+	int veclen = f->get_32();
+	if (veclen > 0) {
+		int nframe = f->get_32();
+		mfcc_t *mean = (mfcc_t *) memalloc(2 * veclen * sizeof(mfcc_t));
+		mfcc_t *sum = mean + veclen;
+
+		for (int i = 0; i < 2 * veclen; i++)
+			mean[i] = FLOAT2MFCC(f->get_float());
+
+		if (cmn != NULL && cmn->veclen == veclen)
+			cmn_live_restore(cmn, mean, sum, nframe);
+		else
+			err = STTError::ADAPT_LOAD_ERR;
+		memfree(mean);
+	}
+
+	// Automatic gain control
+	agc_t *agc = fcb->agc_struct;
+	if (f->get_8()) {
+		float max = f->get_float();
+		float obs_max_sum = f->get_float();
+		int obs_utt = f->get_32();
+
+		if (agc != NULL) {
+			agc->max = FLOAT2MFCC(max);
+			agc->obs_max_sum = FLOAT2MFCC(obs_max_sum);
+			agc->obs_utt = obs_utt;
+		}
+	}
+
+	// Noise and signal floor estimates
+	int n_noise = f->get_32();
+	if (n_noise > 0) {
+		float64 *noise = (float64 *) memalloc(n_noise * sizeof(float64));
+		for (int i = 0; i < n_noise; i++)
+			noise[i] = f->get_double();
+
+		if (fe_set_noise_state(ps_get_fe(decoder), noise, n_noise) < 0)
+			err = STTError::ADAPT_LOAD_ERR;
+		memfree(noise);
+	}
+
+	memdelete(f);
+
+	if (err != STTError::OK)
+		STT_ERR_PRINTS(err);
+	return err;
+}
+
+bool STTConfig::is_fixed_point() const {
+#ifdef FIXED_POINT
+	return true;
+#else
+	return false;
+#endif
+}
+
+STTError::Error STTConfig::add_word(const String &word, const String &phones) {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+
+	// Don't update the searches: keyphrases are added to them one by one
+	decoder_mutex->lock();
+	int rv = ps_add_word(decoder, word.utf8().get_data(),
+	                     phones.utf8().get_data(), FALSE);
+	decoder_mutex->unlock();
+
+	if (rv < 0) {
+		STT_ERR_PRINTS(STTError::WORD_ADD_ERR);
+		return STTError::WORD_ADD_ERR;
+	}
+	return STTError::OK;
+}
+
+STTError::Error STTConfig::add_keyphrase(const String &keyphrase, double threshold) {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+
+	decoder_mutex->lock();
+	int rv = ps_add_keyphrase(decoder, STT_KWS_SEARCH, keyphrase.utf8().get_data(),
+	                          threshold);
+	decoder_mutex->unlock();
+
+	if (rv < 0) {
+		STT_ERR_PRINTS(STTError::KWS_ADD_ERR);
+		return STTError::KWS_ADD_ERR;
+	}
+	return STTError::OK;
+}
+
+STTError::Error STTConfig::remove_keyphrase(const String &keyphrase) {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+
+	decoder_mutex->lock();
+	int rv = ps_remove_keyphrase(decoder, STT_KWS_SEARCH,
+	                             keyphrase.utf8().get_data());
+	decoder_mutex->unlock();
+
+	if (rv < 0) {
+		STT_ERR_PRINTS(STTError::KWS_REMOVE_ERR);
+		return STTError::KWS_REMOVE_ERR;
+	}
+	return STTError::OK;
+}
+
+String STTConfig::get_keyphrases() {
+	if (decoder == NULL)
+		return "";
+
+	decoder_mutex->lock();
+	char *keyphrases = (char *) ps_get_kws(decoder, STT_KWS_SEARCH);
+	decoder_mutex->unlock();
+
+	if (keyphrases == NULL)
+		return "";
+
+	String result = String(keyphrases);
+	ckd_free(keyphrases);
+	return result;
+}
+
+Dictionary STTConfig::get_keyphrase_stats() {
+	Dictionary stats;
+	if (decoder == NULL)
+		return stats;
+
+	Vector<String> keyphrases = get_keyphrases().split("\n", false);
+
+	decoder_mutex->lock();
+	for (int i = 0; i < keyphrases.size(); i++) {
+		double threshold, fa_rate;
+		if (ps_get_kws_threshold(decoder, STT_KWS_SEARCH, keyphrases[i].utf8().get_data(),
+		                         &threshold, &fa_rate) < 0)
+			continue;
+
+		Dictionary entry;
+		entry["threshold"] = threshold;
+		entry["false_alarms_per_hour"] = fa_rate;
+		stats[keyphrases[i]] = entry;
+	}
+	decoder_mutex->unlock();
+
+	return stats;
+}
+
+String STTConfig::decode_raw_file(const String &raw_filename) {
+	if (decoder == NULL) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return "";
+	}
+
+	FileAccess *f = FileAccess::open(raw_filename, FileAccess::READ);
+	if (f == NULL) {
+		ERR_PRINTS("File '" + raw_filename + "' not found!");
+		return "";
+	}
+
+	int n = f->get_len() / sizeof(int16);
+	int16 *samples = (int16 *) memalloc(n * sizeof(int16));
+	if (samples == NULL) {
+		memdelete(f);
+		STT_ERR_PRINTS(STTError::MEM_ALLOC_ERR);
+		return "";
+	}
+
+	for (int i = 0; i < n; i++)
+		samples[i] = (int16) f->get_16();
+	memdelete(f);
+
+	String result = "";
+	decoder_mutex->lock();
+	if (ps_start_utt(decoder) < 0) {
+		STT_ERR_PRINTS(STTError::UTT_START_ERR);
+	}
+	else {
+		ps_process_raw(decoder, samples, n, FALSE, TRUE);
+		ps_end_utt(decoder);
+
+		const char *hyp = ps_get_hyp(decoder, NULL);
+		if (hyp != NULL)
+			result = String(hyp);
+	}
+	decoder_mutex->unlock();
+
+	memfree(samples);
+	return result;
+}
+
+Dictionary STTConfig::get_performance() const {
+	Dictionary perf;
+	if (decoder == NULL)
+		return perf;
+
+	double speech, cpu, wall;
+	ps_get_all_time(decoder, &speech, &cpu, &wall);
+
+	perf["speech"] = speech;
+	perf["cpu"] = cpu;
+	perf["wall"] = wall;
+	return perf;
+}
+
 String STTConfig::_convert_to_data_path(String filename) {
 	String user_path = OS::get_singleton()->get_data_dir();
 	String basename = filename.get_file();
 	return user_path.plus_file(STT_USER_DIRNAME).plus_file(basename);
 }
 
+String STTConfig::_get_adaptation_path() {
+	String mic = "default";
+	if (conf != NULL && cmd_ln_str_r(conf, "-adcdev") != NULL)
+		mic = String(cmd_ln_str_r(conf, "-adcdev"));
+
+	// Device names may contain characters that aren't valid in filenames
+	String basename = "";
+	for (int i = 0; i < mic.length(); i++) {
+		CharType c = mic[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+				(c >= '0' && c <= '9') || c == '-' || c == '_')
+			basename += String::chr(c);
+		else
+			basename += "_";
+	}
+
+	return "user://" + String(STT_ADAPT_DIRNAME) + basename + ".adapt";
+}
+
 void STTConfig::_bind_methods() {
 	ObjectTypeDB::bind_method("init", &STTConfig::init);
 
@@ -187,6 +599,42 @@ void STTConfig::_bind_methods() {
 	                          &STTConfig::set_kws_filename);
 	ObjectTypeDB::bind_method("get_kws_filename", &STTConfig::get_kws_filename);
 
+	ObjectTypeDB::bind_method("save_adaptation", &STTConfig::save_adaptation);
+	ObjectTypeDB::bind_method("load_adaptation", &STTConfig::load_adaptation);
+
+	ObjectTypeDB::bind_method(_MD("add_word", "word", "phones"),
+	                          &STTConfig::add_word);
+	ObjectTypeDB::bind_method(_MD("add_keyphrase", "keyphrase", "threshold"),
+	                          &STTConfig::add_keyphrase, DEFVAL(0));
+	ObjectTypeDB::bind_method(_MD("remove_keyphrase", "keyphrase"),
+	                          &STTConfig::remove_keyphrase);
+	ObjectTypeDB::bind_method("get_keyphrases", &STTConfig::get_keyphrases);
+	ObjectTypeDB::bind_method("get_keyphrase_stats", &STTConfig::get_keyphrase_stats);
+
+	ObjectTypeDB::bind_method(_MD("set_command_filename", "command_filename"),
+	                          &STTConfig::set_command_filename);
+	ObjectTypeDB::bind_method("get_command_filename",
+	                          &STTConfig::get_command_filename);
+
+	ObjectTypeDB::bind_method(_MD("set_device_name", "device_name"),
+	                          &STTConfig::set_device_name);
+	ObjectTypeDB::bind_method("get_device_name", &STTConfig::get_device_name);
+
+	ObjectTypeDB::bind_method(_MD("set_false_alarm_target", "fa_target"),
+	                          &STTConfig::set_false_alarm_target);
+	ObjectTypeDB::bind_method("get_false_alarm_target",
+	                          &STTConfig::get_false_alarm_target);
+
+	ObjectTypeDB::bind_method(_MD("set_verify_threshold", "threshold"),
+	                          &STTConfig::set_verify_threshold);
+	ObjectTypeDB::bind_method("get_verify_threshold",
+	                          &STTConfig::get_verify_threshold);
+
+	ObjectTypeDB::bind_method("is_fixed_point", &STTConfig::is_fixed_point);
+	ObjectTypeDB::bind_method(_MD("decode_raw_file", "raw_filename"),
+	                          &STTConfig::decode_raw_file);
+	ObjectTypeDB::bind_method("get_performance", &STTConfig::get_performance);
+
 	ADD_PROPERTYNZ(PropertyInfo(Variant::STRING, "hmm directory", PROPERTY_HINT_DIR),
 	               _SCS("set_hmm_dirname"), _SCS("get_hmm_dirname"));
 	ADD_PROPERTYNZ(PropertyInfo(Variant::STRING, "dictionary file",
@@ -195,6 +643,16 @@ void STTConfig::_bind_methods() {
 	ADD_PROPERTYNZ(PropertyInfo(Variant::STRING, "keywords file",
 	                            PROPERTY_HINT_FILE, "kws"),
 	               _SCS("set_kws_filename"), _SCS("get_kws_filename"));
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "command file",
+	                          PROPERTY_HINT_FILE, "gram,lm,bin"),
+	             _SCS("set_command_filename"), _SCS("get_command_filename"));
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "microphone device"),
+	             _SCS("set_device_name"), _SCS("get_device_name"));
+	ADD_PROPERTY(PropertyInfo(Variant::REAL, "false alarms per hour",
+	                          PROPERTY_HINT_RANGE, "0,100,0.1"),
+	             _SCS("set_false_alarm_target"), _SCS("get_false_alarm_target"));
+	ADD_PROPERTY(PropertyInfo(Variant::REAL, "verification threshold"),
+	             _SCS("set_verify_threshold"), _SCS("get_verify_threshold"));
 }
 
 STTConfig::STTConfig() {
@@ -204,10 +662,16 @@ STTConfig::STTConfig() {
 	conf = NULL;
 	recorder = NULL;
 	decoder = NULL;
+	decoder_mutex = Mutex::create();
 
 	hmm_dirname   = "";
 	dict_filename = "";
 	kws_filename  = "";
+	command_filename = "";
+	device_name   = "";
+	has_command   = false;
+	fa_target     = 0;
+	verify_threshold = 0;
 
 	hmm = NULL;
 	dict = NULL;
@@ -218,6 +682,7 @@ STTConfig::~STTConfig() {
 	if (conf     != NULL) cmd_ln_free_r(conf);
 	if (recorder != NULL) ad_close(recorder);
 	if (decoder  != NULL) ps_free(decoder);
+	memdelete(decoder_mutex);
 
 	if (hmm  != NULL) memfree(hmm);
 	if (dict != NULL) memfree(dict);
@@ -2,6 +2,8 @@
 #define STT_CONFIG_H
 
 #include "core/resource.h"
+#include "core/dictionary.h"
+#include "core/os/mutex.h"
 #include "stt_error.h"
 
 #include "sphinxbase/err.h"
@@ -13,6 +15,22 @@
  */
 #define STT_USER_DIRNAME "stt/"
 
+/**
+ * Directory, in \c user://, where adaptation statistics are saved. Unlike
+ * \c STT_USER_DIRNAME, it is kept when the module is unloaded.
+ */
+#define STT_ADAPT_DIRNAME "stt_adapt/"
+
+/**
+ * Name of the search spotting the keyphrases of the keywords file
+ */
+#define STT_KWS_SEARCH "_default"
+
+/**
+ * Name of the search recognizing commands after a wake word
+ */
+#define STT_COMMAND_SEARCH "command"
+
 /**
  * Stores filenames and variables for Pocketsphinx speech to text.
  *
@@ -29,15 +47,33 @@ private:
 	cmd_ln_t *conf;         ///< Configuration type for Sphinx variables
 	ad_rec_t *recorder;     ///< Records sound from microphone
 	ps_decoder_t *decoder;  ///< Decodes speech to text
+	Mutex *decoder_mutex;   ///< Locked while \c decoder is in use
 
 	String hmm_dirname;    ///< Hidden Markov Model directory name
 	String dict_filename;  ///< Dictionary filename
 	String kws_filename;   ///< Keywords filename
+	String command_filename;  ///< Command grammar or language model filename
+	String device_name;    ///< Microphone device name, "" for the default one
+	bool has_command;      ///< If true, init() loaded the command search
+	float fa_target;       ///< Target false alarms per hour, 0 for fixed thresholds
+	float verify_threshold;  ///< Lowest alignment probability per frame, 0 if off
 
 	char *hmm;   ///< C string path for hmm_dirname
 	char *dict;  ///< C string path for dict_filename
 	char *kws;   ///< C string path for kws_filename
 
+	enum {
+		ADAPT_FILE_VERSION = 1,  ///< Format version of adaptation statistics files
+
+		/**
+		 * Frames of features kept after decoding when there is a command file or
+		 * detections are verified, so that the audio after a wake word can be
+		 * passed to the command search, and the audio of a detection aligned
+		 * again, once the wake word is spotted
+		 */
+		DECODED_LOOKBACK = 300
+	};
+
 	/**
 	 * Converts the given \c filename to its corresponding path in the STT \c user://
 	 * directory.
@@ -48,6 +84,14 @@ private:
 	 */
 	String _convert_to_data_path(String filename);
 
+	/**
+	 * Returns the path of the adaptation statistics file for the microphone
+	 * currently in use.
+	 *
+	 * @return Path to the adaptation file in the \c STT_ADAPT_DIRNAME directory.
+	 */
+	String _get_adaptation_path();
+
 protected:
 	/**
 	 * Makes \a GDScript recognize public methods from this class.
@@ -70,6 +114,7 @@ public:
 	 * - \c CONFIG_CREATE_ERR
 	 * - \c REC_CREATE_ERR
 	 * - \c DECODER_CREATE_ERR
+	 * - \c COMMAND_LOAD_ERR
 	 *
 	 * @see set_hmm_dirname for setting the HMM directory name
 	 * @see set_dict_filename for setting the dictionary filename
@@ -122,6 +167,207 @@ public:
 	 */
 	String get_kws_filename() const;
 
+	/**
+	 * Sets the file used to recognize commands after a wake word: a JSGF grammar
+	 * (\c .gram) or an ARPA or binary language model (any other extension). If
+	 * set, STTRunner only spots keyphrases until one of them is heard, and then
+	 * recognizes the command that follows it with this file. Takes effect on the
+	 * next call to init(). Use an empty <tt>String ("")</tt> to only spot
+	 * keyphrases.
+	 *
+	 * @param command_filename the grammar or language model filename.
+	 */
+	void set_command_filename(const String &command_filename);
+
+	/**
+	 * Returns the currently defined command grammar or language model filename.
+	 * If no name has been defined yet, returns an empty <tt>String ("")</tt>.
+	 *
+	 * @return The current command filename, or \c "" if not defined.
+	 */
+	String get_command_filename() const;
+
+	/**
+	 * Sets the name of the microphone to record from (e.g. \c "hw:1,0" with
+	 * ALSA), as given to \a Sphinxbase's \c ad_open_dev(). Adaptation
+	 * statistics are kept separately for each device. Takes effect on the next
+	 * call to init(). Use an empty <tt>String ("")</tt> (the default) for the
+	 * default system microphone.
+	 *
+	 * @param device_name the microphone device name, or \c "".
+	 */
+	void set_device_name(const String &device_name);
+
+	/**
+	 * Returns the name of the microphone to record from.
+	 *
+	 * @return The microphone device name, or \c "" for the default one.
+	 */
+	String get_device_name() const;
+
+	/**
+	 * Sets how many false alarms per hour of audio each keyphrase should get.
+	 * If positive, keyphrase thresholds start at the values of the keywords
+	 * file and are then raised or lowered as audio is decoded, to reach that
+	 * rate. Use 0 (the default) to keep the thresholds fixed. Takes effect on
+	 * the next call to init().
+	 *
+	 * @param fa_target target false alarms per hour, or 0.
+	 */
+	void set_false_alarm_target(float fa_target);
+
+	/**
+	 * Returns the target false alarms per hour of each keyphrase.
+	 *
+	 * @return The target rate, or 0 if thresholds are fixed.
+	 */
+	float get_false_alarm_target() const;
+
+	/**
+	 * Sets the threshold of a second check on keyphrase detections. If
+	 * positive, the keyphrase is aligned again to the audio of each detection,
+	 * and the detection is dropped when the probability per frame of that
+	 * alignment is below the threshold (e.g. \c 1e-10 rejects sloppy matches,
+	 * values closer to 1 are stricter). Use 0 (the default) to keep every
+	 * detection. Takes effect on the next call to init().
+	 *
+	 * @param threshold lowest probability per frame, or 0.
+	 */
+	void set_verify_threshold(float threshold);
+
+	/**
+	 * Returns the threshold of the second check on keyphrase detections.
+	 *
+	 * @return The lowest probability per frame, or 0 if detections aren't
+	 * checked.
+	 */
+	float get_verify_threshold() const;
+
+	/**
+	 * Saves what the decoder has learned about the microphone and environment
+	 * (cepstral means, gain and noise estimates) to a file in \c user://, one
+	 * per microphone. It is restored by load_adaptation(), so that recognition
+	 * doesn't have to adapt from scratch in every session. STTRunner calls this
+	 * whenever its recognition thread stops.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c ADAPT_SAVE_ERR
+	 */
+	STTError::Error save_adaptation();
+
+	/**
+	 * Restores the statistics saved by save_adaptation() for the microphone in
+	 * use. If none were saved yet, nothing is changed. STTRunner calls this
+	 * whenever its recognition thread starts, before recording.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c ADAPT_LOAD_ERR
+	 */
+	STTError::Error load_adaptation();
+
+	/**
+	 * Adds a word to the dictionary used for recognition, so it can be part of
+	 * keyphrases given to add_keyphrase(). Only the new word is prepared for
+	 * decoding, so this is fast and can be done while a STTRunner is running.
+	 *
+	 * @param word the word to add.
+	 * @param phones its pronunciation, as phones of the acoustic model separated by
+	 * spaces (as in the dictionary file).
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c WORD_ADD_ERR
+	 */
+	STTError::Error add_word(const String &word, const String &phones);
+
+	/**
+	 * Starts spotting a keyphrase, without reloading the decoder. Can be called
+	 * while a STTRunner is running, e.g. to change the valid commands as the game
+	 * state changes. If the keyphrase is already spotted, only its threshold is
+	 * changed. The keywords file isn't modified.
+	 *
+	 * @param keyphrase one or more words, all of them in the dictionary.
+	 * @param threshold detection threshold, as in the keywords file (e.g.
+	 * \c 1e-20), or \c 0 to use the default one.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c KWS_ADD_ERR
+	 */
+	STTError::Error add_keyphrase(const String &keyphrase, double threshold = 0);
+
+	/**
+	 * Stops spotting a keyphrase, without reloading the decoder. Can be called
+	 * while a STTRunner is running.
+	 *
+	 * @param keyphrase a keyphrase currently spotted.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c KWS_REMOVE_ERR
+	 */
+	STTError::Error remove_keyphrase(const String &keyphrase);
+
+	/**
+	 * Returns the keyphrases currently spotted, one per line. If init() wasn't
+	 * called yet, returns an empty <tt>String ("")</tt>.
+	 *
+	 * @return The spotted keyphrases.
+	 */
+	String get_keyphrases();
+
+	/**
+	 * Returns the current detection state of each spotted keyphrase, as a
+	 * \c Dictionary keyed by keyphrase. Each value is a \c Dictionary with the
+	 * keys \c "threshold" (current detection threshold) and
+	 * \c "false_alarms_per_hour" (estimated rate at that threshold, 0 if
+	 * thresholds are fixed). If init() wasn't called yet, the \c Dictionary is
+	 * empty.
+	 *
+	 * @return \c Dictionary with the keyphrase thresholds.
+	 */
+	Dictionary get_keyphrase_stats();
+
+	/**
+	 * Returns \c true if the module was built with the fixed-point front-end and
+	 * GMM scoring (<tt>speech_to_text_fixed_point=yes</tt>), or \c false if it
+	 * uses floating-point computation.
+	 *
+	 * @return \c true for a fixed-point build, or \c false otherwise.
+	 */
+	bool is_fixed_point() const;
+
+	/**
+	 * Decodes a whole file of raw audio (16-bit little-endian mono PCM, sampled at
+	 * the configured rate) as a single utterance, returning the recognized
+	 * keywords. Used to compare recognition results and speed between builds on
+	 * the same recordings. Must not be called while a STTRunner is using this
+	 * configuration.
+	 *
+	 * @param raw_filename raw audio file to be decoded.
+	 *
+	 * @return The recognized keywords, or an empty <tt>String ("")</tt> if
+	 * nothing was recognized or an error occurred.
+	 */
+	String decode_raw_file(const String &raw_filename);
+
+	/**
+	 * Returns decoding performance accumulated since init(), as a \c Dictionary
+	 * with the keys \c "speech" (seconds of audio processed), \c "cpu" and
+	 * \c "wall" (seconds spent decoding). If init() wasn't called yet, the
+	 * \c Dictionary is empty.
+	 *
+	 * @return \c Dictionary with the decoding times.
+	 */
+	Dictionary get_performance() const;
+
 	/**
 	 * Initializes attributes.
 	 */
@@ -37,6 +37,20 @@ String STTError::get_error_string(STTError::Error err) {
 			return "Couldn't restart utterance during speech recognition";
 		case AUDIO_READ_ERR:
 			return "Error while reading data from recorder";
+		case ADAPT_LOAD_ERR:
+			return "Couldn't restore saved adaptation statistics";
+		case ADAPT_SAVE_ERR:
+			return "Couldn't save adaptation statistics to user://";
+		case WORD_ADD_ERR:
+			return "Couldn't add word to the dictionary";
+		case KWS_ADD_ERR:
+			return "Couldn't add keyphrase (are all its words in the dictionary?)";
+		case KWS_REMOVE_ERR:
+			return "Keyphrase to remove isn't being spotted";
+		case COMMAND_LOAD_ERR:
+			return "Couldn't load the command grammar or language model";
+		case REPLAY_ERR:
+			return "Couldn't pass the audio after a wake word to the command search";
 	}
 
 	String err_number = itos((int64_t) err);  // Error -> int64_t -> String
@@ -67,6 +81,13 @@ void STTError::_bind_methods() {
 	BIND_CONSTANT(UTT_START_ERR);
 	BIND_CONSTANT(UTT_RESTART_ERR);
 	BIND_CONSTANT(AUDIO_READ_ERR);
+	BIND_CONSTANT(ADAPT_LOAD_ERR);
+	BIND_CONSTANT(ADAPT_SAVE_ERR);
+	BIND_CONSTANT(WORD_ADD_ERR);
+	BIND_CONSTANT(KWS_ADD_ERR);
+	BIND_CONSTANT(KWS_REMOVE_ERR);
+	BIND_CONSTANT(COMMAND_LOAD_ERR);
+	BIND_CONSTANT(REPLAY_ERR);
 }
 
 STTError::STTError() {
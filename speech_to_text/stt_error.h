@@ -41,7 +41,14 @@ public:
 		REC_STOP_ERR,       ///< Couldn't stop recording user's voice
 		UTT_START_ERR,      ///< Couldn't start utterance during speech recognition
 		UTT_RESTART_ERR,    ///< Couldn't restart utterance during speech recognition
-		AUDIO_READ_ERR      ///< Error while reading data from recorder
+		AUDIO_READ_ERR,     ///< Error while reading data from recorder
+		ADAPT_LOAD_ERR,     ///< Couldn't restore saved adaptation statistics
+		ADAPT_SAVE_ERR,     ///< Couldn't save adaptation statistics to \c user://
+		WORD_ADD_ERR,       ///< Couldn't add word to the dictionary
+		KWS_ADD_ERR,        ///< Couldn't add keyphrase to the keyword search
+		KWS_REMOVE_ERR,     ///< Keyphrase to remove isn't being spotted
+		COMMAND_LOAD_ERR,   ///< Couldn't load the command grammar or language model
+		REPLAY_ERR          ///< Couldn't pass audio after a wake word to the command search
 	};
 
 protected:
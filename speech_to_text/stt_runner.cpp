@@ -42,7 +42,11 @@ void STTRunner::_thread_recognize(void *runner) {
 void STTRunner::_recognize() {
 	int16 buffer[rec_buffer_size];
 	int32 n;
-	const char *hyp;
+
+	// Start from what was learned in previous sessions, if anything
+	config->decoder_mutex->lock();
+	config->load_adaptation();
+	config->decoder_mutex->unlock();
 
 	// Start recording
 	if (ad_start_rec(config->recorder) < 0) {
@@ -50,6 +54,12 @@ void STTRunner::_recognize() {
 		return;
 	}
 
+	// Start by waiting for a wake word, if there is a command search
+	config->decoder_mutex->lock();
+	in_command = false;
+	ps_set_search(config->decoder, STT_KWS_SEARCH);
+	config->decoder_mutex->unlock();
+
 	// Start utterance
 	if (ps_start_utt(config->decoder) < 0) {
 		_error_stop(STTError::UTT_START_ERR);
@@ -63,37 +73,109 @@ void STTRunner::_recognize() {
 			return;
 		}
 
+		// Keyphrases may be changed by the main thread between buffers
+		config->decoder_mutex->lock();
+
 		// Process captured sound
 		ps_process_raw(config->decoder, buffer, n, FALSE, FALSE);
 
-		// Check for keyword in captured sound
-		hyp = ps_get_hyp(config->decoder, NULL);
-		if (hyp != NULL) {
-			// Add new keyword to queue, if possible
-			if (queue->add(String(hyp))) {
-#ifdef DEBUG_ENABLED
-				print_line("[STTRunner] " + String(hyp));
-#endif
-			}
-			else
-				WARN_PRINT("Cannot store more keywords in the STTQueue!");
-
-			// Restart decoder
-			ps_end_utt(config->decoder);
-			if (ps_start_utt(config->decoder) < 0) {
-				_error_stop(STTError::UTT_RESTART_ERR);
-				return;
-			}
+		// Check for keyword or end of command in captured sound
+		STTError::Error err = in_command ? _recognize_command() : _spot_keyphrase();
+
+		config->decoder_mutex->unlock();
+
+		if (err != STTError::OK) {
+			_error_stop(err);
+			return;
 		}
 	}
 
 	ps_end_utt(config->decoder);
+	if (in_command)
+		ps_set_search(config->decoder, STT_KWS_SEARCH);
+
+	// Keep what was learned about the microphone for the next session
+	config->save_adaptation();
 
 	// Stop recording
 	if (ad_stop_rec(config->recorder) < 0)
 		_error_stop(STTError::REC_STOP_ERR);
 }
 
+STTError::Error STTRunner::_spot_keyphrase() {
+	ps_decoder_t *decoder = config->decoder;
+	const char *hyp = ps_get_hyp(decoder, NULL);
+
+	if (hyp == NULL)
+		return STTError::OK;
+
+	if (!config->has_command) {
+		_queue_hyp(hyp);
+		return _restart_utt();
+	}
+
+	// The command starts after the last wake word spotted, which is still among
+	// the frames kept by the decoder
+	int ef = -1;
+	for (ps_seg_t *seg = ps_seg_iter(decoder); seg != NULL; seg = ps_seg_next(seg))
+		ps_seg_frames(seg, NULL, &ef);
+
+#ifdef DEBUG_ENABLED
+	print_line("[STTRunner] Wake word: " + String(hyp));
+#endif
+
+	if (ps_replay_search(decoder, STT_COMMAND_SEARCH, ef + 1) < 0)
+		return STTError::REPLAY_ERR;
+	in_command = true;
+	return STTError::OK;
+}
+
+STTError::Error STTRunner::_recognize_command() {
+	ps_decoder_t *decoder = config->decoder;
+
+	// Frames are counted from the end of the wake word
+	int max_frames = command_timeout * cmd_ln_int32_r(config->conf, "-frate");
+	if (ps_get_n_frames(decoder) < max_frames) {
+		// Wait until something was said and the user stopped speaking
+		if (ps_get_in_speech(decoder))
+			return STTError::OK;
+		const char *partial = ps_get_hyp(decoder, NULL);
+		if (partial == NULL || partial[0] == '\0')
+			return STTError::OK;
+	}
+
+	// The last partial result may not be the final one
+	ps_end_utt(decoder);
+	const char *hyp = ps_get_hyp(decoder, NULL);
+	if (hyp != NULL && hyp[0] != '\0')
+		_queue_hyp(hyp);
+
+	// Back to spotting the wake word
+	in_command = false;
+	ps_set_search(decoder, STT_KWS_SEARCH);
+	if (ps_start_utt(decoder) < 0)
+		return STTError::UTT_RESTART_ERR;
+	return STTError::OK;
+}
+
+STTError::Error STTRunner::_restart_utt() {
+	ps_end_utt(config->decoder);
+	if (ps_start_utt(config->decoder) < 0)
+		return STTError::UTT_RESTART_ERR;
+	return STTError::OK;
+}
+
+void STTRunner::_queue_hyp(const char *hyp) {
+	// Add new keyword to queue, if possible
+	if (queue->add(String(hyp))) {
+#ifdef DEBUG_ENABLED
+		print_line("[STTRunner] " + String(hyp));
+#endif
+	}
+	else
+		WARN_PRINT("Cannot store more keywords in the STTQueue!");
+}
+
 void STTRunner::_error_stop(STTError::Error err) {
 	STT_ERR_PRINTS(err);
 
@@ -131,10 +213,38 @@ void STTRunner::set_rec_buffer_size(int rec_buffer_size) {
 	this->rec_buffer_size = rec_buffer_size;
 }
 
+STTError::Error STTRunner::add_keyphrase(const String &keyphrase, double threshold) {
+	if (config.is_null()) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+	return config->add_keyphrase(keyphrase, threshold);
+}
+
+STTError::Error STTRunner::remove_keyphrase(const String &keyphrase) {
+	if (config.is_null()) {
+		STT_ERR_PRINTS(STTError::UNDEF_CONFIG_ERR);
+		return STTError::UNDEF_CONFIG_ERR;
+	}
+	return config->remove_keyphrase(keyphrase);
+}
+
 int STTRunner::get_rec_buffer_size() {
 	return rec_buffer_size;
 }
 
+void STTRunner::set_command_timeout(float command_timeout) {
+	if (command_timeout <= 0) {
+		ERR_PRINT("Command timeout must be greater than 0");
+		return;
+	}
+	this->command_timeout = command_timeout;
+}
+
+float STTRunner::get_command_timeout() {
+	return command_timeout;
+}
+
 STTError::Error STTRunner::get_run_error() {
 	return run_error;
 }
@@ -160,10 +270,21 @@ void STTRunner::_bind_methods() {
 	ObjectTypeDB::bind_method("get_rec_buffer_size",
 	                          &STTRunner::get_rec_buffer_size);
 
+	ObjectTypeDB::bind_method(_MD("set_command_timeout", "timeout"),
+	                          &STTRunner::set_command_timeout);
+	ObjectTypeDB::bind_method("get_command_timeout",
+	                          &STTRunner::get_command_timeout);
+
+	ObjectTypeDB::bind_method(_MD("add_keyphrase", "keyphrase", "threshold"),
+	                          &STTRunner::add_keyphrase, DEFVAL(0));
+	ObjectTypeDB::bind_method(_MD("remove_keyphrase", "keyphrase"),
+	                          &STTRunner::remove_keyphrase);
+
 	ObjectTypeDB::bind_method("get_run_error",   &STTRunner::get_run_error);
 	ObjectTypeDB::bind_method("reset_run_error", &STTRunner::reset_run_error);
 
 	BIND_CONSTANT(DEFAULT_REC_BUFFER_SIZE);
+	BIND_CONSTANT(DEFAULT_COMMAND_TIMEOUT);
 
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "config",
 	                          PROPERTY_HINT_RESOURCE_TYPE, "STTConfig"),
@@ -171,12 +292,17 @@ void STTRunner::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "recorder buffer size (bytes)",
 	                          PROPERTY_HINT_RANGE, "256,4096,32"),
 	             _SCS("set_rec_buffer_size"), _SCS("get_rec_buffer_size"));
+	ADD_PROPERTY(PropertyInfo(Variant::REAL, "command timeout (s)",
+	                          PROPERTY_HINT_RANGE, "0.5,30,0.5"),
+	             _SCS("set_command_timeout"), _SCS("get_command_timeout"));
 }
 
 STTRunner::STTRunner() {
 	recognition = NULL;
 	is_running = false;
 	rec_buffer_size = DEFAULT_REC_BUFFER_SIZE;
+	command_timeout = DEFAULT_COMMAND_TIMEOUT;
+	in_command = false;
 	reset_run_error();
 }
 
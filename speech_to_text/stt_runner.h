@@ -11,7 +11,10 @@
  * Uses STT (Speech to Text) to identify keywords spoken by the user.
  *
  * Responsible for running speech recognition itself, identifying keywords spoken
- * by the user.
+ * by the user. If the configuration has a command file, keyphrases are wake words
+ * instead: only the command that follows one is recognized and queued, so that
+ * free-form commands cost no more than keyphrase spotting while nobody speaks
+ * to the game.
  *
  * @author Leonardo Macedo
  */
@@ -26,6 +29,8 @@ private:
 	Ref<STTQueue> queue;   ///< Queue for storing recognized keywords
 
 	int rec_buffer_size;  ///< Microphone recorder buffer size
+	float command_timeout;  ///< Longest command after a wake word, in seconds
+	bool in_command;      ///< If true, a command is being recognized after a wake word
 
 	/**
 	 * Stores the last STTError::Error occurred in the speech recognition thread
@@ -43,6 +48,43 @@ private:
 	 */
 	void _recognize();
 
+	/**
+	 * Checks the keyphrase search for a detection after some audio was processed.
+	 * Without a command search, the keyphrase is added to the queue. Otherwise,
+	 * the audio following it is passed to the command search.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UTT_RESTART_ERR
+	 * - \c REPLAY_ERR
+	 */
+	STTError::Error _spot_keyphrase();
+
+	/**
+	 * Checks if the command following a wake word has ended, once the user stops
+	 * speaking or \c command_timeout is reached. If so, the command is added to
+	 * the queue, and the runner goes back to spotting keyphrases.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UTT_RESTART_ERR
+	 */
+	STTError::Error _recognize_command();
+
+	/**
+	 * Ends the current utterance and starts a new one.
+	 *
+	 * @return \c STTError::OK, or \c STTError::UTT_RESTART_ERR on failure.
+	 */
+	STTError::Error _restart_utt();
+
+	/**
+	 * Adds recognized text to the queue, warning if it is full.
+	 *
+	 * @param hyp recognized keyphrase or command.
+	 */
+	void _queue_hyp(const char *hyp);
+
 	/**
 	 * Stops recognition thread and emits an error value through the end_signal
 	 * signal.
@@ -59,7 +101,8 @@ protected:
 
 public:
 	enum {
-		DEFAULT_REC_BUFFER_SIZE = 2048  ///< Microphone recorder default buffer size
+		DEFAULT_REC_BUFFER_SIZE = 2048, ///< Microphone recorder default buffer size
+		DEFAULT_COMMAND_TIMEOUT = 5     ///< Default command timeout, in seconds
 	};
 
 	/**
@@ -140,6 +183,49 @@ public:
 	 */
 	int get_rec_buffer_size();
 
+	/**
+	 * Sets for how long a command is recognized after a wake word, when the
+	 * configuration has a command file. The command usually ends earlier, as soon
+	 * as the user stops speaking. Must be > 0.
+	 *
+	 * @param command_timeout the longest command, in seconds.
+	 */
+	void set_command_timeout(float command_timeout);
+
+	/**
+	 * Returns for how long a command is recognized after a wake word.
+	 *
+	 * @return The longest command, in seconds.
+	 */
+	float get_command_timeout();
+
+	/**
+	 * Starts spotting a keyphrase with the configuration in use, without stopping
+	 * the speech recognition thread. Shortcut for STTConfig::add_keyphrase().
+	 *
+	 * @param keyphrase one or more words, all of them in the dictionary.
+	 * @param threshold detection threshold, or \c 0 to use the default one.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c KWS_ADD_ERR
+	 */
+	STTError::Error add_keyphrase(const String &keyphrase, double threshold = 0);
+
+	/**
+	 * Stops spotting a keyphrase with the configuration in use, without stopping
+	 * the speech recognition thread. Shortcut for STTConfig::remove_keyphrase().
+	 *
+	 * @param keyphrase a keyphrase currently spotted.
+	 *
+	 * @return One of the following STTError::Error values:
+	 * - \c OK
+	 * - \c UNDEF_CONFIG_ERR
+	 * - \c KWS_REMOVE_ERR
+	 */
+	STTError::Error remove_keyphrase(const String &keyphrase);
+
 	/**
 	 * Returns the STTError::Error value that depicts how the previously running
 	 * speech recognition thread has ended. It can be one of the following values:
@@ -149,6 +235,7 @@ public:
 	 * - \c UTT_START_ERR
 	 * - \c UTT_RESTART_ERR
 	 * - \c AUDIO_READ_ERR
+	 * - \c REPLAY_ERR
 	 *
 	 * If no thread was previously run, returns STTError::OK.
 	 */